@@ -1,5 +1,5 @@
 /*
-Text decoder and encoder. (encoder is slow)
+Text decoder and encoder.
 
 
 # Dependences
@@ -10,6 +10,7 @@ Text decoder and encoder. (encoder is slow)
   - uldecode_api => outside API function modifier
   - uldecode_each_api => internal decoder API function modifier
   - ULDECODE_NO_IMPLE => avoid implement
+  - ULDECODE_NO_ENCODE_INDEX => encode CJK by linear table scans (no lazily built reverse index)
 
   Compact macros:
     - (not defined) => enable all decoders and encoders
@@ -562,16 +563,64 @@ typedef int (*uldecode_func_t)(uldecode_u32_t p[ULDECODE_RETURN_MAX], int c, uld
  */
 typedef int (*ulencode_func_t)(uldecode_u8_t p[ULENCODE_RETURN_MAX], uldecode_u32_t u, uldecode_state_t* _state);
 
+/**
+ * Decode a block of bytes to Unicode code points.
+ * On entry `*psrc_len` and `*pdest_len` are the sizes of `src` and `dest`;
+ * on return they are the number of bytes consumed and code points written.
+ * Stops early when fewer than `ULDECODE_RETURN_MAX` slots are left in `dest`, call again for the rest.
+ * Pass `src == NULL` to signal the end of input (`dest` must hold `ULDECODE_RETURN_MAX` code points).
+ *
+ * \return 0 if succeeded, or negative value if failed (the counts stop before the bad byte).
+ */
+typedef int (*uldecode_block_func_t)(
+  uldecode_u32_t* ul_restrict dest, size_t* pdest_len,    /* */
+  const uldecode_u8_t* ul_restrict src, size_t* psrc_len, /* */
+  uldecode_state_t* _state                                /* */
+);
+
+/**
+ * Encode a block of Unicode code points to bytes.
+ * On entry `*psrc_len` and `*pdest_len` are the sizes of `src` and `dest`;
+ * on return they are the number of code points consumed and bytes written.
+ * Stops early when fewer than `ULENCODE_RETURN_MAX` bytes are left in `dest`, call again for the rest.
+ * Pass `src == NULL` to signal the end of input (`dest` must hold `ULENCODE_RETURN_MAX` bytes).
+ *
+ * \return 0 if succeeded, or negative value if failed (the counts stop before the bad code point).
+ */
+typedef int (*ulencode_block_func_t)(
+  uldecode_u8_t* ul_restrict dest, size_t* pdest_len,      /* */
+  const uldecode_u32_t* ul_restrict src, size_t* psrc_len, /* */
+  uldecode_state_t* _state                                 /* */
+);
+
+/* the maximum number of UTF-8 bytes that a decoder can return for one byte */
+#define ULDECODE_UTF8_RETURN_MAX (ULDECODE_RETURN_MAX * 4)
+
+/**
+ * Decode a block of bytes straight to UTF-8, skipping the code point buffer.
+ * Works like `uldecode_block_func_t` except that `dest` receives bytes,
+ * and it stops early when fewer than `ULDECODE_UTF8_RETURN_MAX` bytes are left in `dest`.
+ */
+typedef int (*uldecode_to_utf8_func_t)(
+  uldecode_u8_t* ul_restrict dest, size_t* pdest_len,     /* */
+  const uldecode_u8_t* ul_restrict src, size_t* psrc_len, /* */
+  uldecode_state_t* _state                                /* */
+);
+
 typedef struct uldecode_t {
   const char* name;
   const char* const* labels;
   uldecode_func_t decode;
   ulencode_func_t encode;
+  uldecode_block_func_t decode_block;
+  ulencode_block_func_t encode_block;
+  uldecode_to_utf8_func_t to_utf8;
 } uldecode_t;
 
 uldecode_api const uldecode_t* const* uldecode_get_lists(void);
 uldecode_api const uldecode_t* uldecode_get(const char* name);
 
+/* allocates `nn` bytes if `ptr` is NULL, frees `ptr` if `nn` is 0 (NULL uses malloc/realloc/free) */
 typedef void* (*uldecode_alloc_t)(void* opaque, void* ptr, size_t nn);
 uldecode_api size_t ul_encode_between_spec(
   void* ul_restrict dest, size_t dest_len, ulencode_func_t encoder,    /* */
@@ -582,6 +631,15 @@ uldecode_api void* ul_encode_between_alloc_spec(
   const void* ul_restrict src, size_t src_len, uldecode_func_t decoder, /* */
   size_t* pwriten                                                       /* */
 );
+uldecode_api size_t ul_encode_between_block_spec(
+  void* ul_restrict dest, size_t dest_len, ulencode_block_func_t encoder,    /* */
+  const void* ul_restrict src, size_t src_len, uldecode_block_func_t decoder /* */
+);
+uldecode_api void* ul_encode_between_alloc_block_spec(
+  uldecode_alloc_t alloc_fn, void* opaque, ulencode_block_func_t encoder,     /* */
+  const void* ul_restrict src, size_t src_len, uldecode_block_func_t decoder, /* */
+  size_t* pwriten                                                             /* */
+);
 uldecode_api size_t ul_encode_between(
   void* ul_restrict dest, size_t dest_len, const char* encoder_name,    /* */
   const void* ul_restrict src, size_t src_len, const char* decoder_name /* */
@@ -709,14 +767,496 @@ ul_hapi Container ul_encode_between_alloc(
 #ifndef ULDECODE_NO_IMPLE
 
   #ifdef ULDECODE_DEFINE_LABELS
-    #define _ULDECODE_T(name) { uldecode_##name##_name, uldecode_##name##_labels, uldecode_##name, ulencode_##name }
+    #define _ULDECODE_T(name)                                                                                          \
+      { uldecode_##name##_name, uldecode_##name##_labels, uldecode_##name, ulencode_##name,                            \
+        uldecode_block_##name,  ulencode_block_##name,     uldecode_to_utf8_##name }
   #else
 static const char* uldecode_null_labels[1] = { NULL };
-    #define _ULDECODE_T(name) { uldecode_##name##_name, uldecode_null_labels, uldecode_##name, ulencode_##name }
+    #define _ULDECODE_T(name)                                                                                          \
+      { uldecode_##name##_name, uldecode_null_labels, uldecode_##name, ulencode_##name,                                \
+        uldecode_block_##name,  ulencode_block_##name, uldecode_to_utf8_##name }
   #endif
-  #define _ULDECODE_DEF_T(name) static const uldecode_t uldecode_##name##_t = _ULDECODE_T(name);
+  /* block functions built on the per-byte ones; the direct calls let the compiler inline them */
+  #define _ULDECODE_DEF_BLOCK(name)                                                                                    \
+    uldecode_each_api int uldecode_block_##name(                                                                       \
+      uldecode_u32_t* ul_restrict dest, size_t* pdest_len, const uldecode_u8_t* ul_restrict src,                       \
+      size_t* psrc_len, uldecode_state_t* _state                                                                       \
+    ) {                                                                                                                \
+      return _uldecode_block(uldecode_##name, dest, pdest_len, src, psrc_len, _state);                                 \
+    }                                                                                                                  \
+    uldecode_each_api int ulencode_block_##name(                                                                       \
+      uldecode_u8_t* ul_restrict dest, size_t* pdest_len, const uldecode_u32_t* ul_restrict src,                       \
+      size_t* psrc_len, uldecode_state_t* _state                                                                       \
+    ) {                                                                                                                \
+      return _ulencode_block(ulencode_##name, dest, pdest_len, src, psrc_len, _state);                                 \
+    }                                                                                                                  \
+    uldecode_each_api int uldecode_to_utf8_##name(                                                                     \
+      uldecode_u8_t* ul_restrict dest, size_t* pdest_len, const uldecode_u8_t* ul_restrict src,                        \
+      size_t* psrc_len, uldecode_state_t* _state                                                                       \
+    ) {                                                                                                                \
+      return _uldecode_to_utf8(uldecode_##name, 0, NULL, dest, pdest_len, src, psrc_len, _state);                      \
+    }
+  /*
+   * for codecs that map 0x00-0x7F to themselves whenever the state is zero;
+   * `pair` (or NULL) decodes a lead and a trail byte in the zero state, see `_uldecode_to_utf8`
+   */
+  #define _ULDECODE_DEF_BLOCK_ASCII(name, pair)                                                                        \
+    uldecode_each_api int uldecode_block_##name(                                                                       \
+      uldecode_u32_t* ul_restrict dest, size_t* pdest_len, const uldecode_u8_t* ul_restrict src,                       \
+      size_t* psrc_len, uldecode_state_t* _state                                                                       \
+    ) {                                                                                                                \
+      return _uldecode_block_ascii(uldecode_##name, dest, pdest_len, src, psrc_len, _state);                           \
+    }                                                                                                                  \
+    uldecode_each_api int ulencode_block_##name(                                                                       \
+      uldecode_u8_t* ul_restrict dest, size_t* pdest_len, const uldecode_u32_t* ul_restrict src,                       \
+      size_t* psrc_len, uldecode_state_t* _state                                                                       \
+    ) {                                                                                                                \
+      return _ulencode_block_ascii(ulencode_##name, dest, pdest_len, src, psrc_len, _state);                           \
+    }                                                                                                                  \
+    uldecode_each_api int uldecode_to_utf8_##name(                                                                     \
+      uldecode_u8_t* ul_restrict dest, size_t* pdest_len, const uldecode_u8_t* ul_restrict src,                        \
+      size_t* psrc_len, uldecode_state_t* _state                                                                       \
+    ) {                                                                                                                \
+      return _uldecode_to_utf8(uldecode_##name, 1, pair, dest, pdest_len, src, psrc_len, _state);                      \
+    }
+  /* for codecs that define their own `uldecode_block_xxx`, `ulencode_block_xxx` and `uldecode_to_utf8_xxx` */
+  #define _ULDECODE_DEF_T_BLOCK(name) static const uldecode_t uldecode_##name##_t = _ULDECODE_T(name);
+  #define _ULDECODE_DEF_T(name)                                                                                        \
+    _ULDECODE_DEF_BLOCK(name)                                                                                          \
+    static const uldecode_t uldecode_##name##_t = _ULDECODE_T(name);
+  #define _ULDECODE_DEF_T_ASCII(name)                                                                                  \
+    _ULDECODE_DEF_BLOCK_ASCII(name, NULL)                                                                              \
+    static const uldecode_t uldecode_##name##_t = _ULDECODE_T(name);
+  #define _ULDECODE_DEF_T_PAIR(name, pair)                                                                             \
+    _ULDECODE_DEF_BLOCK_ASCII(name, pair)                                                                              \
+    static const uldecode_t uldecode_##name##_t = _ULDECODE_T(name);
   #define _ULDECODE_INLIST(name) &uldecode_##name##_t
 
+static ul_inline int _uldecode_block(
+  uldecode_func_t decoder, uldecode_u32_t* ul_restrict dest, size_t* pdest_len, /* */
+  const uldecode_u8_t* ul_restrict src, size_t* psrc_len, uldecode_state_t* _state /* */
+) {
+  size_t si = 0, di = 0;
+  const size_t sn = *psrc_len, dn = *pdest_len;
+  int r = 0;
+
+  if(src == NULL) {
+    *psrc_len = 0;
+    if(ul_unlikely(dn < ULDECODE_RETURN_MAX)) {
+      *pdest_len = 0;
+      return -1;
+    }
+    r = decoder(dest, ULDECODE_EOF, _state);
+    *pdest_len = r < 0 ? 0 : ul_static_cast(size_t, r);
+    return r < 0 ? r : 0;
+  }
+  while(si < sn && dn - di >= ULDECODE_RETURN_MAX) {
+    r = decoder(dest + di, src[si], _state);
+    if(ul_unlikely(r < 0))
+      break;
+    di += ul_static_cast(size_t, r);
+    ++si;
+  }
+  *psrc_len = si;
+  *pdest_len = di;
+  return r < 0 ? r : 0;
+}
+static ul_inline int _ulencode_block(
+  ulencode_func_t encoder, uldecode_u8_t* ul_restrict dest, size_t* pdest_len,      /* */
+  const uldecode_u32_t* ul_restrict src, size_t* psrc_len, uldecode_state_t* _state /* */
+) {
+  size_t si = 0, di = 0;
+  const size_t sn = *psrc_len, dn = *pdest_len;
+  int r = 0;
+
+  if(src == NULL) {
+    *psrc_len = 0;
+    if(ul_unlikely(dn < ULENCODE_RETURN_MAX)) {
+      *pdest_len = 0;
+      return -1;
+    }
+    r = encoder(dest, ULENCODE_EOF, _state);
+    *pdest_len = r < 0 ? 0 : ul_static_cast(size_t, r);
+    return r < 0 ? r : 0;
+  }
+  while(si < sn && dn - di >= ULENCODE_RETURN_MAX) {
+    r = encoder(dest + di, src[si], _state);
+    if(ul_unlikely(r < 0))
+      break;
+    di += ul_static_cast(size_t, r);
+    ++si;
+  }
+  *psrc_len = si;
+  *pdest_len = di;
+  return r < 0 ? r : 0;
+}
+
+  #if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define _ULDECODE_SIMD_SSE2
+    #if defined(__AVX2__)
+      #include <immintrin.h>
+      #define _ULDECODE_SIMD_AVX2
+    #endif
+  #elif defined(__aarch64__) || defined(_M_ARM64)
+    #include <arm_neon.h>
+    #define _ULDECODE_SIMD_NEON
+  #endif
+  #include <string.h>
+/* the number of leading bytes of `s` below 0x80 */
+static ul_inline size_t _uldecode_ascii_len(const uldecode_u8_t* s, size_t n) {
+  size_t i = 0;
+  #if defined(_ULDECODE_SIMD_AVX2)
+  for(; i + 32 <= n; i += 32)
+    if(_mm256_movemask_epi8(_mm256_loadu_si256(ul_reinterpret_cast(const __m256i*, s + i))) != 0)
+      break;
+  #elif defined(_ULDECODE_SIMD_SSE2)
+  for(; i + 16 <= n; i += 16)
+    if(_mm_movemask_epi8(_mm_loadu_si128(ul_reinterpret_cast(const __m128i*, s + i))) != 0)
+      break;
+  #elif defined(_ULDECODE_SIMD_NEON)
+  for(; i + 16 <= n; i += 16)
+    if(vmaxvq_u8(vld1q_u8(s + i)) >= 0x80)
+      break;
+  #else
+  size_t w;
+  for(; i + sizeof(w) <= n; i += sizeof(w)) {
+    memcpy(&w, s + i, sizeof(w));
+    if(w & (ul_static_cast(size_t, -1) / 0xFF * 0x80))
+      break;
+  }
+  #endif
+  while(i < n && s[i] < 0x80)
+    ++i;
+  return i;
+}
+/* widen the leading bytes of `s` below 0x80 to code points, returns how many */
+static ul_inline size_t _uldecode_ascii_widen(
+  uldecode_u32_t* ul_restrict d, const uldecode_u8_t* ul_restrict s, size_t n
+) {
+  size_t i = 0, k;
+  #if defined(_ULDECODE_SIMD_SSE2)
+  const __m128i z = _mm_setzero_si128();
+  __m128i v, lo, hi;
+  for(; i + 16 <= n; i += 16) {
+    v = _mm_loadu_si128(ul_reinterpret_cast(const __m128i*, s + i));
+    if(_mm_movemask_epi8(v) != 0)
+      break;
+    lo = _mm_unpacklo_epi8(v, z);
+    hi = _mm_unpackhi_epi8(v, z);
+    _mm_storeu_si128(ul_reinterpret_cast(__m128i*, d + i), _mm_unpacklo_epi16(lo, z));
+    _mm_storeu_si128(ul_reinterpret_cast(__m128i*, d + i + 4), _mm_unpackhi_epi16(lo, z));
+    _mm_storeu_si128(ul_reinterpret_cast(__m128i*, d + i + 8), _mm_unpacklo_epi16(hi, z));
+    _mm_storeu_si128(ul_reinterpret_cast(__m128i*, d + i + 12), _mm_unpackhi_epi16(hi, z));
+  }
+  #elif defined(_ULDECODE_SIMD_NEON)
+  uint8x16_t v;
+  uint16x8_t lo, hi;
+  for(; i + 16 <= n; i += 16) {
+    v = vld1q_u8(s + i);
+    if(vmaxvq_u8(v) >= 0x80)
+      break;
+    lo = vmovl_u8(vget_low_u8(v));
+    hi = vmovl_u8(vget_high_u8(v));
+    vst1q_u32(ul_reinterpret_cast(uint32_t*, d + i), vmovl_u16(vget_low_u16(lo)));
+    vst1q_u32(ul_reinterpret_cast(uint32_t*, d + i + 4), vmovl_u16(vget_high_u16(lo)));
+    vst1q_u32(ul_reinterpret_cast(uint32_t*, d + i + 8), vmovl_u16(vget_low_u16(hi)));
+    vst1q_u32(ul_reinterpret_cast(uint32_t*, d + i + 12), vmovl_u16(vget_high_u16(hi)));
+  }
+  #endif
+  k = i + _uldecode_ascii_len(s + i, n - i);
+  for(; i < k; ++i)
+    d[i] = s[i];
+  return k;
+}
+/* narrow the leading code points of `s` below 0x80 to bytes, returns how many */
+static ul_inline size_t _ulencode_ascii_narrow(
+  uldecode_u8_t* ul_restrict d, const uldecode_u32_t* ul_restrict s, size_t n
+) {
+  size_t i = 0;
+  #if defined(_ULDECODE_SIMD_SSE2)
+  const __m128i m = _mm_set1_epi32(-0x80);
+  __m128i a, b, c, e;
+  for(; i + 16 <= n; i += 16) {
+    a = _mm_loadu_si128(ul_reinterpret_cast(const __m128i*, s + i));
+    b = _mm_loadu_si128(ul_reinterpret_cast(const __m128i*, s + i + 4));
+    c = _mm_loadu_si128(ul_reinterpret_cast(const __m128i*, s + i + 8));
+    e = _mm_loadu_si128(ul_reinterpret_cast(const __m128i*, s + i + 12));
+    if(_mm_movemask_epi8(_mm_cmpeq_epi32(
+         _mm_and_si128(_mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, e)), m), _mm_setzero_si128()
+       ))
+       != 0xFFFF)
+      break;
+    _mm_storeu_si128(
+      ul_reinterpret_cast(__m128i*, d + i), _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, e))
+    );
+  }
+  #elif defined(_ULDECODE_SIMD_NEON)
+  uint32x4_t a, b, c, e;
+  for(; i + 16 <= n; i += 16) {
+    a = vld1q_u32(ul_reinterpret_cast(const uint32_t*, s + i));
+    b = vld1q_u32(ul_reinterpret_cast(const uint32_t*, s + i + 4));
+    c = vld1q_u32(ul_reinterpret_cast(const uint32_t*, s + i + 8));
+    e = vld1q_u32(ul_reinterpret_cast(const uint32_t*, s + i + 12));
+    if(vmaxvq_u32(vorrq_u32(vorrq_u32(a, b), vorrq_u32(c, e))) >= 0x80)
+      break;
+    vst1q_u8(
+      d + i, vcombine_u8(
+               vmovn_u16(vcombine_u16(vmovn_u32(a), vmovn_u32(b))), vmovn_u16(vcombine_u16(vmovn_u32(c), vmovn_u32(e)))
+             )
+    );
+  }
+  #endif
+  for(; i < n && s[i] < 0x80; ++i)
+    d[i] = ul_static_cast(uldecode_u8_t, s[i]);
+  return i;
+}
+
+/* `_uldecode_block` that widens ASCII runs in bulk while the state is zero */
+static ul_inline int _uldecode_block_ascii(
+  uldecode_func_t decoder, uldecode_u32_t* ul_restrict dest, size_t* pdest_len, /* */
+  const uldecode_u8_t* ul_restrict src, size_t* psrc_len, uldecode_state_t* _state /* */
+) {
+  size_t si = 0, di = 0, k;
+  const size_t sn = *psrc_len, dn = *pdest_len;
+  int r = 0;
+
+  if(src == NULL)
+    return _uldecode_block(decoder, dest, pdest_len, src, psrc_len, _state);
+  while(si < sn && dn - di >= ULDECODE_RETURN_MAX) {
+    if(src[si] < 0x80 && _state->_dummy32[0] == 0 && _state->_dummy32[1] == 0) {
+      k = _uldecode_ascii_widen(dest + di, src + si, sn - si < dn - di ? sn - si : dn - di);
+      si += k;
+      di += k;
+      continue;
+    }
+    r = decoder(dest + di, src[si], _state);
+    if(ul_unlikely(r < 0))
+      break;
+    di += ul_static_cast(size_t, r);
+    ++si;
+  }
+  *psrc_len = si;
+  *pdest_len = di;
+  return r < 0 ? r : 0;
+}
+/* `_ulencode_block` that narrows ASCII runs in bulk while the state is zero */
+static ul_inline int _ulencode_block_ascii(
+  ulencode_func_t encoder, uldecode_u8_t* ul_restrict dest, size_t* pdest_len,      /* */
+  const uldecode_u32_t* ul_restrict src, size_t* psrc_len, uldecode_state_t* _state /* */
+) {
+  size_t si = 0, di = 0, k;
+  const size_t sn = *psrc_len, dn = *pdest_len;
+  int r = 0;
+
+  if(src == NULL)
+    return _ulencode_block(encoder, dest, pdest_len, src, psrc_len, _state);
+  while(si < sn && dn - di >= ULENCODE_RETURN_MAX) {
+    if(src[si] < 0x80 && _state->_dummy32[0] == 0 && _state->_dummy32[1] == 0) {
+      k = _ulencode_ascii_narrow(dest + di, src + si, sn - si < dn - di ? sn - si : dn - di);
+      si += k;
+      di += k;
+      continue;
+    }
+    r = encoder(dest + di, src[si], _state);
+    if(ul_unlikely(r < 0))
+      break;
+    di += ul_static_cast(size_t, r);
+    ++si;
+  }
+  *psrc_len = si;
+  *pdest_len = di;
+  return r < 0 ? r : 0;
+}
+
+/* write `u` as UTF-8, returns the number of bytes or 0 if `u` is out of range */
+static ul_inline size_t _uldecode_put_utf8(uldecode_u8_t* ul_restrict p, uldecode_u32_t u) {
+  if(u <= 0x7F) {
+    p[0] = ul_static_cast(uldecode_u8_t, u);
+    return 1;
+  } else if(u <= 0x7FF) {
+    p[0] = ul_static_cast(uldecode_u8_t, (u >> 6) | 0xC0);
+    p[1] = ul_static_cast(uldecode_u8_t, (u & 0x3F) | 0x80);
+    return 2;
+  } else if(ul_likely(u <= 0xFFFF)) {
+    p[0] = ul_static_cast(uldecode_u8_t, (u >> 12) | 0xE0);
+    p[1] = ul_static_cast(uldecode_u8_t, ((u >> 6) & 0x3F) | 0x80);
+    p[2] = ul_static_cast(uldecode_u8_t, (u & 0x3F) | 0x80);
+    return 3;
+  } else if(ul_likely(u <= 0x10FFFF)) {
+    p[0] = ul_static_cast(uldecode_u8_t, (u >> 18) | 0xF0);
+    p[1] = ul_static_cast(uldecode_u8_t, ((u >> 12) & 0x3F) | 0x80);
+    p[2] = ul_static_cast(uldecode_u8_t, ((u >> 6) & 0x3F) | 0x80);
+    p[3] = ul_static_cast(uldecode_u8_t, (u & 0x3F) | 0x80);
+    return 4;
+  }
+  return 0;
+}
+
+/* decodes a lead and a trail byte in the zero state, returns 0 to leave them to the per-byte decoder */
+typedef uldecode_u32_t (*_uldecode_pair_func_t)(int lead, int trail);
+
+/**
+ * `uldecode_to_utf8_func_t` built on `decoder`.
+ * If `ascii` is set, ASCII runs are copied as-is while the state is zero;
+ * `pair` (or NULL) decodes whole double-byte characters without going through the state.
+ */
+static ul_inline int _uldecode_to_utf8(
+  uldecode_func_t decoder, int ascii, _uldecode_pair_func_t pair,                   /* */
+  uldecode_u8_t* ul_restrict dest, size_t* pdest_len,                               /* */
+  const uldecode_u8_t* ul_restrict src, size_t* psrc_len, uldecode_state_t* _state /* */
+) {
+  uldecode_u32_t db[ULDECODE_RETURN_MAX], u;
+  size_t si = 0, di = 0, k;
+  const size_t sn = *psrc_len, dn = *pdest_len;
+  int r = 0, i;
+
+  if(src == NULL) {
+    *psrc_len = 0;
+    *pdest_len = 0;
+    if(ul_unlikely(dn < ULDECODE_UTF8_RETURN_MAX))
+      return -1;
+    r = decoder(db, ULDECODE_EOF, _state);
+    for(i = 0; i < r; ++i) {
+      if(ul_unlikely((k = _uldecode_put_utf8(dest + di, db[i])) == 0))
+        return -1;
+      di += k;
+    }
+    *pdest_len = di;
+    return r < 0 ? r : 0;
+  }
+  while(si < sn && dn - di >= ULDECODE_UTF8_RETURN_MAX) {
+    if(ascii && _state->_dummy32[0] == 0 && _state->_dummy32[1] == 0) {
+      if(src[si] < 0x80) {
+        k = _uldecode_ascii_len(src + si, sn - si < dn - di ? sn - si : dn - di);
+        memcpy(dest + di, src + si, k);
+        si += k;
+        di += k;
+        continue;
+      }
+      if(pair != NULL && si + 1 < sn && (u = pair(src[si], src[si + 1])) != 0) {
+        di += _uldecode_put_utf8(dest + di, u);
+        si += 2;
+        continue;
+      }
+    }
+    r = decoder(db, src[si], _state);
+    if(ul_unlikely(r < 0))
+      break;
+    for(i = 0; i < r; ++i) {
+      if(ul_unlikely((k = _uldecode_put_utf8(dest + di, db[i])) == 0)) {
+        r = -1;
+        break;
+      }
+      di += k;
+    }
+    if(ul_unlikely(r < 0))
+      break;
+    ++si;
+  }
+  *psrc_len = si;
+  *pdest_len = di;
+  return r < 0 ? r : 0;
+}
+
+  #ifndef ULDECODE_NO_ENCODE_INDEX
+    #if defined(__GNUC__) && ((__GNUC__ * 100 + __GNUC_MINOR__) >= 407 || defined(__clang__))
+      #define _uldecode_index_load(slot) __atomic_load_n((slot), __ATOMIC_ACQUIRE)
+      #define _uldecode_index_publish(slot, expect, index) \
+        __atomic_compare_exchange_n((slot), &(expect), (index), 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+    #elif defined(_MSC_VER)
+      #include <intrin.h>
+      #define _uldecode_index_load(slot) \
+        ul_reinterpret_cast(const uldecode_u16_t*, _InterlockedCompareExchangePointer( \
+          ul_reinterpret_cast(void* volatile*, (slot)), NULL, NULL))
+      #define _uldecode_index_publish(slot, expect, index) \
+        ((expect = ul_reinterpret_cast(const uldecode_u16_t*, _InterlockedCompareExchangePointer( \
+            ul_reinterpret_cast(void* volatile*, (slot)), (index), NULL))) == NULL)
+    #else
+      /* no atomics to share the index between threads, keep the linear scans */
+      #define ULDECODE_NO_ENCODE_INDEX
+    #endif
+  #endif /* ULDECODE_NO_ENCODE_INDEX */
+  #include <stdlib.h>
+  #define _ULENCODE_INDEX_TOP 0x1100
+/**
+ * Build the reverse index of `table[begin, end)` skipping `[skip_begin, skip_end)`, the first pointer wins.
+ * `index[u >> 8]` is 0 or the page number + 1, and page entries are 0 or the pointer + 1.
+ */
+static ul_inline uldecode_u16_t* _ulencode_index_build(
+  const uldecode_u16_t* table16, const uldecode_u32_t* table32, /* */
+  uldecode_u32_t begin, uldecode_u32_t end, uldecode_u32_t skip_begin, uldecode_u32_t skip_end /* */
+) {
+  uldecode_u16_t top[_ULENCODE_INDEX_TOP];
+  uldecode_u16_t* index;
+  uldecode_u16_t* page;
+  uldecode_u32_t i, u, npages = 0;
+
+  memset(top, 0, sizeof(top));
+  for(i = begin; i < end; ++i) {
+    u = table16 ? table16[i] : table32[i];
+    if(u == 0 || u >= 0x110000u || (skip_begin <= i && i < skip_end))
+      continue;
+    if(top[u >> 8] == 0)
+      top[u >> 8] = ul_static_cast(uldecode_u16_t, ++npages);
+  }
+  index = ul_reinterpret_cast(
+    uldecode_u16_t*, malloc((_ULENCODE_INDEX_TOP + npages * 256u) * sizeof(uldecode_u16_t))
+  );
+  if(index == NULL)
+    return NULL;
+  memcpy(index, top, sizeof(top));
+  memset(index + _ULENCODE_INDEX_TOP, 0, npages * 256u * sizeof(uldecode_u16_t));
+  for(i = begin; i < end; ++i) {
+    u = table16 ? table16[i] : table32[i];
+    if(u == 0 || u >= 0x110000u || (skip_begin <= i && i < skip_end))
+      continue;
+    page = index + _ULENCODE_INDEX_TOP + (top[u >> 8] - 1u) * 256u;
+    if(page[u & 0xFF] == 0)
+      page[u & 0xFF] = ul_static_cast(uldecode_u16_t, i + 1);
+  }
+  return index;
+}
+/**
+ * Find the first pointer of `u` in `table[begin, end)` skipping `[skip_begin, skip_end)`, or return `end`.
+ * The index is built on first use and published to `*slot` (it lives until exit);
+ * without atomics or memory it falls back to a linear scan.
+ */
+static ul_inline uldecode_u32_t _ulencode_index_lookup(
+  const uldecode_u16_t** slot, const uldecode_u16_t* table16, const uldecode_u32_t* table32, /* */
+  uldecode_u32_t begin, uldecode_u32_t end, uldecode_u32_t skip_begin, uldecode_u32_t skip_end, /* */
+  uldecode_u32_t u                                                                             /* */
+) {
+  uldecode_u32_t i;
+  #ifndef ULDECODE_NO_ENCODE_INDEX
+  const uldecode_u16_t* index = _uldecode_index_load(slot);
+  uldecode_u16_t* built;
+  uldecode_u16_t page;
+
+  if(ul_unlikely(index == NULL)) {
+    built = _ulencode_index_build(table16, table32, begin, end, skip_begin, skip_end);
+    if(built != NULL) {
+      if(_uldecode_index_publish(slot, index, built))
+        index = built;
+      else
+        free(built); /* another thread won */
+    }
+  }
+  if(ul_likely(index != NULL)) {
+    if(u >= 0x110000u || (page = index[u >> 8]) == 0)
+      return end;
+    i = index[_ULENCODE_INDEX_TOP + (page - 1u) * 256u + (u & 0xFF)];
+    return i ? i - 1 : end;
+  }
+  #else
+  (void)slot;
+  #endif
+  for(i = begin; i < end; ++i)
+    if((table16 ? table16[i] : table32[i]) == u && !(skip_begin <= i && i < skip_end))
+      return i;
+  return end;
+}
+
 
 
   #if ULDECODE_USE_UTF_16BE
@@ -930,6 +1470,8 @@ uldecode_each_api int uldecode_utf_8(uldecode_u32_t* p, int c, uldecode_state_t*
     return -1;
   }
   *p = state->code;
+  state->code = 0;
+  state->total = 0;
   return 1;
 }
 uldecode_each_api int ulencode_utf_8(uldecode_u8_t* p, uldecode_u32_t u, uldecode_state_t* _state) {
@@ -949,7 +1491,7 @@ uldecode_each_api int ulencode_utf_8(uldecode_u8_t* p, uldecode_u32_t u, uldecod
     p[2] = ul_static_cast(uldecode_u8_t, (u & 0x3F) | 0x80);
     return 3;
   } else if(ul_likely(u <= 0x10FFFF)) {
-    p[0] = ul_static_cast(uldecode_u8_t, (u >> 18) | 0xE0);
+    p[0] = ul_static_cast(uldecode_u8_t, (u >> 18) | 0xF0);
     p[1] = ul_static_cast(uldecode_u8_t, ((u >> 12) & 0x3F) | 0x80);
     p[2] = ul_static_cast(uldecode_u8_t, ((u >> 6) & 0x3F) | 0x80);
     p[3] = ul_static_cast(uldecode_u8_t, (u & 0x3F) | 0x80);
@@ -959,12 +1501,83 @@ uldecode_each_api int ulencode_utf_8(uldecode_u8_t* p, uldecode_u32_t u, uldecod
   }
 }
 
+uldecode_each_api int uldecode_block_utf_8(
+  uldecode_u32_t* ul_restrict dest, size_t* pdest_len,    /* */
+  const uldecode_u8_t* ul_restrict src, size_t* psrc_len, /* */
+  uldecode_state_t* _state                                /* */
+) {
+  struct _uldecode_utf_8_state_t* state = ul_reinterpret_cast(struct _uldecode_utf_8_state_t*, _state);
+  size_t si = 0, di = 0, k;
+  const size_t sn = *psrc_len, dn = *pdest_len;
+  int r = 0;
+
+  if(src == NULL)
+    return _uldecode_block(uldecode_utf_8, dest, pdest_len, src, psrc_len, _state);
+  /* UTF-8 yields at most one code point per byte, so `dest` can be filled up */
+  while(si < sn && di < dn) {
+    if(state->rest == 0 && src[si] <= 0x7F) {
+      k = _uldecode_ascii_widen(dest + di, src + si, sn - si < dn - di ? sn - si : dn - di);
+      si += k;
+      di += k;
+      continue;
+    }
+    r = uldecode_utf_8(dest + di, src[si], _state);
+    if(ul_unlikely(r < 0))
+      break;
+    di += ul_static_cast(size_t, r);
+    ++si;
+  }
+  *psrc_len = si;
+  *pdest_len = di;
+  return r < 0 ? r : 0;
+}
+uldecode_each_api int ulencode_block_utf_8(
+  uldecode_u8_t* ul_restrict dest, size_t* pdest_len,      /* */
+  const uldecode_u32_t* ul_restrict src, size_t* psrc_len, /* */
+  uldecode_state_t* _state                                 /* */
+) {
+  size_t si = 0, di = 0, k;
+  const size_t sn = *psrc_len, dn = *pdest_len;
+  uldecode_u32_t u;
+  int r = 0;
+
+  if(src == NULL)
+    return _ulencode_block(ulencode_utf_8, dest, pdest_len, src, psrc_len, _state);
+  while(si < sn && di < dn) {
+    u = src[si];
+    if(u <= 0x7F) {
+      k = _ulencode_ascii_narrow(dest + di, src + si, sn - si < dn - di ? sn - si : dn - di);
+      si += k;
+      di += k;
+      continue;
+    }
+    if(dn - di < ULENCODE_RETURN_MAX)
+      break;
+    r = ulencode_utf_8(dest + di, u, _state);
+    if(ul_unlikely(r < 0))
+      break;
+    di += ul_static_cast(size_t, r);
+    ++si;
+  }
+  *psrc_len = si;
+  *pdest_len = di;
+  return r < 0 ? r : 0;
+}
+
+uldecode_each_api int uldecode_to_utf8_utf_8(
+  uldecode_u8_t* ul_restrict dest, size_t* pdest_len,     /* */
+  const uldecode_u8_t* ul_restrict src, size_t* psrc_len, /* */
+  uldecode_state_t* _state                                /* */
+) {
+  return _uldecode_to_utf8(uldecode_utf_8, 1, NULL, dest, pdest_len, src, psrc_len, _state);
+}
+
     #ifdef ULDECODE_DEFINE_LABELS
 static const char* uldecode_utf_8_labels[] = {
   "unicode-1-1-utf-8", "unicode11utf8", "unicode20utf8", "utf-8", "utf8", "x-unicode20utf8", NULL
 };
     #endif /* ULDECODE_DEFINE_LABELS */
-_ULDECODE_DEF_T(utf_8)
+_ULDECODE_DEF_T_BLOCK(utf_8)
   #endif /* ULDECODE_USE_UTF_8 */
 
   #if ULDECODE_USE_UTF_32BE
@@ -1110,7 +1723,7 @@ static const char* uldecode_ascii_labels[] = {
   "csASCII",  NULL
 };
     #endif /* ULDECODE_DEFINE_LABELS */
-_ULDECODE_DEF_T(ascii)
+_ULDECODE_DEF_T_ASCII(ascii)
   #endif /* ULDECODE_USE_ASCII */
 
 
@@ -1230,7 +1843,7 @@ uldecode_each_api int ulencode_ibm866(uldecode_u8_t* p, uldecode_u32_t u, uldeco
     #ifdef ULDECODE_DEFINE_LABELS
 static const char* uldecode_ibm866_labels[] = { "866", "cp866", "csibm866", "ibm866", NULL };
     #endif /* ULDECODE_DEFINE_LABELS */
-_ULDECODE_DEF_T(ibm866)
+_ULDECODE_DEF_T_ASCII(ibm866)
   #endif /* ULDECODE_USE_IBM866 */
 
   #if ULDECODE_USE_ISO_8859_2
@@ -1261,7 +1874,7 @@ static const char* uldecode_iso_8859_2_labels[] = { "csisolatin2", "iso-8859-2",
                                                     "iso88592",    "iso_8859-2", "iso_8859-2:1987", "l2",
                                                     "latin2",      NULL };
     #endif /* ULDECODE_DEFINE_LABELS */
-_ULDECODE_DEF_T(iso_8859_2)
+_ULDECODE_DEF_T_ASCII(iso_8859_2)
   #endif /* ULDECODE_USE_ISO_8859_2 */
 
   #if ULDECODE_USE_ISO_8859_3
@@ -1292,7 +1905,7 @@ static const char* uldecode_iso_8859_3_labels[] = { "csisolatin3", "iso-8859-3",
                                                     "iso88593",    "iso_8859-3", "iso_8859-3:1988", "l3",
                                                     "latin3",      NULL };
     #endif /* ULDECODE_DEFINE_LABELS */
-_ULDECODE_DEF_T(iso_8859_3)
+_ULDECODE_DEF_T_ASCII(iso_8859_3)
   #endif /* ULDECODE_USE_ISO_8859_3 */
 
   #if ULDECODE_USE_ISO_8859_4
@@ -1323,7 +1936,7 @@ static const char* uldecode_iso_8859_4_labels[] = { "csisolatin4", "iso-8859-4",
                                                     "iso88594",    "iso_8859-4", "iso_8859-4:1988", "l4",
                                                     "latin4",      NULL };
     #endif /* ULDECODE_DEFINE_LABELS */
-_ULDECODE_DEF_T(iso_8859_4)
+_ULDECODE_DEF_T_ASCII(iso_8859_4)
   #endif /* ULDECODE_USE_ISO_8859_4 */
 
   #if ULDECODE_USE_ISO_8859_5
@@ -1354,7 +1967,7 @@ static const char* uldecode_iso_8859_5_labels[] = { "csisolatincyrillic", "cyril
                                                     "iso-ir-144",         "iso8859-5",       "iso88595",
                                                     "iso_8859-5",         "iso_8859-5:1988", NULL };
     #endif /* ULDECODE_DEFINE_LABELS */
-_ULDECODE_DEF_T(iso_8859_5)
+_ULDECODE_DEF_T_ASCII(iso_8859_5)
   #endif /* ULDECODE_USE_ISO_8859_5 */
 
   #if ULDECODE_USE_ISO_8859_6
@@ -1387,7 +2000,7 @@ static const char* uldecode_iso_8859_6_labels[] = { "arabic",      "asmo-708",
                                                     "iso-ir-127",  "iso8859-6",        "iso88596",
                                                     "iso_8859-6",  "iso_8859-6:1987",  NULL };
     #endif /* ULDECODE_DEFINE_LABELS */
-_ULDECODE_DEF_T(iso_8859_6)
+_ULDECODE_DEF_T_ASCII(iso_8859_6)
   #endif /* ULDECODE_USE_ISO_8859_6 */
 
   #if ULDECODE_USE_ISO_8859_7
@@ -1419,7 +2032,7 @@ static const char* uldecode_iso_8859_7_labels[] = {
   "iso8859-7",       "iso88597", "iso_8859-7", "iso_8859-7:1987", "sun_eu_greek", NULL
 };
     #endif /* ULDECODE_DEFINE_LABELS */
-_ULDECODE_DEF_T(iso_8859_7)
+_ULDECODE_DEF_T_ASCII(iso_8859_7)
   #endif /* ULDECODE_USE_ISO_8859_7 */
 
   #if ULDECODE_USE_ISO_8859_8 || ULDECODE_USE_ISO_8859_8_I
@@ -1452,7 +2065,7 @@ static const char* uldecode_iso_8859_8_labels[] = { "csiso88598e",  "csisolatinh
                                                     "iso-8859-8-e", "iso-ir-138",       "iso8859-8", "iso88598",
                                                     "iso_8859-8",   "iso_8859-8:1988",  "visual",    NULL };
     #endif /* ULDECODE_DEFINE_LABELS */
-_ULDECODE_DEF_T(iso_8859_8)
+_ULDECODE_DEF_T_ASCII(iso_8859_8)
   #endif /* ULDECODE_USE_ISO_8859_8 */
   #if ULDECODE_USE_ISO_8859_8_I
 static const char uldecode_iso_8859_8_i_name[] = "ISO-8859-8-I";
@@ -1468,7 +2081,7 @@ uldecode_each_api int ulencode_iso_8859_8_i(uldecode_u8_t* p, uldecode_u32_t u,
     #ifdef ULDECODE_DEFINE_LABELS
 static const char* uldecode_iso_8859_8_i_labels[] = { "csiso88598i", "iso-8859-8-i", "logical", NULL };
     #endif /* ULDECODE_DEFINE_LABELS */
-_ULDECODE_DEF_T(iso_8859_8_i)
+_ULDECODE_DEF_T_ASCII(iso_8859_8_i)
   #endif /* ULDECODE_USE_ISO_8859_8_I */
 
   #if ULDECODE_USE_ISO_8859_10
@@ -1498,7 +2111,7 @@ uldecode_each_api int ulencode_iso_8859_10(uldecode_u8_t* p, uldecode_u32_t u, u
 static const char* uldecode_iso_8859_10_labels[] = { "csisolatin6", "iso-8859-10", "iso-ir-157", "iso8859-10",
                                                      "iso885910",   "l6",          "latin6",     NULL };
     #endif /* ULDECODE_DEFINE_LABELS */
-_ULDECODE_DEF_T(iso_8859_10)
+_ULDECODE_DEF_T_ASCII(iso_8859_10)
   #endif /* ULDECODE_USE_ISO_8859_10 */
 
   #if ULDECODE_USE_ISO_8859_13
@@ -1527,7 +2140,7 @@ uldecode_each_api int ulencode_iso_8859_13(uldecode_u8_t* p, uldecode_u32_t u, u
     #ifdef ULDECODE_DEFINE_LABELS
 static const char* uldecode_iso_8859_13_labels[] = { "iso-8859-13", "iso8859-13", "iso885913", NULL };
     #endif /* ULDECODE_DEFINE_LABELS */
-_ULDECODE_DEF_T(iso_8859_13)
+_ULDECODE_DEF_T_ASCII(iso_8859_13)
   #endif /* ULDECODE_USE_ISO_8859_13 */
 
   #if ULDECODE_USE_ISO_8859_14
@@ -1556,7 +2169,7 @@ uldecode_each_api int ulencode_iso_8859_14(uldecode_u8_t* p, uldecode_u32_t u, u
     #ifdef ULDECODE_DEFINE_LABELS
 static const char* uldecode_iso_8859_14_labels[] = { "iso-8859-14", "iso8859-14", "iso885914", NULL };
     #endif /* ULDECODE_DEFINE_LABELS */
-_ULDECODE_DEF_T(iso_8859_14)
+_ULDECODE_DEF_T_ASCII(iso_8859_14)
   #endif /* ULDECODE_USE_ISO_8859_14 */
 
   #if ULDECODE_USE_ISO_8859_15
@@ -1586,7 +2199,7 @@ uldecode_each_api int ulencode_iso_8859_15(uldecode_u8_t* p, uldecode_u32_t u, u
 static const char* uldecode_iso_8859_15_labels[] = { "csisolatin9", "iso-8859-15", "iso8859-15", "iso885915",
                                                      "l9",          "latin9",      NULL };
     #endif /* ULDECODE_DEFINE_LABELS */
-_ULDECODE_DEF_T(iso_8859_15)
+_ULDECODE_DEF_T_ASCII(iso_8859_15)
   #endif /* ULDECODE_USE_ISO_8859_15 */
 
   #if ULDECODE_USE_ISO_8859_16
@@ -1615,7 +2228,7 @@ uldecode_each_api int ulencode_iso_8859_16(uldecode_u8_t* p, uldecode_u32_t u, u
     #ifdef ULDECODE_DEFINE_LABELS
 static const char* uldecode_iso_8859_16_labels[] = { "iso-8859-16", NULL };
     #endif /* ULDECODE_DEFINE_LABELS */
-_ULDECODE_DEF_T(iso_8859_16)
+_ULDECODE_DEF_T_ASCII(iso_8859_16)
   #endif /* ULDECODE_USE_ISO_8859_16 */
 
   #if ULDECODE_USE_KOI8_R
@@ -1644,7 +2257,7 @@ uldecode_each_api int ulencode_koi8_r(uldecode_u8_t* p, uldecode_u32_t u, uldeco
     #ifdef ULDECODE_DEFINE_LABELS
 static const char* uldecode_koi8_r_labels[] = { "cskoi8r", "koi", "koi8", "koi8-r", "koi8_r", NULL };
     #endif /* ULDECODE_DEFINE_LABELS */
-_ULDECODE_DEF_T(koi8_r)
+_ULDECODE_DEF_T_ASCII(koi8_r)
   #endif /* ULDECODE_USE_KOI8_R */
 
   #if ULDECODE_USE_KOI8_U
@@ -1673,7 +2286,7 @@ uldecode_each_api int ulencode_koi8_u(uldecode_u8_t* p, uldecode_u32_t u, uldeco
     #ifdef ULDECODE_DEFINE_LABELS
 static const char* uldecode_koi8_u_labels[] = { "koi8-ru", "koi8-u", NULL };
     #endif /* ULDECODE_DEFINE_LABELS */
-_ULDECODE_DEF_T(koi8_u)
+_ULDECODE_DEF_T_ASCII(koi8_u)
   #endif /* ULDECODE_USE_KOI8_U */
 
   #if ULDECODE_USE_MACINTOSH
@@ -1702,7 +2315,7 @@ uldecode_each_api int ulencode_macintosh(uldecode_u8_t* p, uldecode_u32_t u, uld
     #ifdef ULDECODE_DEFINE_LABELS
 static const char* uldecode_macintosh_labels[] = { "csmacintosh", "mac", uldecode_macintosh_name, "x-mac-roman", NULL };
     #endif /* ULDECODE_DEFINE_LABELS */
-_ULDECODE_DEF_T(macintosh)
+_ULDECODE_DEF_T_ASCII(macintosh)
   #endif /* ULDECODE_USE_MACINTOSH */
 
   #if ULDECODE_USE_WINDOWS_874
@@ -1733,7 +2346,7 @@ static const char* uldecode_windows_874_labels[] = { "dos-874",   "iso-8859-11",
                                                      "iso885911", "tis-620",     uldecode_windows_874_name,
                                                      NULL };
     #endif /* ULDECODE_DEFINE_LABELS */
-_ULDECODE_DEF_T(windows_874)
+_ULDECODE_DEF_T_ASCII(windows_874)
   #endif /* ULDECODE_USE_WINDOWS_874 */
 
   #if ULDECODE_USE_WINDOWS_1250
@@ -1762,7 +2375,7 @@ uldecode_each_api int ulencode_windows_1250(uldecode_u8_t* p, uldecode_u32_t u,
     #ifdef ULDECODE_DEFINE_LABELS
 static const char* uldecode_windows_1250_labels[] = { "cp1250", uldecode_windows_1250_name, "x-cp1250", NULL };
     #endif /* ULDECODE_DEFINE_LABELS */
-_ULDECODE_DEF_T(windows_1250)
+_ULDECODE_DEF_T_ASCII(windows_1250)
   #endif /* ULDECODE_USE_WINDOWS_1250 */
 
   #if ULDECODE_USE_WINDOWS_1251
@@ -1791,7 +2404,7 @@ uldecode_each_api int ulencode_windows_1251(uldecode_u8_t* p, uldecode_u32_t u,
     #ifdef ULDECODE_DEFINE_LABELS
 static const char* uldecode_windows_1251_labels[] = { "cp1251", uldecode_windows_1251_name, "x-cp1251", NULL };
     #endif /* ULDECODE_DEFINE_LABELS */
-_ULDECODE_DEF_T(windows_1251)
+_ULDECODE_DEF_T_ASCII(windows_1251)
   #endif /* ULDECODE_USE_WINDOWS_1251 */
 
   #if ULDECODE_USE_WINDOWS_1252
@@ -1837,7 +2450,7 @@ static const char* uldecode_windows_1252_labels[] = { "ansi_x3.4-1968",
                                                       "x-cp1252",
                                                       NULL };
     #endif /* ULDECODE_DEFINE_LABELS */
-_ULDECODE_DEF_T(windows_1252)
+_ULDECODE_DEF_T_ASCII(windows_1252)
   #endif /* ULDECODE_USE_WINDOWS_1252 */
 
   #if ULDECODE_USE_WINDOWS_1253
@@ -1866,7 +2479,7 @@ uldecode_each_api int ulencode_windows_1253(uldecode_u8_t* p, uldecode_u32_t u,
     #ifdef ULDECODE_DEFINE_LABELS
 static const char* uldecode_windows_1253_labels[] = { "cp1253", uldecode_windows_1253_name, "x-cp1253", NULL };
     #endif /* ULDECODE_DEFINE_LABELS */
-_ULDECODE_DEF_T(windows_1253)
+_ULDECODE_DEF_T_ASCII(windows_1253)
   #endif /* ULDECODE_USE_WINDOWS_1253 */
 
   #if ULDECODE_USE_WINDOWS_1254
@@ -1907,7 +2520,7 @@ static const char* uldecode_windows_1254_labels[] = { "cp1254",
                                                       "x-cp1254",
                                                       NULL };
     #endif /* ULDECODE_DEFINE_LABELS */
-_ULDECODE_DEF_T(windows_1254)
+_ULDECODE_DEF_T_ASCII(windows_1254)
   #endif /* ULDECODE_USE_WINDOWS_1254 */
 
   #if ULDECODE_USE_WINDOWS_1255
@@ -1936,7 +2549,7 @@ uldecode_each_api int ulencode_windows_1255(uldecode_u8_t* p, uldecode_u32_t u,
     #ifdef ULDECODE_DEFINE_LABELS
 static const char* uldecode_windows_1255_labels[] = { "cp1255", uldecode_windows_1255_name, "x-cp1255", NULL };
     #endif /* ULDECODE_DEFINE_LABELS */
-_ULDECODE_DEF_T(windows_1255)
+_ULDECODE_DEF_T_ASCII(windows_1255)
   #endif /* ULDECODE_USE_WINDOWS_1255 */
 
   #if ULDECODE_USE_WINDOWS_1256
@@ -1965,7 +2578,7 @@ uldecode_each_api int ulencode_windows_1256(uldecode_u8_t* p, uldecode_u32_t u,
     #ifdef ULDECODE_DEFINE_LABELS
 static const char* uldecode_windows_1256_labels[] = { "cp1256", uldecode_windows_1256_name, "x-cp1256", NULL };
     #endif /* ULDECODE_DEFINE_LABELS */
-_ULDECODE_DEF_T(windows_1256)
+_ULDECODE_DEF_T_ASCII(windows_1256)
   #endif /* ULDECODE_USE_WINDOWS_1256 */
 
   #if ULDECODE_USE_WINDOWS_1257
@@ -1994,7 +2607,7 @@ uldecode_each_api int ulencode_windows_1257(uldecode_u8_t* p, uldecode_u32_t u,
     #ifdef ULDECODE_DEFINE_LABELS
 static const char* uldecode_windows_1257_labels[] = { "cp1257", uldecode_windows_1257_name, "x-cp1257", NULL };
     #endif /* ULDECODE_DEFINE_LABELS */
-_ULDECODE_DEF_T(windows_1257)
+_ULDECODE_DEF_T_ASCII(windows_1257)
   #endif /* ULDECODE_USE_WINDOWS_1257 */
 
   #if ULDECODE_USE_WINDOWS_1258
@@ -2023,7 +2636,7 @@ uldecode_each_api int ulencode_windows_1258(uldecode_u8_t* p, uldecode_u32_t u,
     #ifdef ULDECODE_DEFINE_LABELS
 static const char* uldecode_windows_1258_labels[] = { "cp1258", uldecode_windows_1258_name, "x-cp1258", NULL };
     #endif /* ULDECODE_DEFINE_LABELS */
-_ULDECODE_DEF_T(windows_1258)
+_ULDECODE_DEF_T_ASCII(windows_1258)
   #endif /* ULDECODE_USE_WINDOWS_1258 */
 
   #if ULDECODE_USE_X_MAC_CYRILLIC
@@ -2052,7 +2665,7 @@ uldecode_each_api int ulencode_x_mac_cyrillic(uldecode_u8_t* p, uldecode_u32_t u
     #ifdef ULDECODE_DEFINE_LABELS
 static const char* uldecode_x_mac_cyrillic_labels[] = { uldecode_x_mac_cyrillic_name, "x-mac-ukrainian", NULL };
     #endif /* ULDECODE_DEFINE_LABELS */
-_ULDECODE_DEF_T(x_mac_cyrillic)
+_ULDECODE_DEF_T_ASCII(x_mac_cyrillic)
   #endif /* ULDECODE_USE_X_MAC_CYRILLIC */
 
   #if ULDECODE_USE_GB18030 || ULDECODE_USE_GBK
@@ -3900,6 +4513,7 @@ static int _uldecode_gb18030(uldecode_u32_t* p, int c, uldecode_state_t* _state)
   }
   return -1;
 }
+static const uldecode_u16_t* _ulencode_gb18030_index = NULL;
 static int _ulencode_gb18030(uldecode_u8_t* p, uldecode_u32_t u, int is_gbk) {
   uldecode_u32_t pointer;
 
@@ -3916,9 +4530,9 @@ static int _ulencode_gb18030(uldecode_u8_t* p, uldecode_u32_t u, int is_gbk) {
     return 1;
   }
 
-  for(pointer = 0; pointer < _uldecode_gb18030_table_len; ++pointer)
-    if(_uldecode_gb18030_table[pointer] == u)
-      break;
+  pointer = _ulencode_index_lookup(
+    &_ulencode_gb18030_index, _uldecode_gb18030_table, NULL, 0, _uldecode_gb18030_table_len, 0, 0, u
+  );
   if(pointer != _uldecode_gb18030_table_len) {
     p[0] = ul_static_cast(uldecode_u8_t, pointer / 190u + 0x81u);
     pointer %= 190u;
@@ -3957,6 +4571,13 @@ static int _ulencode_gb18030(uldecode_u8_t* p, uldecode_u32_t u, int is_gbk) {
   pointer %= 10u;
   p[3] = ul_static_cast(uldecode_u8_t, pointer + 0x30u);
   return 4;
+}
+static ul_inline uldecode_u32_t _uldecode_gb18030_pair(int lead, int trail) {
+  if(!(0x81 <= lead && lead <= 0xFE) || !((0x40 <= trail && trail <= 0x7E) || (0x80 <= trail && trail <= 0xFE)))
+    return 0;
+  return _uldecode_gb18030_table
+    [(ul_static_cast(uldecode_u32_t, lead) - 0x81u) * 190u + ul_static_cast(uldecode_u32_t, trail)
+     - (trail < 0x7F ? 0x40u : 0x41u)];
 }
   #endif /* ULDECODE_USE_GB18030 || ULDECODE_USE_GBK */
   #if ULDECODE_USE_GB18030
@@ -3972,7 +4593,7 @@ uldecode_each_api int ulencode_gb18030(uldecode_u8_t* p, uldecode_u32_t u, uldec
     #ifdef ULDECODE_DEFINE_LABELS
 static const char* uldecode_gb18030_labels[] = { uldecode_gb18030_name, NULL };
     #endif
-_ULDECODE_DEF_T(gb18030)
+_ULDECODE_DEF_T_PAIR(gb18030, _uldecode_gb18030_pair)
   #endif /* ULDECODE_USE_GB18030 */
   #if ULDECODE_USE_GBK
 static const char uldecode_gbk_name[] = "GBK";
@@ -3988,7 +4609,7 @@ uldecode_each_api int ulencode_gbk(uldecode_u8_t* p, uldecode_u32_t u, uldecode_
 static const char* uldecode_gbk_labels[] = { "chinese",    "csgb2312", "csiso58gb231280", "gb2312", "gb_2312",
                                              "gb_2312-80", "gbk",      "iso-ir-58",       "x-gbk",  NULL };
     #endif
-_ULDECODE_DEF_T(gbk)
+_ULDECODE_DEF_T_PAIR(gbk, _uldecode_gb18030_pair)
   #endif /* ULDECODE_USE_GBK */
 
   #if ULDECODE_USE_BIG5
@@ -5518,6 +6139,17 @@ static const uldecode_u32_t _uldecode_big5_table[] = {
 };
     #define _uldecode_big5_table_len 19782
 static const char uldecode_big5_name[] = "Big5";
+static ul_inline uldecode_u32_t _uldecode_big5_pair(int lead, int trail) {
+  uldecode_u32_t u;
+  if(!(0x81 <= lead && lead <= 0xFE) || !((0x40 <= trail && trail <= 0x7E) || (0xA1 <= trail && trail <= 0xFE)))
+    return 0;
+  u = ul_static_cast(uldecode_u32_t, lead - 0x81) * 157u + ul_static_cast(uldecode_u32_t, trail)
+      - (trail < 0x7F ? 0x40u : 0x62u);
+  /* 1133, 1135, 1164 and 1166 decode to two code points */
+  if(u == 1133 || u == 1135 || u == 1164 || u == 1166)
+    return 0;
+  return _uldecode_big5_table[u];
+}
 struct _uldecode_big5_state_t {
   uldecode_u16_t c;
 };
@@ -5580,6 +6212,7 @@ uldecode_each_api int uldecode_big5(uldecode_u32_t* p, int c, uldecode_state_t*
   }
   return -1;
 }
+static const uldecode_u16_t* _ulencode_big5_index = NULL;
 uldecode_each_api int ulencode_big5(uldecode_u8_t* p, uldecode_u32_t u, uldecode_state_t* _state) {
   uldecode_u8_t c;
   int i;
@@ -5594,9 +6227,10 @@ uldecode_each_api int ulencode_big5(uldecode_u8_t* p, uldecode_u32_t u, uldecode
   if(u == 0x2550 || u == 0x255E || u == 0x2561 || u == 0x256A || u == 0x5341 || u == 0x5345) {
     i = _uldecode_big5_table_len - 1;
   } else {
-    for(i = /*hkscs ? 0 : */ (0xA1 - 0x81) * 157; i < _uldecode_big5_table_len; ++i)
-      if(u == (_uldecode_big5_table[i]))
-        break;
+    i = ul_static_cast(int, _ulencode_index_lookup(
+      &_ulencode_big5_index, NULL, _uldecode_big5_table, /*hkscs ? 0 : */ (0xA1 - 0x81) * 157, _uldecode_big5_table_len,
+      0, 0, u
+    ));
   }
   if(i == _uldecode_big5_table_len)
     return -1;
@@ -5613,7 +6247,7 @@ uldecode_each_api int ulencode_big5(uldecode_u8_t* p, uldecode_u32_t u, uldecode
     #ifdef ULDECODE_DEFINE_LABELS
 static const char* uldecode_big5_labels[] = { "big5", "big5-hkscs", "cn-big5", "csbig5", "x-x-big5", NULL };
     #endif
-_ULDECODE_DEF_T(big5)
+_ULDECODE_DEF_T_PAIR(big5, _uldecode_big5_pair)
   #endif /* ULDECODE_USE_BIG5 */
 
   #if ULDECODE_USE_EUC_JP || ULDECODE_USE_ISO_2022_JP || ULDECODE_USE_SHIFT_JIS
@@ -6426,6 +7060,9 @@ static const uldecode_u16_t _uldecode_jis0208_table[] = {
   0,      0,      0,      0,      0,      0,      0,      0,      0,      0,
 };
     #define _uldecode_jis0208_table_len 11280u
+    #if ULDECODE_USE_EUC_JP || ULDECODE_USE_ISO_2022_JP
+static const uldecode_u16_t* _ulencode_jis0208_index = NULL;
+    #endif
   #endif /* ULDECODE_USE_EUC_JP || ULDECODE_USE_ISO_2022_JP || ULDECODE_USE_SHIFT_JIS */
   #if ULDECODE_USE_EUC_JP
 static const uldecode_u16_t _uldecode_jis0212_table[] = {
@@ -7140,7 +7777,9 @@ uldecode_each_api int ulencode_euc_jp(uldecode_u8_t* p, uldecode_u32_t u, uldeco
 
   if(u == 0x2212)
     u = 0xFF0D;
-  for(i = 0; i < _uldecode_jis0208_table_len && _uldecode_jis0208_table[i] != u; ++i) { }
+  i = _ulencode_index_lookup(
+    &_ulencode_jis0208_index, _uldecode_jis0208_table, NULL, 0, _uldecode_jis0208_table_len, 0, 0, u
+  );
   if(i == _uldecode_jis0208_table_len)
     return -1;
   p[0] = ul_static_cast(uldecode_u8_t, i / 94u + 0xA1u);
@@ -7151,7 +7790,7 @@ uldecode_each_api int ulencode_euc_jp(uldecode_u8_t* p, uldecode_u32_t u, uldeco
     #ifdef ULDECODE_DEFINE_LABELS
 static const char* uldecode_euc_jp_labels[] = { "cseucpkdfmtjapanese", "euc-jp", "x-euc-jp", NULL };
     #endif
-_ULDECODE_DEF_T(euc_jp)
+_ULDECODE_DEF_T_ASCII(euc_jp)
   #endif /* ULDECODE_USE_EUC_JP */
   #if ULDECODE_USE_ISO_2022_JP
 static const char uldecode_iso_2022_jp_name[] = "ISO-2022-JP";
@@ -7343,7 +7982,9 @@ uldecode_each_api int ulencode_iso_2022_jp(uldecode_u8_t* p, uldecode_u32_t u, u
 
   if(u == 0x2212)
     u = 0xFF0D;
-  for(x = 0; x < _uldecode_jis0208_table_len && _uldecode_jis0208_table[x] != u; ++x) { }
+  x = _ulencode_index_lookup(
+    &_ulencode_jis0208_index, _uldecode_jis0208_table, NULL, 0, _uldecode_jis0208_table_len, 0, 0, u
+  );
   if(x == _uldecode_jis0208_table_len)
     return -1;
   if(state->state != _jis0208) {
@@ -7366,6 +8007,17 @@ _ULDECODE_DEF_T(iso_2022_jp)
   #endif /* ULDECODE_USE_ISO_2022_JP */
   #if ULDECODE_USE_SHIFT_JIS
 static const char uldecode_shift_jis_name[] = "Shift_JIS";
+static ul_inline uldecode_u32_t _uldecode_shift_jis_pair(int lead, int trail) {
+  uldecode_u32_t u;
+  if(!((0x81 <= lead && lead <= 0x9F) || (0xE0 <= lead && lead <= 0xFC))
+     || !((0x40 <= trail && trail <= 0x7E) || (0x80 <= trail && trail <= 0xFC)))
+    return 0;
+  u = (ul_static_cast(uldecode_u32_t, lead) - (lead < 0xA0 ? 0x81u : 0xC1u)) * 188u
+      + ul_static_cast(uldecode_u32_t, trail) - (trail < 0x7F ? 0x40u : 0x41u);
+  if(8836 <= u && u <= 10715)
+    return 0xE000 - 8835 + u;
+  return _uldecode_jis0208_table[u];
+}
 struct _uldecode_shift_jis_state_t {
   uldecode_u8_t lead;
 };
@@ -7414,6 +8066,7 @@ uldecode_each_api int uldecode_shift_jis(uldecode_u32_t* p, int c, uldecode_stat
   }
   return -1;
 }
+static const uldecode_u16_t* _ulencode_shift_jis_index = NULL;
 uldecode_each_api int ulencode_shift_jis(uldecode_u8_t* p, uldecode_u32_t u, uldecode_state_t* _state) {
   uldecode_u32_t i;
 
@@ -7438,9 +8091,9 @@ uldecode_each_api int ulencode_shift_jis(uldecode_u8_t* p, uldecode_u32_t u, uld
   }
   if(u == 0x2212)
     u = 0xFF0D;
-  for(i = 0; i < _uldecode_jis0208_table_len; ++i)
-    if(!(8272 <= i && i <= 8835) && _uldecode_jis0208_table[i] == u)
-      break;
+  i = _ulencode_index_lookup(
+    &_ulencode_shift_jis_index, _uldecode_jis0208_table, NULL, 0, _uldecode_jis0208_table_len, 8272, 8836, u
+  );
   if(i == _uldecode_jis0208_table_len)
     return -1;
   u = i / 188;
@@ -7454,7 +8107,7 @@ uldecode_each_api int ulencode_shift_jis(uldecode_u8_t* p, uldecode_u32_t u, uld
 static const char* uldecode_shift_jis_labels[] = { "csshiftjis", "ms_kanji",    "shift-jis", "shift_jis",
                                                    "sjis",       "windows-31j", "x-sjis",    NULL };
     #endif
-_ULDECODE_DEF_T(shift_jis)
+_ULDECODE_DEF_T_PAIR(shift_jis, _uldecode_shift_jis_pair)
   #endif /* ULDECODE_USE_SHIFT_JIS */
 
   #if ULDECODE_USE_EUC_KR
@@ -9210,6 +9863,7 @@ uldecode_each_api int uldecode_euc_kr(uldecode_u32_t* p, int c, uldecode_state_t
   }
   return -1;
 }
+static const uldecode_u16_t* _ulencode_euc_kr_index = NULL;
 uldecode_each_api int ulencode_euc_kr(uldecode_u8_t* p, uldecode_u32_t u, uldecode_state_t* _state) {
   uldecode_u32_t i;
 
@@ -9220,9 +9874,9 @@ uldecode_each_api int ulencode_euc_kr(uldecode_u8_t* p, uldecode_u32_t u, uldeco
     p[0] = ul_static_cast(uldecode_u8_t, u);
     return 1;
   }
-  for(i = 0; i < _uldecode_euc_kr_table_len; ++i)
-    if(_uldecode_euc_kr_table[i] == u)
-      break;
+  i = _ulencode_index_lookup(
+    &_ulencode_euc_kr_index, _uldecode_euc_kr_table, NULL, 0, _uldecode_euc_kr_table_len, 0, 0, u
+  );
   if(i == _uldecode_euc_kr_table_len)
     return -1;
   p[0] = ul_static_cast(uldecode_u8_t, i / 190 + 0x81);
@@ -9236,7 +9890,7 @@ static const char* uldecode_euc_kr_labels[] = {
   "ks_c_5601-1989", "ksc5601",       "ksc_5601", "windows-949", NULL
 };
     #endif
-_ULDECODE_DEF_T(euc_kr)
+_ULDECODE_DEF_T_ASCII(euc_kr)
   #endif /* ULDECODE_USE_EUC_KR */
 
   #if ULDECODE_USE_IBM037
@@ -9321,7 +9975,7 @@ uldecode_each_api int ulencode_ibm437(uldecode_u8_t* p, uldecode_u32_t u, uldeco
     #ifdef ULDECODE_DEFINE_LABELS
 static const char* uldecode_ibm437_labels[] = { "cp437", "437", "csPC8CodePage437", NULL };
     #endif /* ULDECODE_DEFINE_LABELS */
-_ULDECODE_DEF_T(ibm437)
+_ULDECODE_DEF_T_ASCII(ibm437)
   #endif /* ULDECODE_USE_IBM437 */
 
   #if ULDECODE_USE_IBM500
@@ -9440,7 +10094,7 @@ uldecode_each_api int ulencode_dos_720(uldecode_u8_t* p, uldecode_u32_t u, uldec
     #ifdef ULDECODE_DEFINE_LABELS
 static const char* uldecode_dos_720_labels[] = { NULL };
     #endif /* ULDECODE_DEFINE_LABELS */
-_ULDECODE_DEF_T(dos_720)
+_ULDECODE_DEF_T_ASCII(dos_720)
   #endif /* ULDECODE_USE_DOS_720 */
 
   #if ULDECODE_USE_IBM775
@@ -9509,7 +10163,7 @@ uldecode_each_api int ulencode_ibm850(uldecode_u8_t* p, uldecode_u32_t u, uldeco
     #ifdef ULDECODE_DEFINE_LABELS
 static const char* uldecode_ibm850_labels[] = { "cp850", "850", "csPC850Multilingual", NULL };
     #endif /* ULDECODE_DEFINE_LABELS */
-_ULDECODE_DEF_T(ibm850)
+_ULDECODE_DEF_T_ASCII(ibm850)
   #endif /* ULDECODE_USE_IBM850 */
 
   #if ULDECODE_USE_IBM852
@@ -9539,7 +10193,7 @@ uldecode_each_api int ulencode_ibm852(uldecode_u8_t* p, uldecode_u32_t u, uldeco
     #ifdef ULDECODE_DEFINE_LABELS
 static const char* uldecode_ibm852_labels[] = { "cp852", "852", "csPCp852", NULL };
     #endif /* ULDECODE_DEFINE_LABELS */
-_ULDECODE_DEF_T(ibm852)
+_ULDECODE_DEF_T_ASCII(ibm852)
   #endif /* ULDECODE_USE_IBM852 */
 
   #if ULDECODE_USE_IBM855
@@ -9569,7 +10223,7 @@ uldecode_each_api int ulencode_ibm855(uldecode_u8_t* p, uldecode_u32_t u, uldeco
     #ifdef ULDECODE_DEFINE_LABELS
 static const char* uldecode_ibm855_labels[] = { "cp855", "855", "csIBM855", NULL };
     #endif /* ULDECODE_DEFINE_LABELS */
-_ULDECODE_DEF_T(ibm855)
+_ULDECODE_DEF_T_ASCII(ibm855)
   #endif /* ULDECODE_USE_IBM855 */
 
   #if ULDECODE_USE_IBM857
@@ -9599,7 +10253,7 @@ uldecode_each_api int ulencode_ibm857(uldecode_u8_t* p, uldecode_u32_t u, uldeco
     #ifdef ULDECODE_DEFINE_LABELS
 static const char* uldecode_ibm857_labels[] = { "cp857", "857", "csIBM857", NULL };
     #endif /* ULDECODE_DEFINE_LABELS */
-_ULDECODE_DEF_T(ibm857)
+_ULDECODE_DEF_T_ASCII(ibm857)
   #endif /* ULDECODE_USE_IBM857 */
 
   #if ULDECODE_USE_IBM00858
@@ -9669,7 +10323,7 @@ uldecode_each_api int ulencode_ibm860(uldecode_u8_t* p, uldecode_u32_t u, uldeco
     #ifdef ULDECODE_DEFINE_LABELS
 static const char* uldecode_ibm860_labels[] = { "cp860", "860", "csIBM860", NULL };
     #endif /* ULDECODE_DEFINE_LABELS */
-_ULDECODE_DEF_T(ibm860)
+_ULDECODE_DEF_T_ASCII(ibm860)
   #endif /* ULDECODE_USE_IBM860 */
 
   #if ULDECODE_USE_IBM861
@@ -9699,7 +10353,7 @@ uldecode_each_api int ulencode_ibm861(uldecode_u8_t* p, uldecode_u32_t u, uldeco
     #ifdef ULDECODE_DEFINE_LABELS
 static const char* uldecode_ibm861_labels[] = { "cp861", "861", "cp-is", "csIBM861", NULL };
     #endif /* ULDECODE_DEFINE_LABELS */
-_ULDECODE_DEF_T(ibm861)
+_ULDECODE_DEF_T_ASCII(ibm861)
   #endif /* ULDECODE_USE_IBM861 */
 
   #if ULDECODE_USE_IBM862
@@ -9730,7 +10384,7 @@ uldecode_each_api int ulencode_ibm862(uldecode_u8_t* p, uldecode_u32_t u, uldeco
 static const char* uldecode_ibm862_labels[] = { "cp862", "862", "csPC862LatinHebrew", "DOS-862" /* (for .NET) */,
                                                 NULL };
     #endif /* ULDECODE_DEFINE_LABELS */
-_ULDECODE_DEF_T(ibm862)
+_ULDECODE_DEF_T_ASCII(ibm862)
   #endif /* ULDECODE_USE_IBM862 */
 
   #if ULDECODE_USE_IBM863
@@ -9760,7 +10414,7 @@ uldecode_each_api int ulencode_ibm863(uldecode_u8_t* p, uldecode_u32_t u, uldeco
     #ifdef ULDECODE_DEFINE_LABELS
 static const char* uldecode_ibm863_labels[] = { "cp863", "863", "csIBM863", NULL };
     #endif /* ULDECODE_DEFINE_LABELS */
-_ULDECODE_DEF_T(ibm863)
+_ULDECODE_DEF_T_ASCII(ibm863)
   #endif /* ULDECODE_USE_IBM863 */
 
   #if ULDECODE_USE_IBM864
@@ -9790,7 +10444,7 @@ uldecode_each_api int ulencode_ibm864(uldecode_u8_t* p, uldecode_u32_t u, uldeco
     #ifdef ULDECODE_DEFINE_LABELS
 static const char* uldecode_ibm864_labels[] = { "cp864", "csIBM864", NULL };
     #endif /* ULDECODE_DEFINE_LABELS */
-_ULDECODE_DEF_T(ibm864)
+_ULDECODE_DEF_T_ASCII(ibm864)
   #endif /* ULDECODE_USE_IBM864 */
 
   #if ULDECODE_USE_IBM865
@@ -9820,7 +10474,7 @@ uldecode_each_api int ulencode_ibm865(uldecode_u8_t* p, uldecode_u32_t u, uldeco
     #ifdef ULDECODE_DEFINE_LABELS
 static const char* uldecode_ibm865_labels[] = { "cp865", "csIBM865", NULL };
     #endif /* ULDECODE_DEFINE_LABELS */
-_ULDECODE_DEF_T(ibm865)
+_ULDECODE_DEF_T_ASCII(ibm865)
   #endif /* ULDECODE_USE_IBM865 */
 
   #if ULDECODE_USE_IBM869
@@ -9850,7 +10504,7 @@ uldecode_each_api int ulencode_ibm869(uldecode_u8_t* p, uldecode_u32_t u, uldeco
     #ifdef ULDECODE_DEFINE_LABELS
 static const char* uldecode_ibm869_labels[] = { "cp869", "869", "cp-gr", "csIBM869", NULL };
     #endif /* ULDECODE_DEFINE_LABELS */
-_ULDECODE_DEF_T(ibm869)
+_ULDECODE_DEF_T_ASCII(ibm869)
   #endif /* ULDECODE_USE_IBM869 */
 
   #if ULDECODE_USE_IBM870
@@ -11187,111 +11841,240 @@ uldecode_api const uldecode_t* uldecode_get(const char* name) {
 
 
   #include <string.h>
-uldecode_api size_t ul_encode_between_spec(
-  void* ul_restrict dest, size_t dest_len, ulencode_func_t encoder,    /* */
-  const void* ul_restrict src, size_t src_len, uldecode_func_t decoder /* */
+  #ifndef ULDECODE_BLOCK_SIZE
+    /* the number of code points converted per block */
+    #define ULDECODE_BLOCK_SIZE 256
+  #endif /* ULDECODE_BLOCK_SIZE */
+  #include <stdlib.h>
+/* the growable output of `_ul_encode_between_alloc`, `alloc_fn == NULL` for malloc/realloc/free */
+typedef struct _uldecode_grow_t {
+  uldecode_alloc_t alloc_fn;
+  void* opaque;
+  uldecode_u8_t* buf;
+  size_t cap;
+} _uldecode_grow_t;
+/* grow `g->buf` geometrically to at least `need` bytes keeping the first `used`, returns 0 if out of memory */
+static int _uldecode_grow(_uldecode_grow_t* g, size_t used, size_t need) {
+  size_t cap = g->cap;
+  void* buf;
+
+  while(cap < need)
+    cap = cap == 0 || cap > (ul_static_cast(size_t, -1) >> 1) ? need : cap * 2;
+  if(g->alloc_fn == NULL)
+    buf = realloc(g->buf, cap);
+  else {
+    /* `alloc_fn` only allocates and frees, so move the bytes over */
+    buf = g->alloc_fn(g->opaque, NULL, cap);
+    if(buf == NULL)
+      return 0;
+    if(g->buf) {
+      memcpy(buf, g->buf, used);
+      g->alloc_fn(g->opaque, g->buf, 0);
+    }
+  }
+  if(buf == NULL)
+    return 0;
+  g->buf = ul_reinterpret_cast(uldecode_u8_t*, buf);
+  g->cap = cap;
+  return 1;
+}
+
+/* decode straight to UTF-8, writing into `dest` in place while it has room */
+static size_t _ul_encode_between_utf8(
+  void* ul_restrict dest, size_t dest_len, const void* ul_restrict src, size_t src_len, /* */
+  uldecode_to_utf8_func_t to_utf8, _uldecode_grow_t* grow                            /* */
 ) {
-  uldecode_state_t _decoder_state = ULDECODE_STATE_INIT, _encoder_state = ULDECODE_STATE_INIT;
-  uldecode_u32_t _db[ULDECODE_RETURN_MAX];
-  uldecode_u8_t _eb[ULENCODE_RETURN_MAX];
-  int _di = 0, _ei;
-  int _dr = 0, _er = 0;
+  uldecode_state_t _decoder_state = ULDECODE_STATE_INIT;
+  uldecode_u8_t _eb[ULDECODE_BLOCK_SIZE * ULENCODE_RETURN_MAX];
   uldecode_u8_t* ul_restrict _d = ul_reinterpret_cast(uldecode_u8_t*, dest);
   const uldecode_u8_t* ul_restrict _s = ul_reinterpret_cast(const uldecode_u8_t*, src);
+  uldecode_u8_t* _out;
+  size_t _sn, _en, _n;
   size_t writen = 0;
+  int eof = 0;
+
+  while(!eof) {
+    _sn = src_len;
+    eof = src_len == 0;
+    if(writen < dest_len && dest_len - writen >= sizeof(_eb)) {
+      _out = _d + writen;
+      _en = dest_len - writen;
+    } else {
+      _out = _eb;
+      _en = sizeof(_eb);
+    }
+    if(to_utf8(_out, &_en, eof ? NULL : _s, &_sn, &_decoder_state) < 0)
+      return 0;
+    if(ul_unlikely(!eof && _sn == 0))
+      return 0; /* no progress */
+    _s += _sn;
+    src_len -= _sn;
+    if(_out == _eb && grow && writen + _en > dest_len) {
+      if(!_uldecode_grow(grow, writen, writen + _en))
+        return 0;
+      _d = grow->buf;
+      dest_len = grow->cap;
+    }
+    if(_out == _eb && writen < dest_len) {
+      _n = dest_len - writen < _en ? dest_len - writen : _en;
+      /* back off to the lead byte of a cut sequence, then write nothing more */
+      if(_n < _en)
+        while(_n > 0 && (_eb[_n] & 0xC0) == 0x80)
+          --_n;
+      memcpy(_d + writen, _eb, _n);
+    }
+    writen += _en;
+  }
+  return writen;
+}
 
-  if(ul_unlikely(encoder == NULL || decoder == NULL))
+/* one call of `encoder_block` if given, otherwise of `encoder` per code point */
+static ul_inline int _ulencode_block_or(
+  ulencode_block_func_t encoder_block, ulencode_func_t encoder, uldecode_u8_t* dest, size_t* pdest_len, /* */
+  const uldecode_u32_t* src, size_t* psrc_len, uldecode_state_t* _state                                 /* */
+) {
+  if(encoder_block)
+    return encoder_block(dest, pdest_len, src, psrc_len, _state);
+  return _ulencode_block(encoder, dest, pdest_len, src, psrc_len, _state);
+}
+/**
+ * use `to_utf8` if given, then the block functions if given, otherwise the per-byte ones;
+ * with `grow`, `dest` is `grow->buf` and it is grown instead of truncating the output
+ */
+static size_t _ul_encode_between(
+  void* ul_restrict dest, size_t dest_len, ulencode_block_func_t encoder_block, ulencode_func_t encoder,     /* */
+  const void* ul_restrict src, size_t src_len, uldecode_block_func_t decoder_block, uldecode_func_t decoder, /* */
+  uldecode_to_utf8_func_t to_utf8, _uldecode_grow_t* grow                                                    /* */
+) {
+  uldecode_state_t _decoder_state = ULDECODE_STATE_INIT, _encoder_state = ULDECODE_STATE_INIT, _saved_state;
+  uldecode_u32_t _db[ULDECODE_BLOCK_SIZE];
+  uldecode_u8_t _eb[ULDECODE_BLOCK_SIZE * ULENCODE_RETURN_MAX];
+  uldecode_u8_t* ul_restrict _d = ul_reinterpret_cast(uldecode_u8_t*, dest);
+  const uldecode_u8_t* ul_restrict _s = ul_reinterpret_cast(const uldecode_u8_t*, src);
+  size_t _dn, _di, _sn, _en, _k, _one;
+  size_t writen = 0;
+  int eof = 0;
+
+  if(ul_unlikely(
+       to_utf8 == NULL && ((encoder_block == NULL && encoder == NULL) || (decoder_block == NULL && decoder == NULL))
+     ))
     return 0;
   if(ul_unlikely(src == NULL || src_len == 0))
     return 0;
   if(dest == NULL)
-    goto calc_length;
-  if(ul_unlikely(dest_len == 0))
+    dest_len = 0; /* only calculate the length */
+  else if(ul_unlikely(dest_len == 0))
     return 0;
-
-  while(src_len-- != 0) {
-    _dr = decoder(_db, *_s++, &_decoder_state);
-    if(_dr < 0)
+  if(to_utf8)
+    return _ul_encode_between_utf8(dest, dest_len, src, src_len, to_utf8, grow);
+
+  while(!eof) {
+    _dn = ULDECODE_BLOCK_SIZE;
+    _sn = src_len;
+    eof = src_len == 0;
+    if(decoder_block) {
+      if(decoder_block(_db, &_dn, eof ? NULL : _s, &_sn, &_decoder_state) < 0)
+        return 0;
+    } else if(_uldecode_block(decoder, _db, &_dn, eof ? NULL : _s, &_sn, &_decoder_state) < 0)
       return 0;
-    for(_di = 0; _di < _dr; ++_di) {
-      _er = encoder(_eb, _db[_di], &_encoder_state);
-      if(_er < 0)
+    if(ul_unlikely(!eof && _sn == 0 && _dn == 0))
+      return 0; /* no progress */
+    _s += _sn;
+    src_len -= _sn;
+
+    for(_di = 0; _di < _dn || (eof && _di == _dn); _di += _sn) {
+      _en = sizeof(_eb);
+      _sn = _dn - _di;
+      _saved_state = _encoder_state;
+      if(_ulencode_block_or(encoder_block, encoder, _eb, &_en, _di == _dn ? NULL : _db + _di, &_sn, &_encoder_state) < 0)
         return 0;
-      if(writen + ul_static_cast(size_t, _er) > dest_len)
-        goto calc_length;
-      for(_ei = 0; _ei < _er; ++_ei)
-        *_d++ = _eb[_ei];
-      writen += ul_static_cast(size_t, _er);
+      if(grow && writen + _en > dest_len) {
+        if(!_uldecode_grow(grow, writen, writen + _en))
+          return 0;
+        _d = grow->buf;
+        dest_len = grow->cap;
+      }
+      if(writen + _en <= dest_len) {
+        memcpy(_d + writen, _eb, _en);
+        writen += _en;
+      } else if(writen < dest_len) {
+        /* the block is cut: redo it per code point, so only whole characters are written */
+        _encoder_state = _saved_state;
+        for(_k = 0; _k < _sn || (_di == _dn && _k == 0); ++_k) {
+          _en = sizeof(_eb);
+          _one = 1;
+          if(_ulencode_block_or(
+               encoder_block, encoder, _eb, &_en, _di == _dn ? NULL : _db + _di + _k, &_one, &_encoder_state
+             ) < 0)
+            return 0;
+          if(writen + _en <= dest_len)
+            memcpy(_d + writen, _eb, _en);
+          writen += _en; /* past `dest_len` once a character doesn't fit, so nothing more is written */
+        }
+      } else
+        writen += _en;
+      if(_di == _dn)
+        break; /* flushed the encoder */
+      if(ul_unlikely(_sn == 0))
+        return 0; /* no progress */
     }
   }
+  return writen;
+}
 
-  _dr = decoder(_db, ULDECODE_EOF, &_decoder_state);
-  if(_dr < 0)
+uldecode_api size_t ul_encode_between_spec(
+  void* ul_restrict dest, size_t dest_len, ulencode_func_t encoder,    /* */
+  const void* ul_restrict src, size_t src_len, uldecode_func_t decoder /* */
+) {
+  if(ul_unlikely(encoder == NULL || decoder == NULL))
     return 0;
-  for(_di = 0; _di < _dr; ++_di) {
-    _er = encoder(_eb, _db[_di], &_encoder_state);
-    if(_er < 0)
-      return 0;
-    if(writen + ul_static_cast(size_t, _er) > dest_len)
-      goto calc_length;
-    for(_ei = 0; _ei < _er; ++_ei)
-      *_d++ = _eb[_ei];
-    writen += ul_static_cast(size_t, _er);
-  }
-
-  _er = encoder(_eb, ULENCODE_EOF, &_encoder_state);
-  if(_er < 0)
+  return _ul_encode_between(dest, dest_len, NULL, encoder, src, src_len, NULL, decoder, NULL, NULL);
+}
+uldecode_api size_t ul_encode_between_block_spec(
+  void* ul_restrict dest, size_t dest_len, ulencode_block_func_t encoder,    /* */
+  const void* ul_restrict src, size_t src_len, uldecode_block_func_t decoder /* */
+) {
+  if(ul_unlikely(encoder == NULL || decoder == NULL))
     return 0;
-  if(writen + ul_static_cast(size_t, _er) <= dest_len) {
-    for(_ei = 0; _ei < _er; ++_ei)
-      *_d++ = _eb[_ei];
-  }
-  writen += ul_static_cast(size_t, _er);
-  return writen;
+  return _ul_encode_between(dest, dest_len, encoder, NULL, src, src_len, decoder, NULL, NULL, NULL);
+}
 
-calc_length:
-  writen += ul_static_cast(size_t, _er);
-  for(++_di; _di < _dr; ++_di) {
-    _er = encoder(_eb, _db[_di], &_encoder_state);
-    if(_er < 0)
-      return 0;
-    writen += ul_static_cast(size_t, _er);
-  }
+/* convert in one pass into a buffer grown from an estimate, then shrink it if it is ours */
+static void* _ul_encode_between_alloc(
+  uldecode_alloc_t alloc_fn, void* opaque, ulencode_block_func_t encoder_block, ulencode_func_t encoder,     /* */
+  const void* ul_restrict src, size_t src_len, uldecode_block_func_t decoder_block, uldecode_func_t decoder, /* */
+  uldecode_to_utf8_func_t to_utf8, size_t* pwriten                                                           /* */
+) {
+  _uldecode_grow_t grow;
+  size_t writen;
+  void* shrunk;
 
-  while(src_len-- != 0) {
-    _dr = decoder(_db, *_s++, &_decoder_state);
-    if(_dr < 0)
-      return 0;
-    for(_di = 0; _di < _dr; ++_di) {
-      _er = encoder(_eb, _db[_di], &_encoder_state);
-      if(_er < 0)
-        return 0;
-      writen += ul_static_cast(size_t, _er);
-    }
+  if(ul_unlikely(src == NULL || src_len == 0))
+    return NULL;
+  grow.alloc_fn = alloc_fn;
+  grow.opaque = opaque;
+  grow.buf = NULL;
+  grow.cap = 0;
+  if(!_uldecode_grow(&grow, 0, src_len + (src_len >> 1) + 16))
+    return NULL;
+  writen = _ul_encode_between(
+    grow.buf, grow.cap, encoder_block, encoder, src, src_len, decoder_block, decoder, to_utf8, &grow
+  );
+  if(writen == 0) {
+    if(alloc_fn)
+      alloc_fn(opaque, grow.buf, 0);
+    else
+      free(grow.buf);
+    return NULL;
   }
-
-  _dr = decoder(_db, ULDECODE_EOF, &_decoder_state);
-  if(_dr < 0)
-    return 0;
-  for(_di = 0; _di < _dr; ++_di) {
-    _er = encoder(_eb, _db[_di], &_encoder_state);
-    if(_er < 0)
-      return 0;
-    writen += ul_static_cast(size_t, _er);
+  if(alloc_fn == NULL && writen < grow.cap) {
+    shrunk = realloc(grow.buf, writen);
+    if(shrunk)
+      grow.buf = ul_reinterpret_cast(uldecode_u8_t*, shrunk);
   }
-
-  _er = encoder(_eb, ULENCODE_EOF, &_encoder_state);
-  if(_er < 0)
-    return 0;
-  writen += ul_static_cast(size_t, _er);
-
-  return writen;
-}
-
-  #include <stdlib.h>
-static ul_inline void* _uldecode_alloc(void* opaque, void* ptr, size_t nn) {
-  (void)opaque;
-  return nn ? malloc(nn) : (free(ptr), ul_reinterpret_cast(void*, 0));
+  if(pwriten)
+    *pwriten = writen;
+  return grow.buf;
 }
 
 uldecode_api void* ul_encode_between_alloc_spec(
@@ -11299,70 +12082,73 @@ uldecode_api void* ul_encode_between_alloc_spec(
   const void* ul_restrict src, size_t src_len, uldecode_func_t decoder, /* */
   size_t* pwriten                                                       /* */
 ) {
-  size_t len, writen;
-  void* alloc;
-  if(alloc_fn == NULL)
-    alloc_fn = _uldecode_alloc;
-  len = ul_encode_between_spec(NULL, 0, encoder, src, src_len, decoder);
-  if(len == 0)
-    return NULL;
-  alloc = alloc_fn(opaque, NULL, len);
-  if(alloc == NULL)
+  if(ul_unlikely(encoder == NULL || decoder == NULL))
     return NULL;
-  writen = ul_encode_between_spec(alloc, len, encoder, src, src_len, decoder);
-  if(ul_unlikely(writen != len)) {
-    alloc_fn(opaque, alloc, 0);
+  return _ul_encode_between_alloc(alloc_fn, opaque, NULL, encoder, src, src_len, NULL, decoder, NULL, pwriten);
+}
+uldecode_api void* ul_encode_between_alloc_block_spec(
+  uldecode_alloc_t alloc_fn, void* opaque, ulencode_block_func_t encoder,     /* */
+  const void* ul_restrict src, size_t src_len, uldecode_block_func_t decoder, /* */
+  size_t* pwriten                                                             /* */
+) {
+  if(ul_unlikely(encoder == NULL || decoder == NULL))
     return NULL;
-  }
-  if(pwriten)
-    *pwriten = writen;
-  return alloc;
+  return _ul_encode_between_alloc(alloc_fn, opaque, encoder, NULL, src, src_len, decoder, NULL, NULL, pwriten);
+}
+
+/* the direct converter if `enc` is UTF-8 */
+static ul_inline uldecode_to_utf8_func_t _uldecode_pick_to_utf8(const uldecode_t* enc, const uldecode_t* dec) {
+  #if ULDECODE_USE_UTF_8
+  if(enc == &uldecode_utf_8_t)
+    return dec->to_utf8;
+  #else
+  (void)enc;
+  (void)dec;
+  #endif
+  return NULL;
 }
 
 uldecode_api size_t ul_encode_between(
   void* ul_restrict dest, size_t dest_len, const char* encoder_name,    /* */
   const void* ul_restrict src, size_t src_len, const char* decoder_name /* */
 ) {
-  const uldecode_t* t;
-  ulencode_func_t encoder;
-  uldecode_func_t decoder;
+  const uldecode_t* enc;
+  const uldecode_t* dec;
 
-  t = uldecode_get(encoder_name);
-  if(t == NULL)
+  enc = uldecode_get(encoder_name);
+  if(enc == NULL)
     return 0;
-  encoder = t->encode;
-
-  t = uldecode_get(decoder_name);
-  if(t == NULL)
+  dec = uldecode_get(decoder_name);
+  if(dec == NULL)
     return 0;
-  decoder = t->decode;
 
-  return ul_encode_between_spec(dest, dest_len, encoder, src, src_len, decoder);
+  return _ul_encode_between(
+    dest, dest_len, enc->encode_block, enc->encode, src, src_len, dec->decode_block, dec->decode,
+    _uldecode_pick_to_utf8(enc, dec), NULL
+  );
 }
 uldecode_api void* ul_encode_between_alloc(
   uldecode_alloc_t alloc_fn, void* opaque, const char* encoder_name,     /* */
   const void* ul_restrict src, size_t src_len, const char* decoder_name, /* */
   size_t* pwriten                                                        /* */
 ) {
-  const uldecode_t* t;
-  ulencode_func_t encoder;
-  uldecode_func_t decoder;
+  const uldecode_t* enc;
+  const uldecode_t* dec;
 
-  t = uldecode_get(encoder_name);
-  if(t == NULL)
+  enc = uldecode_get(encoder_name);
+  if(enc == NULL)
     return NULL;
-  encoder = t->encode;
-
-  t = uldecode_get(decoder_name);
-  if(t == NULL)
+  dec = uldecode_get(decoder_name);
+  if(dec == NULL)
     return NULL;
-  decoder = t->decode;
 
-  return ul_encode_between_alloc_spec(alloc_fn, opaque, encoder, src, src_len, decoder, pwriten);
+  return _ul_encode_between_alloc(
+    alloc_fn, opaque, enc->encode_block, enc->encode, src, src_len, dec->decode_block, dec->decode,
+    _uldecode_pick_to_utf8(enc, dec), pwriten
+  );
 }
 
 
-
 #endif /* ULDECODE_NO_IMPLE */
 
 #endif /* ULDECODE_H */
@@ -6,26 +6,20 @@
 int main() {
     ulfd_t fd;
     int err;
-    void* map;
-    ulfd_int64_t length;
+    ulfd_mapfile_t mf;
 
     err = ulfd_open(&fd, "example_ulfd_map.c", ULFD_O_RDONLY, 0664);
     if(err) {
         fprintf(stderr, "fail to open: %s\n", strerror(err)); exit(1);
     }
 
-    err = ulfd_filelength(fd, &length);
-    if(err) {
-        fprintf(stderr, "fail to get length: %s\n", strerror(err)); exit(1);
-    }
-
-    err = ulfd_mmap(&map, fd, NULL, (size_t)length, 0, ULFD_PROT_READ);
+    err = ulfd_mapfile_open(&mf, fd, 0, 0, ULFD_PROT_READ | ULFD_MAP_SHARED, ULFD_MAPFILE_SEQUENTIAL);
     if(err) {
         fprintf(stderr, "fail to map: %s\n", strerror(err)); exit(1);
     }
 
-    fwrite(map, 1, (size_t)length, stdout);
-    err = ulfd_munmap(map, (size_t)length);
+    fwrite(mf.data, 1, mf.len, stdout);
+    err = ulfd_mapfile_close(&mf);
     if(err) {
         fprintf(stderr, "fail to umap: %s\n", strerror(err)); exit(1);
     }
@@ -32,10 +32,22 @@ File descriptor (Unix style)
   | ULFD_NO_PREAD           | ulfd_pread                                                   |
   | ULFD_NO_PWRITE          | ulfd_pwrite                                                  |
   | ULFD_NO_COPY_FILE_RANGE | ulfd_copy_file_range                                         |
+  | ULFD_NO_SENDFILE        | ulfd_sendfile                                                |
+  | ULFD_NO_SPLICE          | ulfd_splice                                                  |
+  | ULFD_NO_IO_URING        | ulfd_ring_* (requests are emulated)                          |
+  | ULFD_NO_EPOLL           | ulfd_poller_* (POSIX: poll without `ULFD_POLL_ET`)           |
+  | ULFD_NO_WATCH           | ulfd_watch_*                                                 |
   | ULFD_NO_FSYNC           | ulfd_fsync                                                   |
   | ULFD_NO_FFULLSYNC       | ulfd_ffullsync                                               |
   | ULFD_NO_FDATASYNC       | ulfd_fdatasync                                               |
+  | ULFD_NO_SYNC_FILE_RANGE | ulfd_sync_file_range (falls back to `ulfd_fdatasync`)        |
+  | ULFD_NO_FADVISE         | ulfd_fadvise                                                 |
+  | ULFD_NO_READAHEAD       | ulfd_readahead                                               |
+  | ULFD_NO_RESIDENCY       | ulfd_residency                                               |
+  | ULFD_NO_OFD_LOCK        | ulfd_ofd_lock, ulfd_ofd_lockw                                |
   | ULFD_NO_FTRUNCATE       | ulfd_ftruncate                                               |
+  | ULFD_NO_FALLOCATE       | ulfd_fallocate                                               |
+  | ULFD_NO_PUNCH_HOLE      | ulfd_punch_hole                                              |
   | ULFD_NO_FDOPEN          | ulfd_fdopen, ulfd_fdopen_w, ulfd_fdopen_u                    |
   | ULFD_NO_FILENO          | ulfd_fileno                                                  |
   | ULFD_NO_TRUNCATE        | ulfd_truncate, ulfd_truncate_w, ulfd_truncate_u              |
@@ -340,6 +352,9 @@ typedef ulfd_int64_t ulfd_time_t;
 /* POSIX: prevent the OS from assigning the opened file
   as the process's controlling terminal when opening a TTY device file */
 #define ULFD_O_NOCTTY    (1l << 17)
+/* bypass the page cache, offsets, sizes and buffers must be aligned to `ulfd_logical_block_size`
+  (Linux/FreeBSD: `O_DIRECT`, macOS: `F_NOCACHE`, Windows: `FILE_FLAG_NO_BUFFERING`, EINVAL elsewhere) */
+#define ULFD_O_DIRECT    (1l << 18)
 
 #define ULFD_O_DENYRD    (1l << 24) /* Windows: deny share read access */
 #define ULFD_O_DENYWR    (1l << 25) /* Windows: deny share write access */
@@ -358,6 +373,41 @@ ul_hapi int ulfd_write(ulfd_t fd, const void* buf, size_t count, size_t* pwriten
 ul_hapi int ulfd_pread(ulfd_t fd, void* buf, size_t count, ulfd_int64_t off, size_t* pread_bytes);
 ul_hapi int ulfd_pwrite(ulfd_t fd, const void* buf, size_t count, ulfd_int64_t off, size_t* pwriten_bytes);
 
+/* the alignment `ULFD_O_DIRECT` needs for offsets, sizes and buffers */
+ul_hapi int ulfd_logical_block_size(ulfd_t fd, size_t* psize);
+/* `alignment` must be a power of two; the memory comes from `ul_malloc` */
+ul_hapi int ulfd_aligned_alloc(void** pptr, size_t alignment, size_t size);
+ul_hapi void ulfd_aligned_free(void* ptr);
+/* `buf` and `off` must be aligned to `align` (0 means `ulfd_logical_block_size`), otherwise EINVAL;
+  `count` may have an unaligned tail, which goes through a bounce block
+  (the write reads, patches and writes back the last block, then restores the file length) */
+ul_hapi int ulfd_pread_direct(ulfd_t fd, void* buf, size_t count, ulfd_int64_t off, size_t align, size_t* pread_bytes);
+ul_hapi int ulfd_pwrite_direct(ulfd_t fd, const void* buf, size_t count, ulfd_int64_t off, size_t align, size_t* pwriten_bytes);
+
+/* scatter/gather buffer (POSIX: layout-compatible with `struct iovec`) */
+typedef struct ulfd_iovec_t {
+  void* base;
+  size_t len;
+} ulfd_iovec_t;
+/* `iovcnt` should not exceed IOV_MAX (1024 on Linux);
+  Windows or missing system calls: emulated by multiple calls, stop at the first short transfer */
+ul_hapi int ulfd_readv(ulfd_t fd, const ulfd_iovec_t* iov, int iovcnt, size_t* pread_bytes);
+ul_hapi int ulfd_writev(ulfd_t fd, const ulfd_iovec_t* iov, int iovcnt, size_t* pwriten_bytes);
+ul_hapi int ulfd_preadv(ulfd_t fd, const ulfd_iovec_t* iov, int iovcnt, ulfd_int64_t off, size_t* pread_bytes);
+ul_hapi int ulfd_pwritev(ulfd_t fd, const ulfd_iovec_t* iov, int iovcnt, ulfd_int64_t off, size_t* pwriten_bytes);
+
+#define ULFD_RWF_HIPRI  (1 << 0) /* Linux: high priority request, poll if possible (ignored if unsupported) */
+#define ULFD_RWF_DSYNC  (1 << 1) /* write like `O_DSYNC` (emulated by `ulfd_fdatasync` if unsupported) */
+#define ULFD_RWF_SYNC   (1 << 2) /* write like `O_SYNC` (emulated by `ulfd_fsync` if unsupported) */
+#define ULFD_RWF_NOWAIT (1 << 3) /* Linux: fail with EAGAIN instead of blocking (EOPNOTSUPP if unsupported) */
+/* if `off` is -1, use current pos (and advance it) */
+ul_hapi int ulfd_preadv2(
+  ulfd_t fd, const ulfd_iovec_t* iov, int iovcnt, ulfd_int64_t off, int flags, size_t* pread_bytes
+);
+ul_hapi int ulfd_pwritev2(
+  ulfd_t fd, const ulfd_iovec_t* iov, int iovcnt, ulfd_int64_t off, int flags, size_t* pwriten_bytes
+);
+
 #define ULFD_SEEK_SET 0 /* seek to an absolute position */
 #define ULFD_SEEK_CUR 1 /* seek relative to current position */
 #define ULFD_SEEK_END 2 /* seek relative to end of the file */
@@ -370,10 +420,26 @@ ul_hapi int ulfd_copy_file_range(
   size_t len, size_t* pcopyed
 );
 
+/* Linux: copy data inside the kernel, `fd_out` is always written at current pos;
+  if `off_in` is NULL, use current pos, otherwise `*off_in` will be advanced */
+ul_hapi int ulfd_sendfile(ulfd_t fd_out, ulfd_t fd_in, ulfd_int64_t* off_in, size_t len, size_t* psent);
+
+#define ULFD_SPLICE_F_MOVE     (1 << 0) /* Linux: attempt to move pages instead of copying */
+#define ULFD_SPLICE_F_NONBLOCK (1 << 1) /* Linux: do not block on I/O of the pipe */
+#define ULFD_SPLICE_F_MORE     (1 << 2) /* Linux: more data will be coming in a subsequent splice */
+/* Linux: move data between a file and a pipe (one of `fd_in` and `fd_out` must be a pipe);
+  if `off_in` or `off_out` is NULL, use current pos (must be NULL for the pipe), otherwise it will be advanced */
+ul_hapi int ulfd_splice(
+  ulfd_t fd_in, ulfd_int64_t* off_in, ulfd_t fd_out, ulfd_int64_t* off_out,
+  size_t len, int flags, size_t* pspliced
+);
+
 ul_hapi int ulfd_pread_user(ulfd_t fd, void* buf, size_t count, ulfd_int64_t off, size_t* pread_bytes);
 ul_hapi int ulfd_pwrite_user(ulfd_t fd, const void* buf, size_t count, ulfd_int64_t off, size_t* pwriten_bytes);
 /* if `off_in` or `off_out` is NULL, use current pos;
-  if `buf` is NULL, the function will automatically allocate memory */
+  it tries `ulfd_sendfile` and `ulfd_splice` first, then copies data through a buffer;
+  if `buf` is NULL, the function will automatically allocate memory
+    (if `buf_len` is also 0, the size is picked from the block size of files and `len`) */
 ul_hapi int ulfd_copy_file_range_user(
   ulfd_t fd_in, ulfd_int64_t* off_in, ulfd_t fd_out, ulfd_int64_t* off_out,
   size_t len, size_t* pcopyed, void* buf, size_t buf_len
@@ -382,24 +448,173 @@ ul_hapi int ulfd_copy_file_range_user(
 ul_hapi int ulfd_pread_allowuser(ulfd_t fd, void* buf, size_t count, ulfd_int64_t off, size_t* pread_bytes);
 ul_hapi int ulfd_pwrite_allowuser(ulfd_t fd, const void* buf, size_t count, ulfd_int64_t off, size_t* pwriten_bytes);
 /* if `off_in` or `off_out` is NULL, use current pos;
-  if `buf` is NULL, the function will automatically allocate memory */
+  if `ulfd_copy_file_range` is unavailable for these files, fall back to `ulfd_copy_file_range_user` */
 ul_hapi int ulfd_copy_file_range_allowuser(
   ulfd_t fd_in, ulfd_int64_t* off_in, ulfd_t fd_out, ulfd_int64_t* off_out,
   size_t len, size_t* pcopyed
 );
 
+/* share the extents of `fd_in` with `fd_out` instead of copying data
+  (Linux: `FICLONE` on Btrfs/XFS, Windows: `FSCTL_DUPLICATE_EXTENTS_TO_FILE` on ReFS);
+  returns EOPNOTSUPP, EXDEV or EINVAL if the file system can't */
+ul_hapi int ulfd_clone_file(ulfd_t fd_in, ulfd_t fd_out);
+/* offsets and `len` must be aligned to the file system block size,
+  except that the range may end at the end of `fd_in` (`len` 0 means up to the end of `fd_in`) */
+ul_hapi int ulfd_clone_range(ulfd_t fd_in, ulfd_int64_t off_in, ulfd_t fd_out, ulfd_int64_t off_out, ulfd_int64_t len);
+
+#define ULFD_COPY_NOREPLACE (1 << 0) /* fails with EEXIST if the destination exists */
+#define ULFD_COPY_NOATTR    (1 << 1) /* don't copy mode and times */
+/* copy contents (and mode and times) by the cheapest way:
+  `ulfd_clone_file`, `ulfd_copy_file_range`, `ulfd_sendfile`, then buffered I/O */
+ul_hapi int ulfd_copy_fd(ulfd_t fd_in, ulfd_t fd_out, int flags);
+
 ul_hapi int ulfd_ffullsync(ulfd_t fd);
 ul_hapi int ulfd_fsync(ulfd_t fd);
 ul_hapi int ulfd_fdatasync(ulfd_t fd);
 
+#define ULFD_SYNC_RANGE_WAIT_BEFORE (1 << 0) /* wait for writeback already in progress */
+#define ULFD_SYNC_RANGE_WRITE       (1 << 1) /* start writeback of dirty pages */
+#define ULFD_SYNC_RANGE_WAIT_AFTER  (1 << 2) /* wait for the writeback to complete */
+/* control writeback of `[off, off + len)` (`len` 0: to the end of the file), which lets writeback start
+  early and overlap further writes; it doesn't flush metadata or the drive cache, so it isn't durable.
+  Without `sync_file_range`, `ULFD_SYNC_RANGE_WAIT_AFTER` calls `ulfd_fdatasync` and the rest is ignored */
+ul_hapi int ulfd_sync_file_range(ulfd_t fd, ulfd_int64_t off, ulfd_int64_t len, int flags);
+
+#define ULFD_FADV_NORMAL     0
+#define ULFD_FADV_RANDOM     1 /* expect random access, disables readahead */
+#define ULFD_FADV_SEQUENTIAL 2 /* expect sequential access, enlarges readahead */
+#define ULFD_FADV_WILLNEED   3 /* start reading the range into the page cache */
+#define ULFD_FADV_DONTNEED   4 /* drop the clean cached pages of the range */
+#define ULFD_FADV_NOREUSE    5 /* the range is accessed only once */
+/* page cache advice for `[off, off + len)` (`len` 0: to the end of the file) */
+ul_hapi int ulfd_fadvise(ulfd_t fd, ulfd_int64_t off, ulfd_int64_t len, int advice);
+/* read `[off, off + len)` into the page cache (Linux: `readahead`, otherwise `ULFD_FADV_WILLNEED`) */
+ul_hapi int ulfd_readahead(ulfd_t fd, ulfd_int64_t off, ulfd_int64_t len);
+/* page cache residency of `[off, off + len)` by `mincore` over a temporary mapping of `fd` (readable):
+  `vec[i]` is 1 if the i-th page is cached, otherwise 0, `off` must be a multiple of `ulfd_pagesize()`.
+  Linux reports other processes' pages only for files the caller owns or may write */
+ul_hapi int ulfd_residency(ulfd_t fd, ulfd_int64_t off, size_t len, unsigned char* vec);
+
+
+/* Batched I/O:
+  queue many requests, submit them with one system call, then reap completions.
+  In Linux, it's backed by io_uring; otherwise (or if io_uring isn't usable) requests are executed
+  one by one in `ulfd_ring_submit`, so the same code works everywhere. */
+typedef struct ulfd_ring_cqe_t {
+  void* userdata; /* value passed when the request was queued */
+  size_t result; /* bytes transferred */
+  int error; /* 0 or error code */
+} ulfd_ring_cqe_t;
+
+typedef struct _ulfd_ring_req_t {
+  void* userdata;
+  void* buf;
+  size_t count;
+  ulfd_int64_t off;
+  ulfd_t fd;
+  int op;
+  int flags;
+  int error;
+  unsigned next;
+  size_t result;
+} _ulfd_ring_req_t;
+
+typedef struct ulfd_ring_t {
+  int uring_fd; /* Linux: the io_uring descriptor, -1 if requests are emulated */
+  unsigned sq_entries, cq_entries;
+  unsigned queued, inflight;
+
+  _ulfd_ring_req_t* reqs; /* `cq_entries` slots */
+  unsigned free_head;
+  unsigned* fifo; /* emulated: queued requests, then completed requests */
+  unsigned fifo_head, fifo_done;
+
+  void* sq_map; size_t sq_map_len;
+  void* cq_map; size_t cq_map_len;
+  void* sqes; size_t sqes_len;
+  unsigned* sq_head, *sq_tail, *sq_mask, *sq_array;
+  unsigned* cq_head, *cq_tail, *cq_mask;
+  void* cqes;
+  unsigned sq_tail_local;
+} ulfd_ring_t;
+
+#define ULFD_RING_EMULATE (1 << 0) /* never use io_uring */
+/* `entries` is the number of requests that can be queued before submission */
+ul_hapi int ulfd_ring_init(ulfd_ring_t* ring, unsigned entries, int flags);
+ul_hapi int ulfd_ring_deinit(ulfd_ring_t* ring);
+/* queue requests, returns EAGAIN if the queue is full (submit or reap completions first) */
+ul_hapi int ulfd_ring_pread(ulfd_ring_t* ring, ulfd_t fd, void* buf, size_t count, ulfd_int64_t off, void* userdata);
+ul_hapi int ulfd_ring_pwrite(ulfd_ring_t* ring, ulfd_t fd, const void* buf, size_t count, ulfd_int64_t off, void* userdata);
+ul_hapi int ulfd_ring_fsync(ulfd_ring_t* ring, ulfd_t fd, void* userdata);
+ul_hapi int ulfd_ring_fdatasync(ulfd_ring_t* ring, ulfd_t fd, void* userdata);
+/* `len` beyond what a request can hold syncs to the end of the file */
+ul_hapi int ulfd_ring_sync_file_range(ulfd_ring_t* ring, ulfd_t fd, ulfd_int64_t off, ulfd_int64_t len, int flags, void* userdata);
+/* submit all queued requests (`psubmitted` can be NULL) */
+ul_hapi int ulfd_ring_submit(ulfd_ring_t* ring, unsigned* psubmitted);
+/* reap up to `max` completions, wait until `min_complete` completions are reaped or nothing is in flight */
+ul_hapi int ulfd_ring_wait(ulfd_ring_t* ring, ulfd_ring_cqe_t* cqes, unsigned max, unsigned min_complete, unsigned* pcount);
+/* submit all queued requests and wait for completions with one system call if possible */
+ul_hapi int ulfd_ring_submit_wait(
+  ulfd_ring_t* ring, ulfd_ring_cqe_t* cqes, unsigned max, unsigned min_complete, unsigned* pcount
+);
+
+#define ULFD_FSYNC_GROUP_DATA (1 << 0) /* `ulfd_fdatasync` instead of `ulfd_fsync` */
+/* flush all `fds` concurrently (io_uring workers, otherwise one by one) and wait for all of them;
+  returns the first error, `errors` (optional) receives the result of each descriptor.
+  `ring` (optional, with nothing queued or in flight) saves setting up a ring for each group */
+ul_hapi int ulfd_fsync_group(ulfd_ring_t* ring, const ulfd_t* fds, unsigned count, int flags, int* errors);
+
+
 #define ULFD_F_RDLCK 0 /* specify a read (or shared) lock */
 #define ULFD_F_WRLCK 1 /* specify a write (or exclusive) lock */
 #define ULFD_F_UNLCK 2 /* specify that the region is unlocked */
 ul_hapi int ulfd_lock(ulfd_t fd, ulfd_int64_t off, ulfd_int64_t len, int mode);
 ul_hapi int ulfd_lockw(ulfd_t fd, ulfd_int64_t off, ulfd_int64_t len, int mode); /* wait for that lock to be released */
+/* open file description locks: owned by the open file instead of the process, so closing another descriptor
+  of the file keeps them, and they conflict with locks taken through other `ulfd_open` of the same file
+  (Linux: `F_OFD_SETLK`, Windows: `LockFileEx` already works this way, ENOSYS elsewhere) */
+ul_hapi int ulfd_ofd_lock(ulfd_t fd, ulfd_int64_t off, ulfd_int64_t len, int mode);
+ul_hapi int ulfd_ofd_lockw(ulfd_t fd, ulfd_int64_t off, ulfd_int64_t len, int mode);
 
 ul_hapi int ulfd_ftruncate(ulfd_t fd, ulfd_int64_t length);
 ul_hapi int ulfd_ffilelength(ulfd_t fd, ulfd_int64_t* plength);
+
+#define ULFD_FALLOC_KEEP_SIZE (1 << 0) /* do not change the file length */
+/* reserve blocks for [off, off + len) so later writes won't fail with ENOSPC */
+ul_hapi int ulfd_fallocate(ulfd_t fd, int flags, ulfd_int64_t off, ulfd_int64_t len);
+/* deallocate [off, off + len), which reads as zeros afterwards; the file length is kept
+  (EOPNOTSUPP/ENOSYS if the file system has no sparse files) */
+ul_hapi int ulfd_punch_hole(ulfd_t fd, ulfd_int64_t off, ulfd_int64_t len);
+/* make [off, off + len) read as zeros, without writing them if the file system can */
+ul_hapi int ulfd_zero_range(ulfd_t fd, ulfd_int64_t off, ulfd_int64_t len, int flags);
+
+/* iterates the data extents of a sparse file
+  (POSIX: `SEEK_DATA`/`SEEK_HOLE`, Windows: `FSCTL_QUERY_ALLOCATED_RANGES`);
+  without hole support the whole range is reported as one extent */
+typedef struct ulfd_extent_iter_t {
+  ulfd_t fd;
+  ulfd_int64_t off;
+  ulfd_int64_t end;
+#ifdef _WIN32
+  ulfd_int64_t ranges[32]; /* pairs of offset and length */
+  unsigned count;
+  unsigned index;
+#else
+  ulfd_int64_t pos; /* file offset, restored by `ulfd_extent_end` */
+#endif
+} ulfd_extent_iter_t;
+/* `len` 0 means up to the end of file */
+ul_hapi int ulfd_extent_begin(ulfd_extent_iter_t* it, ulfd_t fd, ulfd_int64_t off, ulfd_int64_t len);
+/* `*plen` is 0 when there is no more data */
+ul_hapi int ulfd_extent_next(ulfd_extent_iter_t* it, ulfd_int64_t* poff, ulfd_int64_t* plen);
+ul_hapi int ulfd_extent_end(ulfd_extent_iter_t* it);
+/* copy [off_in, off_in + len) (`len` 0 means up to the end of file) to `off_out`, keeping holes:
+  only data extents are copied, holes are punched (or zeroed) in the output */
+ul_hapi int ulfd_copy_sparse(
+  ulfd_t fd_in, ulfd_int64_t off_in, ulfd_t fd_out, ulfd_int64_t off_out,
+  ulfd_int64_t len, ulfd_int64_t* pcopyed
+);
+
 ul_hapi int ulfd_fchmod(ulfd_t fd, ulfd_mode_t mode);
 ul_hapi int ulfd_fchown(ulfd_t fd, ulfd_uid_t uid, ulfd_gid_t gid);
 ul_hapi int ulfd_futime(ulfd_t fd, ulfd_int64_t atime, ulfd_int64_t mtime);
@@ -452,6 +667,164 @@ ul_hapi int ulfd_munlock(const void* addr, size_t len);
 ul_hapi int ulfd_madvise(void* addr, size_t len, int advice);
 
 ul_hapi size_t ulfd_pagesize(void);
+/* alignment required by the offset of `ulfd_mmap` (Windows: allocation granularity, otherwise page size) */
+ul_hapi size_t ulfd_mapgranularity(void);
+/* resize a mapping created by `ulfd_mmap`, the mapping may be moved (Linux only, ENOSYS otherwise) */
+ul_hapi int ulfd_mremap(void** pmap, size_t old_len, size_t new_len);
+
+/* a window [off, off + len) of a file, mapped with aligned offset */
+typedef struct ulfd_mapfile_t {
+  char* data; /* start of the window (NULL if `len` is 0) */
+  size_t len;
+  ulfd_int64_t off;
+
+  ulfd_t fd; /* borrowed, not closed by `ulfd_mapfile_close` */
+  int flags; /* `prot_and_flags` passed to `ulfd_mmap` */
+  int policy;
+  void* map;
+  size_t map_len;
+  ulfd_int64_t map_off;
+  size_t granularity;
+} ulfd_mapfile_t;
+
+#define ULFD_MAPFILE_NORMAL     0 /* no advice */
+#define ULFD_MAPFILE_SEQUENTIAL 1 /* `ULFD_MADV_SEQUENTIAL` and `ULFD_MADV_WILLNEED`, for scans */
+#define ULFD_MAPFILE_RANDOM     2 /* `ULFD_MADV_RANDOM`, for point lookups */
+#define ULFD_MAPFILE_WILLNEED   3 /* `ULFD_MADV_WILLNEED`, prefetch the whole window */
+/* if `len` is 0, map to the end of the file; the policy is reapplied after every remapping (advice errors are ignored) */
+ul_hapi int ulfd_mapfile_open(
+  ulfd_mapfile_t* mf, ulfd_t fd, ulfd_int64_t off, size_t len, int prot_and_flags, int policy
+);
+ul_hapi int ulfd_mapfile_close(ulfd_mapfile_t* mf);
+/* move the window; no system call if it stays inside the current mapping (`len` 0: to the end of the file) */
+ul_hapi int ulfd_mapfile_remap(ulfd_mapfile_t* mf, ulfd_int64_t off, size_t len);
+/* change the window length, writable shared mappings extend the file first */
+ul_hapi int ulfd_mapfile_resize(ulfd_mapfile_t* mf, size_t len);
+ul_hapi int ulfd_mapfile_set_policy(ulfd_mapfile_t* mf, int policy);
+/* `off` is relative to the window, `len` 0 means to the end of the window */
+ul_hapi int ulfd_mapfile_sync(ulfd_mapfile_t* mf, size_t off, size_t len, int flags);
+
+/* records of a file split on a delimiter, returned in place from a sliding `ulfd_mapfile_t` window
+  (`ULFD_MAPFILE_SEQUENTIAL`); delimiters are located 64 bytes at a time (SSE2, AVX2 or NEON) */
+typedef struct ulfd_mapscan_t {
+  ulfd_mapfile_t mf;
+  ulfd_int64_t size; /* length of the file when opened */
+  ulfd_int64_t pos; /* offset of the next record */
+  ulfd_int64_t scanned; /* delimiters before this offset are in `mask` or already returned */
+  ulfd_int64_t mask_off; /* offset of bit 0 of `mask` */
+  ulfd_uint64_t mask; /* delimiters found but not returned yet */
+  size_t window;
+  int delim;
+} ulfd_mapscan_t;
+#ifndef ULFD_MAPSCAN_WINDOW
+  #define ULFD_MAPSCAN_WINDOW 67108864
+#endif
+/* scan `fd` (not owned) from its beginning, `window` 0 means `ULFD_MAPSCAN_WINDOW` */
+ul_hapi int ulfd_mapscan_open(ulfd_mapscan_t* scan, ulfd_t fd, size_t window, int delim);
+ul_hapi int ulfd_mapscan_close(ulfd_mapscan_t* scan);
+/* the next record ending with `delim` (included), valid until the next call;
+  a record crossing the end of the window moves the window to its start, so records are never copied;
+  the last record may lack `delim`, `*plen` is 0 at the end of file */
+ul_hapi int ulfd_mapscan_next(ulfd_mapscan_t* scan, const char** pdata, size_t* plen);
+
+/* buffered reader/writer over `ulfd_read`/`ulfd_write`, without locking or text translation */
+typedef struct ulfd_stream_t {
+  ulfd_t fd;
+  int flags;
+  int state; /* 0: empty, 1: buffered input, 2: buffered output */
+  char* buf;
+  size_t cap;
+  size_t pos; /* next byte to read */
+  size_t end; /* end of the buffered bytes */
+  size_t readahead; /* size of the next read, doubled while reads stay sequential */
+} ulfd_stream_t;
+#define ULFD_STREAM_OWNFD (1 << 0) /* `ulfd_stream_close` closes `fd` */
+#ifndef ULFD_STREAM_BUFSIZE
+  #define ULFD_STREAM_BUFSIZE 65536
+#endif
+
+/* `bufsize` 0 means `ULFD_STREAM_BUFSIZE` */
+ul_hapi int ulfd_stream_open(ulfd_stream_t* stream, ulfd_t fd, size_t bufsize, int flags);
+ul_hapi int ulfd_stream_close(ulfd_stream_t* stream);
+ul_hapi int ulfd_stream_flush(ulfd_stream_t* stream);
+/* short only at the end of file; requests as large as the buffer bypass it */
+ul_hapi int ulfd_stream_read(ulfd_stream_t* stream, void* buf, size_t count, size_t* pread_bytes);
+ul_hapi int ulfd_stream_write(ulfd_stream_t* stream, const void* buf, size_t count, size_t* pwriten_bytes);
+/* buffer at least `want` bytes (fewer at the end of file) and expose all buffered bytes without copying;
+  `*pdata` is valid until the next call other than `ulfd_stream_consume` */
+ul_hapi int ulfd_stream_peek(ulfd_stream_t* stream, size_t want, const void** pdata, size_t* pavail);
+ul_hapi void ulfd_stream_consume(ulfd_stream_t* stream, size_t count);
+/* consume the next record ending with `delim` (included), the buffer grows to hold it;
+  the last record may lack `delim`, `*plen` is 0 at the end of file */
+ul_hapi int ulfd_stream_scan(ulfd_stream_t* stream, int delim, const char** pdata, size_t* plen);
+/* buffered output is flushed and buffered input is dropped */
+ul_hapi int ulfd_stream_seek(ulfd_stream_t* stream, ulfd_int64_t off, int origin, ulfd_int64_t* poff);
+ul_hapi int ulfd_stream_tell(ulfd_stream_t* stream, ulfd_int64_t* poff);
+
+/* durable replacement of a file: the data goes to a temporary file next to `path`,
+  which is synced and renamed over `path`, then the directory is synced;
+  readers see the old or the new content, never a mix
+  (Linux: the temporary file is anonymous `O_TMPFILE` until the commit) */
+typedef struct ulfd_atomic_writer_t {
+  ulfd_stream_t stream; /* buffered output to the temporary file */
+#ifdef _WIN32
+  wchar_t* path;
+  wchar_t* tmppath; /* shares the allocation of `path` */
+#else
+  char* path;
+  char* tmppath; /* shares the allocation of `path` */
+#endif
+  int tmpfile; /* the temporary file has no name yet */
+  int flags;
+} ulfd_atomic_writer_t;
+#define ULFD_ATOMIC_NOSYNC    (1 << 0) /* keep the atomicity but skip all syncs */
+#define ULFD_ATOMIC_FULLSYNC  (1 << 1) /* sync the data with `ulfd_ffullsync` (macOS: through the drive cache) */
+#define ULFD_ATOMIC_NOREPLACE (1 << 2) /* fail with EEXIST if `path` exists */
+
+/* `mode` is used to create the file, like `ulfd_open` */
+ul_hapi int ulfd_atomic_writer_open(ulfd_atomic_writer_t* writer, const char* path, ulfd_mode_t mode, int flags);
+ul_hapi int ulfd_atomic_writer_open_w(ulfd_atomic_writer_t* writer, const wchar_t* wpath, ulfd_mode_t mode, int flags);
+/* write all of `buf` */
+ul_hapi int ulfd_atomic_writer_write(ulfd_atomic_writer_t* writer, const void* buf, size_t count);
+/* publish the content; the writer is released even on failure, which keeps the old file */
+ul_hapi int ulfd_atomic_writer_commit(ulfd_atomic_writer_t* writer);
+/* drop the content and release the writer */
+ul_hapi void ulfd_atomic_writer_abort(ulfd_atomic_writer_t* writer);
+ul_hapi int ulfd_atomic_write_file(const char* path, const void* buf, size_t len, ulfd_mode_t mode, int flags);
+ul_hapi int ulfd_atomic_write_file_w(const wchar_t* wpath, const void* buf, size_t len, ulfd_mode_t mode, int flags);
+
+/* readiness multiplexer (Linux: epoll, other POSIX: poll, Windows: ENOSYS) */
+typedef struct ulfd_poller_t {
+  ulfd_t fd; /* Linux: the epoll descriptor */
+  ulfd_t wake_rd; /* eventfd, or the read end of a pipe */
+  ulfd_t wake_wr;
+  void* fds; /* poll: `struct pollfd` array, the wakeup descriptor first */
+  void* slots; /* poll: user data and events of each descriptor */
+  size_t count, cap;
+} ulfd_poller_t;
+#define ULFD_POLL_IN      (1 << 0) /* ready to read */
+#define ULFD_POLL_OUT     (1 << 1) /* ready to write */
+#define ULFD_POLL_ERR     (1 << 2) /* reported only: error condition */
+#define ULFD_POLL_HUP     (1 << 3) /* reported only: the peer is closed */
+#define ULFD_POLL_ET      (1 << 4) /* edge-triggered (epoll only, otherwise ENOSYS) */
+#define ULFD_POLL_ONESHOT (1 << 5) /* disable after one event until `ulfd_poller_mod` */
+typedef struct ulfd_poller_event_t {
+  void* udata;
+  int events;
+} ulfd_poller_event_t;
+
+ul_hapi int ulfd_poller_open(ulfd_poller_t* poller);
+ul_hapi int ulfd_poller_close(ulfd_poller_t* poller);
+/* with poll, registration must not race with `ulfd_poller_wait` */
+ul_hapi int ulfd_poller_add(ulfd_poller_t* poller, ulfd_t fd, int events, void* udata);
+ul_hapi int ulfd_poller_mod(ulfd_poller_t* poller, ulfd_t fd, int events, void* udata);
+ul_hapi int ulfd_poller_del(ulfd_poller_t* poller, ulfd_t fd);
+/* wait up to `timeout` milliseconds (-1: forever) and report at most `max` events;
+  `*pcount` is 0 on timeout or after `ulfd_poller_wake` */
+ul_hapi int ulfd_poller_wait(ulfd_poller_t* poller, ulfd_poller_event_t* events, unsigned max, int timeout, unsigned* pcount);
+/* make a pending or the next `ulfd_poller_wait` return, callable from any thread */
+ul_hapi int ulfd_poller_wake(ulfd_poller_t* poller);
+
 ul_hapi int ulfd_tmpdir_alloc(char** ppath);
 ul_hapi int ulfd_tmpdir_alloc_w(wchar_t** pwpath);
 
@@ -519,6 +892,9 @@ ul_hapi int ulfd_mkdir(const char* path, ulfd_mode_t mode);
 ul_hapi int ulfd_mkdir_w(const wchar_t* wpath, ulfd_mode_t mode);
 ul_hapi int ulfd_rename(const char* newpath, const char* oldpath);
 ul_hapi int ulfd_rename_w(const wchar_t* newpath, const wchar_t* oldpath);
+/* see `ulfd_copy_fd` (Windows: `CopyFileW`, which clones by itself where it can) */
+ul_hapi int ulfd_copy_file(const char* newpath, const char* oldpath, int flags);
+ul_hapi int ulfd_copy_file_w(const wchar_t* newpath, const wchar_t* oldpath, int flags);
 ul_hapi int ulfd_unlink(const char* path);
 ul_hapi int ulfd_unlink_w(const wchar_t* wpath);
 ul_hapi int ulfd_remove(const char* path);
@@ -543,6 +919,7 @@ ul_hapi int ulfd_truncate_w(const wchar_t* wpath, ulfd_int64_t size);
 #ifdef _WIN32
   typedef struct ulfd_dir_t {
     HANDLE handle;
+    HANDLE dirhandle; /* opened by `ulfd_dirfd` */
     WIN32_FIND_DATAW data;
     wchar_t* dirpath;
     char* entry;
@@ -558,6 +935,9 @@ ul_hapi int ulfd_truncate_w(const wchar_t* wpath, ulfd_int64_t size);
     wchar_t* wentry;
     size_t wentry_cap;
     int cached;
+    int batch; /* Linux: the stream is read by `getdents64` */
+    ulfd_uint64_t cached_ino;
+    ulfd_mode_t cached_type;
   } ulfd_dir_t;
 #endif
 ul_hapi int ulfd_opendir(ulfd_dir_t* dir, const char* path);
@@ -567,6 +947,193 @@ ul_hapi int ulfd_closedir(ulfd_dir_t* dir);
 ul_hapi int ulfd_readdir(ulfd_dir_t* dir, const char** pname);
 ul_hapi int ulfd_readdir_w(ulfd_dir_t* dir, const wchar_t** pwname);
 
+typedef struct ulfd_dirent_t {
+  ulfd_uint64_t ino; /* inode number (Windows: 0) */
+  ulfd_mode_t type; /* `ULFD_S_IF*` of the entry itself (symbolic links are not followed), 0 if unknown */
+  unsigned short reclen; /* size of this record */
+  unsigned short namelen; /* length of `name`, excluding the null terminator */
+  char name[1];
+} ulfd_dirent_t;
+#define ulfd_dirent_next(ent) \
+  ul_reinterpret_cast(ulfd_dirent_t*, ul_reinterpret_cast(char*, (ent)) + (ent)->reclen)
+/* fill `buf` (8-byte aligned) with as many records as fit, skipping "." and "..";
+  `*pused` is the number of bytes used, 0 at the end of the directory (EINVAL if one record doesn't fit);
+  Linux: reads by `getdents64` directly into `buf`, and the first call restarts from the beginning,
+    so don't mix it with `ulfd_readdir` unless `ulfd_rewinddir` is called */
+ul_hapi int ulfd_readdir_batch(ulfd_dir_t* dir, void* buf, size_t len, size_t* pused);
+
+/* the descriptor of the directory stream, owned by `dir` (Windows: opened on first use) */
+ul_hapi int ulfd_dirfd(ulfd_dir_t* dir, ulfd_t* pfd);
+
+/* directory change notifications (Linux: inotify, Windows: `ReadDirectoryChangesW`, ENOSYS elsewhere) */
+typedef struct ulfd_watch_t {
+  ulfd_t fd; /* Linux: the inotify descriptor, which can be added to `ulfd_poller_t` */
+  char* buf; /* events of one read */
+  size_t pos, end, cap;
+#ifdef _WIN32
+  void* dirs; /* watched directories, indexed by `wd - 1` */
+  size_t dir_count;
+  int current; /* `wd` of the events in `buf` */
+  char* names; /* UTF-8 names of the events returned by the last `ulfd_watch_read` */
+  size_t names_cap;
+#endif
+} ulfd_watch_t;
+#define ULFD_WATCH_CREATE     (1 << 0)
+#define ULFD_WATCH_MODIFY     (1 << 1)
+#define ULFD_WATCH_DELETE     (1 << 2) /* an entry or the watched directory itself is deleted */
+#define ULFD_WATCH_MOVED_FROM (1 << 3)
+#define ULFD_WATCH_MOVED_TO   (1 << 4)
+#define ULFD_WATCH_ATTRIB     (1 << 5) /* metadata changes */
+#define ULFD_WATCH_ALL        ((1 << 6) - 1)
+#define ULFD_WATCH_OVERFLOW   (1 << 8) /* reported only: events were dropped, rescan */
+#define ULFD_WATCH_IGNORED    (1 << 9) /* reported only: the watch is removed */
+#define ULFD_WATCH_ISDIR      (1 << 10) /* reported only: the entry is a directory (Linux) */
+typedef struct ulfd_watch_event_t {
+  int wd; /* -1 with `ULFD_WATCH_OVERFLOW` in Linux */
+  int mask;
+  unsigned cookie; /* pairs `ULFD_WATCH_MOVED_FROM` with `ULFD_WATCH_MOVED_TO` (Linux) */
+  size_t namelen;
+  const char* name; /* entry name in the watched directory, "" for the directory itself;
+                      valid until the next `ulfd_watch_read` */
+} ulfd_watch_event_t;
+
+ul_hapi int ulfd_watch_open(ulfd_watch_t* watch);
+ul_hapi int ulfd_watch_close(ulfd_watch_t* watch);
+/* watch the entries of the directory `path`, `*pwd` identifies the events;
+  Linux: adding the same directory again returns the same `wd` and replaces its mask */
+ul_hapi int ulfd_watch_add(ulfd_watch_t* watch, const char* path, int mask, int* pwd);
+ul_hapi int ulfd_watch_add_w(ulfd_watch_t* watch, const wchar_t* wpath, int mask, int* pwd);
+ul_hapi int ulfd_watch_add_dir(ulfd_watch_t* watch, ulfd_dir_t* dir, int mask, int* pwd);
+ul_hapi int ulfd_watch_rm(ulfd_watch_t* watch, int wd);
+/* wait up to `timeout` milliseconds (-1: forever) for events, which are read in batches;
+  `*pcount` is 0 on timeout */
+ul_hapi int ulfd_watch_read(ulfd_watch_t* watch, ulfd_watch_event_t* events, unsigned max, int timeout, unsigned* pcount);
+
+/* dirfd-relative operations:
+  `path` is resolved relative to `dirfd` unless it's absolute or `dirfd` is `ULFD_AT_FDCWD`;
+  Windows: emulated by joining `path` with the final path of `dirfd` */
+#ifdef _WIN32
+  #define ULFD_AT_FDCWD ul_reinterpret_cast(ulfd_t, ul_static_cast(LONG_PTR, -100))
+#else
+  #define ULFD_AT_FDCWD (-100)
+#endif
+#define ULFD_AT_SYMLINK_NOFOLLOW (1 << 0) /* don't follow a trailing symbolic link */
+#define ULFD_AT_EMPTY_PATH       (1 << 1) /* an empty `path` refers to `dirfd` itself */
+#define ULFD_AT_REMOVEDIR        (1 << 2) /* `ulfd_unlinkat`: remove a directory */
+#define ULFD_AT_STATX_DONT_SYNC  (1 << 3) /* `ulfd_statx`: cached attributes are fine (network filesystems) */
+#define ULFD_AT_STATX_FORCE_SYNC (1 << 4) /* `ulfd_statx`: synchronize attributes with the server */
+
+#define ULFD_RENAME_NOREPLACE (1 << 0) /* fail with EEXIST if `newpath` exists */
+#define ULFD_RENAME_EXCHANGE  (1 << 1) /* atomically swap `newpath` and `oldpath` */
+
+ul_hapi int ulfd_openat(ulfd_t* pfd, ulfd_t dirfd, const char* path, ulfd_int32_t oflag, ulfd_mode_t mode);
+ul_hapi int ulfd_openat_w(ulfd_t* pfd, ulfd_t dirfd, const wchar_t* wpath, ulfd_int32_t oflag, ulfd_mode_t mode);
+/* `flags` accepts ULFD_AT_SYMLINK_NOFOLLOW, ULFD_AT_EMPTY_PATH */
+ul_hapi int ulfd_fstatat(ulfd_t dirfd, const char* path, ulfd_stat_t* state, int flags);
+ul_hapi int ulfd_fstatat_w(ulfd_t dirfd, const wchar_t* wpath, ulfd_stat_t* state, int flags);
+
+/* fields of `ulfd_stat_t` requested from or returned by `ulfd_statx` */
+#define ULFD_STATX_TYPE  (1u << 0) /* `ULFD_S_IFMT` bits of `mode` */
+#define ULFD_STATX_MODE  (1u << 1) /* the other bits of `mode` */
+#define ULFD_STATX_NLINK (1u << 2)
+#define ULFD_STATX_UID   (1u << 3)
+#define ULFD_STATX_GID   (1u << 4)
+#define ULFD_STATX_ATIME (1u << 5)
+#define ULFD_STATX_MTIME (1u << 6)
+#define ULFD_STATX_CTIME (1u << 7)
+#define ULFD_STATX_INO   (1u << 8)
+#define ULFD_STATX_SIZE  (1u << 9)
+#define ULFD_STATX_DEV   (1u << 10) /* `dev` and `rdev` */
+#define ULFD_STATX_ALL   ((1u << 11) - 1)
+/* fetch only the fields in `mask` when the system allows it, the others are zeroed;
+  `*pmask` (may be NULL) receives the fields actually filled, which may be more or fewer than requested;
+  `flags` accepts ULFD_AT_SYMLINK_NOFOLLOW, ULFD_AT_EMPTY_PATH, ULFD_AT_STATX_DONT_SYNC, ULFD_AT_STATX_FORCE_SYNC;
+  Linux: uses `statx`, otherwise falls back to `ulfd_fstatat`;
+  Windows: type, size and times are read without opening the file, or by `GetFileInformationByHandleEx` */
+ul_hapi int ulfd_statx(ulfd_t dirfd, const char* path, int flags, unsigned mask, ulfd_stat_t* state, unsigned* pmask);
+ul_hapi int ulfd_statx_w(ulfd_t dirfd, const wchar_t* wpath, int flags, unsigned mask, ulfd_stat_t* state, unsigned* pmask);
+ul_hapi int ulfd_mkdirat(ulfd_t dirfd, const char* path, ulfd_mode_t mode);
+ul_hapi int ulfd_mkdirat_w(ulfd_t dirfd, const wchar_t* wpath, ulfd_mode_t mode);
+/* `flags` accepts ULFD_AT_REMOVEDIR */
+ul_hapi int ulfd_unlinkat(ulfd_t dirfd, const char* path, int flags);
+ul_hapi int ulfd_unlinkat_w(ulfd_t dirfd, const wchar_t* wpath, int flags);
+/* `flags` accepts ULFD_RENAME_NOREPLACE or ULFD_RENAME_EXCHANGE (ENOSYS if the system doesn't support it) */
+ul_hapi int ulfd_renameat2(ulfd_t newdirfd, const char* newpath, ulfd_t olddirfd, const char* oldpath, int flags);
+ul_hapi int ulfd_renameat2_w(ulfd_t newdirfd, const wchar_t* newpath, ulfd_t olddirfd, const wchar_t* oldpath, int flags);
+ul_hapi int ulfd_opendirat(ulfd_dir_t* dir, ulfd_t dirfd, const char* path);
+ul_hapi int ulfd_opendirat_w(ulfd_dir_t* dir, ulfd_t dirfd, const wchar_t* wpath);
+
+typedef struct ulfd_walk_entry_t {
+  const char* path; /* the root joined with the relative path of the entry */
+  const char* name; /* the last component of `path` */
+  size_t pathlen;
+  ulfd_uint64_t ino; /* Windows: 0 */
+  ulfd_mode_t type; /* `ULFD_S_IF*` (of the target if symbolic links are followed), 0 if unknown */
+  int depth; /* entries directly inside the root are at depth 1 */
+  /* the directory holding the entry during the callback, `name` is relative to it;
+    `ULFD_AT_FDCWD` when only `path` can be used (Windows) */
+  ulfd_t dirfd;
+  const ulfd_stat_t* stat; /* NULL unless `ULFD_WALK_STAT` is set */
+} ulfd_walk_entry_t;
+
+#define ULFD_WALK_CONTINUE 0
+#define ULFD_WALK_PRUNE    1 /* don't descend into this directory */
+#define ULFD_WALK_STOP     2 /* stop the walk, ECANCELED is returned */
+
+#define ULFD_WALK_FOLLOW (1 << 0) /* follow symbolic links (POSIX: loops are skipped with ELOOP) */
+#define ULFD_WALK_STAT   (1 << 1) /* stat every entry */
+
+typedef struct ulfd_walk_options_t {
+  int flags;
+  int max_depth; /* don't report entries deeper than it, <= 0 means unlimited */
+  /* may be NULL; `ul::fd::Walker` calls it from many threads, each with its own `userdata` */
+  int (*callback)(void* userdata, const ulfd_walk_entry_t* entry);
+  /* a directory can't be read; return nonzero to stop the walk with `err` (if NULL, skip the directory) */
+  int (*on_error)(void* userdata, const char* path, int err);
+  void* userdata;
+} ulfd_walk_options_t;
+/* walk the tree under `root` (the root itself isn't reported);
+  POSIX: directories are opened and stated relative to the descriptor of their parent */
+ul_hapi int ulfd_walk(const char* root, const ulfd_walk_options_t* options);
+
+/* a directory waiting to be scanned, for custom schedulers */
+typedef struct ulfd_walk_task_t {
+  void* parent; /* POSIX: the parent directory shared by sibling tasks, NULL to open by `path` */
+  int depth;
+  size_t pathlen;
+  size_t namepos;
+  size_t nancestors;
+  ulfd_uint64_t* ancestors; /* (dev, ino) pairs of the ancestors, when following symbolic links */
+  char path[1];
+} ulfd_walk_task_t;
+ul_hapi int ulfd_walk_task_root(ulfd_walk_task_t** ptask, const char* root);
+ul_hapi void ulfd_walk_task_free(ulfd_walk_task_t* task);
+/* scan the directory of `task` and free it; every subdirectory to descend is passed to `push`,
+  which takes its ownership (return nonzero from `push` to stop the walk with that error) */
+ul_hapi int ulfd_walk_scan(
+  ulfd_walk_task_t* task, const ulfd_walk_options_t* options,
+  int (*push)(void* ctx, ulfd_walk_task_t* subtask), void* ctx
+);
+
+typedef struct ulfd_tree_options_t {
+  int flags; /* `ulfd_copy_tree`: ULFD_COPY_NOREPLACE, ULFD_COPY_NOATTR */
+  /* may be NULL; an entry is done (`bytes` is the size of a copied file), return nonzero to stop with ECANCELED */
+  int (*progress)(void* userdata, const char* path, ulfd_mode_t type, ulfd_uint64_t bytes);
+  /* may be NULL; an entry failed, return nonzero to stop with `err` (if NULL, go on with the other entries) */
+  int (*on_error)(void* userdata, const char* path, int err);
+  void* userdata;
+} ulfd_tree_options_t;
+/* remove `path` and everything under it (`options` may be NULL);
+  entries are removed relative to the descriptor of their directory, and a missing `path` isn't an error;
+  failures don't stop the removal, the first one is returned at the end */
+ul_hapi int ulfd_remove_all(const char* path, const ulfd_tree_options_t* options);
+ul_hapi int ulfd_remove_all_w(const wchar_t* wpath, const ulfd_tree_options_t* options);
+/* copy the tree under `oldpath` to `newpath`, merging into existing directories;
+  files go through `ulfd_copy_fd` (clone, then `ulfd_copy_file_range`), symbolic links are copied as links;
+  `path` of the callbacks is the source entry, errors are reported like `ulfd_remove_all` */
+ul_hapi int ulfd_copy_tree(const char* newpath, const char* oldpath, const ulfd_tree_options_t* options);
+ul_hapi int ulfd_copy_tree_w(const wchar_t* newpath, const wchar_t* oldpath, const ulfd_tree_options_t* options);
+
 typedef struct ulfd_spaceinfo_t {
   ulfd_uint64_t capacity; /* total size of the filesystem */
   ulfd_uint64_t free; /* free space on the filesystem */
@@ -678,6 +1245,9 @@ ul_hapi wchar_t* ulfd_wcsdup(const wchar_t* wstr) {
   ul_hapi int ulfd_rename_u(const ulfd_uchar_t* newpath, const ulfd_uchar_t* oldpath) {
     return ulfd_rename_w(newpath, oldpath);
   }
+  ul_hapi int ulfd_copy_file_u(const ulfd_uchar_t* newpath, const ulfd_uchar_t* oldpath, int flags) {
+    return ulfd_copy_file_w(newpath, oldpath, flags);
+  }
   ul_hapi int ulfd_unlink_u(const ulfd_uchar_t* path) {
     return ulfd_unlink_w(path);
   }
@@ -711,6 +1281,42 @@ ul_hapi wchar_t* ulfd_wcsdup(const wchar_t* wstr) {
   ul_hapi int ulfd_readdir_u(ulfd_dir_t* dir, const ulfd_uchar_t** pname) {
     return ulfd_readdir_w(dir, pname);
   }
+  ul_hapi int ulfd_openat_u(ulfd_t* pfd, ulfd_t dirfd, const ulfd_uchar_t* path, ulfd_int32_t oflag, ulfd_mode_t mode) {
+    return ulfd_openat_w(pfd, dirfd, path, oflag, mode);
+  }
+  ul_hapi int ulfd_fstatat_u(ulfd_t dirfd, const ulfd_uchar_t* path, ulfd_stat_t* state, int flags) {
+    return ulfd_fstatat_w(dirfd, path, state, flags);
+  }
+  ul_hapi int ulfd_statx_u(ulfd_t dirfd, const ulfd_uchar_t* path, int flags, unsigned mask, ulfd_stat_t* state, unsigned* pmask) {
+    return ulfd_statx_w(dirfd, path, flags, mask, state, pmask);
+  }
+  ul_hapi int ulfd_mkdirat_u(ulfd_t dirfd, const ulfd_uchar_t* path, ulfd_mode_t mode) {
+    return ulfd_mkdirat_w(dirfd, path, mode);
+  }
+  ul_hapi int ulfd_unlinkat_u(ulfd_t dirfd, const ulfd_uchar_t* path, int flags) {
+    return ulfd_unlinkat_w(dirfd, path, flags);
+  }
+  ul_hapi int ulfd_renameat2_u(ulfd_t newdirfd, const ulfd_uchar_t* newpath, ulfd_t olddirfd, const ulfd_uchar_t* oldpath, int flags) {
+    return ulfd_renameat2_w(newdirfd, newpath, olddirfd, oldpath, flags);
+  }
+  ul_hapi int ulfd_opendirat_u(ulfd_dir_t* dir, ulfd_t dirfd, const ulfd_uchar_t* path) {
+    return ulfd_opendirat_w(dir, dirfd, path);
+  }
+  ul_hapi int ulfd_watch_add_u(ulfd_watch_t* watch, const ulfd_uchar_t* path, int mask, int* pwd) {
+    return ulfd_watch_add_w(watch, path, mask, pwd);
+  }
+  ul_hapi int ulfd_atomic_writer_open_u(ulfd_atomic_writer_t* writer, const ulfd_uchar_t* path, ulfd_mode_t mode, int flags) {
+    return ulfd_atomic_writer_open_w(writer, path, mode, flags);
+  }
+  ul_hapi int ulfd_atomic_write_file_u(const ulfd_uchar_t* path, const void* buf, size_t len, ulfd_mode_t mode, int flags) {
+    return ulfd_atomic_write_file_w(path, buf, len, mode, flags);
+  }
+  ul_hapi int ulfd_remove_all_u(const ulfd_uchar_t* path, const ulfd_tree_options_t* options) {
+    return ulfd_remove_all_w(path, options);
+  }
+  ul_hapi int ulfd_copy_tree_u(const ulfd_uchar_t* newpath, const ulfd_uchar_t* oldpath, const ulfd_tree_options_t* options) {
+    return ulfd_copy_tree_w(newpath, oldpath, options);
+  }
   ul_hapi int ulfd_space_u(ulfd_spaceinfo_t* info, const ulfd_uchar_t* path) {
     return ulfd_space_w(info, path);
   }
@@ -785,6 +1391,9 @@ ul_hapi wchar_t* ulfd_wcsdup(const wchar_t* wstr) {
   ul_hapi int ulfd_rename_u(const ulfd_uchar_t* newpath, const ulfd_uchar_t* oldpath) {
     return ulfd_rename(newpath, oldpath);
   }
+  ul_hapi int ulfd_copy_file_u(const ulfd_uchar_t* newpath, const ulfd_uchar_t* oldpath, int flags) {
+    return ulfd_copy_file(newpath, oldpath, flags);
+  }
   ul_hapi int ulfd_unlink_u(const ulfd_uchar_t* path) {
     return ulfd_unlink(path);
   }
@@ -818,6 +1427,42 @@ ul_hapi wchar_t* ulfd_wcsdup(const wchar_t* wstr) {
   ul_hapi int ulfd_readdir_u(ulfd_dir_t* dir, const ulfd_uchar_t** pname) {
     return ulfd_readdir(dir, pname);
   }
+  ul_hapi int ulfd_openat_u(ulfd_t* pfd, ulfd_t dirfd, const ulfd_uchar_t* path, ulfd_int32_t oflag, ulfd_mode_t mode) {
+    return ulfd_openat(pfd, dirfd, path, oflag, mode);
+  }
+  ul_hapi int ulfd_fstatat_u(ulfd_t dirfd, const ulfd_uchar_t* path, ulfd_stat_t* state, int flags) {
+    return ulfd_fstatat(dirfd, path, state, flags);
+  }
+  ul_hapi int ulfd_statx_u(ulfd_t dirfd, const ulfd_uchar_t* path, int flags, unsigned mask, ulfd_stat_t* state, unsigned* pmask) {
+    return ulfd_statx(dirfd, path, flags, mask, state, pmask);
+  }
+  ul_hapi int ulfd_mkdirat_u(ulfd_t dirfd, const ulfd_uchar_t* path, ulfd_mode_t mode) {
+    return ulfd_mkdirat(dirfd, path, mode);
+  }
+  ul_hapi int ulfd_unlinkat_u(ulfd_t dirfd, const ulfd_uchar_t* path, int flags) {
+    return ulfd_unlinkat(dirfd, path, flags);
+  }
+  ul_hapi int ulfd_renameat2_u(ulfd_t newdirfd, const ulfd_uchar_t* newpath, ulfd_t olddirfd, const ulfd_uchar_t* oldpath, int flags) {
+    return ulfd_renameat2(newdirfd, newpath, olddirfd, oldpath, flags);
+  }
+  ul_hapi int ulfd_opendirat_u(ulfd_dir_t* dir, ulfd_t dirfd, const ulfd_uchar_t* path) {
+    return ulfd_opendirat(dir, dirfd, path);
+  }
+  ul_hapi int ulfd_watch_add_u(ulfd_watch_t* watch, const ulfd_uchar_t* path, int mask, int* pwd) {
+    return ulfd_watch_add(watch, path, mask, pwd);
+  }
+  ul_hapi int ulfd_atomic_writer_open_u(ulfd_atomic_writer_t* writer, const ulfd_uchar_t* path, ulfd_mode_t mode, int flags) {
+    return ulfd_atomic_writer_open(writer, path, mode, flags);
+  }
+  ul_hapi int ulfd_atomic_write_file_u(const ulfd_uchar_t* path, const void* buf, size_t len, ulfd_mode_t mode, int flags) {
+    return ulfd_atomic_write_file(path, buf, len, mode, flags);
+  }
+  ul_hapi int ulfd_remove_all_u(const ulfd_uchar_t* path, const ulfd_tree_options_t* options) {
+    return ulfd_remove_all(path, options);
+  }
+  ul_hapi int ulfd_copy_tree_u(const ulfd_uchar_t* newpath, const ulfd_uchar_t* oldpath, const ulfd_tree_options_t* options) {
+    return ulfd_copy_tree(newpath, oldpath, options);
+  }
   ul_hapi int ulfd_space_u(ulfd_spaceinfo_t* info, const ulfd_uchar_t* path) {
     return ulfd_space(info, path);
   }
@@ -838,6 +1483,8 @@ ul_hapi wchar_t* ulfd_wcsdup(const wchar_t* wstr) {
   #endif
   #if (_WIN32_WINNT+0) >= 0x0600 /* Windows Vista */
     #define ULFD_WIN32_HAS_GetFinalPathNameByHandle
+    #define ULFD_WIN32_HAS_GetFileInformationByHandleEx
+    #define ULFD_WIN32_HAS_SetFileInformationByHandle
   #endif
   #if (_WIN32_WINNT+0) >= 0x0602 /* Windows 8 */
     #define ULFD_WIN32_HAS_PrefetchVirtualMemory
@@ -850,6 +1497,7 @@ ul_hapi wchar_t* ulfd_wcsdup(const wchar_t* wstr) {
       #define ULFD_POSIX_HAS_utimensat
       #define ULFD_POSIX_HAS_fchmod
       #define ULFD_POSIX_HAS_fchmodat
+      #define ULFD_POSIX_HAS_openat
       #define ULFD_POSIX_HAS_fchown
       #define ULFD_POSIX_HAS_fchownat
       #define ULFD_POSIX_HAS_truncate
@@ -861,6 +1509,10 @@ ul_hapi wchar_t* ulfd_wcsdup(const wchar_t* wstr) {
       #define ULFD_POSIX_HAS_lstat
       #define ULFD_POSIX_HAS_symlink
       #define ULFD_POSIX_HAS_ftruncate
+      #ifndef __APPLE__
+        #define ULFD_POSIX_HAS_posix_fallocate
+        #define ULFD_POSIX_HAS_posix_fadvise
+      #endif
     #endif
     #if (_POSIX_C_SOURCE+0) >= 199309L
       #define ULFD_POSIX_HAS_fdatasync
@@ -881,6 +1533,7 @@ ul_hapi wchar_t* ulfd_wcsdup(const wchar_t* wstr) {
       #define ULFD_POSIX_HAS_utimensat
       #define ULFD_POSIX_HAS_fchownat
       #define ULFD_POSIX_HAS_fchmodat
+      #define ULFD_POSIX_HAS_openat
     #endif
     #if (_XOPEN_SOURCE+0) >= 500
       #define ULFD_POSIX_HAS_pread
@@ -931,10 +1584,12 @@ ul_hapi wchar_t* ulfd_wcsdup(const wchar_t* wstr) {
     #define ULFD_POSIX_HAS_utimensat
     #define ULFD_POSIX_HAS_fchownat
     #define ULFD_POSIX_HAS_fchmodat
+    #define ULFD_POSIX_HAS_openat
   #endif
 
   #if defined(_DEFAULT_SOURCE) && (_DEFAULT_SOURCE+0)
     #define ULFD_POSIX_HAS_futimes
+    #define ULFD_POSIX_HAS_syscall
   #endif
 
   #if defined(_SVID_SOURCE) && (_SVID_SOURCE+0)
@@ -946,14 +1601,58 @@ ul_hapi wchar_t* ulfd_wcsdup(const wchar_t* wstr) {
       #define ULFD_POSIX_HAS_canonicalize_file_name
       #define ULFD_POSIX_HAS_get_current_dir_name
       #define ULFD_POSIX_HAS_copy_file_range
+      #define ULFD_POSIX_HAS_splice
+      #ifdef __linux__
+        #define ULFD_POSIX_HAS_mremap
+        #define ULFD_POSIX_HAS_fallocate
+        #define ULFD_POSIX_HAS_sync_file_range
+        #define ULFD_POSIX_HAS_readahead
+      #endif
       #define ULFD_POSIX_STAT_HAS_TIM
     #endif
   #endif
+
+  #ifdef __linux__
+    #define ULFD_POSIX_HAS_sendfile
+  #endif
+
+  #ifdef __GLIBC__
+    #if defined(_DEFAULT_SOURCE) && (_DEFAULT_SOURCE+0)
+      #define ULFD_POSIX_HAS_preadv
+      #define ULFD_POSIX_HAS_mincore
+      #ifdef __linux__
+        #define ULFD_POSIX_HAS_getdents64
+      #endif
+    #endif
+    #if defined(_GNU_SOURCE) && (_GNU_SOURCE+0) && __GLIBC_PREREQ(2, 20) && defined(__linux__)
+      #define ULFD_POSIX_HAS_ofd_lock
+    #endif
+    #if defined(_GNU_SOURCE) && (_GNU_SOURCE+0) && __GLIBC_PREREQ(2, 26)
+      #define ULFD_POSIX_HAS_preadv2
+    #endif
+    #if defined(_GNU_SOURCE) && (_GNU_SOURCE+0) && __GLIBC_PREREQ(2, 28)
+      #define ULFD_POSIX_HAS_renameat2
+      #ifdef __linux__
+        #define ULFD_POSIX_HAS_statx
+      #endif
+    #endif
+  #elif defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__)
+    #define ULFD_POSIX_HAS_preadv
+    #define ULFD_POSIX_HAS_mincore
+  #elif defined(__APPLE__)
+    #define ULFD_POSIX_HAS_mincore
+  #endif
 #endif
 
 
 #ifdef _WIN32
   #define ULFD_NO_COPY_FILE_RANGE
+  #define ULFD_NO_SENDFILE
+  #define ULFD_NO_SPLICE
+  #define ULFD_NO_SYNC_FILE_RANGE
+  #define ULFD_NO_FADVISE
+  #define ULFD_NO_READAHEAD
+  #define ULFD_NO_RESIDENCY
   #define ULFD_NO_CHOWN
   #define ULFD_NO_LCHOWN
   #define ULFD_NO_FCHOWN
@@ -981,6 +1680,12 @@ ul_hapi wchar_t* ulfd_wcsdup(const wchar_t* wstr) {
   #ifndef ULFD_POSIX_HAS_copy_file_range
     #define ULFD_NO_COPY_FILE_RANGE
   #endif
+  #ifndef ULFD_POSIX_HAS_sendfile
+    #define ULFD_NO_SENDFILE
+  #endif
+  #ifndef ULFD_POSIX_HAS_splice
+    #define ULFD_NO_SPLICE
+  #endif
   #ifndef ULFD_POSIX_HAS_fsync
     #define ULFD_NO_FSYNC
     #define ULFD_NO_FFULLSYNC
@@ -991,9 +1696,30 @@ ul_hapi wchar_t* ulfd_wcsdup(const wchar_t* wstr) {
   #else
     #undef ULFD_NO_FDATASYNC /* nearly impossible */
   #endif
+  #ifndef ULFD_POSIX_HAS_sync_file_range
+    #define ULFD_NO_SYNC_FILE_RANGE
+  #endif
+  #if !defined(ULFD_POSIX_HAS_posix_fadvise) && !defined(__APPLE__)
+    #define ULFD_NO_FADVISE
+    #ifndef ULFD_POSIX_HAS_readahead
+      #define ULFD_NO_READAHEAD
+    #endif
+  #endif
+  #ifndef ULFD_POSIX_HAS_mincore
+    #define ULFD_NO_RESIDENCY
+  #endif
+  #ifndef ULFD_POSIX_HAS_ofd_lock
+    #define ULFD_NO_OFD_LOCK
+  #endif
   #ifndef ULFD_POSIX_HAS_ftruncate
     #define ULFD_NO_FTRUNCATE
   #endif
+  #if !defined(ULFD_POSIX_HAS_fallocate) && !defined(ULFD_POSIX_HAS_posix_fallocate)
+    #define ULFD_NO_FALLOCATE
+  #endif
+  #ifndef ULFD_POSIX_HAS_fallocate
+    #define ULFD_NO_PUNCH_HOLE
+  #endif
   #ifndef ULFD_POSIX_HAS_fchmod
     #define ULFD_NO_FCHMOD
   #endif
@@ -1183,6 +1909,122 @@ ul_hapi int ulfd_wstr_to_str_alloc(char** pstr, const wchar_t* wstr) {
 
 
 
+#ifndef ULFD_COPY_BUFSIZE_MIN
+  #define ULFD_COPY_BUFSIZE_MIN 16384
+#endif
+#ifndef ULFD_COPY_BUFSIZE_MAX
+  #define ULFD_COPY_BUFSIZE_MAX 1048576
+#endif
+
+/* preferred I/O block size of the file, returns 0 if unknown */
+ul_hapi size_t _ulfd_fblksize(ulfd_t fd);
+
+/* errors which mean "this way can't copy between these files, try another way" */
+ul_hapi int _ulfd_copy_should_fallback(int err) {
+  if(err == ENOSYS || err == EXDEV || err == EINVAL) return 1;
+#ifdef EOPNOTSUPP
+  if(err == EOPNOTSUPP) return 1;
+#endif
+#if defined(ENOTSUP) && (!defined(EOPNOTSUPP) || ENOTSUP != EOPNOTSUPP)
+  if(err == ENOTSUP) return 1;
+#endif
+  return 0;
+}
+
+ul_hapi size_t _ulfd_copy_bufsize(ulfd_t fd_in, ulfd_t fd_out, size_t len) {
+  size_t blksize, blksize_out, buf_len;
+  blksize = _ulfd_fblksize(fd_in);
+  blksize_out = _ulfd_fblksize(fd_out);
+  if(blksize < blksize_out) blksize = blksize_out;
+  if(blksize == 0 || blksize > ULFD_COPY_BUFSIZE_MAX) blksize = ULFD_COPY_BUFSIZE_MIN;
+
+  /* use multiple of block size, large enough to amortize syscalls but no larger than needed */
+  buf_len = blksize;
+  while(buf_len < ULFD_COPY_BUFSIZE_MIN) buf_len <<= 1;
+  while(buf_len < len && (buf_len << 1) <= ULFD_COPY_BUFSIZE_MAX) buf_len <<= 1;
+  return buf_len;
+}
+
+/* move data that is already in the pipe to `fd_out` through a small buffer */
+ul_hapi int _ulfd_copy_drain_pipe(ulfd_t pipe_in, ulfd_t fd_out, ulfd_int64_t* off_out, size_t len, size_t* pcopyed) {
+  char buf[4096];
+  size_t nread, nwriten, off;
+  int err = 0;
+  *pcopyed = 0;
+  while(len > 0) {
+    err = ulfd_read(pipe_in, buf, len < sizeof(buf) ? len : sizeof(buf), &nread);
+    if(err || nread == 0) break;
+    len -= nread;
+    for(off = 0; off < nread; off += nwriten) {
+      if(off_out) {
+        err = ulfd_pwrite(fd_out, buf + off, nread - off, *off_out, &nwriten);
+        if(!err) *off_out += ul_static_cast(ulfd_int64_t, nwriten);
+      } else err = ulfd_write(fd_out, buf + off, nread - off, &nwriten);
+      if(err) return err;
+      if(nwriten == 0) return EIO;
+      *pcopyed += nwriten;
+    }
+  }
+  return err;
+}
+
+/* returns ENOSYS (and copies nothing) if there is no kernel way for these files */
+ul_hapi int _ulfd_copy_file_range_kernel(
+  ulfd_t fd_in, ulfd_int64_t* off_in, ulfd_t fd_out, ulfd_int64_t* off_out,
+  size_t len, size_t* pcopyed
+) {
+  ulfd_int64_t nin, nout;
+  ulfd_int64_t* pin = NULL, *pout = NULL;
+  size_t copyed = 0, n;
+  int err = ENOSYS;
+
+  if(off_in) { nin = *off_in; pin = &nin; }
+  if(off_out) { nout = *off_out; pout = &nout; }
+
+#ifndef ULFD_NO_SENDFILE
+  if(off_out == NULL) {
+    while(copyed < len) {
+      err = ulfd_sendfile(fd_out, fd_in, pin, len - copyed, &n);
+      if(err || n == 0) break;
+      copyed += n;
+    }
+    if(copyed || !_ulfd_copy_should_fallback(err)) { *pcopyed = copyed; return err; }
+  }
+#endif
+
+#ifndef ULFD_NO_SPLICE
+  {
+    ulfd_t pfds[2];
+    size_t nin_pipe, nout_pipe;
+    if(ulfd_pipe(pfds)) return ENOSYS;
+    while(copyed < len) {
+      err = ulfd_splice(fd_in, pin, pfds[1], NULL, len - copyed, ULFD_SPLICE_F_MOVE | ULFD_SPLICE_F_MORE, &nin_pipe);
+      if(err || nin_pipe == 0) break;
+      while(nin_pipe > 0) {
+        err = ulfd_splice(pfds[0], NULL, fd_out, pout, nin_pipe, ULFD_SPLICE_F_MOVE | ULFD_SPLICE_F_MORE, &nout_pipe);
+        if(ul_unlikely(err)) break;
+        if(ul_unlikely(nout_pipe == 0)) { err = EIO; break; }
+        nin_pipe -= nout_pipe; copyed += nout_pipe;
+      }
+      if(ul_unlikely(err)) {
+        /* data has been consumed from `fd_in`, so we must write it out */
+        if(nin_pipe > 0 && _ulfd_copy_should_fallback(err)) {
+          err = _ulfd_copy_drain_pipe(pfds[0], fd_out, pout, nin_pipe, &nout_pipe);
+          copyed += nout_pipe;
+          if(err == 0 && copyed < len) continue;
+        }
+        break;
+      }
+    }
+    ulfd_close(pfds[0]); ulfd_close(pfds[1]);
+    if(copyed || !_ulfd_copy_should_fallback(err)) { *pcopyed = copyed; return err; }
+  }
+#endif
+
+  (void)fd_in; (void)fd_out; (void)pin; (void)pout; (void)n;
+  return ENOSYS;
+}
+
 ul_hapi int ulfd_copy_file_range_user(
   ulfd_t fd_in, ulfd_int64_t* off_in, ulfd_t fd_out, ulfd_int64_t* off_out,
   size_t len, size_t* pcopyed, void* buf, size_t buf_len
@@ -1203,13 +2045,17 @@ ul_hapi int ulfd_copy_file_range_user(
     nout = *off_out;
     if(ULFD_INT64_C(0x7FFFFFFFFFFFFFFF) - nout < ul_static_cast(ulfd_int64_t, len)) return EINVAL;
   } else nout = -1;
+  if(buf && buf_len == 0) return EINVAL;
 
-  if(buf) {
-    if(buf_len == 0) return EINVAL;
-    else nbuf = buf;
-  } else {
+  if(ul_unlikely(len == 0)) { *pcopyed = 0; return 0; }
+  err = _ulfd_copy_file_range_kernel(fd_in, off_in, fd_out, off_out, len, pcopyed);
+  if(err != ENOSYS) return err;
+  err = 0;
+
+  if(buf) nbuf = buf;
+  else {
     if(buf_len == 0) {
-      buf_len = 16384;
+      buf_len = _ulfd_copy_bufsize(fd_in, fd_out, len);
       do {
         nbuf = ul_malloc(buf_len);
         if(ul_likely(nbuf)) break;
@@ -1232,7 +2078,7 @@ ul_hapi int ulfd_copy_file_range_user(
       if(nout >= 0) {
         err = ulfd_pwrite(fd_out, nbuf, nread, nout, &nwriten);
         nout += ul_static_cast(ulfd_int64_t, nwriten);
-      } else err = ulfd_write(fd_out, nbuf, buf_len, &nwriten);
+      } else err = ulfd_write(fd_out, nbuf, nread, &nwriten);
     }
     if(err) goto do_return;
 
@@ -1248,7 +2094,7 @@ ul_hapi int ulfd_copy_file_range_user(
 
 do_return:
   *pcopyed = copyed;
-  if(buf) ul_free(nbuf);
+  if(!buf) ul_free(nbuf);
   return err;
 }
 ul_hapi int ulfd_pread_user(ulfd_t fd, void* buf, size_t count, ulfd_int64_t off, size_t* pread_bytes) {
@@ -1297,12 +2143,378 @@ ul_hapi int ulfd_copy_file_range_allowuser(
   size_t len, size_t* pcopyed
 ) {
 #ifndef ULFD_NO_COPY_FILE_RANGE
-  return ulfd_copy_file_range(fd_in, off_in, fd_out, off_out, len, pcopyed);
-#else
+  int err = ulfd_copy_file_range(fd_in, off_in, fd_out, off_out, len, pcopyed);
+  if(!_ulfd_copy_should_fallback(err)) return err;
+#endif
   return ulfd_copy_file_range_user(fd_in, off_in, fd_out, off_out, len, pcopyed, NULL, 0);
+}
+
+#define _ulfd_dirent_reclen(namelen) \
+  ((offsetof(ulfd_dirent_t, name) + (namelen) + 1 + 7) & ~ul_static_cast(size_t, 7))
+
+#ifdef _WIN32
+  #define _ULFD_WALK_SEP '\\'
+#else
+  #define _ULFD_WALK_SEP '/'
 #endif
+ul_hapi void _ulfd_walk_release_parent(void* parent);
+ul_hapi ulfd_walk_task_t* _ulfd_walk_task_new(
+  const char* dirpath, size_t dirlen, const char* name, size_t namelen, int depth,
+  const ulfd_uint64_t* ancestors, size_t nancestors
+) {
+  ulfd_walk_task_t* task;
+  size_t pathlen = dirlen + 1 + namelen, anc_off;
+
+  anc_off = (offsetof(ulfd_walk_task_t, path) + pathlen + 1 + 7) & ~ul_static_cast(size_t, 7);
+  task = ul_reinterpret_cast(ulfd_walk_task_t*, ul_malloc(anc_off + nancestors * sizeof(ulfd_uint64_t)));
+  if(ul_unlikely(task == NULL)) return NULL;
+
+  memcpy(task->path, dirpath, dirlen);
+  if(dirlen && dirpath[dirlen - 1] != '/' && dirpath[dirlen - 1] != _ULFD_WALK_SEP) task->path[dirlen++] = _ULFD_WALK_SEP;
+  memcpy(task->path + dirlen, name, namelen);
+  task->path[dirlen + namelen] = 0;
+  task->pathlen = dirlen + namelen;
+  task->namepos = dirlen;
+  task->parent = NULL;
+  task->depth = depth;
+  task->nancestors = nancestors;
+  task->ancestors = ul_reinterpret_cast(ulfd_uint64_t*, ul_reinterpret_cast(char*, task) + anc_off);
+  if(nancestors) memcpy(task->ancestors, ancestors, nancestors * sizeof(ulfd_uint64_t));
+  return task;
+}
+ul_hapi int ulfd_walk_task_root(ulfd_walk_task_t** ptask, const char* root) {
+  ulfd_walk_task_t* task = _ulfd_walk_task_new("", 0, root, strlen(root), 0, NULL, 0);
+  if(ul_unlikely(task == NULL)) return ENOMEM;
+  *ptask = task; return 0;
+}
+ul_hapi void ulfd_walk_task_free(ulfd_walk_task_t* task) {
+  if(task->parent) _ulfd_walk_release_parent(task->parent);
+  ul_free(task);
+}
+
+typedef struct _ulfd_walk_stack_t {
+  ulfd_walk_task_t** tasks;
+  size_t len, cap;
+} _ulfd_walk_stack_t;
+ul_hapi int _ulfd_walk_stack_push(void* ctx, ulfd_walk_task_t* task) {
+  _ulfd_walk_stack_t* stack = ul_reinterpret_cast(_ulfd_walk_stack_t*, ctx);
+  if(stack->len == stack->cap) {
+    size_t cap2 = stack->cap + (stack->cap >> 1) + 16;
+    ulfd_walk_task_t** tasks = ul_reinterpret_cast(ulfd_walk_task_t**,
+      ul_realloc(stack->tasks, cap2 * sizeof(ulfd_walk_task_t*)));
+    if(ul_unlikely(tasks == NULL)) { ulfd_walk_task_free(task); return ENOMEM; }
+    stack->tasks = tasks; stack->cap = cap2;
+  }
+  stack->tasks[stack->len++] = task;
+  return 0;
+}
+ul_hapi int ulfd_walk(const char* root, const ulfd_walk_options_t* options) {
+  _ulfd_walk_stack_t stack = { NULL, 0, 0 };
+  ulfd_walk_task_t* task;
+  int err;
+
+  err = ulfd_walk_task_root(&task, root);
+  if(err) return err;
+  err = _ulfd_walk_stack_push(&stack, task);
+  /* depth first, so only the descriptors of the current path are held open */
+  while(!err && stack.len) err = ulfd_walk_scan(stack.tasks[--stack.len], options, _ulfd_walk_stack_push, &stack);
+  while(stack.len) ulfd_walk_task_free(stack.tasks[--stack.len]);
+  if(stack.tasks) ul_free(stack.tasks);
+  return err;
+}
+ul_hapi int _ulfd_walk_error(const ulfd_walk_options_t* options, const char* path, int err) {
+  if(err == ECANCELED || err == ENOMEM) return err;
+  if(options->on_error == NULL) return 0;
+  return options->on_error(options->userdata, path, err) ? err : 0;
+}
+
+/* `off` < 0 means current pos */
+ul_hapi int _ulfd_preadv_user(ulfd_t fd, const ulfd_iovec_t* iov, int iovcnt, ulfd_int64_t off, size_t* pread_bytes) {
+  size_t total = 0, nread;
+  int i, err = 0;
+
+  if(ul_unlikely(iovcnt < 0)) return EINVAL;
+  for(i = 0; i < iovcnt; ++i) {
+    if(iov[i].len == 0) continue;
+    if(off < 0) err = ulfd_read(fd, iov[i].base, iov[i].len, &nread);
+    else err = ulfd_pread_allowuser(fd, iov[i].base, iov[i].len, off + ul_static_cast(ulfd_int64_t, total), &nread);
+    if(err) break;
+    total += nread;
+    if(nread < iov[i].len) break;
+  }
+  if(err && total == 0) return err;
+  *pread_bytes = total;
+  return 0;
+}
+ul_hapi int _ulfd_pwritev_user(
+  ulfd_t fd, const ulfd_iovec_t* iov, int iovcnt, ulfd_int64_t off, size_t* pwriten_bytes
+) {
+  size_t total = 0, nwriten;
+  int i, err = 0;
+
+  if(ul_unlikely(iovcnt < 0)) return EINVAL;
+  for(i = 0; i < iovcnt; ++i) {
+    if(iov[i].len == 0) continue;
+    if(off < 0) err = ulfd_write(fd, iov[i].base, iov[i].len, &nwriten);
+    else err = ulfd_pwrite_allowuser(fd, iov[i].base, iov[i].len, off + ul_static_cast(ulfd_int64_t, total), &nwriten);
+    if(err) break;
+    total += nwriten;
+    if(nwriten < iov[i].len) break;
+  }
+  if(err && total == 0) return err;
+  *pwriten_bytes = total;
+  return 0;
+}
+ul_hapi int _ulfd_preadv2_user(
+  ulfd_t fd, const ulfd_iovec_t* iov, int iovcnt, ulfd_int64_t off, int flags, size_t* pread_bytes
+) {
+  if(flags & ULFD_RWF_NOWAIT) return EOPNOTSUPP;
+  if(off < 0) return ulfd_readv(fd, iov, iovcnt, pread_bytes);
+  return ulfd_preadv(fd, iov, iovcnt, off, pread_bytes);
+}
+ul_hapi int _ulfd_pwritev2_user(
+  ulfd_t fd, const ulfd_iovec_t* iov, int iovcnt, ulfd_int64_t off, int flags, size_t* pwriten_bytes
+) {
+  int err;
+  if(flags & ULFD_RWF_NOWAIT) return EOPNOTSUPP;
+  if(off < 0) err = ulfd_writev(fd, iov, iovcnt, pwriten_bytes);
+  else err = ulfd_pwritev(fd, iov, iovcnt, off, pwriten_bytes);
+  if(err) return err;
+  if(flags & ULFD_RWF_SYNC) return ulfd_fsync(fd);
+  if(flags & ULFD_RWF_DSYNC) return ulfd_fdatasync(fd);
+  return 0;
+}
+
+ul_hapi int ulfd_aligned_alloc(void** pptr, size_t alignment, size_t size) {
+  char* raw;
+  size_t addr;
+  if(alignment < sizeof(void*)) alignment = sizeof(void*);
+  if(alignment & (alignment - 1)) return EINVAL;
+  if(ul_unlikely(size > ~ul_static_cast(size_t, 0) - alignment - sizeof(void*))) return ENOMEM;
+  raw = ul_reinterpret_cast(char*, ul_malloc(size + alignment + sizeof(void*)));
+  if(ul_unlikely(raw == NULL)) return ENOMEM;
+  /* the pointer returned by `ul_malloc` is kept just before the aligned block */
+  addr = (ul_reinterpret_cast(size_t, raw) + sizeof(void*) + alignment - 1) & ~(alignment - 1);
+  ul_reinterpret_cast(void**, addr)[-1] = raw;
+  *pptr = ul_reinterpret_cast(void*, addr);
+  return 0;
+}
+ul_hapi void ulfd_aligned_free(void* ptr) {
+  if(ptr) ul_free(ul_reinterpret_cast(void**, ptr)[-1]);
+}
+ul_hapi int _ulfd_direct_check(ulfd_t fd, const void* buf, ulfd_int64_t off, size_t* palign) {
+  int err;
+  if(*palign == 0) {
+    err = ulfd_logical_block_size(fd, palign);
+    if(err) return err;
+  }
+  if(*palign & (*palign - 1)) return EINVAL;
+  if((ul_reinterpret_cast(size_t, buf) | ul_static_cast(size_t, off)) & (*palign - 1)) return EINVAL;
+  return off < 0 ? EINVAL : 0;
+}
+ul_hapi int ulfd_pread_direct(ulfd_t fd, void* buf, size_t count, ulfd_int64_t off, size_t align, size_t* pread_bytes) {
+  char* out = ul_reinterpret_cast(char*, buf);
+  size_t head, done = 0, got;
+  void* bounce;
+  int err;
+
+  *pread_bytes = 0;
+  err = _ulfd_direct_check(fd, buf, off, &align);
+  if(err) return err;
+  head = count - count % align;
+  while(done < head) {
+    err = ulfd_pread(fd, out + done, head - done, off + ul_static_cast(ulfd_int64_t, done), &got);
+    if(err) { *pread_bytes = done; return err; }
+    if(got == 0) break;
+    done += got;
+  }
+  if(done == head && head < count) {
+    err = ulfd_aligned_alloc(&bounce, align, align);
+    if(err) { *pread_bytes = done; return err; }
+    err = ulfd_pread(fd, bounce, align, off + ul_static_cast(ulfd_int64_t, head), &got);
+    if(err == 0) {
+      if(got > count - head) got = count - head;
+      memcpy(out + head, bounce, got);
+      done += got;
+    }
+    ulfd_aligned_free(bounce);
+  }
+  *pread_bytes = done;
+  return err;
+}
+ul_hapi int ulfd_pwrite_direct(ulfd_t fd, const void* buf, size_t count, ulfd_int64_t off, size_t align, size_t* pwriten_bytes) {
+  const char* in = ul_reinterpret_cast(const char*, buf);
+  size_t head, done = 0, got, writen, tail;
+  ulfd_int64_t tail_off;
+  char* bounce;
+  int err;
+
+  *pwriten_bytes = 0;
+  err = _ulfd_direct_check(fd, buf, off, &align);
+  if(err) return err;
+  head = count - count % align;
+  while(done < head) {
+    err = ulfd_pwrite(fd, in + done, head - done, off + ul_static_cast(ulfd_int64_t, done), &writen);
+    if(!err && ul_unlikely(writen == 0)) err = EIO;
+    if(err) { *pwriten_bytes = done; return err; }
+    done += writen;
+  }
+  if(head == count) { *pwriten_bytes = done; return 0; }
+
+  tail = count - head;
+  tail_off = off + ul_static_cast(ulfd_int64_t, head);
+  err = ulfd_aligned_alloc(ul_reinterpret_cast(void**, &bounce), align, align);
+  if(err) { *pwriten_bytes = done; return err; }
+  err = ulfd_pread(fd, bounce, align, tail_off, &got);
+  if(err) goto do_return;
+  memcpy(bounce, in + head, tail);
+  if(got < tail) got = tail;
+  if(got < align) memset(bounce + got, 0, align - got);
+  err = ulfd_pwrite(fd, bounce, align, tail_off, &writen);
+  if(err) goto do_return;
+  /* the block was past the end of file, cut the padding off */
+  if(got < align) err = ulfd_ftruncate(fd, tail_off + ul_static_cast(ulfd_int64_t, got));
+  if(err == 0) done += tail;
+do_return:
+  ulfd_aligned_free(bounce);
+  *pwriten_bytes = done;
+  return err;
+}
+
+ul_hapi int _ulfd_range_check(ulfd_int64_t off, ulfd_int64_t len) {
+  if(off < 0 || len <= 0) return EINVAL;
+  return ULFD_INT64_C(0x7FFFFFFFFFFFFFFF) - off < len ? EFBIG : 0;
+}
+#define _ULFD_ZERO_BUFSIZE 65536
+ul_hapi int _ulfd_zero_range_user(ulfd_t fd, ulfd_int64_t off, ulfd_int64_t len, int flags) {
+  ulfd_int64_t length, end = off + len;
+  size_t n, writen;
+  void* zeros;
+  int err;
+
+  err = ulfd_ffilelength(fd, &length);
+  if(err) return err;
+  if(end > length) {
+    /* the extended part reads as zeros already */
+    if(!(flags & ULFD_FALLOC_KEEP_SIZE)) {
+      err = ulfd_ftruncate(fd, end);
+      if(err) return err;
+    }
+    end = length;
+  }
+  if(off >= end) return 0;
+
+  n = end - off > _ULFD_ZERO_BUFSIZE ? _ULFD_ZERO_BUFSIZE : ul_static_cast(size_t, end - off);
+  zeros = ul_malloc(n);
+  if(ul_unlikely(zeros == NULL)) return ENOMEM;
+  memset(zeros, 0, n);
+  while(off < end) {
+    if(end - off < ul_static_cast(ulfd_int64_t, n)) n = ul_static_cast(size_t, end - off);
+    err = ulfd_pwrite_allowuser(fd, zeros, n, off, &writen);
+    if(!err && ul_unlikely(writen == 0)) err = EIO;
+    if(err) break;
+    off += ul_static_cast(ulfd_int64_t, writen);
+  }
+  ul_free(zeros);
+  return err;
+}
+
+ul_hapi int ulfd_copy_sparse(
+  ulfd_t fd_in, ulfd_int64_t off_in, ulfd_t fd_out, ulfd_int64_t off_out,
+  ulfd_int64_t len, ulfd_int64_t* pcopyed
+) {
+  ulfd_extent_iter_t it;
+  ulfd_int64_t data_off, data_len, pos, hole_end, out_len, out_off, out_end, in_off;
+  size_t chunk, copyed;
+  int err, err2;
+
+  *pcopyed = 0;
+  if(off_out < 0) return EINVAL;
+  err = ulfd_ffilelength(fd_out, &out_len);
+  if(err) return err;
+  err = ulfd_extent_begin(&it, fd_in, off_in, len);
+  if(err) return err;
+  if(it.end > off_in && ULFD_INT64_C(0x7FFFFFFFFFFFFFFF) - off_out < it.end - off_in) {
+    ulfd_extent_end(&it);
+    return EFBIG;
+  }
+
+  pos = off_in;
+  for(;;) {
+    err = ulfd_extent_next(&it, &data_off, &data_len);
+    if(err) break;
+    hole_end = data_len ? data_off : it.end;
+    if(hole_end > pos) {
+      /* only the part of the hole that overlaps the old output has to be cleared */
+      out_off = off_out + (pos - off_in);
+      out_end = off_out + (hole_end - off_in);
+      if(out_end > out_len) out_end = out_len;
+      if(out_off < out_end) {
+        err = ulfd_punch_hole(fd_out, out_off, out_end - out_off);
+        if(err == ENOSYS || err == EOPNOTSUPP)
+          err = ulfd_zero_range(fd_out, out_off, out_end - out_off, ULFD_FALLOC_KEEP_SIZE);
+        if(err) break;
+      }
+      pos = hole_end;
+    }
+    if(data_len == 0) break;
+
+    while(data_len > 0) {
+      chunk = data_len > 0x40000000 ? 0x40000000 : ul_static_cast(size_t, data_len);
+      in_off = pos;
+      out_off = off_out + (pos - off_in);
+      err = ulfd_copy_file_range_allowuser(fd_in, &in_off, fd_out, &out_off, chunk, &copyed);
+      if(err || copyed == 0) break;
+      pos += ul_static_cast(ulfd_int64_t, copyed);
+      data_len -= ul_static_cast(ulfd_int64_t, copyed);
+    }
+    if(err) break;
+    out_off = off_out + (pos - off_in);
+    if(out_off > out_len) out_len = out_off;
+    if(data_len) break; /* the input shrank */
+  }
+
+  /* a trailing hole only extends the output */
+  out_end = off_out + (pos - off_in);
+  if(!err && out_end > out_len) err = ulfd_ftruncate(fd_out, out_end);
+  err2 = ulfd_extent_end(&it);
+  if(!err) err = err2;
+  *pcopyed = pos - off_in;
+  return err;
 }
 
+ul_hapi int ulfd_copy_fd(ulfd_t fd_in, ulfd_t fd_out, int flags) {
+  ulfd_stat_t state;
+  ulfd_int64_t done = 0, in_off, pos;
+  size_t chunk, copyed;
+  int err;
+
+  err = ulfd_fstat(fd_in, &state);
+  if(err) return err;
+  err = ulfd_clone_file(fd_in, fd_out);
+  if(err) {
+    if(!_ulfd_copy_should_fallback(err)) return err;
+    /* `fd_out` goes by its position, so `ulfd_copy_file_range_allowuser` may try `ulfd_sendfile` */
+    err = ulfd_seek(fd_out, 0, ULFD_SEEK_SET, &pos);
+    if(err) return err;
+    while(done < state.size) {
+      chunk = state.size - done > 0x40000000 ? 0x40000000 : ul_static_cast(size_t, state.size - done);
+      in_off = done;
+      err = ulfd_copy_file_range_allowuser(fd_in, &in_off, fd_out, NULL, chunk, &copyed);
+      if(err) return err;
+      if(copyed == 0) break; /* the input shrank */
+      done += ul_static_cast(ulfd_int64_t, copyed);
+    }
+    err = ulfd_ftruncate(fd_out, done);
+    if(err) return err;
+  }
+
+  if(flags & ULFD_COPY_NOATTR) return 0;
+  /* times first, a read-only mode may forbid changing them in Windows */
+  err = ulfd_futime(fd_out, state.atime, state.mtime);
+  if(err == 0) err = ulfd_fchmod(fd_out, state.mode & ULFD_S_IMASK);
+  return err;
+}
 
 #define _ulfd_begin_to_str(varname, wstr) do { \
   char* varname; int _ulfd_bts_err1 = ulfd_wstr_to_str_alloc(&(varname), (wstr)); \
@@ -1678,6 +2890,38 @@ ul_hapi int ulfd_copy_file_range_allowuser(
     }
   #endif
 
+  /* `FILE_BASIC_INFO` and `FILE_STANDARD_INFO`, which older SDKs don't declare */
+  typedef struct _ulfd_file_basic_info_t {
+    LARGE_INTEGER CreationTime;
+    LARGE_INTEGER LastAccessTime;
+    LARGE_INTEGER LastWriteTime;
+    LARGE_INTEGER ChangeTime;
+    DWORD FileAttributes;
+  } _ulfd_file_basic_info_t;
+  typedef struct _ulfd_file_standard_info_t {
+    LARGE_INTEGER AllocationSize;
+    LARGE_INTEGER EndOfFile;
+    DWORD NumberOfLinks;
+    BOOLEAN DeletePending;
+    BOOLEAN Directory;
+  } _ulfd_file_standard_info_t;
+  #define _ULFD_FileBasicInfo 0
+  #define _ULFD_FileStandardInfo 1
+  typedef BOOL (WINAPI *_ulfd_GetFileInformationByHandleEx_t)(
+    HANDLE hFile, int FileInformationClass, LPVOID lpFileInformation, DWORD dwBufferSize
+  );
+  #ifdef ULFD_WIN32_HAS_GetFileInformationByHandleEx
+    ul_hapi _ulfd_GetFileInformationByHandleEx_t _ulfd_get_GetFileInformationByHandleEx(void) {
+      return _ULFD_POINTER_TO_FUNCTION(_ulfd_GetFileInformationByHandleEx_t, GetFileInformationByHandleEx);
+    }
+  #else
+    ul_hapi _ulfd_GetFileInformationByHandleEx_t _ulfd_get_GetFileInformationByHandleEx(void) {
+      static HANDLE hold = NULL;
+      return _ULFD_POINTER_TO_FUNCTION(_ulfd_GetFileInformationByHandleEx_t,
+        _ulfd_kernel32_function(&hold, "GetFileInformationByHandleEx"));
+    }
+  #endif
+
   ul_hapi int ulfd_open_w(ulfd_t* pfd, const wchar_t* path, ulfd_int32_t oflag, int mode) {
     DWORD access = 0;
     DWORD share;
@@ -1710,6 +2954,8 @@ ul_hapi int ulfd_copy_file_range_allowuser(
       if(mode & ULFD_S_IHIDDEN) flags_attr |= FILE_ATTRIBUTE_HIDDEN;
     }
 
+    if(oflag & ULFD_O_DIRECT) flags_attr |= FILE_FLAG_NO_BUFFERING;
+
     if(oflag & ULFD_O_TEMPORARY) {
       share |= FILE_SHARE_DELETE;
       access |= DELETE;
@@ -1906,11 +3152,66 @@ ul_hapi int ulfd_copy_file_range_allowuser(
     return ENOSYS;
   }
 
+  ul_hapi int ulfd_sendfile(ulfd_t fd_out, ulfd_t fd_in, ulfd_int64_t* off_in, size_t len, size_t* psent) {
+    (void)fd_out; (void)fd_in; (void)off_in; (void)len; (void)psent;
+    return ENOSYS;
+  }
+  ul_hapi int ulfd_splice(
+    ulfd_t fd_in, ulfd_int64_t* off_in, ulfd_t fd_out, ulfd_int64_t* off_out,
+    size_t len, int flags, size_t* pspliced
+  ) {
+    (void)fd_in; (void)off_in; (void)fd_out; (void)off_out; (void)len; (void)flags; (void)pspliced;
+    return ENOSYS;
+  }
+  ul_hapi size_t _ulfd_fblksize(ulfd_t fd) {
+    (void)fd; return 0;
+  }
+
+  /* `ReadFileScatter` requires page-sized buffers and unbuffered handles, so loop instead */
+  ul_hapi int ulfd_readv(ulfd_t fd, const ulfd_iovec_t* iov, int iovcnt, size_t* pread_bytes) {
+    return _ulfd_preadv_user(fd, iov, iovcnt, -1, pread_bytes);
+  }
+  ul_hapi int ulfd_writev(ulfd_t fd, const ulfd_iovec_t* iov, int iovcnt, size_t* pwriten_bytes) {
+    return _ulfd_pwritev_user(fd, iov, iovcnt, -1, pwriten_bytes);
+  }
+  ul_hapi int ulfd_preadv(ulfd_t fd, const ulfd_iovec_t* iov, int iovcnt, ulfd_int64_t off, size_t* pread_bytes) {
+    if(ul_unlikely(off < 0)) return EINVAL;
+    return _ulfd_preadv_user(fd, iov, iovcnt, off, pread_bytes);
+  }
+  ul_hapi int ulfd_pwritev(ulfd_t fd, const ulfd_iovec_t* iov, int iovcnt, ulfd_int64_t off, size_t* pwriten_bytes) {
+    if(ul_unlikely(off < 0)) return EINVAL;
+    return _ulfd_pwritev_user(fd, iov, iovcnt, off, pwriten_bytes);
+  }
+  ul_hapi int ulfd_preadv2(
+    ulfd_t fd, const ulfd_iovec_t* iov, int iovcnt, ulfd_int64_t off, int flags, size_t* pread_bytes
+  ) {
+    if(ul_unlikely(off < -1)) return EINVAL;
+    return _ulfd_preadv2_user(fd, iov, iovcnt, off, flags, pread_bytes);
+  }
+  ul_hapi int ulfd_pwritev2(
+    ulfd_t fd, const ulfd_iovec_t* iov, int iovcnt, ulfd_int64_t off, int flags, size_t* pwriten_bytes
+  ) {
+    if(ul_unlikely(off < -1)) return EINVAL;
+    return _ulfd_pwritev2_user(fd, iov, iovcnt, off, flags, pwriten_bytes);
+  }
+
   ul_hapi int ulfd_fsync(ulfd_t fd) {
     return FlushFileBuffers(fd) ? 0 : _ul_win32_toerrno(GetLastError());
   }
   ul_hapi int ulfd_ffullsync(ulfd_t fd) { return ulfd_fsync(fd); }
   ul_hapi int ulfd_fdatasync(ulfd_t fd) { return ulfd_fsync(fd); }
+  ul_hapi int ulfd_sync_file_range(ulfd_t fd, ulfd_int64_t off, ulfd_int64_t len, int flags) {
+    if(off < 0 || len < 0) return EINVAL;
+    return (flags & ULFD_SYNC_RANGE_WAIT_AFTER) ? ulfd_fsync(fd) : 0;
+  }
+  ul_hapi int ulfd_fadvise(ulfd_t fd, ulfd_int64_t off, ulfd_int64_t len, int advice) {
+    (void)fd; (void)off; (void)len; (void)advice;
+    return ENOSYS;
+  }
+  ul_hapi int ulfd_readahead(ulfd_t fd, ulfd_int64_t off, ulfd_int64_t len) {
+    (void)fd; (void)off; (void)len;
+    return ENOSYS;
+  }
 
   ul_hapi int _ulfd_lock(ulfd_t fd, ulfd_int64_t off, ulfd_int64_t len, int mode, DWORD flags) {
     OVERLAPPED overlapped;
@@ -1947,6 +3248,12 @@ ul_hapi int ulfd_copy_file_range_allowuser(
   ul_hapi int ulfd_lockw(ulfd_t fd, ulfd_int64_t off, ulfd_int64_t len, int mode) {
     return _ulfd_lock(fd, off, len, mode, 0);
   }
+  ul_hapi int ulfd_ofd_lock(ulfd_t fd, ulfd_int64_t off, ulfd_int64_t len, int mode) {
+    return _ulfd_lock(fd, off, len, mode, LOCKFILE_FAIL_IMMEDIATELY);
+  }
+  ul_hapi int ulfd_ofd_lockw(ulfd_t fd, ulfd_int64_t off, ulfd_int64_t len, int mode) {
+    return _ulfd_lock(fd, off, len, mode, 0);
+  }
 
   ul_hapi int ulfd_ftruncate(ulfd_t fd, ulfd_int64_t length) {
     ulfd_int64_t nul_off;
@@ -1970,10 +3277,10 @@ ul_hapi int ulfd_copy_file_range_allowuser(
     sysfunc = _ulfd_get_GetFinalPathNameByHandleW();
     if(ul_unlikely(sysfunc == NULL)) return ENOSYS;
     need_len = sysfunc(fd, NULL, 0, 0);
+    if(ul_unlikely(need_len == 0)) return _ul_win32_toerrno(GetLastError());
     wpath = ul_reinterpret_cast(wchar_t*, ul_malloc(need_len * sizeof(wchar_t)));
     if(ul_unlikely(wpath == NULL)) return ENOMEM;
-    if(sysfunc(fd, NULL, 0, 0) > need_len) { ul_free(wpath); return ERANGE; }
-    wpath[need_len] = 0;
+    if(sysfunc(fd, wpath, need_len, 0) >= need_len) { ul_free(wpath); return ERANGE; }
     *pwpath = wpath;
     return 0;
   }
@@ -2240,12 +3547,25 @@ ul_hapi int ulfd_copy_file_range_allowuser(
       return VirtualUnlock(addr, len) ? 0 : _ul_win32_toerrno(GetLastError());
     } else return EINVAL;
   }
+  ul_hapi int ulfd_residency(ulfd_t fd, ulfd_int64_t off, size_t len, unsigned char* vec) {
+    (void)fd; (void)off; (void)len; (void)vec;
+    return ENOSYS;
+  }
 
   ul_hapi size_t ulfd_pagesize(void) {
     SYSTEM_INFO info;
     GetSystemInfo(&info);
     return info.dwPageSize;
   }
+  ul_hapi size_t ulfd_mapgranularity(void) {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwAllocationGranularity;
+  }
+  ul_hapi int ulfd_mremap(void** pmap, size_t old_len, size_t new_len) {
+    (void)pmap; (void)old_len; (void)new_len;
+    return ENOSYS;
+  }
   ul_hapi int ulfd_tmpdir_alloc_w(wchar_t** pwpath) {
     DWORD len, writen;
     wchar_t* wpath;
@@ -3194,12 +4514,21 @@ ul_hapi int ulfd_copy_file_range_allowuser(
   }
 
 
+  ul_hapi HANDLE _ulfd_find_first(const wchar_t* wpath, WIN32_FIND_DATAW* data) {
+    /* `FindExInfoBasic` (skip short names) and `FIND_FIRST_EX_LARGE_FETCH` need Windows 7 */
+    HANDLE handle = FindFirstFileExW(
+      wpath, ul_static_cast(FINDEX_INFO_LEVELS, 1), data, FindExSearchNameMatch, NULL, 2
+    );
+    if(handle == INVALID_HANDLE_VALUE && GetLastError() == ERROR_INVALID_PARAMETER)
+      handle = FindFirstFileW(wpath, data);
+    return handle;
+  }
   ul_hapi int ulfd_rewinddir(ulfd_dir_t* dir) {
     char meet_dot = 0, meet_dotdot = 0;
     if(ul_likely(dir->handle != INVALID_HANDLE_VALUE)) FindClose(dir->handle);
 
     dir->cached = 1;
-    dir->handle = FindFirstFileW(dir->dirpath, &dir->data);
+    dir->handle = _ulfd_find_first(dir->dirpath, &dir->data);
     if(dir->handle == INVALID_HANDLE_VALUE) {
       DWORD error = GetLastError();
       return _ul_win32_toerrno(error);
@@ -3228,6 +4557,7 @@ ul_hapi int ulfd_copy_file_range_allowuser(
     dir->entry = NULL;
     dir->entry_cap = 0;
     dir->handle = INVALID_HANDLE_VALUE;
+    dir->dirhandle = INVALID_HANDLE_VALUE;
 
     len = ul_os_str_to_wstr_len(path);
     if(ul_unlikely(len == 0)) return EILSEQ;
@@ -3257,6 +4587,7 @@ ul_hapi int ulfd_copy_file_range_allowuser(
     dir->entry = NULL;
     dir->entry_cap = 0;
     dir->handle = INVALID_HANDLE_VALUE;
+    dir->dirhandle = INVALID_HANDLE_VALUE;
 
     len = ulfd_wcslen(wpath);
     if(ul_unlikely(len == 0)) return ENOENT;
@@ -3279,6 +4610,7 @@ ul_hapi int ulfd_copy_file_range_allowuser(
   ul_hapi int ulfd_closedir(ulfd_dir_t* dir) {
     if(ul_likely(dir->dirpath)) ul_free(dir->dirpath);
     if(dir->entry) ul_free(dir->entry);
+    if(dir->dirhandle != INVALID_HANDLE_VALUE) CloseHandle(dir->dirhandle);
     if(ul_unlikely(dir->handle == INVALID_HANDLE_VALUE)) return 0;
     return FindClose(dir->handle) ? 0 : _ul_win32_toerrno(GetLastError());
   }
@@ -3322,15 +4654,690 @@ ul_hapi int ulfd_copy_file_range_allowuser(
     *pwname = dir->data.cFileName;
     return 0;
   }
+  ul_hapi ulfd_mode_t _ulfd_find_data_type(const WIN32_FIND_DATAW* data) {
+    if((data->dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) && data->dwReserved0 == IO_REPARSE_TAG_SYMLINK)
+      return ULFD_S_IFLNK;
+    return (data->dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) ? ULFD_S_IFDIR : ULFD_S_IFREG;
+  }
+  ul_hapi int ulfd_readdir_batch(ulfd_dir_t* dir, void* buf, size_t len, size_t* pused) {
+    size_t used = 0, cast_len, reclen;
+    ulfd_dirent_t* ent;
 
+    if(ul_unlikely(dir->handle == INVALID_HANDLE_VALUE)) return EBADF;
+    for(;;) {
+      if(dir->cached) dir->cached = 0;
+      else if(FindNextFileW(dir->handle, &dir->data) == FALSE) {
+        DWORD error = GetLastError();
+        if(ul_likely(error == ERROR_NO_MORE_FILES) || used) break;
+        return _ul_win32_toerrno(error);
+      }
 
-  ul_hapi int _ulfd_space(ulfd_spaceinfo_t* info, const wchar_t* wpath) {
-    ULARGE_INTEGER avail, total, free;
-    if(!GetDiskFreeSpaceExW(wpath, &avail, &total, &free)) return _ul_win32_toerrno(GetLastError());
-    info->available = ul_static_cast(ulfd_uint64_t, avail.QuadPart);
-    info->capacity = ul_static_cast(ulfd_uint64_t, total.QuadPart);
-    info->free = ul_static_cast(ulfd_uint64_t, free.QuadPart);
-    return 0;
+      cast_len = ul_os_wstr_to_str_len(dir->data.cFileName);
+      if(ul_unlikely(cast_len == 0)) { dir->cached = 1; return EILSEQ; }
+      reclen = _ulfd_dirent_reclen(cast_len - 1);
+      if(reclen > len - used) {
+        dir->cached = 1;
+        if(used == 0) return EINVAL;
+        break;
+      }
+
+      ent = ul_reinterpret_cast(ulfd_dirent_t*, ul_reinterpret_cast(char*, buf) + used);
+      ul_os_wstr_to_str(ent->name, dir->data.cFileName);
+      ent->ino = 0;
+      ent->type = _ulfd_find_data_type(&dir->data);
+      ent->reclen = ul_static_cast(unsigned short, reclen);
+      ent->namelen = ul_static_cast(unsigned short, cast_len - 1);
+      used += reclen;
+    }
+    *pused = used;
+    return 0;
+  }
+
+  ul_hapi int ulfd_dirfd(ulfd_dir_t* dir, ulfd_t* pfd) {
+    if(dir->dirhandle == INVALID_HANDLE_VALUE) {
+      size_t len = ulfd_wcslen(dir->dirpath);
+      HANDLE handle;
+      dir->dirpath[len - 1] = 0; /* drop the trailing L'*' */
+      handle = CreateFileW(dir->dirpath, FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL);
+      dir->dirpath[len - 1] = L'*';
+      if(handle == INVALID_HANDLE_VALUE) return _ul_win32_toerrno(GetLastError());
+      dir->dirhandle = handle;
+    }
+    *pfd = dir->dirhandle;
+    return 0;
+  }
+
+  /* `*pjoined` is NULL if `wpath` can be used as is */
+  ul_hapi int _ulfd_at_join_w(ulfd_t dirfd, const wchar_t* wpath, wchar_t** pjoined) {
+    wchar_t* dirpath, *joined, *p;
+    size_t dirlen, len, i;
+    int err;
+
+    *pjoined = NULL;
+    if(dirfd == ULFD_AT_FDCWD || _ulfd_is_slash(wpath[0]) || (wpath[0] && wpath[1] == L':')) return 0;
+    err = _ulfd_get_path_from_handle(dirfd, &dirpath);
+    if(err) return err;
+    p = dirpath;
+    /* drop L"\\?\" before a drive letter, so ".." in `wpath` is still resolved */
+    if(p[0] == L'\\' && p[1] == L'\\' && p[2] == L'?' && p[3] == L'\\' && p[4] && p[5] == L':') p += 4;
+    dirlen = ulfd_wcslen(p);
+    len = ulfd_wcslen(wpath);
+    joined = ul_reinterpret_cast(wchar_t*, ul_malloc((dirlen + len + 2) * sizeof(wchar_t)));
+    if(ul_unlikely(joined == NULL)) { ul_free(dirpath); return ENOMEM; }
+    memcpy(joined, p, dirlen * sizeof(wchar_t));
+    ul_free(dirpath);
+    if(dirlen && !_ulfd_is_slash(joined[dirlen - 1])) joined[dirlen++] = L'\\';
+    for(i = 0; i <= len; ++i) joined[dirlen + i] = wpath[i] == L'/' ? L'\\' : wpath[i];
+    *pjoined = joined;
+    return 0;
+  }
+  ul_hapi int ulfd_openat_w(ulfd_t* pfd, ulfd_t dirfd, const wchar_t* wpath, ulfd_int32_t oflag, ulfd_mode_t mode) {
+    wchar_t* joined;
+    int ret = _ulfd_at_join_w(dirfd, wpath, &joined);
+    if(ret) return ret;
+    ret = ulfd_open_w(pfd, joined ? joined : wpath, oflag, mode);
+    if(joined) ul_free(joined);
+    return ret;
+  }
+  ul_hapi int ulfd_openat(ulfd_t* pfd, ulfd_t dirfd, const char* path, ulfd_int32_t oflag, ulfd_mode_t mode) {
+    int ret;
+    _ulfd_begin_to_wstr(wpath, path);
+    ret = ulfd_openat_w(pfd, dirfd, wpath, oflag, mode);
+    _ulfd_end_to_wstr(wpath);
+    return ret;
+  }
+  ul_hapi int ulfd_fstatat_w(ulfd_t dirfd, const wchar_t* wpath, ulfd_stat_t* state, int flags) {
+    wchar_t* joined;
+    int ret;
+    if((flags & ULFD_AT_EMPTY_PATH) && wpath[0] == 0) {
+      if(dirfd != ULFD_AT_FDCWD) return ulfd_fstat(dirfd, state);
+      wpath = L".";
+    }
+    ret = _ulfd_at_join_w(dirfd, wpath, &joined);
+    if(ret) return ret;
+    if(flags & ULFD_AT_SYMLINK_NOFOLLOW) ret = ulfd_lstat_w(joined ? joined : wpath, state);
+    else ret = ulfd_stat_w(joined ? joined : wpath, state);
+    if(joined) ul_free(joined);
+    return ret;
+  }
+  ul_hapi int ulfd_fstatat(ulfd_t dirfd, const char* path, ulfd_stat_t* state, int flags) {
+    int ret;
+    _ulfd_begin_to_wstr(wpath, path);
+    ret = ulfd_fstatat_w(dirfd, wpath, state, flags);
+    _ulfd_end_to_wstr(wpath);
+    return ret;
+  }
+
+  ul_hapi ulfd_mode_t _ulfd_attr_type(DWORD attr) {
+    if(attr & FILE_ATTRIBUTE_REPARSE_POINT) return ULFD_S_IFLNK;
+    return (attr & FILE_ATTRIBUTE_DIRECTORY) ? ULFD_S_IFDIR : ULFD_S_IFREG;
+  }
+  ul_hapi ulfd_int64_t _ulfd_large_time_to_time_t(LARGE_INTEGER large_time, ulfd_int64_t fallback) {
+    FILETIME file_time;
+    file_time.dwLowDateTime = large_time.LowPart;
+    file_time.dwHighDateTime = ul_static_cast(DWORD, large_time.HighPart);
+    return _ulfd_filetime_to_time_t(file_time, fallback);
+  }
+  #define _ULFD_STATX_BY_HANDLE \
+    (ULFD_STATX_TYPE | ULFD_STATX_NLINK | ULFD_STATX_ATIME | ULFD_STATX_MTIME | ULFD_STATX_CTIME | ULFD_STATX_SIZE)
+  #define _ULFD_STATX_BY_ATTRIBUTES \
+    (ULFD_STATX_TYPE | ULFD_STATX_MODE | ULFD_STATX_ATIME | ULFD_STATX_MTIME | ULFD_STATX_CTIME | ULFD_STATX_SIZE)
+  ul_hapi int _ulfd_statx_handle(ulfd_t fd, unsigned mask, ulfd_stat_t* state, unsigned* pmask) {
+    _ulfd_GetFileInformationByHandleEx_t sysfunc = _ulfd_get_GetFileInformationByHandleEx();
+    _ulfd_file_basic_info_t basic;
+    _ulfd_file_standard_info_t standard;
+    unsigned got = 0;
+
+    if(sysfunc == NULL || (mask & ~_ULFD_STATX_BY_HANDLE)
+      || (GetFileType(fd) & ul_static_cast(DWORD, ~FILE_TYPE_REMOTE)) != FILE_TYPE_DISK
+    ) {
+      int ret = ulfd_fstat(fd, state);
+      if(ret == 0 && pmask) *pmask = ULFD_STATX_ALL;
+      return ret;
+    }
+    memset(state, 0, sizeof(*state));
+    if(mask & (ULFD_STATX_TYPE | ULFD_STATX_ATIME | ULFD_STATX_MTIME | ULFD_STATX_CTIME)) {
+      if(!sysfunc(fd, _ULFD_FileBasicInfo, &basic, sizeof(basic))) return _ul_win32_toerrno(GetLastError());
+      state->mode = _ulfd_attr_type(basic.FileAttributes);
+      state->mtime = _ulfd_large_time_to_time_t(basic.LastWriteTime, 0);
+      state->atime = _ulfd_large_time_to_time_t(basic.LastAccessTime, state->mtime);
+      state->ctime = _ulfd_large_time_to_time_t(basic.CreationTime, state->mtime);
+      got |= ULFD_STATX_TYPE | ULFD_STATX_ATIME | ULFD_STATX_MTIME | ULFD_STATX_CTIME;
+    }
+    if(mask & (ULFD_STATX_NLINK | ULFD_STATX_SIZE)) {
+      if(!sysfunc(fd, _ULFD_FileStandardInfo, &standard, sizeof(standard))) return _ul_win32_toerrno(GetLastError());
+      state->nlink = ul_static_cast(ulfd_nlink_t, standard.NumberOfLinks);
+      state->size = ul_static_cast(ulfd_int64_t, standard.EndOfFile.QuadPart);
+      got |= ULFD_STATX_NLINK | ULFD_STATX_SIZE;
+    }
+    if(pmask) *pmask = got;
+    return 0;
+  }
+  ul_hapi int ulfd_statx_w(ulfd_t dirfd, const wchar_t* wpath, int flags, unsigned mask, ulfd_stat_t* state, unsigned* pmask) {
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    const wchar_t* target;
+    wchar_t* joined;
+    int ret;
+
+    if((flags & ULFD_AT_EMPTY_PATH) && wpath[0] == 0) {
+      if(dirfd != ULFD_AT_FDCWD) return _ulfd_statx_handle(dirfd, mask, state, pmask);
+      wpath = L".";
+    }
+    ret = _ulfd_at_join_w(dirfd, wpath, &joined);
+    if(ret) return ret;
+    target = joined ? joined : wpath;
+
+    /* the attributes come from the directory entry, so the file isn't opened;
+      a reparse point has to be opened to be followed */
+    if(!(mask & ~_ULFD_STATX_BY_ATTRIBUTES) && !_ulfd_is_root_or_empty(target)
+      && GetFileAttributesExW(target, GetFileExInfoStandard, &data)
+      && (!(data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) || (flags & ULFD_AT_SYMLINK_NOFOLLOW))
+    ) {
+      memset(state, 0, sizeof(*state));
+      if(mask & ULFD_STATX_MODE) state->mode = _ulfd_stat_mode_cast(data.dwFileAttributes, target);
+      else state->mode = _ulfd_attr_type(data.dwFileAttributes);
+      state->mtime = _ulfd_filetime_to_time_t(data.ftLastWriteTime, 0);
+      state->atime = _ulfd_filetime_to_time_t(data.ftLastAccessTime, state->mtime);
+      state->ctime = _ulfd_filetime_to_time_t(data.ftCreationTime, state->mtime);
+      state->size = ul_static_cast(
+        ulfd_int64_t,
+        (ul_static_cast(ULONGLONG, data.nFileSizeHigh) << 32) | data.nFileSizeLow
+      );
+      if(pmask) *pmask = (mask & ULFD_STATX_MODE) ? _ULFD_STATX_BY_ATTRIBUTES : _ULFD_STATX_BY_ATTRIBUTES & ~ULFD_STATX_MODE;
+    } else {
+      if(flags & ULFD_AT_SYMLINK_NOFOLLOW) ret = ulfd_lstat_w(target, state);
+      else ret = ulfd_stat_w(target, state);
+      if(ret == 0 && pmask) *pmask = ULFD_STATX_ALL;
+    }
+    if(joined) ul_free(joined);
+    return ret;
+  }
+  ul_hapi int ulfd_statx(ulfd_t dirfd, const char* path, int flags, unsigned mask, ulfd_stat_t* state, unsigned* pmask) {
+    int ret;
+    _ulfd_begin_to_wstr(wpath, path);
+    ret = ulfd_statx_w(dirfd, wpath, flags, mask, state, pmask);
+    _ulfd_end_to_wstr(wpath);
+    return ret;
+  }
+
+  typedef struct _ulfd_file_storage_info_t {
+    ULONG LogicalBytesPerSector;
+    ULONG PhysicalBytesPerSectorForAtomicity;
+    ULONG PhysicalBytesPerSectorForPerformance;
+    ULONG FileSystemEffectivePhysicalBytesPerSectorForAtomicity;
+    ULONG Flags;
+    ULONG ByteOffsetForSectorAlignment;
+    ULONG ByteOffsetForPartitionAlignment;
+  } _ulfd_file_storage_info_t;
+  #define _ULFD_FileStorageInfo 16
+  ul_hapi int ulfd_logical_block_size(ulfd_t fd, size_t* psize) {
+    _ulfd_GetFileInformationByHandleEx_t sysfunc = _ulfd_get_GetFileInformationByHandleEx();
+    _ulfd_file_storage_info_t info;
+    /* `FileStorageInfo` needs Windows 8, otherwise assume 4096 that suits any common sector size */
+    if(sysfunc && sysfunc(fd, _ULFD_FileStorageInfo, &info, sizeof(info)) && info.LogicalBytesPerSector) {
+      *psize = info.LogicalBytesPerSector;
+      return 0;
+    }
+    *psize = 4096;
+    return 0;
+  }
+
+  typedef BOOL (WINAPI *_ulfd_SetFileInformationByHandle_t)(
+    HANDLE hFile, int FileInformationClass, LPVOID lpFileInformation, DWORD dwBufferSize
+  );
+  #ifdef ULFD_WIN32_HAS_SetFileInformationByHandle
+    ul_hapi _ulfd_SetFileInformationByHandle_t _ulfd_get_SetFileInformationByHandle(void) {
+      return _ULFD_POINTER_TO_FUNCTION(_ulfd_SetFileInformationByHandle_t, SetFileInformationByHandle);
+    }
+  #else
+    ul_hapi _ulfd_SetFileInformationByHandle_t _ulfd_get_SetFileInformationByHandle(void) {
+      static HANDLE hold = NULL;
+      return _ULFD_POINTER_TO_FUNCTION(_ulfd_SetFileInformationByHandle_t,
+        _ulfd_kernel32_function(&hold, "SetFileInformationByHandle"));
+    }
+  #endif
+  #define _ULFD_FileAllocationInfo 5
+  #define _ULFD_FileEndOfFileInfo 6
+  /* winioctl.h is left out by `WIN32_LEAN_AND_MEAN` */
+  #define _ULFD_FSCTL_SET_SPARSE             0x000900C4
+  #define _ULFD_FSCTL_SET_ZERO_DATA          0x000980C8
+  #define _ULFD_FSCTL_QUERY_ALLOCATED_RANGES 0x000940CF
+
+  ul_hapi int ulfd_fallocate(ulfd_t fd, int flags, ulfd_int64_t off, ulfd_int64_t len) {
+    _ulfd_GetFileInformationByHandleEx_t getinfo = _ulfd_get_GetFileInformationByHandleEx();
+    _ulfd_SetFileInformationByHandle_t setinfo = _ulfd_get_SetFileInformationByHandle();
+    _ulfd_file_standard_info_t standard;
+    LARGE_INTEGER size;
+    ulfd_int64_t length;
+    int err = _ulfd_range_check(off, len);
+    if(err) return err;
+
+    if(getinfo == NULL || setinfo == NULL) {
+      if(flags & ULFD_FALLOC_KEEP_SIZE) return ENOSYS;
+      err = ulfd_ffilelength(fd, &length);
+      if(err) return err;
+      return length < off + len ? ulfd_ftruncate(fd, off + len) : 0;
+    }
+    if(!getinfo(fd, _ULFD_FileStandardInfo, &standard, sizeof(standard)))
+      return _ul_win32_toerrno(GetLastError());
+    /* an allocation size below the end of file truncates it, so only grow it */
+    if(standard.AllocationSize.QuadPart < off + len) {
+      size.QuadPart = off + len;
+      if(!setinfo(fd, _ULFD_FileAllocationInfo, &size, sizeof(size)))
+        return _ul_win32_toerrno(GetLastError());
+    }
+    if(!(flags & ULFD_FALLOC_KEEP_SIZE) && standard.EndOfFile.QuadPart < off + len) {
+      size.QuadPart = off + len;
+      if(!setinfo(fd, _ULFD_FileEndOfFileInfo, &size, sizeof(size)))
+        return _ul_win32_toerrno(GetLastError());
+    }
+    return 0;
+  }
+  ul_hapi int _ulfd_fsctl_errno(void) {
+    DWORD code = GetLastError();
+    /* FAT and network shares without sparse files */
+    if(code == ERROR_INVALID_FUNCTION || code == ERROR_NOT_SUPPORTED) return EOPNOTSUPP;
+    return _ul_win32_toerrno(code);
+  }
+  ul_hapi int _ulfd_set_zero_data(ulfd_t fd, ulfd_int64_t off, ulfd_int64_t len) {
+    ulfd_int64_t zero[2]; /* `FILE_ZERO_DATA_INFORMATION` */
+    DWORD bytes;
+    zero[0] = off;
+    zero[1] = off + len;
+    if(!DeviceIoControl(fd, _ULFD_FSCTL_SET_ZERO_DATA, zero, sizeof(zero), NULL, 0, &bytes, NULL))
+      return _ulfd_fsctl_errno();
+    return 0;
+  }
+  ul_hapi int ulfd_punch_hole(ulfd_t fd, ulfd_int64_t off, ulfd_int64_t len) {
+    DWORD bytes;
+    int err = _ulfd_range_check(off, len);
+    if(err) return err;
+    /* zeroing only deallocates the blocks of sparse files */
+    if(!DeviceIoControl(fd, _ULFD_FSCTL_SET_SPARSE, NULL, 0, NULL, 0, &bytes, NULL))
+      return _ulfd_fsctl_errno();
+    return _ulfd_set_zero_data(fd, off, len);
+  }
+  ul_hapi int ulfd_zero_range(ulfd_t fd, ulfd_int64_t off, ulfd_int64_t len, int flags) {
+    ulfd_int64_t length;
+    int err = _ulfd_range_check(off, len);
+    if(err) return err;
+    err = _ulfd_set_zero_data(fd, off, len);
+    if(err == EOPNOTSUPP) return _ulfd_zero_range_user(fd, off, len, flags);
+    if(err || (flags & ULFD_FALLOC_KEEP_SIZE)) return err;
+    /* `FSCTL_SET_ZERO_DATA` never extends the file */
+    err = ulfd_ffilelength(fd, &length);
+    if(err) return err;
+    return length < off + len ? ulfd_ftruncate(fd, off + len) : 0;
+  }
+
+  ul_hapi int ulfd_extent_begin(ulfd_extent_iter_t* it, ulfd_t fd, ulfd_int64_t off, ulfd_int64_t len) {
+    ulfd_int64_t length;
+    int err;
+    if(off < 0 || len < 0) return EINVAL;
+    err = ulfd_ffilelength(fd, &length);
+    if(err) return err;
+    it->fd = fd;
+    it->off = off;
+    if(off >= length) it->end = off;
+    else it->end = (len == 0 || len > length - off) ? length : off + len;
+    it->count = it->index = 0;
+    return 0;
+  }
+  ul_hapi int ulfd_extent_next(ulfd_extent_iter_t* it, ulfd_int64_t* poff, ulfd_int64_t* plen) {
+    ulfd_int64_t query[2]; /* `FILE_ALLOCATED_RANGE_BUFFER` */
+    ulfd_int64_t data, hole;
+    DWORD bytes, code;
+
+    if(it->index == it->count) {
+      it->index = it->count = 0;
+      if(it->off < it->end) {
+        query[0] = it->off;
+        query[1] = it->end - it->off;
+        /* with ERROR_MORE_DATA the filled part is still valid, the rest is queried from the last range */
+        if(DeviceIoControl(it->fd, _ULFD_FSCTL_QUERY_ALLOCATED_RANGES,
+            query, sizeof(query), it->ranges, sizeof(it->ranges), &bytes, NULL)
+          || GetLastError() == ERROR_MORE_DATA
+        ) it->count = ul_static_cast(unsigned, bytes / (2 * sizeof(ulfd_int64_t)));
+        else {
+          code = GetLastError();
+          if(code != ERROR_INVALID_FUNCTION && code != ERROR_NOT_SUPPORTED) return _ul_win32_toerrno(code);
+          /* no sparse files on this file system, all is data */
+          it->ranges[0] = it->off;
+          it->ranges[1] = it->end - it->off;
+          it->count = 1;
+        }
+      }
+      if(it->count == 0) { it->off = it->end; *poff = it->end; *plen = 0; return 0; }
+    }
+
+    data = it->ranges[2 * it->index];
+    hole = data + it->ranges[2 * it->index + 1];
+    ++it->index;
+    if(data < it->off) data = it->off;
+    if(hole > it->end) hole = it->end;
+    it->off = hole;
+    *poff = data;
+    *plen = hole - data;
+    return 0;
+  }
+  ul_hapi int ulfd_extent_end(ulfd_extent_iter_t* it) {
+    (void)it;
+    return 0;
+  }
+
+  typedef struct _ulfd_duplicate_extents_data_t {
+    HANDLE FileHandle;
+    LARGE_INTEGER SourceFileOffset;
+    LARGE_INTEGER TargetFileOffset;
+    LARGE_INTEGER ByteCount;
+  } _ulfd_duplicate_extents_data_t;
+  #define _ULFD_FSCTL_DUPLICATE_EXTENTS_TO_FILE 0x00098344
+  #define _ULFD_CLONE_ALIGN 65536 /* the largest ReFS cluster */
+  ul_hapi int ulfd_clone_range(ulfd_t fd_in, ulfd_int64_t off_in, ulfd_t fd_out, ulfd_int64_t off_out, ulfd_int64_t len) {
+    _ulfd_duplicate_extents_data_t data;
+    ulfd_int64_t length, out_length;
+    DWORD bytes;
+    int err;
+
+    if(off_in < 0 || off_out < 0 || len < 0) return EINVAL;
+    err = ulfd_ffilelength(fd_in, &length);
+    if(err) return err;
+    if(len == 0 || len > length - off_in) len = length > off_in ? length - off_in : 0;
+    if(len == 0) return 0;
+    /* the target range must be inside the file already */
+    err = ulfd_ffilelength(fd_out, &out_length);
+    if(err) return err;
+    if(out_length < off_out + len) {
+      err = ulfd_ftruncate(fd_out, off_out + len);
+      if(err) return err;
+    }
+
+    data.FileHandle = fd_in;
+    data.SourceFileOffset.QuadPart = off_in;
+    data.TargetFileOffset.QuadPart = off_out;
+    data.ByteCount.QuadPart = len;
+    /* a range ending at the end of `fd_in` clones the whole last cluster */
+    if(off_in + len == length)
+      data.ByteCount.QuadPart = (len + _ULFD_CLONE_ALIGN - 1) & ~ul_static_cast(ulfd_int64_t, _ULFD_CLONE_ALIGN - 1);
+    if(!DeviceIoControl(fd_out, _ULFD_FSCTL_DUPLICATE_EXTENTS_TO_FILE,
+      &data, sizeof(data), NULL, 0, &bytes, NULL)
+    ) return _ulfd_fsctl_errno();
+    return 0;
+  }
+  ul_hapi int ulfd_clone_file(ulfd_t fd_in, ulfd_t fd_out) {
+    ulfd_int64_t length;
+    int err = ulfd_ffilelength(fd_in, &length);
+    if(err) return err;
+    err = ulfd_ftruncate(fd_out, length);
+    if(err || length == 0) return err;
+    return ulfd_clone_range(fd_in, 0, fd_out, 0, length);
+  }
+  ul_hapi int ulfd_copy_file_w(const wchar_t* newpath, const wchar_t* oldpath, int flags) {
+    ulfd_t fd_in, fd_out;
+    int err;
+
+    /* `CopyFileW` always copies attributes and times */
+    if(!(flags & ULFD_COPY_NOATTR)) {
+      if(CopyFileW(oldpath, newpath, (flags & ULFD_COPY_NOREPLACE) ? TRUE : FALSE)) return 0;
+      return _ul_win32_toerrno(GetLastError());
+    }
+    err = ulfd_open_w(&fd_in, oldpath, ULFD_O_RDONLY, 0);
+    if(err) return err;
+    err = ulfd_open_w(&fd_out, newpath,
+      ULFD_O_WRONLY | ULFD_O_CREAT | ((flags & ULFD_COPY_NOREPLACE) ? ULFD_O_EXCL : ULFD_O_TRUNC), 0666);
+    if(err) { ulfd_close(fd_in); return err; }
+    err = ulfd_copy_fd(fd_in, fd_out, flags);
+    ulfd_close(fd_in);
+    if(ulfd_close(fd_out) && err == 0) err = EIO;
+    if(err) ulfd_unlink_w(newpath);
+    return err;
+  }
+  ul_hapi int ulfd_copy_file(const char* newpath, const char* oldpath, int flags) {
+    int ret;
+    _ulfd_begin_to_wstr(_newpath, newpath);
+    _ulfd_begin_to_wstr2(_oldpath, oldpath, _newpath);
+    ret = ulfd_copy_file_w(_newpath, _oldpath, flags);
+    _ulfd_end_to_wstr2(_oldpath);
+    _ulfd_end_to_wstr(_newpath);
+    return ret;
+  }
+  ul_hapi int ulfd_mkdirat_w(ulfd_t dirfd, const wchar_t* wpath, ulfd_mode_t mode) {
+    wchar_t* joined;
+    int ret = _ulfd_at_join_w(dirfd, wpath, &joined);
+    if(ret) return ret;
+    ret = ulfd_mkdir_w(joined ? joined : wpath, mode);
+    if(joined) ul_free(joined);
+    return ret;
+  }
+  ul_hapi int ulfd_mkdirat(ulfd_t dirfd, const char* path, ulfd_mode_t mode) {
+    int ret;
+    _ulfd_begin_to_wstr(wpath, path);
+    ret = ulfd_mkdirat_w(dirfd, wpath, mode);
+    _ulfd_end_to_wstr(wpath);
+    return ret;
+  }
+  ul_hapi int ulfd_unlinkat_w(ulfd_t dirfd, const wchar_t* wpath, int flags) {
+    wchar_t* joined;
+    int ret = _ulfd_at_join_w(dirfd, wpath, &joined);
+    if(ret) return ret;
+    if(flags & ULFD_AT_REMOVEDIR) ret = ulfd_rmdir_w(joined ? joined : wpath);
+    else ret = ulfd_unlink_w(joined ? joined : wpath);
+    if(joined) ul_free(joined);
+    return ret;
+  }
+  ul_hapi int ulfd_unlinkat(ulfd_t dirfd, const char* path, int flags) {
+    int ret;
+    _ulfd_begin_to_wstr(wpath, path);
+    ret = ulfd_unlinkat_w(dirfd, wpath, flags);
+    _ulfd_end_to_wstr(wpath);
+    return ret;
+  }
+  /* `ulfd_rename_w` never replaces an existing file, so ULFD_RENAME_NOREPLACE needs nothing more */
+  ul_hapi int ulfd_renameat2_w(ulfd_t newdirfd, const wchar_t* newpath, ulfd_t olddirfd, const wchar_t* oldpath, int flags) {
+    wchar_t* newjoined, *oldjoined;
+    int ret;
+    if(flags & ULFD_RENAME_EXCHANGE) return ENOSYS;
+    ret = _ulfd_at_join_w(newdirfd, newpath, &newjoined);
+    if(ret) return ret;
+    ret = _ulfd_at_join_w(olddirfd, oldpath, &oldjoined);
+    if(ret) { if(newjoined) ul_free(newjoined); return ret; }
+    ret = ulfd_rename_w(newjoined ? newjoined : newpath, oldjoined ? oldjoined : oldpath);
+    if(oldjoined) ul_free(oldjoined);
+    if(newjoined) ul_free(newjoined);
+    return ret;
+  }
+  ul_hapi int ulfd_renameat2(ulfd_t newdirfd, const char* newpath, ulfd_t olddirfd, const char* oldpath, int flags) {
+    int ret;
+    _ulfd_begin_to_wstr(_newpath, newpath);
+    _ulfd_begin_to_wstr2(_oldpath, oldpath, _newpath);
+    ret = ulfd_renameat2_w(newdirfd, _newpath, olddirfd, _oldpath, flags);
+    _ulfd_end_to_wstr2(_oldpath);
+    _ulfd_end_to_wstr(_newpath);
+    return ret;
+  }
+  ul_hapi int ulfd_opendirat_w(ulfd_dir_t* dir, ulfd_t dirfd, const wchar_t* wpath) {
+    wchar_t* joined;
+    int ret = _ulfd_at_join_w(dirfd, wpath, &joined);
+    if(ret) return ret;
+    ret = ulfd_opendir_w(dir, joined ? joined : wpath);
+    if(joined) ul_free(joined);
+    return ret;
+  }
+  ul_hapi int ulfd_opendirat(ulfd_dir_t* dir, ulfd_t dirfd, const char* path) {
+    int ret;
+    _ulfd_begin_to_wstr(wpath, path);
+    ret = ulfd_opendirat_w(dir, dirfd, wpath);
+    _ulfd_end_to_wstr(wpath);
+    return ret;
+  }
+  /* `ulfd_opendirat`, but ELOOP for a reparse point (a symbolic link or a junction) */
+  ul_hapi int _ulfd_opendirat_nofollow(ulfd_dir_t* dir, ulfd_t dirfd, const char* path) {
+    wchar_t* joined;
+    DWORD attr;
+    int ret;
+    _ulfd_begin_to_wstr(wpath, path);
+    ret = _ulfd_at_join_w(dirfd, wpath, &joined);
+    if(ret == 0) {
+      attr = GetFileAttributesW(joined ? joined : wpath);
+      if(attr == INVALID_FILE_ATTRIBUTES) ret = _ul_win32_toerrno(GetLastError());
+      else if(attr & FILE_ATTRIBUTE_REPARSE_POINT) ret = ELOOP;
+      else if(!(attr & FILE_ATTRIBUTE_DIRECTORY)) ret = ENOTDIR;
+      else ret = ulfd_opendir_w(dir, joined ? joined : wpath);
+      if(joined) ul_free(joined);
+    }
+    _ulfd_end_to_wstr(wpath);
+    return ret;
+  }
+  /* `ulfd_openat`, but ELOOP for a reparse point */
+  ul_hapi int _ulfd_openat_nofollow(ulfd_t* pfd, ulfd_t dirfd, const char* path, ulfd_int32_t oflag, ulfd_mode_t mode) {
+    wchar_t* joined;
+    DWORD attr;
+    int ret;
+    _ulfd_begin_to_wstr(wpath, path);
+    ret = _ulfd_at_join_w(dirfd, wpath, &joined);
+    if(ret == 0) {
+      attr = GetFileAttributesW(joined ? joined : wpath);
+      if(attr != INVALID_FILE_ATTRIBUTES && (attr & FILE_ATTRIBUTE_REPARSE_POINT)) ret = ELOOP;
+      else ret = ulfd_open_w(pfd, joined ? joined : wpath, oflag, mode);
+      if(joined) ul_free(joined);
+    }
+    _ulfd_end_to_wstr(wpath);
+    return ret;
+  }
+  /* `ulfd_readlink_alloc` relative to `dirfd` */
+  ul_hapi int _ulfd_readlinkat_alloc(char** pbuf, ulfd_t dirfd, const char* path) {
+    wchar_t* joined, *wbuf = NULL;
+    int ret;
+    _ulfd_begin_to_wstr(wpath, path);
+    ret = _ulfd_at_join_w(dirfd, wpath, &joined);
+    if(ret == 0) {
+      ret = ulfd_readlink_alloc_w(&wbuf, joined ? joined : wpath);
+      if(joined) ul_free(joined);
+    }
+    _ulfd_end_to_wstr(wpath);
+    if(ret) return ret;
+    ret = ulfd_wstr_to_str_alloc(pbuf, wbuf);
+    ul_free(wbuf); return ret;
+  }
+  /* `ulfd_symlink` relative to `dirfd` */
+  ul_hapi int _ulfd_symlinkat(ulfd_t dirfd, const char* target, const char* source) {
+    wchar_t* joined;
+    int ret;
+    _ulfd_begin_to_wstr(w_target, target);
+    _ulfd_begin_to_wstr2(w_source, source, w_target);
+    ret = _ulfd_at_join_w(dirfd, w_target, &joined);
+    if(ret == 0) {
+      ret = ulfd_symlink_w(joined ? joined : w_target, w_source);
+      if(joined) ul_free(joined);
+    }
+    _ulfd_end_to_wstr2(w_source);
+    _ulfd_end_to_wstr(w_target);
+    return ret;
+  }
+
+  ul_hapi void _ulfd_walk_release_parent(void* parent) { (void)parent; }
+  ul_hapi int ulfd_walk_scan(
+    ulfd_walk_task_t* task, const ulfd_walk_options_t* options,
+    int (*push)(void* ctx, ulfd_walk_task_t* subtask), void* ctx
+  ) {
+    WIN32_FIND_DATAW data;
+    HANDLE handle = INVALID_HANDLE_VALUE;
+    ulfd_walk_task_t* sub;
+    ulfd_walk_entry_t entry;
+    ulfd_stat_t ustate;
+    wchar_t* wpath = NULL;
+    char* path = NULL;
+    size_t path_cap, cast_len, wlen;
+    int flags = options->flags, err = 0, ret, is_link;
+
+    err = ulfd_str_to_wstr_alloc(&wpath, task->path);
+    if(err) { err = _ulfd_walk_error(options, task->path, err); goto do_return; }
+    wlen = ulfd_wcslen(wpath);
+    {
+      wchar_t* wpath2 = ul_reinterpret_cast(wchar_t*, ul_realloc(wpath, (wlen + 3) * sizeof(wchar_t)));
+      if(ul_unlikely(wpath2 == NULL)) { err = ENOMEM; goto do_return; }
+      wpath = wpath2;
+    }
+    if(wlen && !_ulfd_is_slash(wpath[wlen - 1])) wpath[wlen++] = L'\\';
+    wpath[wlen++] = L'*'; wpath[wlen] = 0;
+    handle = _ulfd_find_first(wpath, &data);
+    if(handle == INVALID_HANDLE_VALUE) {
+      err = _ulfd_walk_error(options, task->path, _ul_win32_toerrno(GetLastError()));
+      goto do_return;
+    }
+
+    path_cap = task->pathlen + 770;
+    path = ul_reinterpret_cast(char*, ul_malloc(path_cap));
+    if(ul_unlikely(path == NULL)) { err = ENOMEM; goto do_return; }
+    memcpy(path, task->path, task->pathlen);
+    entry.path = path;
+    entry.name = path + task->pathlen;
+    if(task->pathlen && path[task->pathlen - 1] != '\\' && path[task->pathlen - 1] != '/')
+      path[task->pathlen] = '\\', ++entry.name;
+    entry.depth = task->depth + 1;
+    entry.dirfd = ULFD_AT_FDCWD;
+    entry.ino = 0;
+
+    do {
+      if(data.cFileName[0] == L'.'
+        && (data.cFileName[1] == 0 || (data.cFileName[1] == L'.' && data.cFileName[2] == 0))) continue;
+
+      cast_len = ul_os_wstr_to_str_len(data.cFileName);
+      if(ul_unlikely(cast_len == 0)) continue;
+      entry.pathlen = ul_static_cast(size_t, entry.name - path) + cast_len - 1;
+      if(entry.pathlen >= path_cap) {
+        char* path2;
+        size_t name_off = ul_static_cast(size_t, entry.name - path);
+        path_cap = entry.pathlen + 1;
+        path2 = ul_reinterpret_cast(char*, ul_realloc(path, path_cap));
+        if(ul_unlikely(path2 == NULL)) { err = ENOMEM; break; }
+        path = path2; entry.path = path; entry.name = path + name_off;
+      }
+      ul_os_wstr_to_str(ul_const_cast(char*, entry.name), data.cFileName);
+
+      /* reparse points (symbolic links and junctions) are only descended when following links */
+      is_link = (data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0;
+      entry.type = _ulfd_find_data_type(&data);
+      if((flags & ULFD_WALK_FOLLOW) && entry.type == ULFD_S_IFLNK)
+        entry.type = (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) ? ULFD_S_IFDIR : ULFD_S_IFREG;
+      entry.stat = NULL;
+      if(flags & ULFD_WALK_STAT) {
+        if(((flags & ULFD_WALK_FOLLOW) ? ulfd_stat(path, &ustate) : ulfd_lstat(path, &ustate)) == 0)
+          entry.stat = &ustate;
+      }
+
+      ret = options->callback ? options->callback(options->userdata, &entry) : ULFD_WALK_CONTINUE;
+      if(ret == ULFD_WALK_STOP) { err = ECANCELED; break; }
+      if(entry.type != ULFD_S_IFDIR || ret == ULFD_WALK_PRUNE) continue;
+      if(is_link && !(flags & ULFD_WALK_FOLLOW)) continue;
+      if(options->max_depth > 0 && entry.depth >= options->max_depth) continue;
+
+      sub = _ulfd_walk_task_new(path, ul_static_cast(size_t, entry.name - path), entry.name, cast_len - 1,
+        entry.depth, NULL, 0);
+      if(ul_unlikely(sub == NULL)) { err = ENOMEM; break; }
+      err = push(ctx, sub);
+      if(err) break;
+    } while(FindNextFileW(handle, &data));
+    if(!err && GetLastError() != ERROR_NO_MORE_FILES)
+      err = _ulfd_walk_error(options, task->path, _ul_win32_toerrno(GetLastError()));
+
+  do_return:
+    if(handle != INVALID_HANDLE_VALUE) FindClose(handle);
+    if(wpath) ul_free(wpath);
+    if(path) ul_free(path);
+    ulfd_walk_task_free(task);
+    return err;
+  }
+
+
+  ul_hapi int _ulfd_space(ulfd_spaceinfo_t* info, const wchar_t* wpath) {
+    ULARGE_INTEGER avail, total, free;
+    if(!GetDiskFreeSpaceExW(wpath, &avail, &total, &free)) return _ul_win32_toerrno(GetLastError());
+    info->available = ul_static_cast(ulfd_uint64_t, avail.QuadPart);
+    info->capacity = ul_static_cast(ulfd_uint64_t, total.QuadPart);
+    info->free = ul_static_cast(ulfd_uint64_t, free.QuadPart);
+    return 0;
   }
   ul_hapi int ulfd_space_w(ulfd_spaceinfo_t* info, const wchar_t* wpath) {
     ulfd_stat_t state;
@@ -3402,9 +5409,8 @@ ul_hapi int ulfd_copy_file_range_allowuser(
   }
 
 
-  ul_hapi int ulfd_open(ulfd_t* pfd, const char* path, ulfd_int32_t oflag, ulfd_mode_t mode) {
+  ul_hapi int _ulfd_to_oflag(ulfd_int32_t oflag, int* pflag) {
     int flag = 0;
-    int fd;
 
     if(oflag & ULFD_O_RDONLY) flag |= O_RDONLY;
     if(oflag & ULFD_O_WRONLY) flag |= O_WRONLY;
@@ -3423,16 +5429,33 @@ ul_hapi int ulfd_copy_file_range_allowuser(
 
     if(oflag & ULFD_O_NONBLOCK) flag |= O_NONBLOCK;
     if(oflag & ULFD_O_NOCTTY) flag |= O_NOCTTY;
+  #ifdef O_DIRECT
+    if(oflag & ULFD_O_DIRECT) flag |= O_DIRECT;
+  #elif !defined(F_NOCACHE)
+    if(oflag & ULFD_O_DIRECT) return EINVAL;
+  #endif
 
   #if defined(ULFD_HAS_LFS) && defined(O_LARGEFILE)
     #if !defined(_FILE_OFFSET_BITS) || _FILE_OFFSET_BITS != 64
       flag |= O_LARGEFILE;
     #endif
   #endif
+    *pflag = flag;
+    return 0;
+  }
+  ul_hapi int ulfd_open(ulfd_t* pfd, const char* path, ulfd_int32_t oflag, ulfd_mode_t mode) {
+    int flag, fd, err;
 
+    err = _ulfd_to_oflag(oflag, &flag);
+    if(ul_unlikely(err)) return err;
     fd = open(path, flag, _ulfd_to_access_mode(mode));
 
     if(fd < 0) return errno;
+  #if !defined(O_DIRECT) && defined(F_NOCACHE)
+    if((oflag & ULFD_O_DIRECT) && fcntl(fd, F_NOCACHE, 1) < 0) {
+      err = errno; close(fd); return err;
+    }
+  #endif
     if(oflag & ULFD_O_TEMPORARY) {
       if(unlink(path) < 0) {
         close(fd); return errno;
@@ -3517,40 +5540,159 @@ ul_hapi int ulfd_copy_file_range_allowuser(
   #endif
   }
 
-  ul_hapi int ulfd_seek(ulfd_t fd, ulfd_int64_t off, int origin, ulfd_int64_t* poff) {
-  #ifdef ULFD_HAS_LFS
-    off64_t new_off;
-  #else
-    off_t new_off;
-  #endif
-    int whence;
-
-    if(origin == ULFD_SEEK_CUR) whence = SEEK_CUR;
-    else if(origin == ULFD_SEEK_CUR) whence = SEEK_CUR;
-    else if(origin == ULFD_SEEK_END) whence = SEEK_END;
-    else return EINVAL;
+  #include <sys/uio.h>
+  typedef char _ulfd_iovec_size_check[sizeof(ulfd_iovec_t) == sizeof(struct iovec) ? 1 : -1];
+  #define _ulfd_to_iovec(iov) ul_reinterpret_cast(const struct iovec*, (iov))
 
-  #ifdef ULFD_HAS_LFS
-    new_off = lseek64(fd, off, whence);
-  #else
-    if(ul_static_cast(off_t, off) != off) return EOVERFLOW;
-    new_off = lseek(fd, ul_static_cast(off_t, off), whence);
-  #endif
-    if(new_off < 0) return errno;
-    *poff = new_off;
+  ul_hapi int ulfd_readv(ulfd_t fd, const ulfd_iovec_t* iov, int iovcnt, size_t* pread_bytes) {
+    ssize_t ret;
+    ret = readv(fd, _ulfd_to_iovec(iov), iovcnt);
+    if(ret < 0) return errno;
+    *pread_bytes = ul_static_cast(size_t, ret);
     return 0;
   }
-  ul_hapi int ulfd_tell(ulfd_t fd, ulfd_int64_t* poff) {
-    return ulfd_seek(fd, 0, ULFD_SEEK_END, poff);
+  ul_hapi int ulfd_writev(ulfd_t fd, const ulfd_iovec_t* iov, int iovcnt, size_t* pwriten_bytes) {
+    ssize_t ret;
+    ret = writev(fd, _ulfd_to_iovec(iov), iovcnt);
+    if(ret < 0) return errno;
+    *pwriten_bytes = ul_static_cast(size_t, ret);
+    return 0;
   }
-
-  ul_hapi int ulfd_copy_file_range(
-    ulfd_t fd_in, ulfd_int64_t* off_in, ulfd_t fd_out, ulfd_int64_t* off_out,
-    size_t len, size_t* pcopyed
-  ) {
-  #ifdef ULFD_POSIX_HAS_copy_file_range
-    off_t nin, nout;
-    off_t* pin, *pout;
+  ul_hapi int ulfd_preadv(ulfd_t fd, const ulfd_iovec_t* iov, int iovcnt, ulfd_int64_t off, size_t* pread_bytes) {
+    if(ul_unlikely(off < 0)) return EINVAL;
+  #ifdef ULFD_POSIX_HAS_preadv
+    {
+      ssize_t ret;
+    #ifdef ULFD_HAS_LFS
+      ret = preadv64(fd, _ulfd_to_iovec(iov), iovcnt, off);
+    #else
+      if(ul_static_cast(off_t, off) != off) return EOVERFLOW;
+      ret = preadv(fd, _ulfd_to_iovec(iov), iovcnt, ul_static_cast(off_t, off));
+    #endif
+      if(ret < 0) return errno;
+      *pread_bytes = ul_static_cast(size_t, ret);
+      return 0;
+    }
+  #else
+    return _ulfd_preadv_user(fd, iov, iovcnt, off, pread_bytes);
+  #endif
+  }
+  ul_hapi int ulfd_pwritev(ulfd_t fd, const ulfd_iovec_t* iov, int iovcnt, ulfd_int64_t off, size_t* pwriten_bytes) {
+    if(ul_unlikely(off < 0)) return EINVAL;
+  #ifdef ULFD_POSIX_HAS_preadv
+    {
+      ssize_t ret;
+    #ifdef ULFD_HAS_LFS
+      ret = pwritev64(fd, _ulfd_to_iovec(iov), iovcnt, off);
+    #else
+      if(ul_static_cast(off_t, off) != off) return EOVERFLOW;
+      ret = pwritev(fd, _ulfd_to_iovec(iov), iovcnt, ul_static_cast(off_t, off));
+    #endif
+      if(ret < 0) return errno;
+      *pwriten_bytes = ul_static_cast(size_t, ret);
+      return 0;
+    }
+  #else
+    return _ulfd_pwritev_user(fd, iov, iovcnt, off, pwriten_bytes);
+  #endif
+  }
+
+  #if defined(ULFD_POSIX_HAS_preadv2) && defined(RWF_HIPRI)
+  /* returns -1 if some flags are not supported by the system headers */
+  ul_hapi int _ulfd_rwf_flags(int flags) {
+    int ret = 0;
+    if(flags & ULFD_RWF_HIPRI) ret |= RWF_HIPRI;
+    if(flags & ULFD_RWF_DSYNC) ret |= RWF_DSYNC;
+    if(flags & ULFD_RWF_SYNC) ret |= RWF_SYNC;
+    if(flags & ULFD_RWF_NOWAIT) {
+    #ifdef RWF_NOWAIT
+      ret |= RWF_NOWAIT;
+    #else
+      return -1;
+    #endif
+    }
+    return ret;
+  }
+  #endif
+  ul_hapi int ulfd_preadv2(
+    ulfd_t fd, const ulfd_iovec_t* iov, int iovcnt, ulfd_int64_t off, int flags, size_t* pread_bytes
+  ) {
+    if(ul_unlikely(off < -1)) return EINVAL;
+  #if defined(ULFD_POSIX_HAS_preadv2) && defined(RWF_HIPRI)
+    {
+      int sysflags = _ulfd_rwf_flags(flags & ~(ULFD_RWF_DSYNC | ULFD_RWF_SYNC));
+      ssize_t ret;
+      if(sysflags >= 0) {
+      #ifdef ULFD_HAS_LFS
+        ret = preadv64v2(fd, _ulfd_to_iovec(iov), iovcnt, off, sysflags);
+      #else
+        if(ul_static_cast(off_t, off) != off) return EOVERFLOW;
+        ret = preadv2(fd, _ulfd_to_iovec(iov), iovcnt, ul_static_cast(off_t, off), sysflags);
+      #endif
+        if(ret >= 0) { *pread_bytes = ul_static_cast(size_t, ret); return 0; }
+        if(errno != ENOSYS && errno != EOPNOTSUPP) return errno;
+      }
+    }
+  #endif
+    return _ulfd_preadv2_user(fd, iov, iovcnt, off, flags, pread_bytes);
+  }
+  ul_hapi int ulfd_pwritev2(
+    ulfd_t fd, const ulfd_iovec_t* iov, int iovcnt, ulfd_int64_t off, int flags, size_t* pwriten_bytes
+  ) {
+    if(ul_unlikely(off < -1)) return EINVAL;
+  #if defined(ULFD_POSIX_HAS_preadv2) && defined(RWF_HIPRI)
+    {
+      int sysflags = _ulfd_rwf_flags(flags);
+      ssize_t ret;
+      if(sysflags >= 0) {
+      #ifdef ULFD_HAS_LFS
+        ret = pwritev64v2(fd, _ulfd_to_iovec(iov), iovcnt, off, sysflags);
+      #else
+        if(ul_static_cast(off_t, off) != off) return EOVERFLOW;
+        ret = pwritev2(fd, _ulfd_to_iovec(iov), iovcnt, ul_static_cast(off_t, off), sysflags);
+      #endif
+        if(ret >= 0) { *pwriten_bytes = ul_static_cast(size_t, ret); return 0; }
+        if(errno != ENOSYS && errno != EOPNOTSUPP) return errno;
+      }
+    }
+  #endif
+    return _ulfd_pwritev2_user(fd, iov, iovcnt, off, flags, pwriten_bytes);
+  }
+
+  ul_hapi int ulfd_seek(ulfd_t fd, ulfd_int64_t off, int origin, ulfd_int64_t* poff) {
+  #ifdef ULFD_HAS_LFS
+    off64_t new_off;
+  #else
+    off_t new_off;
+  #endif
+    int whence;
+
+    if(origin == ULFD_SEEK_SET) whence = SEEK_SET;
+    else if(origin == ULFD_SEEK_CUR) whence = SEEK_CUR;
+    else if(origin == ULFD_SEEK_END) whence = SEEK_END;
+    else return EINVAL;
+
+  #ifdef ULFD_HAS_LFS
+    new_off = lseek64(fd, off, whence);
+  #else
+    if(ul_static_cast(off_t, off) != off) return EOVERFLOW;
+    new_off = lseek(fd, ul_static_cast(off_t, off), whence);
+  #endif
+    if(new_off < 0) return errno;
+    *poff = new_off;
+    return 0;
+  }
+  ul_hapi int ulfd_tell(ulfd_t fd, ulfd_int64_t* poff) {
+    return ulfd_seek(fd, 0, ULFD_SEEK_CUR, poff);
+  }
+
+  ul_hapi int ulfd_copy_file_range(
+    ulfd_t fd_in, ulfd_int64_t* off_in, ulfd_t fd_out, ulfd_int64_t* off_out,
+    size_t len, size_t* pcopyed
+  ) {
+  #ifdef ULFD_POSIX_HAS_copy_file_range
+    off_t nin, nout;
+    off_t* pin, *pout;
     ssize_t copyed;
 
     if(off_in) {
@@ -3571,6 +5713,63 @@ ul_hapi int ulfd_copy_file_range_allowuser(
   #endif
   }
 
+  #ifdef ULFD_POSIX_HAS_sendfile
+    #include <sys/sendfile.h>
+  #endif
+  ul_hapi int ulfd_sendfile(ulfd_t fd_out, ulfd_t fd_in, ulfd_int64_t* off_in, size_t len, size_t* psent) {
+  #ifdef ULFD_POSIX_HAS_sendfile
+    ssize_t sent;
+    #ifdef ULFD_HAS_LFS
+      off64_t nin;
+      if(off_in) nin = *off_in;
+      sent = sendfile64(fd_out, fd_in, off_in ? &nin : NULL, len);
+    #else
+      off_t nin;
+      if(off_in) {
+        nin = ul_static_cast(off_t, *off_in);
+        if(ul_unlikely(nin != *off_in)) return EOVERFLOW;
+      }
+      sent = sendfile(fd_out, fd_in, off_in ? &nin : NULL, len);
+    #endif
+    if(sent < 0) return errno;
+    if(off_in) *off_in = nin;
+    *psent = ul_static_cast(size_t, sent); return 0;
+  #else
+    (void)fd_out; (void)fd_in; (void)off_in; (void)len; (void)psent;
+    return ENOSYS;
+  #endif
+  }
+  ul_hapi int ulfd_splice(
+    ulfd_t fd_in, ulfd_int64_t* off_in, ulfd_t fd_out, ulfd_int64_t* off_out,
+    size_t len, int flags, size_t* pspliced
+  ) {
+  #ifdef ULFD_POSIX_HAS_splice
+    loff_t nin, nout;
+    unsigned int flag = 0;
+    ssize_t spliced;
+
+    if(flags & ULFD_SPLICE_F_MOVE) flag |= SPLICE_F_MOVE;
+    if(flags & ULFD_SPLICE_F_NONBLOCK) flag |= SPLICE_F_NONBLOCK;
+    if(flags & ULFD_SPLICE_F_MORE) flag |= SPLICE_F_MORE;
+    if(off_in) nin = *off_in;
+    if(off_out) nout = *off_out;
+
+    spliced = splice(fd_in, off_in ? &nin : NULL, fd_out, off_out ? &nout : NULL, len, flag);
+    if(spliced < 0) return errno;
+    if(off_in) *off_in = nin;
+    if(off_out) *off_out = nout;
+    *pspliced = ul_static_cast(size_t, spliced); return 0;
+  #else
+    (void)fd_in; (void)off_in; (void)fd_out; (void)off_out; (void)len; (void)flags; (void)pspliced;
+    return ENOSYS;
+  #endif
+  }
+  ul_hapi size_t _ulfd_fblksize(ulfd_t fd) {
+    struct stat state;
+    if(fstat(fd, &state) < 0 || state.st_blksize <= 0) return 0;
+    return ul_static_cast(size_t, state.st_blksize);
+  }
+
   ul_hapi int ulfd_fsync(ulfd_t fd) {
   #ifdef ULFD_POSIX_HAS_fsync
     return fsync(fd) < 0 ? errno : 0;
@@ -3592,6 +5791,76 @@ ul_hapi int ulfd_copy_file_range_allowuser(
     return ulfd_fsync(fd);
   #endif
   }
+  ul_hapi int ulfd_sync_file_range(ulfd_t fd, ulfd_int64_t off, ulfd_int64_t len, int flags) {
+  #ifdef ULFD_POSIX_HAS_sync_file_range
+    unsigned flag = 0;
+    if(off < 0 || len < 0) return EINVAL;
+    if(flags & ULFD_SYNC_RANGE_WAIT_BEFORE) flag |= SYNC_FILE_RANGE_WAIT_BEFORE;
+    if(flags & ULFD_SYNC_RANGE_WRITE) flag |= SYNC_FILE_RANGE_WRITE;
+    if(flags & ULFD_SYNC_RANGE_WAIT_AFTER) flag |= SYNC_FILE_RANGE_WAIT_AFTER;
+    return sync_file_range(fd, off, len, flag) < 0 ? errno : 0;
+  #else
+    if(off < 0 || len < 0) return EINVAL;
+    return (flags & ULFD_SYNC_RANGE_WAIT_AFTER) ? ulfd_fdatasync(fd) : 0;
+  #endif
+  }
+  ul_hapi int ulfd_fadvise(ulfd_t fd, ulfd_int64_t off, ulfd_int64_t len, int advice) {
+  #ifdef ULFD_POSIX_HAS_posix_fadvise
+    int adv;
+    if(off < 0 || len < 0) return EINVAL;
+    switch(advice) {
+    case ULFD_FADV_NORMAL:     adv = POSIX_FADV_NORMAL; break;
+    case ULFD_FADV_RANDOM:     adv = POSIX_FADV_RANDOM; break;
+    case ULFD_FADV_SEQUENTIAL: adv = POSIX_FADV_SEQUENTIAL; break;
+    case ULFD_FADV_WILLNEED:   adv = POSIX_FADV_WILLNEED; break;
+    case ULFD_FADV_DONTNEED:   adv = POSIX_FADV_DONTNEED; break;
+    case ULFD_FADV_NOREUSE:    adv = POSIX_FADV_NOREUSE; break;
+    default: return EINVAL;
+    }
+    #ifdef ULFD_HAS_LFS
+      return posix_fadvise64(fd, off, len, adv);
+    #else
+      if(ul_static_cast(off_t, off) != off || ul_static_cast(off_t, len) != len) return EOVERFLOW;
+      return posix_fadvise(fd, ul_static_cast(off_t, off), ul_static_cast(off_t, len), adv);
+    #endif
+  #elif defined(__APPLE__) && defined(F_RDADVISE)
+    struct radvisory ra;
+    if(off < 0 || len < 0) return EINVAL;
+    switch(advice) {
+    case ULFD_FADV_NORMAL:
+    case ULFD_FADV_SEQUENTIAL: return fcntl(fd, F_RDAHEAD, 1) < 0 ? errno : 0;
+    case ULFD_FADV_RANDOM:     return fcntl(fd, F_RDAHEAD, 0) < 0 ? errno : 0;
+    case ULFD_FADV_WILLNEED:
+      ra.ra_offset = ul_static_cast(off_t, off);
+      ra.ra_count = len == 0 || len > 0x7FFFFFFF ? 0x7FFFFFFF : ul_static_cast(int, len);
+      return fcntl(fd, F_RDADVISE, &ra) < 0 ? errno : 0;
+    case ULFD_FADV_DONTNEED:
+    case ULFD_FADV_NOREUSE:    return ENOSYS;
+    default: return EINVAL;
+    }
+  #else
+    (void)fd; (void)off; (void)len; (void)advice;
+    return ENOSYS;
+  #endif
+  }
+  ul_hapi int ulfd_readahead(ulfd_t fd, ulfd_int64_t off, ulfd_int64_t len) {
+  #ifdef ULFD_POSIX_HAS_readahead
+    ulfd_int64_t length;
+    int err;
+    if(off < 0 || len < 0) return EINVAL;
+    /* `readahead` has no "to the end of the file" */
+    if(len == 0) {
+      err = ulfd_ffilelength(fd, &length);
+      if(err) return err;
+      if(length <= off) return 0;
+      len = length - off;
+    }
+    if(ul_static_cast(ulfd_int64_t, ul_static_cast(size_t, len)) != len) len = ul_static_cast(ulfd_int64_t, ~ul_static_cast(size_t, 0) >> 1);
+    return readahead(fd, off, ul_static_cast(size_t, len)) < 0 ? errno : 0;
+  #else
+    return ulfd_fadvise(fd, off, len, ULFD_FADV_WILLNEED);
+  #endif
+  }
 
   ul_hapi int ulfd_lock(ulfd_t fd, ulfd_int64_t off, ulfd_int64_t len, int mode) {
   #ifdef ULFD_HAS_LFS
@@ -3641,6 +5910,37 @@ ul_hapi int ulfd_copy_file_range_allowuser(
     return fcntl(fd, F_SETLKW, &lock) < 0 ? errno : 0;
   #endif
   }
+  ul_hapi int _ulfd_ofd_lock(ulfd_t fd, ulfd_int64_t off, ulfd_int64_t len, int mode, int wait) {
+  #ifdef ULFD_POSIX_HAS_ofd_lock
+    #ifdef ULFD_HAS_LFS
+      struct flock64 lock;
+      lock.l_len = len;
+      lock.l_start = off;
+    #else
+      struct flock lock;
+      if(ul_static_cast(off_t, len) != len) return EOVERFLOW;
+      lock.l_len = ul_static_cast(off_t, len);
+      if(ul_static_cast(off_t, off) != off) return EOVERFLOW;
+      lock.l_start = ul_static_cast(off_t, off);
+    #endif
+    lock.l_whence = SEEK_SET;
+    lock.l_pid = 0; /* required by OFD locks */
+    if(mode == ULFD_F_RDLCK) lock.l_type = F_RDLCK;
+    else if(mode == ULFD_F_WRLCK) lock.l_type = F_WRLCK;
+    else if(mode == ULFD_F_UNLCK) lock.l_type = F_UNLCK;
+    else return EINVAL;
+    return fcntl(fd, wait ? F_OFD_SETLKW : F_OFD_SETLK, &lock) < 0 ? errno : 0;
+  #else
+    (void)fd; (void)off; (void)len; (void)mode; (void)wait;
+    return ENOSYS;
+  #endif
+  }
+  ul_hapi int ulfd_ofd_lock(ulfd_t fd, ulfd_int64_t off, ulfd_int64_t len, int mode) {
+    return _ulfd_ofd_lock(fd, off, len, mode, 0);
+  }
+  ul_hapi int ulfd_ofd_lockw(ulfd_t fd, ulfd_int64_t off, ulfd_int64_t len, int mode) {
+    return _ulfd_ofd_lock(fd, off, len, mode, 1);
+  }
 
   ul_hapi int ulfd_ftruncate(ulfd_t fd, ulfd_int64_t length) {
   #ifdef ULFD_POSIX_HAS_ftruncate
@@ -3689,12 +5989,19 @@ ul_hapi int ulfd_copy_file_range_allowuser(
   }
   #include <sys/time.h>
   ul_hapi int ulfd_futime(ulfd_t fd, ulfd_int64_t atime, ulfd_int64_t mtime) {
-  #ifdef ULFD_POSIX_HAS_futimes
+  #if defined(ULFD_POSIX_HAS_utimensat)
+    struct timespec tv[2];
+    tv[0].tv_sec = ul_static_cast(time_t, atime / 1000);
+    tv[0].tv_nsec = ul_static_cast(long, (atime % 1000) * 1000000);
+    tv[1].tv_sec = ul_static_cast(time_t, mtime / 1000);
+    tv[1].tv_nsec = ul_static_cast(long, (mtime % 1000) * 1000000);
+    return futimens(fd, tv) < 0 ? errno : 0;
+  #elif defined(ULFD_POSIX_HAS_futimes)
     struct timeval tv[2];
     tv[0].tv_sec = ul_static_cast(time_t, atime / 1000);
-    tv[0].tv_usec = ul_static_cast(suseconds_t, (atime % 1000) * 1000000);
+    tv[0].tv_usec = ul_static_cast(suseconds_t, (atime % 1000) * 1000);
     tv[1].tv_sec = ul_static_cast(time_t, mtime / 1000);
-    tv[1].tv_usec = ul_static_cast(suseconds_t, (mtime % 1000) * 1000000);
+    tv[1].tv_usec = ul_static_cast(suseconds_t, (mtime % 1000) * 1000);
     return futimes(fd, tv) < 0 ? errno : 0;
   #else
     (void)fd; (void)atime; (void)mtime;
@@ -3870,10 +6177,56 @@ ul_hapi int ulfd_copy_file_range_allowuser(
     return ENOSYS;
   #endif
   }
+  #ifdef __linux__
+    typedef unsigned char* _ulfd_mincore_vec_t;
+  #else
+    typedef char* _ulfd_mincore_vec_t;
+  #endif
+  /* mapped in chunks to keep the address space usage bounded */
+  #define _ULFD_RESIDENCY_CHUNK (ul_static_cast(size_t, 1) << 28)
+  ul_hapi int ulfd_residency(ulfd_t fd, ulfd_int64_t off, size_t len, unsigned char* vec) {
+  #ifdef ULFD_POSIX_HAS_mincore
+    size_t page = ulfd_pagesize(), chunk, pages, i;
+    void* map;
+    int err;
+
+    if(off < 0 || (ul_static_cast(size_t, off) & (page - 1))) return EINVAL;
+    while(len) {
+      chunk = len < _ULFD_RESIDENCY_CHUNK ? len : _ULFD_RESIDENCY_CHUNK;
+      err = ulfd_mmap(&map, fd, NULL, chunk, off, ULFD_PROT_READ | ULFD_MAP_SHARED);
+      if(err) return err;
+      err = mincore(ul_reinterpret_cast(char*, map), chunk, ul_reinterpret_cast(_ulfd_mincore_vec_t, vec)) < 0 ? errno : 0;
+      ulfd_munmap(map, chunk);
+      if(err) return err;
+      pages = (chunk + page - 1) / page;
+      for(i = 0; i < pages; ++i) vec[i] &= 1;
+      vec += pages;
+      off += ul_static_cast(ulfd_int64_t, chunk);
+      len -= chunk;
+    }
+    return 0;
+  #else
+    (void)fd; (void)off; (void)len; (void)vec;
+    return ENOSYS;
+  #endif
+  }
 
   ul_hapi size_t ulfd_pagesize(void) {
     return ul_static_cast(size_t, sysconf(_SC_PAGESIZE));
   }
+  ul_hapi size_t ulfd_mapgranularity(void) {
+    return ulfd_pagesize();
+  }
+  ul_hapi int ulfd_mremap(void** pmap, size_t old_len, size_t new_len) {
+  #if defined(ULFD_POSIX_HAS_mremap) && defined(MREMAP_MAYMOVE)
+    void* map = mremap(*pmap, old_len, new_len, MREMAP_MAYMOVE);
+    if(map == MAP_FAILED) return errno;
+    *pmap = map; return 0;
+  #else
+    (void)pmap; (void)old_len; (void)new_len;
+    return ENOSYS;
+  #endif
+  }
   ul_hapi int ulfd_tmpdir_alloc(char** ppath) {
     char* s;
     if((s = getenv("TMPDIR"))) return (*ppath = ulfd_strdup(s)) == NULL ? ENOMEM : 0;
@@ -4468,10 +6821,17 @@ ul_hapi int ulfd_copy_file_range_allowuser(
     ul_os_str_to_wstr(dir->wentry, name);
     return 0;
   }
+  #ifdef DT_UNKNOWN
+    /* `DT_*` is `S_IF*` >> 12 */
+    #define _ulfd_dirent_type(dirent) (ul_static_cast(ulfd_mode_t, (dirent)->d_type) << 12)
+  #else
+    #define _ulfd_dirent_type(dirent) ul_static_cast(ulfd_mode_t, 0)
+  #endif
   ul_hapi int _ulfd_dir_skip_dot(ulfd_dir_t* dir) {
     struct dirent* dirent;
     char meet_dot = 0, meet_dotdot = 0;
     dir->cached = 0;
+    dir->batch = 0;
     for(;;) {
       dirent = readdir(dir->dir);
       if(dirent == NULL) return errno;
@@ -4482,6 +6842,8 @@ ul_hapi int ulfd_copy_file_range_allowuser(
       if(meet_dot && meet_dotdot) return 0;
     }
     dir->cached = 1;
+    dir->cached_ino = ul_static_cast(ulfd_uint64_t, dirent->d_ino);
+    dir->cached_type = _ulfd_dirent_type(dirent);
     return _ulfd_dir_store(dir, dirent->d_name);
   }
   ul_hapi int ulfd_opendir(ulfd_dir_t* dir, const char* path) {
@@ -4553,30 +6915,2964 @@ ul_hapi int ulfd_copy_file_range_allowuser(
     return err;
   }
 
+  #define _ulfd_at_is_cwd(dirfd, path) ((dirfd) == ULFD_AT_FDCWD || (path)[0] == '/')
+  #ifdef ULFD_POSIX_HAS_openat
+    #define _ulfd_at_dirfd(dirfd) ((dirfd) == ULFD_AT_FDCWD ? AT_FDCWD : (dirfd))
+  #endif
+  ul_hapi int ulfd_dirfd(ulfd_dir_t* dir, ulfd_t* pfd) {
+  #ifdef ULFD_POSIX_HAS_openat
+    int fd = dirfd(dir->dir);
+    if(fd < 0) return errno;
+    *pfd = fd; return 0;
+  #else
+    (void)dir; (void)pfd;
+    return ENOSYS;
+  #endif
+  }
+
+  ul_hapi int ulfd_openat(ulfd_t* pfd, ulfd_t dirfd, const char* path, ulfd_int32_t oflag, ulfd_mode_t mode) {
+  #ifdef ULFD_POSIX_HAS_openat
+    int flag, fd, err;
 
-  #include <sys/statvfs.h>
-  int ulfd_space(ulfd_spaceinfo_t* info, const char* path) {
-  #ifdef ULFD_HAS_LFS
-    struct statvfs64 vfs;
-    if(statvfs64(path, &vfs) < 0) return errno;
+    err = _ulfd_to_oflag(oflag, &flag);
+    if(ul_unlikely(err)) return err;
+    fd = openat(_ulfd_at_dirfd(dirfd), path, flag, _ulfd_to_access_mode(mode));
+
+    if(fd < 0) return errno;
+  #if !defined(O_DIRECT) && defined(F_NOCACHE)
+    if((oflag & ULFD_O_DIRECT) && fcntl(fd, F_NOCACHE, 1) < 0) {
+      err = errno; close(fd); return err;
+    }
+  #endif
+    if(oflag & ULFD_O_TEMPORARY) {
+      if(unlinkat(_ulfd_at_dirfd(dirfd), path, 0) < 0) {
+        err = errno; close(fd); return err;
+      }
+    }
+    *pfd = fd;
+    return 0;
   #else
-    struct statvfs vfs;
-    if(statvfs(path, &vfs) < 0) return errno;
+    if(!_ulfd_at_is_cwd(dirfd, path)) return ENOSYS;
+    return ulfd_open(pfd, path, oflag, mode);
+  #endif
+  }
+  ul_hapi int ulfd_openat_w(ulfd_t* pfd, ulfd_t dirfd, const wchar_t* wpath, ulfd_int32_t oflag, ulfd_mode_t mode) {
+    int ret;
+    _ulfd_begin_to_str(path, wpath);
+    ret = ulfd_openat(pfd, dirfd, path, oflag, mode);
+    _ulfd_end_to_str(path);
+    return ret;
+  }
+  ul_hapi int ulfd_fstatat(ulfd_t dirfd, const char* path, ulfd_stat_t* out, int flags) {
+    if((flags & ULFD_AT_EMPTY_PATH) && path[0] == 0) {
+      if(dirfd != ULFD_AT_FDCWD) return ulfd_fstat(dirfd, out);
+      path = ".";
+    }
+  #ifdef ULFD_POSIX_HAS_openat
+    {
+      int flag = 0;
+    #ifdef ULFD_HAS_LFS
+      struct stat64 state;
+    #else
+      struct stat state;
+    #endif
+      if(flags & ULFD_AT_SYMLINK_NOFOLLOW) flag |= AT_SYMLINK_NOFOLLOW;
+    #ifdef ULFD_HAS_LFS
+      if(fstatat64(_ulfd_at_dirfd(dirfd), path, &state, flag) < 0) return errno;
+    #else
+      if(fstatat(_ulfd_at_dirfd(dirfd), path, &state, flag) < 0) return errno;
+    #endif
+      _ulfd_stat_parse(out, &state);
+      return 0;
+    }
+  #else
+    if(!_ulfd_at_is_cwd(dirfd, path)) return ENOSYS;
+    return (flags & ULFD_AT_SYMLINK_NOFOLLOW) ? ulfd_lstat(path, out) : ulfd_stat(path, out);
+  #endif
+  }
+  ul_hapi int ulfd_fstatat_w(ulfd_t dirfd, const wchar_t* wpath, ulfd_stat_t* state, int flags) {
+    int ret;
+    _ulfd_begin_to_str(path, wpath);
+    ret = ulfd_fstatat(dirfd, path, state, flags);
+    _ulfd_end_to_str(path);
+    return ret;
+  }
+
+  #ifdef ULFD_POSIX_HAS_statx
+    #include <sys/sysmacros.h>
+    #define _ulfd_statx_time(ts) \
+      (ul_static_cast(ulfd_time_t, (ts).tv_sec) * 1000 + ul_static_cast(ulfd_time_t, (ts).tv_nsec / 1000000))
   #endif
+  ul_hapi int ulfd_statx(ulfd_t dirfd, const char* path, int flags, unsigned mask, ulfd_stat_t* out, unsigned* pmask) {
+    int err;
+  #ifdef ULFD_POSIX_HAS_statx
+    struct statx stx;
+    unsigned req = 0, got = ULFD_STATX_DEV;
+    int flag = 0;
 
-    info->capacity = ul_static_cast(ulfd_uint64_t, vfs.f_blocks) * vfs.f_frsize;
-    info->free = ul_static_cast(ulfd_uint64_t, vfs.f_bfree) * vfs.f_frsize;
-    info->available = ul_static_cast(ulfd_uint64_t, vfs.f_bavail) * vfs.f_frsize;
+    if(flags & ULFD_AT_SYMLINK_NOFOLLOW) flag |= AT_SYMLINK_NOFOLLOW;
+    if(flags & ULFD_AT_EMPTY_PATH) flag |= AT_EMPTY_PATH;
+    if(flags & ULFD_AT_STATX_DONT_SYNC) flag |= AT_STATX_DONT_SYNC;
+    else if(flags & ULFD_AT_STATX_FORCE_SYNC) flag |= AT_STATX_FORCE_SYNC;
+
+    if(mask & ULFD_STATX_TYPE) req |= STATX_TYPE;
+    if(mask & ULFD_STATX_MODE) req |= STATX_MODE;
+    if(mask & ULFD_STATX_NLINK) req |= STATX_NLINK;
+    if(mask & ULFD_STATX_UID) req |= STATX_UID;
+    if(mask & ULFD_STATX_GID) req |= STATX_GID;
+    if(mask & ULFD_STATX_ATIME) req |= STATX_ATIME;
+    if(mask & ULFD_STATX_MTIME) req |= STATX_MTIME;
+    if(mask & ULFD_STATX_CTIME) req |= STATX_CTIME;
+    if(mask & ULFD_STATX_INO) req |= STATX_INO;
+    if(mask & ULFD_STATX_SIZE) req |= STATX_SIZE;
+
+    if(statx(_ulfd_at_dirfd(dirfd), path, flag, req, &stx) == 0) {
+      ulfd_mode_t mode = _ulfd_from_full_mode(stx.stx_mode);
+      memset(out, 0, sizeof(*out));
+      out->dev = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+      out->rdev = makedev(stx.stx_rdev_major, stx.stx_rdev_minor);
+      if(stx.stx_mask & STATX_TYPE) { out->mode |= mode & ULFD_S_IFMT; got |= ULFD_STATX_TYPE; }
+      if(stx.stx_mask & STATX_MODE) { out->mode |= mode & ~ul_static_cast(ulfd_mode_t, ULFD_S_IFMT); got |= ULFD_STATX_MODE; }
+      if(stx.stx_mask & STATX_NLINK) { out->nlink = stx.stx_nlink; got |= ULFD_STATX_NLINK; }
+      if(stx.stx_mask & STATX_UID) { out->uid = stx.stx_uid; got |= ULFD_STATX_UID; }
+      if(stx.stx_mask & STATX_GID) { out->gid = stx.stx_gid; got |= ULFD_STATX_GID; }
+      if(stx.stx_mask & STATX_ATIME) { out->atime = _ulfd_statx_time(stx.stx_atime); got |= ULFD_STATX_ATIME; }
+      if(stx.stx_mask & STATX_MTIME) { out->mtime = _ulfd_statx_time(stx.stx_mtime); got |= ULFD_STATX_MTIME; }
+      if(stx.stx_mask & STATX_CTIME) { out->ctime = _ulfd_statx_time(stx.stx_ctime); got |= ULFD_STATX_CTIME; }
+      if(stx.stx_mask & STATX_INO) { out->ino = stx.stx_ino; got |= ULFD_STATX_INO; }
+      if(stx.stx_mask & STATX_SIZE) { out->size = ul_static_cast(ulfd_int64_t, stx.stx_size); got |= ULFD_STATX_SIZE; }
+      if(pmask) *pmask = got;
+      return 0;
+    }
+    if(errno != ENOSYS) return errno;
+  #else
+    (void)mask;
+  #endif
+    err = ulfd_fstatat(dirfd, path, out, flags & (ULFD_AT_SYMLINK_NOFOLLOW | ULFD_AT_EMPTY_PATH));
+    if(err) return err;
+    if(pmask) *pmask = ULFD_STATX_ALL;
     return 0;
   }
-  int ulfd_space_w(ulfd_spaceinfo_t* info, const wchar_t* wpath) {
+  ul_hapi int ulfd_statx_w(ulfd_t dirfd, const wchar_t* wpath, int flags, unsigned mask, ulfd_stat_t* state, unsigned* pmask) {
     int ret;
     _ulfd_begin_to_str(path, wpath);
-    ret = ulfd_space(info, path);
+    ret = ulfd_statx(dirfd, path, flags, mask, state, pmask);
     _ulfd_end_to_str(path);
     return ret;
   }
 
-#endif
+  #ifdef __linux__
+    #include <sys/ioctl.h>
+    #ifndef BLKSSZGET
+      #define BLKSSZGET _IO(0x12, 104)
+    #endif
+  #endif
+  ul_hapi int ulfd_logical_block_size(ulfd_t fd, size_t* psize) {
+  #ifdef ULFD_HAS_LFS
+    struct stat64 state;
+  #else
+    struct stat state;
+  #endif
+  #if defined(ULFD_POSIX_HAS_statx) && defined(STATX_DIOALIGN)
+    struct statx stx;
+    /* Linux 6.1+: the filesystem knows the exact direct I/O alignment */
+    if(statx(fd, "", AT_EMPTY_PATH, STATX_DIOALIGN, &stx) == 0
+      && (stx.stx_mask & STATX_DIOALIGN) && stx.stx_dio_offset_align
+    ) {
+      *psize = stx.stx_dio_offset_align;
+      return 0;
+    }
+  #endif
+  #ifdef ULFD_HAS_LFS
+    if(fstat64(fd, &state) < 0) return errno;
+  #else
+    if(fstat(fd, &state) < 0) return errno;
+  #endif
+  #ifdef __linux__
+    if(S_ISBLK(state.st_mode)) {
+      int size;
+      if(ioctl(fd, BLKSSZGET, &size) == 0 && size > 0) {
+        *psize = ul_static_cast(size_t, size);
+        return 0;
+      }
+    }
+  #endif
+    /* the preferred I/O size is a multiple of the logical block size */
+    *psize = state.st_blksize > 0 ? ul_static_cast(size_t, state.st_blksize) : 512;
+    return 0;
+  }
+
+  #ifdef ULFD_POSIX_HAS_fallocate
+    ul_hapi int _ulfd_fallocate(ulfd_t fd, int mode, ulfd_int64_t off, ulfd_int64_t len) {
+    #ifdef ULFD_HAS_LFS
+      return fallocate64(fd, mode, off, len) < 0 ? errno : 0;
+    #else
+      if(ul_static_cast(off_t, off) != off || ul_static_cast(off_t, len) != len) return EOVERFLOW;
+      return fallocate(fd, mode, ul_static_cast(off_t, off), ul_static_cast(off_t, len)) < 0 ? errno : 0;
+    #endif
+    }
+  #endif
+  ul_hapi int ulfd_fallocate(ulfd_t fd, int flags, ulfd_int64_t off, ulfd_int64_t len) {
+    int err = _ulfd_range_check(off, len);
+    if(err) return err;
+  #ifdef ULFD_POSIX_HAS_fallocate
+    err = _ulfd_fallocate(fd, (flags & ULFD_FALLOC_KEEP_SIZE) ? FALLOC_FL_KEEP_SIZE : 0, off, len);
+    if(err != EOPNOTSUPP || (flags & ULFD_FALLOC_KEEP_SIZE)) return err;
+  #endif
+  #ifdef ULFD_POSIX_HAS_posix_fallocate
+    if(flags & ULFD_FALLOC_KEEP_SIZE) return ENOSYS;
+    #ifdef ULFD_HAS_LFS
+      return posix_fallocate64(fd, off, len);
+    #else
+      if(ul_static_cast(off_t, off) != off || ul_static_cast(off_t, len) != len) return EOVERFLOW;
+      return posix_fallocate(fd, ul_static_cast(off_t, off), ul_static_cast(off_t, len));
+    #endif
+  #else
+    (void)fd; (void)flags;
+    return ENOSYS;
+  #endif
+  }
+  ul_hapi int ulfd_punch_hole(ulfd_t fd, ulfd_int64_t off, ulfd_int64_t len) {
+    int err = _ulfd_range_check(off, len);
+    if(err) return err;
+  #ifdef ULFD_POSIX_HAS_fallocate
+    return _ulfd_fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, off, len);
+  #else
+    (void)fd;
+    return ENOSYS;
+  #endif
+  }
+  ul_hapi int ulfd_zero_range(ulfd_t fd, ulfd_int64_t off, ulfd_int64_t len, int flags) {
+    int err = _ulfd_range_check(off, len);
+    if(err) return err;
+  #if defined(ULFD_POSIX_HAS_fallocate) && defined(FALLOC_FL_ZERO_RANGE)
+    err = _ulfd_fallocate(fd,
+      FALLOC_FL_ZERO_RANGE | ((flags & ULFD_FALLOC_KEEP_SIZE) ? FALLOC_FL_KEEP_SIZE : 0), off, len);
+    if(err != EOPNOTSUPP && err != ENOSYS) return err;
+  #endif
+    return _ulfd_zero_range_user(fd, off, len, flags);
+  }
+
+  #ifdef SEEK_DATA
+    ul_hapi int _ulfd_lseek_extent(ulfd_t fd, ulfd_int64_t off, int whence, ulfd_int64_t* presult) {
+    #ifdef ULFD_HAS_LFS
+      off64_t ret = lseek64(fd, off, whence);
+    #else
+      off_t ret;
+      if(ul_static_cast(off_t, off) != off) return EOVERFLOW;
+      ret = lseek(fd, ul_static_cast(off_t, off), whence);
+    #endif
+      if(ret < 0) return errno;
+      *presult = ret;
+      return 0;
+    }
+  #endif
+  ul_hapi int ulfd_extent_begin(ulfd_extent_iter_t* it, ulfd_t fd, ulfd_int64_t off, ulfd_int64_t len) {
+    ulfd_int64_t length;
+    int err;
+    if(off < 0 || len < 0) return EINVAL;
+    err = ulfd_ffilelength(fd, &length);
+    if(err) return err;
+    it->fd = fd;
+    it->off = off;
+    if(off >= length) it->end = off;
+    else it->end = (len == 0 || len > length - off) ? length : off + len;
+    return ulfd_tell(fd, &it->pos);
+  }
+  ul_hapi int ulfd_extent_next(ulfd_extent_iter_t* it, ulfd_int64_t* poff, ulfd_int64_t* plen) {
+    ulfd_int64_t data, hole;
+  #ifdef SEEK_DATA
+    int err;
+  #endif
+
+    if(it->off >= it->end) { *poff = it->end; *plen = 0; return 0; }
+  #ifdef SEEK_DATA
+    err = _ulfd_lseek_extent(it->fd, it->off, SEEK_DATA, &data);
+    if(err == ENXIO) data = it->end; /* only a hole is left */
+    else if(err) return err;
+    if(data >= it->end) { it->off = it->end; *poff = it->end; *plen = 0; return 0; }
+    err = _ulfd_lseek_extent(it->fd, data, SEEK_HOLE, &hole);
+    if(err) return err;
+    if(hole > it->end) hole = it->end;
+  #else
+    data = it->off;
+    hole = it->end;
+  #endif
+    it->off = hole;
+    *poff = data;
+    *plen = hole - data;
+    return 0;
+  }
+  ul_hapi int ulfd_extent_end(ulfd_extent_iter_t* it) {
+  #ifdef SEEK_DATA
+    ulfd_int64_t pos;
+    return ulfd_seek(it->fd, it->pos, ULFD_SEEK_SET, &pos);
+  #else
+    (void)it;
+    return 0;
+  #endif
+  }
+
+  #ifdef __linux__
+    /* linux/fs.h conflicts with sys/mount.h, so define them here */
+    typedef struct _ulfd_file_clone_range_t {
+      ulfd_int64_t src_fd;
+      ulfd_uint64_t src_offset;
+      ulfd_uint64_t src_length;
+      ulfd_uint64_t dest_offset;
+    } _ulfd_file_clone_range_t;
+    #ifndef FICLONE
+      #define FICLONE _IOW(0x94, 9, int)
+    #endif
+    #ifndef FICLONERANGE
+      #define FICLONERANGE _IOW(0x94, 13, _ulfd_file_clone_range_t)
+    #endif
+    ul_hapi int _ulfd_clone_errno(void) {
+      /* not a file system that shares extents */
+      return errno == ENOTTY ? EOPNOTSUPP : errno;
+    }
+  #endif
+  ul_hapi int ulfd_clone_file(ulfd_t fd_in, ulfd_t fd_out) {
+  #ifdef __linux__
+    return ioctl(fd_out, FICLONE, fd_in) < 0 ? _ulfd_clone_errno() : 0;
+  #else
+    (void)fd_in; (void)fd_out;
+    return ENOSYS;
+  #endif
+  }
+  ul_hapi int ulfd_clone_range(ulfd_t fd_in, ulfd_int64_t off_in, ulfd_t fd_out, ulfd_int64_t off_out, ulfd_int64_t len) {
+  #ifdef __linux__
+    _ulfd_file_clone_range_t range;
+    if(off_in < 0 || off_out < 0 || len < 0) return EINVAL;
+    range.src_fd = fd_in;
+    range.src_offset = ul_static_cast(ulfd_uint64_t, off_in);
+    range.src_length = ul_static_cast(ulfd_uint64_t, len);
+    range.dest_offset = ul_static_cast(ulfd_uint64_t, off_out);
+    return ioctl(fd_out, FICLONERANGE, &range) < 0 ? _ulfd_clone_errno() : 0;
+  #else
+    (void)fd_in; (void)off_in; (void)fd_out; (void)off_out; (void)len;
+    return ENOSYS;
+  #endif
+  }
+  ul_hapi int ulfd_copy_file(const char* newpath, const char* oldpath, int flags) {
+    ulfd_t fd_in, fd_out;
+    int err;
+
+    err = ulfd_open(&fd_in, oldpath, ULFD_O_RDONLY, 0);
+    if(err) return err;
+    /* the mode is copied later, keep the file private until then */
+    err = ulfd_open(&fd_out, newpath,
+      ULFD_O_WRONLY | ULFD_O_CREAT | ((flags & ULFD_COPY_NOREPLACE) ? ULFD_O_EXCL : ULFD_O_TRUNC),
+      (flags & ULFD_COPY_NOATTR) ? 0666 : 0600);
+    if(err) { ulfd_close(fd_in); return err; }
+    err = ulfd_copy_fd(fd_in, fd_out, flags);
+    ulfd_close(fd_in);
+    if(ulfd_close(fd_out) && err == 0) err = EIO;
+    if(err) ulfd_unlink(newpath);
+    return err;
+  }
+  ul_hapi int ulfd_copy_file_w(const wchar_t* newpath, const wchar_t* oldpath, int flags) {
+    int ret;
+    _ulfd_begin_to_str(_newpath, newpath);
+    _ulfd_begin_to_str2(_oldpath, oldpath, _newpath);
+    ret = ulfd_copy_file(_newpath, _oldpath, flags);
+    _ulfd_end_to_str2(_oldpath);
+    _ulfd_end_to_str(_newpath);
+    return ret;
+  }
+  ul_hapi int ulfd_mkdirat(ulfd_t dirfd, const char* path, ulfd_mode_t mode) {
+  #ifdef ULFD_POSIX_HAS_openat
+    return mkdirat(_ulfd_at_dirfd(dirfd), path, _ulfd_to_access_mode(mode)) < 0 ? errno : 0;
+  #else
+    if(!_ulfd_at_is_cwd(dirfd, path)) return ENOSYS;
+    return ulfd_mkdir(path, mode);
+  #endif
+  }
+  ul_hapi int ulfd_mkdirat_w(ulfd_t dirfd, const wchar_t* wpath, ulfd_mode_t mode) {
+    int ret;
+    _ulfd_begin_to_str(path, wpath);
+    ret = ulfd_mkdirat(dirfd, path, mode);
+    _ulfd_end_to_str(path);
+    return ret;
+  }
+  ul_hapi int ulfd_unlinkat(ulfd_t dirfd, const char* path, int flags) {
+  #ifdef ULFD_POSIX_HAS_openat
+    return unlinkat(_ulfd_at_dirfd(dirfd), path, (flags & ULFD_AT_REMOVEDIR) ? AT_REMOVEDIR : 0) < 0 ? errno : 0;
+  #else
+    if(!_ulfd_at_is_cwd(dirfd, path)) return ENOSYS;
+    return (flags & ULFD_AT_REMOVEDIR) ? ulfd_rmdir(path) : ulfd_unlink(path);
+  #endif
+  }
+  ul_hapi int ulfd_unlinkat_w(ulfd_t dirfd, const wchar_t* wpath, int flags) {
+    int ret;
+    _ulfd_begin_to_str(path, wpath);
+    ret = ulfd_unlinkat(dirfd, path, flags);
+    _ulfd_end_to_str(path);
+    return ret;
+  }
+
+  #if !defined(ULFD_POSIX_HAS_renameat2) && defined(__linux__) \
+    && defined(ULFD_POSIX_HAS_openat) && defined(_DEFAULT_SOURCE) && (_DEFAULT_SOURCE+0)
+    #include <sys/syscall.h>
+    #ifdef SYS_renameat2
+      #define _ULFD_SYS_renameat2
+    #endif
+  #endif
+  ul_hapi int ulfd_renameat2(ulfd_t newdirfd, const char* newpath, ulfd_t olddirfd, const char* oldpath, int flags) {
+  #if defined(ULFD_POSIX_HAS_renameat2) || defined(_ULFD_SYS_renameat2)
+    unsigned flag = 0;
+    if(flags == 0)
+      return renameat(_ulfd_at_dirfd(olddirfd), oldpath, _ulfd_at_dirfd(newdirfd), newpath) < 0 ? errno : 0;
+    #ifdef ULFD_POSIX_HAS_renameat2
+      if(flags & ULFD_RENAME_NOREPLACE) flag |= RENAME_NOREPLACE;
+      if(flags & ULFD_RENAME_EXCHANGE) flag |= RENAME_EXCHANGE;
+      return renameat2(_ulfd_at_dirfd(olddirfd), oldpath, _ulfd_at_dirfd(newdirfd), newpath, flag) < 0 ? errno : 0;
+    #else
+      if(flags & ULFD_RENAME_NOREPLACE) flag |= 1u; /* RENAME_NOREPLACE */
+      if(flags & ULFD_RENAME_EXCHANGE) flag |= 2u; /* RENAME_EXCHANGE */
+      return syscall(SYS_renameat2, _ulfd_at_dirfd(olddirfd), oldpath, _ulfd_at_dirfd(newdirfd), newpath, flag) < 0 ? errno : 0;
+    #endif
+  #elif defined(ULFD_POSIX_HAS_openat)
+    if(flags) return ENOSYS;
+    return renameat(_ulfd_at_dirfd(olddirfd), oldpath, _ulfd_at_dirfd(newdirfd), newpath) < 0 ? errno : 0;
+  #else
+    if(flags) return ENOSYS;
+    if(!_ulfd_at_is_cwd(newdirfd, newpath) || !_ulfd_at_is_cwd(olddirfd, oldpath)) return ENOSYS;
+    return ulfd_rename(newpath, oldpath);
+  #endif
+  }
+  ul_hapi int ulfd_renameat2_w(ulfd_t newdirfd, const wchar_t* newpath, ulfd_t olddirfd, const wchar_t* oldpath, int flags) {
+    int ret;
+    _ulfd_begin_to_str(_newpath, newpath);
+    _ulfd_begin_to_str2(_oldpath, oldpath, _newpath);
+    ret = ulfd_renameat2(newdirfd, _newpath, olddirfd, _oldpath, flags);
+    _ulfd_end_to_str2(_oldpath);
+    _ulfd_end_to_str(_newpath);
+    return ret;
+  }
+
+  ul_hapi int _ulfd_opendirat(ulfd_dir_t* dir, ulfd_t dirfd, const char* path, int nofollow) {
+  #ifdef ULFD_POSIX_HAS_openat
+    int oflag = O_RDONLY, fd, err;
+    #ifdef O_DIRECTORY
+      oflag |= O_DIRECTORY;
+    #endif
+    #ifdef O_CLOEXEC
+      oflag |= O_CLOEXEC;
+    #endif
+    #ifdef O_NOFOLLOW
+      if(nofollow) oflag |= O_NOFOLLOW;
+    #else
+      (void)nofollow;
+    #endif
+    dir->entry = NULL;
+    dir->entry_cap = 0;
+    dir->wentry = NULL;
+    dir->wentry_cap = 0;
+    fd = openat(_ulfd_at_dirfd(dirfd), path, oflag);
+    if(fd < 0) return errno;
+    dir->dir = fdopendir(fd);
+    if(dir->dir == NULL) { err = errno; close(fd); return err; }
+    err = _ulfd_dir_skip_dot(dir);
+    if(ul_unlikely(err)) { closedir(dir->dir); return err; }
+    return 0;
+  #else
+    if(!_ulfd_at_is_cwd(dirfd, path)) return ENOSYS;
+    if(nofollow) {
+      ulfd_stat_t state;
+      int err = ulfd_fstatat(dirfd, path, &state, ULFD_AT_SYMLINK_NOFOLLOW);
+      if(err) return err;
+      if((state.mode & ULFD_S_IFMT) == ULFD_S_IFLNK) return ELOOP;
+    }
+    return ulfd_opendir(dir, path);
+  #endif
+  }
+  ul_hapi int ulfd_opendirat(ulfd_dir_t* dir, ulfd_t dirfd, const char* path) {
+    return _ulfd_opendirat(dir, dirfd, path, 0);
+  }
+  /* `ulfd_opendirat`, but ELOOP (or ENOTDIR) if `path` is a symbolic link */
+  ul_hapi int _ulfd_opendirat_nofollow(ulfd_dir_t* dir, ulfd_t dirfd, const char* path) {
+    return _ulfd_opendirat(dir, dirfd, path, 1);
+  }
+  /* `ulfd_openat`, but ELOOP if `path` is a symbolic link */
+  ul_hapi int _ulfd_openat_nofollow(ulfd_t* pfd, ulfd_t dirfd, const char* path, ulfd_int32_t oflag, ulfd_mode_t mode) {
+  #if defined(ULFD_POSIX_HAS_openat) && defined(O_NOFOLLOW)
+    int flag, fd, err;
+
+    err = _ulfd_to_oflag(oflag, &flag);
+    if(ul_unlikely(err)) return err;
+    fd = openat(_ulfd_at_dirfd(dirfd), path, flag | O_NOFOLLOW, _ulfd_to_access_mode(mode));
+    if(fd < 0) return errno == EMLINK ? ELOOP : errno; /* FreeBSD: EMLINK */
+    *pfd = fd;
+    return 0;
+  #else
+    ulfd_stat_t state;
+    int err = ulfd_fstatat(dirfd, path, &state, ULFD_AT_SYMLINK_NOFOLLOW);
+    if(err == 0 && (state.mode & ULFD_S_IFMT) == ULFD_S_IFLNK) return ELOOP;
+    return ulfd_openat(pfd, dirfd, path, oflag, mode);
+  #endif
+  }
+  /* `ulfd_readlink_alloc` relative to `dirfd` */
+  ul_hapi int _ulfd_readlinkat_alloc(char** pbuf, ulfd_t dirfd, const char* path) {
+  #ifdef ULFD_POSIX_HAS_openat
+    char* buf;
+    ssize_t sret;
+
+    buf = ul_reinterpret_cast(char*, ul_malloc(ULFD_PATH_MAX + 1));
+    if(ul_unlikely(buf == NULL)) return ENOMEM;
+    sret = readlinkat(_ulfd_at_dirfd(dirfd), path, buf, ULFD_PATH_MAX + 1);
+    if(sret < 0) { ul_free(buf); return errno; }
+    else if(sret == ULFD_PATH_MAX + 1) { ul_free(buf); return ERANGE; }
+
+    buf[sret] = 0;
+    *pbuf = buf;
+    return 0;
+  #else
+    if(!_ulfd_at_is_cwd(dirfd, path)) return ENOSYS;
+    return ulfd_readlink_alloc(pbuf, path);
+  #endif
+  }
+  /* `ulfd_symlink` relative to `dirfd` */
+  ul_hapi int _ulfd_symlinkat(ulfd_t dirfd, const char* target, const char* source) {
+  #ifdef ULFD_POSIX_HAS_openat
+    return symlinkat(source, _ulfd_at_dirfd(dirfd), target) < 0 ? errno : 0;
+  #else
+    if(!_ulfd_at_is_cwd(dirfd, target)) return ENOSYS;
+    return ulfd_symlink(target, source);
+  #endif
+  }
+  ul_hapi int ulfd_opendirat_w(ulfd_dir_t* dir, ulfd_t dirfd, const wchar_t* wpath) {
+    int ret;
+    _ulfd_begin_to_str(path, wpath);
+    ret = ulfd_opendirat(dir, dirfd, path);
+    _ulfd_end_to_str(path);
+    return ret;
+  }
+
+  #ifdef ULFD_POSIX_HAS_getdents64
+    #include <sys/syscall.h>
+    struct _ulfd_linux_dirent64 {
+      ulfd_uint64_t d_ino;
+      ulfd_int64_t d_off;
+      unsigned short d_reclen;
+      unsigned char d_type;
+      char d_name[1];
+    };
+    ul_hapi int ulfd_readdir_batch(ulfd_dir_t* dir, void* buf, size_t len, size_t* pused) {
+      const struct _ulfd_linux_dirent64* kent;
+      ulfd_dirent_t* ent;
+      char* rp, *wp, *end;
+      ulfd_uint64_t ino;
+      unsigned char type;
+      size_t namelen;
+      long ret;
+
+      if(ul_unlikely(ul_reinterpret_cast(size_t, buf) & 7u)) return EINVAL;
+      if(!dir->batch) {
+        if(lseek(dirfd(dir->dir), 0, SEEK_SET) < 0) return errno;
+        dir->batch = 1; dir->cached = 0;
+      }
+      if(len > 0x7FFFF000u) len = 0x7FFFF000u;
+
+      /* records are converted in place, an `ulfd_dirent_t` is never longer than the kernel's record */
+      for(;;) {
+        ret = syscall(SYS_getdents64, dirfd(dir->dir), buf, ul_static_cast(unsigned, len));
+        if(ret < 0) return errno;
+        rp = wp = ul_reinterpret_cast(char*, buf);
+        end = rp + ret;
+        while(rp < end) {
+          kent = ul_reinterpret_cast(const struct _ulfd_linux_dirent64*, rp);
+          rp += kent->d_reclen;
+          if(kent->d_name[0] == '.' && (kent->d_name[1] == 0 || (kent->d_name[1] == '.' && kent->d_name[2] == 0)))
+            continue;
+          ino = kent->d_ino; type = kent->d_type;
+          namelen = strlen(kent->d_name);
+
+          ent = ul_reinterpret_cast(ulfd_dirent_t*, wp);
+          memmove(ent->name, kent->d_name, namelen + 1);
+          ent->ino = ino;
+          ent->type = ul_static_cast(ulfd_mode_t, type) << 12;
+          ent->reclen = ul_static_cast(unsigned short, _ulfd_dirent_reclen(namelen));
+          ent->namelen = ul_static_cast(unsigned short, namelen);
+          wp += ent->reclen;
+        }
+        if(ret == 0 || wp != ul_reinterpret_cast(char*, buf)) break; /* or only "." and ".." were read */
+      }
+      *pused = ul_static_cast(size_t, wp - ul_reinterpret_cast(char*, buf));
+      return 0;
+    }
+  #else
+    ul_hapi int ulfd_readdir_batch(ulfd_dir_t* dir, void* buf, size_t len, size_t* pused) {
+      struct dirent* dirent;
+      ulfd_dirent_t* ent;
+      size_t used = 0, namelen, reclen;
+      const char* name;
+      ulfd_uint64_t ino;
+      ulfd_mode_t type;
+      int err;
+
+      if(ul_unlikely(ul_reinterpret_cast(size_t, buf) & 7u)) return EINVAL;
+      for(;;) {
+        if(dir->cached) {
+          name = dir->entry; ino = dir->cached_ino; type = dir->cached_type;
+        } else {
+          errno = 0;
+          dirent = readdir(dir->dir);
+          if(dirent == NULL) {
+            if(errno && used == 0) return errno;
+            break;
+          }
+          name = dirent->d_name;
+          if(name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0))) continue;
+          ino = ul_static_cast(ulfd_uint64_t, dirent->d_ino);
+          type = _ulfd_dirent_type(dirent);
+        }
+
+        namelen = strlen(name);
+        reclen = _ulfd_dirent_reclen(namelen);
+        if(reclen > len - used) {
+          if(!dir->cached) {
+            err = _ulfd_dir_store(dir, name);
+            if(ul_unlikely(err)) return err;
+            dir->cached = 1; dir->cached_ino = ino; dir->cached_type = type;
+          }
+          if(used == 0) return EINVAL;
+          break;
+        }
+
+        ent = ul_reinterpret_cast(ulfd_dirent_t*, ul_reinterpret_cast(char*, buf) + used);
+        memcpy(ent->name, name, namelen + 1);
+        ent->ino = ino;
+        ent->type = type;
+        ent->reclen = ul_static_cast(unsigned short, reclen);
+        ent->namelen = ul_static_cast(unsigned short, namelen);
+        used += reclen;
+        dir->cached = 0;
+      }
+      *pused = used;
+      return 0;
+    }
+  #endif
+
+  typedef struct _ulfd_walk_parent_t {
+    DIR* dir;
+    int refcount;
+  } _ulfd_walk_parent_t;
+  /* siblings share the descriptor of their parent when it's safe across threads */
+  #if defined(ULFD_POSIX_HAS_openat) && defined(__ATOMIC_ACQ_REL)
+    #define _ULFD_WALK_SHARE_PARENT
+  #endif
+  ul_hapi void _ulfd_walk_release_parent(void* parent) {
+  #ifdef _ULFD_WALK_SHARE_PARENT
+    _ulfd_walk_parent_t* p = ul_reinterpret_cast(_ulfd_walk_parent_t*, parent);
+    if(__atomic_sub_fetch(&p->refcount, 1, __ATOMIC_ACQ_REL) == 0) {
+      closedir(p->dir); ul_free(p);
+    }
+  #else
+    (void)parent;
+  #endif
+  }
+
+  ul_hapi DIR* _ulfd_walk_opendir(const ulfd_walk_task_t* task, int flags) {
+  #ifdef _ULFD_WALK_SHARE_PARENT
+    if(task->parent) {
+      int oflag = O_RDONLY, fd;
+      DIR* dir;
+    #ifdef O_DIRECTORY
+      oflag |= O_DIRECTORY;
+    #endif
+    #ifdef O_CLOEXEC
+      oflag |= O_CLOEXEC;
+    #endif
+    #ifdef O_NOFOLLOW
+      if(!(flags & ULFD_WALK_FOLLOW)) oflag |= O_NOFOLLOW;
+    #endif
+      fd = openat(dirfd(ul_reinterpret_cast(_ulfd_walk_parent_t*, task->parent)->dir), task->path + task->namepos, oflag);
+      if(fd < 0) return NULL;
+      dir = fdopendir(fd);
+      if(dir == NULL) { int err = errno; close(fd); errno = err; }
+      return dir;
+    }
+  #endif
+    (void)flags;
+    return opendir(task->path);
+  }
+
+  ul_hapi int ulfd_walk_scan(
+    ulfd_walk_task_t* task, const ulfd_walk_options_t* options,
+    int (*push)(void* ctx, ulfd_walk_task_t* subtask), void* ctx
+  ) {
+  #ifdef ULFD_HAS_LFS
+    struct stat64 state;
+  #else
+    struct stat state;
+  #endif
+    _ulfd_walk_parent_t* self = NULL;
+    ulfd_walk_task_t* sub;
+    ulfd_walk_entry_t entry;
+    ulfd_stat_t ustate;
+    struct dirent* dirent;
+    char* path = NULL;
+    size_t path_cap, namelen;
+    ulfd_uint64_t* ancestors = NULL;
+    size_t nancestors = 0;
+    int flags = options->flags, err = 0, ret, stated;
+    DIR* dir;
+
+    dir = _ulfd_walk_opendir(task, flags);
+    if(dir == NULL) { err = _ulfd_walk_error(options, task->path, errno); goto do_return; }
+
+    if(flags & ULFD_WALK_FOLLOW) {
+      size_t i;
+    #ifdef ULFD_HAS_LFS
+      if(fstat64(dirfd(dir), &state) < 0)
+    #else
+      if(fstat(dirfd(dir), &state) < 0)
+    #endif
+      { err = _ulfd_walk_error(options, task->path, errno); goto do_return; }
+      for(i = 0; i < task->nancestors; i += 2) {
+        if(task->ancestors[i] == ul_static_cast(ulfd_uint64_t, state.st_dev)
+          && task->ancestors[i + 1] == ul_static_cast(ulfd_uint64_t, state.st_ino)
+        ) { err = _ulfd_walk_error(options, task->path, ELOOP); goto do_return; }
+      }
+      nancestors = task->nancestors + 2;
+      ancestors = ul_reinterpret_cast(ulfd_uint64_t*, ul_malloc(nancestors * sizeof(ulfd_uint64_t)));
+      if(ul_unlikely(ancestors == NULL)) { err = ENOMEM; goto do_return; }
+      if(task->nancestors) memcpy(ancestors, task->ancestors, task->nancestors * sizeof(ulfd_uint64_t));
+      ancestors[nancestors - 2] = ul_static_cast(ulfd_uint64_t, state.st_dev);
+      ancestors[nancestors - 1] = ul_static_cast(ulfd_uint64_t, state.st_ino);
+    }
+
+    path_cap = task->pathlen + 258;
+    path = ul_reinterpret_cast(char*, ul_malloc(path_cap));
+    if(ul_unlikely(path == NULL)) { err = ENOMEM; goto do_return; }
+    memcpy(path, task->path, task->pathlen);
+    entry.path = path;
+    entry.name = path + task->pathlen;
+    if(task->pathlen && path[task->pathlen - 1] != '/') path[task->pathlen] = '/', ++entry.name;
+    entry.depth = task->depth + 1;
+  #ifdef ULFD_POSIX_HAS_openat
+    entry.dirfd = dirfd(dir);
+  #else
+    entry.dirfd = ULFD_AT_FDCWD;
+  #endif
+
+    for(;;) {
+      errno = 0;
+      dirent = readdir(dir);
+      if(dirent == NULL) {
+        if(errno) err = _ulfd_walk_error(options, task->path, errno);
+        break;
+      }
+      if(dirent->d_name[0] == '.'
+        && (dirent->d_name[1] == 0 || (dirent->d_name[1] == '.' && dirent->d_name[2] == 0))) continue;
+
+      namelen = strlen(dirent->d_name);
+      entry.pathlen = ul_static_cast(size_t, entry.name - path) + namelen;
+      if(entry.pathlen >= path_cap) {
+        char* path2;
+        size_t name_off = ul_static_cast(size_t, entry.name - path);
+        path_cap = entry.pathlen + 1;
+        path2 = ul_reinterpret_cast(char*, ul_realloc(path, path_cap));
+        if(ul_unlikely(path2 == NULL)) { err = ENOMEM; break; }
+        path = path2; entry.path = path; entry.name = path + name_off;
+      }
+      memcpy(ul_const_cast(char*, entry.name), dirent->d_name, namelen + 1);
+
+      entry.ino = ul_static_cast(ulfd_uint64_t, dirent->d_ino);
+      entry.type = _ulfd_dirent_type(dirent);
+      entry.stat = NULL;
+      if((flags & ULFD_WALK_STAT) || entry.type == 0 || ((flags & ULFD_WALK_FOLLOW) && entry.type == ULFD_S_IFLNK)) {
+      #ifdef ULFD_POSIX_HAS_openat
+        #ifdef ULFD_HAS_LFS
+          #define _ulfd_walk_stat(nofollow) \
+            fstatat64(dirfd(dir), dirent->d_name, &state, (nofollow) ? AT_SYMLINK_NOFOLLOW : 0)
+        #else
+          #define _ulfd_walk_stat(nofollow) \
+            fstatat(dirfd(dir), dirent->d_name, &state, (nofollow) ? AT_SYMLINK_NOFOLLOW : 0)
+        #endif
+      #else
+        #ifdef ULFD_HAS_LFS
+          #define _ulfd_walk_stat(nofollow) ((nofollow) ? lstat64(path, &state) : stat64(path, &state))
+        #else
+          #define _ulfd_walk_stat(nofollow) ((nofollow) ? lstat(path, &state) : stat(path, &state))
+        #endif
+      #endif
+        stated = _ulfd_walk_stat(!(flags & ULFD_WALK_FOLLOW)) == 0;
+        /* a dangling symbolic link */
+        if(!stated && (flags & ULFD_WALK_FOLLOW)) stated = _ulfd_walk_stat(1) == 0;
+        #undef _ulfd_walk_stat
+        if(stated) {
+          _ulfd_stat_parse(&ustate, &state);
+          entry.ino = ul_static_cast(ulfd_uint64_t, state.st_ino);
+          entry.type = ustate.mode & ULFD_S_IFMT;
+          if(flags & ULFD_WALK_STAT) entry.stat = &ustate;
+        }
+      }
+
+      ret = options->callback ? options->callback(options->userdata, &entry) : ULFD_WALK_CONTINUE;
+      if(ret == ULFD_WALK_STOP) { err = ECANCELED; break; }
+      if(entry.type != ULFD_S_IFDIR || ret == ULFD_WALK_PRUNE) continue;
+      if(options->max_depth > 0 && entry.depth >= options->max_depth) continue;
+
+      sub = _ulfd_walk_task_new(path, ul_static_cast(size_t, entry.name - path), entry.name, namelen,
+        entry.depth, ancestors, nancestors);
+      if(ul_unlikely(sub == NULL)) { err = ENOMEM; break; }
+    #ifdef _ULFD_WALK_SHARE_PARENT
+      if(self == NULL) {
+        self = ul_reinterpret_cast(_ulfd_walk_parent_t*, ul_malloc(sizeof(_ulfd_walk_parent_t)));
+        if(self) { self->dir = dir; self->refcount = 1; }
+      }
+      if(self) {
+        __atomic_add_fetch(&self->refcount, 1, __ATOMIC_ACQ_REL);
+        sub->parent = self;
+      }
+    #endif
+      err = push(ctx, sub);
+      if(err) break;
+    }
+
+  do_return:
+    if(self) _ulfd_walk_release_parent(self);
+    else if(dir) closedir(dir);
+    if(path) ul_free(path);
+    if(ancestors) ul_free(ancestors);
+    ulfd_walk_task_free(task);
+    return err;
+  }
+
+
+  #include <sys/statvfs.h>
+  int ulfd_space(ulfd_spaceinfo_t* info, const char* path) {
+  #ifdef ULFD_HAS_LFS
+    struct statvfs64 vfs;
+    if(statvfs64(path, &vfs) < 0) return errno;
+  #else
+    struct statvfs vfs;
+    if(statvfs(path, &vfs) < 0) return errno;
+  #endif
+
+    info->capacity = ul_static_cast(ulfd_uint64_t, vfs.f_blocks) * vfs.f_frsize;
+    info->free = ul_static_cast(ulfd_uint64_t, vfs.f_bfree) * vfs.f_frsize;
+    info->available = ul_static_cast(ulfd_uint64_t, vfs.f_bavail) * vfs.f_frsize;
+    return 0;
+  }
+  int ulfd_space_w(ulfd_spaceinfo_t* info, const wchar_t* wpath) {
+    int ret;
+    _ulfd_begin_to_str(path, wpath);
+    ret = ulfd_space(info, path);
+    _ulfd_end_to_str(path);
+    return ret;
+  }
+
+#endif
+
+
+#define _ULFD_RING_OP_READ      0
+#define _ULFD_RING_OP_WRITE     1
+#define _ULFD_RING_OP_FSYNC     2
+#define _ULFD_RING_OP_FDATASYNC 3
+#define _ULFD_RING_OP_SYNC_RANGE 4
+#define _ULFD_RING_NIL          (~0u)
+
+#if defined(__linux__) && !defined(ULFD_NO_IO_URING) && defined(__has_include) && defined(__ATOMIC_ACQUIRE) \
+  && defined(ULFD_POSIX_HAS_syscall)
+  #if __has_include(<linux/io_uring.h>)
+    #include <linux/io_uring.h>
+    #include <sys/syscall.h>
+    /* `IORING_FEAT_RW_CUR_POS` comes with `IORING_OP_READ` and `IORING_REGISTER_PROBE` (Linux 5.6) */
+    #if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter) && defined(__NR_io_uring_register) \
+      && defined(IORING_FEAT_RW_CUR_POS)
+      #define ULFD_POSIX_HAS_io_uring
+    #endif
+  #endif
+#endif
+
+ul_hapi unsigned _ulfd_ring_alloc_req(ulfd_ring_t* ring) {
+  unsigned slot = ring->free_head;
+  if(slot != _ULFD_RING_NIL) ring->free_head = ring->reqs[slot].next;
+  return slot;
+}
+ul_hapi void _ulfd_ring_free_req(ulfd_ring_t* ring, unsigned slot) {
+  ring->reqs[slot].next = ring->free_head;
+  ring->free_head = slot;
+}
+ul_hapi void _ulfd_ring_fill_cqe(ulfd_ring_cqe_t* cqe, const _ulfd_ring_req_t* req) {
+  cqe->userdata = req->userdata;
+  cqe->result = req->result;
+  cqe->error = req->error;
+}
+
+#ifdef ULFD_POSIX_HAS_io_uring
+  ul_hapi int _ulfd_uring_enter(ulfd_ring_t* ring, unsigned to_submit, unsigned min_complete, unsigned* psubmitted) {
+    long ret;
+    unsigned flags = min_complete ? IORING_ENTER_GETEVENTS : 0u;
+    do {
+      ret = syscall(__NR_io_uring_enter, ring->uring_fd, to_submit, min_complete, flags, NULL, 0);
+    } while(ret < 0 && errno == EINTR && to_submit == 0);
+    if(ret < 0) return errno;
+    *psubmitted = ul_static_cast(unsigned, ret);
+    return 0;
+  }
+
+  ul_hapi int _ulfd_uring_probe(int fd) {
+    struct io_uring_probe* probe;
+    size_t len = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    int ok;
+
+    probe = ul_reinterpret_cast(struct io_uring_probe*, ul_malloc(len));
+    if(ul_unlikely(probe == NULL)) return 0;
+    memset(probe, 0, len);
+    ok = syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) >= 0
+      && probe->last_op >= IORING_OP_WRITE
+      && (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED)
+      && (probe->ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED)
+      && (probe->ops[IORING_OP_FSYNC].flags & IO_URING_OP_SUPPORTED);
+    ul_free(probe);
+    return ok;
+  }
+
+  ul_hapi void _ulfd_uring_unmap(ulfd_ring_t* ring) {
+    if(ring->sqes) ulfd_munmap(ring->sqes, ring->sqes_len);
+    if(ring->cq_map && ring->cq_map != ring->sq_map) ulfd_munmap(ring->cq_map, ring->cq_map_len);
+    if(ring->sq_map) ulfd_munmap(ring->sq_map, ring->sq_map_len);
+    ring->sqes = ring->cq_map = ring->sq_map = NULL;
+  }
+
+  ul_hapi int _ulfd_uring_init(ulfd_ring_t* ring, unsigned entries) {
+    struct io_uring_params params;
+    char* sq;
+    char* cq;
+    int fd, err;
+
+    memset(&params, 0, sizeof(params));
+    fd = ul_static_cast(int, syscall(__NR_io_uring_setup, entries, &params));
+    if(fd < 0) return errno;
+    if(!_ulfd_uring_probe(fd)) { close(fd); return ENOSYS; }
+
+    ring->uring_fd = fd;
+    ring->sq_entries = params.sq_entries;
+    ring->cq_entries = params.cq_entries;
+    ring->sq_map_len = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_map_len = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+    if(params.features & IORING_FEAT_SINGLE_MMAP) {
+      if(ring->cq_map_len > ring->sq_map_len) ring->sq_map_len = ring->cq_map_len;
+      ring->cq_map_len = ring->sq_map_len;
+    }
+
+    err = ulfd_mmap(&ring->sq_map, fd, NULL, ring->sq_map_len, IORING_OFF_SQ_RING, ULFD_PROT_READWRITE | ULFD_MAP_SHARED);
+    if(err) goto fail;
+    if(params.features & IORING_FEAT_SINGLE_MMAP) ring->cq_map = ring->sq_map;
+    else {
+      err = ulfd_mmap(&ring->cq_map, fd, NULL, ring->cq_map_len, IORING_OFF_CQ_RING, ULFD_PROT_READWRITE | ULFD_MAP_SHARED);
+      if(err) goto fail;
+    }
+    err = ulfd_mmap(&ring->sqes, fd, NULL, ring->sqes_len, IORING_OFF_SQES, ULFD_PROT_READWRITE | ULFD_MAP_SHARED);
+    if(err) goto fail;
+
+    sq = ul_reinterpret_cast(char*, ring->sq_map);
+    cq = ul_reinterpret_cast(char*, ring->cq_map);
+    ring->sq_head = ul_reinterpret_cast(unsigned*, sq + params.sq_off.head);
+    ring->sq_tail = ul_reinterpret_cast(unsigned*, sq + params.sq_off.tail);
+    ring->sq_mask = ul_reinterpret_cast(unsigned*, sq + params.sq_off.ring_mask);
+    ring->sq_array = ul_reinterpret_cast(unsigned*, sq + params.sq_off.array);
+    ring->cq_head = ul_reinterpret_cast(unsigned*, cq + params.cq_off.head);
+    ring->cq_tail = ul_reinterpret_cast(unsigned*, cq + params.cq_off.tail);
+    ring->cq_mask = ul_reinterpret_cast(unsigned*, cq + params.cq_off.ring_mask);
+    ring->cqes = cq + params.cq_off.cqes;
+    ring->sq_tail_local = *ring->sq_tail;
+    return 0;
+
+  fail:
+    _ulfd_uring_unmap(ring);
+    close(fd); ring->uring_fd = -1;
+    return err;
+  }
+
+  ul_hapi int _ulfd_uring_queue(ulfd_ring_t* ring, unsigned slot) {
+    const _ulfd_ring_req_t* req = ring->reqs + slot;
+    struct io_uring_sqe* sqe;
+    unsigned idx = ring->sq_tail_local & *ring->sq_mask;
+
+    sqe = ul_reinterpret_cast(struct io_uring_sqe*, ring->sqes) + idx;
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->fd = req->fd;
+    sqe->user_data = slot;
+    switch(req->op) {
+    case _ULFD_RING_OP_READ: sqe->opcode = IORING_OP_READ; break;
+    case _ULFD_RING_OP_WRITE: sqe->opcode = IORING_OP_WRITE; break;
+    case _ULFD_RING_OP_SYNC_RANGE:
+      sqe->opcode = IORING_OP_SYNC_FILE_RANGE;
+      sqe->sync_range_flags = ul_static_cast(__u32, req->flags);
+      break;
+    case _ULFD_RING_OP_FDATASYNC: sqe->fsync_flags = IORING_FSYNC_DATASYNC; /* fallthrough */
+    default: sqe->opcode = IORING_OP_FSYNC; break;
+    }
+    if(req->op != _ULFD_RING_OP_FSYNC && req->op != _ULFD_RING_OP_FDATASYNC) {
+      sqe->addr = ul_static_cast(__u64, ul_reinterpret_cast(size_t, req->buf));
+      sqe->len = ul_static_cast(__u32, req->count);
+      sqe->off = ul_static_cast(__u64, req->off);
+    }
+    ring->sq_array[idx] = idx;
+    ++ring->sq_tail_local;
+    return 0;
+  }
+
+  ul_hapi unsigned _ulfd_uring_reap(ulfd_ring_t* ring, ulfd_ring_cqe_t* cqes, unsigned max) {
+    unsigned head = *ring->cq_head, tail, n = 0;
+    const struct io_uring_cqe* cqe;
+    _ulfd_ring_req_t* req;
+
+    tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+    while(head != tail && n < max) {
+      cqe = ul_reinterpret_cast(const struct io_uring_cqe*, ring->cqes) + (head & *ring->cq_mask);
+      req = ring->reqs + ul_static_cast(unsigned, cqe->user_data);
+      if(cqe->res < 0) { req->error = -cqe->res; req->result = 0; }
+      else { req->error = 0; req->result = ul_static_cast(size_t, cqe->res); }
+      _ulfd_ring_fill_cqe(cqes + n++, req);
+      _ulfd_ring_free_req(ring, ul_static_cast(unsigned, cqe->user_data));
+      ++head;
+    }
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    ring->inflight -= n;
+    return n;
+  }
+#endif
+
+ul_hapi int ulfd_ring_init(ulfd_ring_t* ring, unsigned entries, int flags) {
+  unsigned i;
+
+  if(entries == 0 || entries > 32768) return EINVAL;
+  memset(ring, 0, sizeof(*ring));
+  ring->uring_fd = -1;
+  ring->sq_entries = 1;
+  while(ring->sq_entries < entries) ring->sq_entries <<= 1;
+  ring->cq_entries = ring->sq_entries << 1;
+
+#ifdef ULFD_POSIX_HAS_io_uring
+  if(!(flags & ULFD_RING_EMULATE)) _ulfd_uring_init(ring, ring->sq_entries);
+#else
+  (void)flags;
+#endif
+
+  ring->reqs = ul_reinterpret_cast(_ulfd_ring_req_t*, ul_malloc(ring->cq_entries * sizeof(_ulfd_ring_req_t)));
+  if(ul_unlikely(ring->reqs == NULL)) goto no_memory;
+  for(i = 0; i < ring->cq_entries; ++i) ring->reqs[i].next = i + 1;
+  ring->reqs[ring->cq_entries - 1].next = _ULFD_RING_NIL;
+  ring->free_head = 0;
+
+  if(ring->uring_fd < 0) {
+    ring->fifo = ul_reinterpret_cast(unsigned*, ul_malloc(ring->cq_entries * sizeof(unsigned)));
+    if(ul_unlikely(ring->fifo == NULL)) goto no_memory;
+  }
+  return 0;
+
+no_memory:
+  ulfd_ring_deinit(ring);
+  return ENOMEM;
+}
+ul_hapi int ulfd_ring_deinit(ulfd_ring_t* ring) {
+  int err = 0;
+#ifdef ULFD_POSIX_HAS_io_uring
+  if(ring->uring_fd >= 0) {
+    _ulfd_uring_unmap(ring);
+    err = ulfd_close(ring->uring_fd);
+    ring->uring_fd = -1;
+  }
+#endif
+  if(ring->reqs) ul_free(ring->reqs);
+  if(ring->fifo) ul_free(ring->fifo);
+  ring->reqs = NULL; ring->fifo = NULL;
+  return err;
+}
+
+ul_hapi int _ulfd_ring_queue(
+  ulfd_ring_t* ring, int op, ulfd_t fd, void* buf, size_t count, ulfd_int64_t off, int flags, void* userdata
+) {
+  _ulfd_ring_req_t* req;
+  unsigned slot;
+
+  if(ul_unlikely(off < 0)) return EINVAL;
+  if(ring->queued >= ring->sq_entries) return EAGAIN;
+  slot = _ulfd_ring_alloc_req(ring);
+  if(slot == _ULFD_RING_NIL) return EAGAIN;
+
+  req = ring->reqs + slot;
+  req->userdata = userdata;
+  req->buf = buf;
+  req->count = count > 0x7FFFF000u ? 0x7FFFF000u : count; /* completions report `int` bytes */
+  req->off = off;
+  req->fd = fd;
+  req->op = op;
+  req->flags = flags;
+  req->error = 0;
+  req->result = 0;
+
+#ifdef ULFD_POSIX_HAS_io_uring
+  if(ring->uring_fd >= 0) _ulfd_uring_queue(ring, slot);
+  else
+#endif
+  ring->fifo[(ring->fifo_head + ring->fifo_done + ring->queued) % ring->cq_entries] = slot;
+  ++ring->queued;
+  return 0;
+}
+ul_hapi int ulfd_ring_pread(ulfd_ring_t* ring, ulfd_t fd, void* buf, size_t count, ulfd_int64_t off, void* userdata) {
+  return _ulfd_ring_queue(ring, _ULFD_RING_OP_READ, fd, buf, count, off, 0, userdata);
+}
+ul_hapi int ulfd_ring_pwrite(ulfd_ring_t* ring, ulfd_t fd, const void* buf, size_t count, ulfd_int64_t off, void* userdata) {
+  return _ulfd_ring_queue(ring, _ULFD_RING_OP_WRITE, fd, ul_const_cast(void*, buf), count, off, 0, userdata);
+}
+ul_hapi int ulfd_ring_fsync(ulfd_ring_t* ring, ulfd_t fd, void* userdata) {
+  return _ulfd_ring_queue(ring, _ULFD_RING_OP_FSYNC, fd, NULL, 0, 0, 0, userdata);
+}
+ul_hapi int ulfd_ring_fdatasync(ulfd_ring_t* ring, ulfd_t fd, void* userdata) {
+  return _ulfd_ring_queue(ring, _ULFD_RING_OP_FDATASYNC, fd, NULL, 0, 0, 0, userdata);
+}
+ul_hapi int ulfd_ring_sync_file_range(ulfd_ring_t* ring, ulfd_t fd, ulfd_int64_t off, ulfd_int64_t len, int flags, void* userdata) {
+  if(ul_unlikely(len < 0)) return EINVAL;
+  if(len > 0x7FFFF000) len = 0; /* syncing more is harmless */
+  return _ulfd_ring_queue(ring, _ULFD_RING_OP_SYNC_RANGE, fd, NULL, ul_static_cast(size_t, len), off, flags, userdata);
+}
+
+ul_hapi void _ulfd_ring_emulate(ulfd_ring_t* ring) {
+  _ulfd_ring_req_t* req;
+  while(ring->queued) {
+    req = ring->reqs + ring->fifo[(ring->fifo_head + ring->fifo_done) % ring->cq_entries];
+    switch(req->op) {
+    case _ULFD_RING_OP_READ: req->error = ulfd_pread(req->fd, req->buf, req->count, req->off, &req->result); break;
+    case _ULFD_RING_OP_WRITE: req->error = ulfd_pwrite(req->fd, req->buf, req->count, req->off, &req->result); break;
+    case _ULFD_RING_OP_FSYNC: req->error = ulfd_fsync(req->fd); break;
+    case _ULFD_RING_OP_SYNC_RANGE:
+      req->error = ulfd_sync_file_range(req->fd, req->off, ul_static_cast(ulfd_int64_t, req->count), req->flags);
+      break;
+    default: req->error = ulfd_fdatasync(req->fd); break;
+    }
+    if(req->error) req->result = 0;
+    --ring->queued; ++ring->fifo_done;
+  }
+}
+ul_hapi unsigned _ulfd_ring_emulate_reap(ulfd_ring_t* ring, ulfd_ring_cqe_t* cqes, unsigned max) {
+  unsigned n = 0, slot;
+  while(n < max && ring->fifo_done) {
+    slot = ring->fifo[ring->fifo_head];
+    _ulfd_ring_fill_cqe(cqes + n++, ring->reqs + slot);
+    _ulfd_ring_free_req(ring, slot);
+    ring->fifo_head = (ring->fifo_head + 1) % ring->cq_entries;
+    --ring->fifo_done;
+  }
+  return n;
+}
+
+ul_hapi int ulfd_ring_submit(ulfd_ring_t* ring, unsigned* psubmitted) {
+  unsigned submitted = ring->queued;
+#ifdef ULFD_POSIX_HAS_io_uring
+  if(ring->uring_fd >= 0) {
+    int err;
+    __atomic_store_n(ring->sq_tail, ring->sq_tail_local, __ATOMIC_RELEASE);
+    if(submitted) {
+      err = _ulfd_uring_enter(ring, ring->queued, 0, &submitted);
+      if(err) return err;
+    }
+    ring->queued -= submitted;
+    ring->inflight += submitted;
+    if(psubmitted) *psubmitted = submitted;
+    return 0;
+  }
+#endif
+  _ulfd_ring_emulate(ring);
+  if(psubmitted) *psubmitted = submitted;
+  return 0;
+}
+
+ul_hapi int _ulfd_ring_wait(
+  ulfd_ring_t* ring, ulfd_ring_cqe_t* cqes, unsigned max, unsigned min_complete, unsigned* pcount, int submit
+) {
+  unsigned n = 0;
+  if(min_complete > max) min_complete = max;
+
+#ifdef ULFD_POSIX_HAS_io_uring
+  if(ring->uring_fd >= 0) {
+    unsigned submitted, to_submit = 0, need;
+    int err = 0;
+    if(submit && ring->queued) {
+      __atomic_store_n(ring->sq_tail, ring->sq_tail_local, __ATOMIC_RELEASE);
+      to_submit = ring->queued;
+    }
+    for(;;) {
+      n += _ulfd_uring_reap(ring, cqes + n, max - n);
+      need = min_complete > n ? min_complete - n : 0;
+      if(need > ring->inflight + to_submit) need = ring->inflight + to_submit;
+      if(need == 0 && to_submit == 0) break;
+      err = _ulfd_uring_enter(ring, to_submit, need, &submitted);
+      if(err) {
+        if(err == EINTR && to_submit == 0) continue;
+        break;
+      }
+      ring->queued -= submitted;
+      ring->inflight += submitted;
+      to_submit = 0;
+    }
+    *pcount = n;
+    return err;
+  }
+#endif
+
+  if(submit) _ulfd_ring_emulate(ring);
+  n = _ulfd_ring_emulate_reap(ring, cqes, max);
+  *pcount = n;
+  return 0;
+}
+ul_hapi int ulfd_ring_wait(ulfd_ring_t* ring, ulfd_ring_cqe_t* cqes, unsigned max, unsigned min_complete, unsigned* pcount) {
+  return _ulfd_ring_wait(ring, cqes, max, min_complete, pcount, 0);
+}
+ul_hapi int ulfd_ring_submit_wait(
+  ulfd_ring_t* ring, ulfd_ring_cqe_t* cqes, unsigned max, unsigned min_complete, unsigned* pcount
+) {
+  return _ulfd_ring_wait(ring, cqes, max, min_complete, pcount, 1);
+}
+
+#define _ULFD_FSYNC_GROUP_BATCH 64
+ul_hapi int ulfd_fsync_group(ulfd_ring_t* ring, const ulfd_t* fds, unsigned count, int flags, int* errors) {
+  ulfd_ring_t local;
+  ulfd_ring_cqe_t cqes[_ULFD_FSYNC_GROUP_BATCH];
+  unsigned queued = 0, done = 0, n, i, want;
+  int err = 0, first = 0;
+  size_t index;
+
+  if(count == 0) return 0;
+  if(ring == NULL) {
+    err = ulfd_ring_init(&local, count < _ULFD_FSYNC_GROUP_BATCH ? count : _ULFD_FSYNC_GROUP_BATCH, 0);
+    if(err) return err;
+    ring = &local;
+  }
+  while(done < count) {
+    for(; queued < count; ++queued) {
+      err = (flags & ULFD_FSYNC_GROUP_DATA)
+        ? ulfd_ring_fdatasync(ring, fds[queued], ul_reinterpret_cast(void*, ul_static_cast(size_t, queued)))
+        : ulfd_ring_fsync(ring, fds[queued], ul_reinterpret_cast(void*, ul_static_cast(size_t, queued)));
+      if(err) break;
+    }
+    if(err == EAGAIN) err = 0;
+    if(err) break;
+    want = queued - done < _ULFD_FSYNC_GROUP_BATCH ? queued - done : _ULFD_FSYNC_GROUP_BATCH;
+    err = ulfd_ring_submit_wait(ring, cqes, _ULFD_FSYNC_GROUP_BATCH, want, &n);
+    for(i = 0; i < n; ++i) {
+      index = ul_reinterpret_cast(size_t, cqes[i].userdata);
+      if(errors) errors[index] = cqes[i].error;
+      if(first == 0) first = cqes[i].error;
+    }
+    done += n;
+    if(err) break;
+  }
+  /* requests in flight must complete before returning */
+  while(err && done < queued) {
+    want = queued - done < _ULFD_FSYNC_GROUP_BATCH ? queued - done : _ULFD_FSYNC_GROUP_BATCH;
+    if(ulfd_ring_submit_wait(ring, cqes, _ULFD_FSYNC_GROUP_BATCH, want, &n) && n == 0) break;
+    for(i = 0; i < n; ++i)
+      if(errors) errors[ul_reinterpret_cast(size_t, cqes[i].userdata)] = cqes[i].error;
+    done += n;
+  }
+  if(ring == &local) ulfd_ring_deinit(&local);
+  return err ? err : first;
+}
+
+
+ul_hapi void _ulfd_mapfile_apply_policy(ulfd_mapfile_t* mf) {
+  if(mf->map == NULL) return;
+  switch(mf->policy) {
+  case ULFD_MAPFILE_SEQUENTIAL:
+    ulfd_madvise(mf->map, mf->map_len, ULFD_MADV_SEQUENTIAL);
+    ulfd_madvise(mf->map, mf->map_len, ULFD_MADV_WILLNEED);
+    break;
+  case ULFD_MAPFILE_RANDOM: ulfd_madvise(mf->map, mf->map_len, ULFD_MADV_RANDOM); break;
+  case ULFD_MAPFILE_WILLNEED: ulfd_madvise(mf->map, mf->map_len, ULFD_MADV_WILLNEED); break;
+  default: break;
+  }
+}
+ul_hapi void _ulfd_mapfile_unmap(ulfd_mapfile_t* mf) {
+  if(mf->map) ulfd_munmap(mf->map, mf->map_len);
+  mf->map = NULL; mf->map_len = 0;
+  mf->data = NULL; mf->len = 0;
+}
+ul_hapi int _ulfd_mapfile_len_to_end(ulfd_mapfile_t* mf, ulfd_int64_t off, size_t* plen) {
+  ulfd_int64_t length;
+  int err = ulfd_ffilelength(mf->fd, &length);
+  if(err) return err;
+  if(off > length) return EINVAL;
+  length -= off;
+  if(ul_static_cast(ulfd_int64_t, ul_static_cast(size_t, length)) != length) return EOVERFLOW;
+  *plen = ul_static_cast(size_t, length);
+  return 0;
+}
+ul_hapi int _ulfd_mapfile_map(ulfd_mapfile_t* mf, ulfd_int64_t off, size_t len) {
+  ulfd_int64_t map_off = off - off % ul_static_cast(ulfd_int64_t, mf->granularity);
+  size_t head = ul_static_cast(size_t, off - map_off);
+  void* map;
+  int err;
+
+  if(len == 0) {
+    _ulfd_mapfile_unmap(mf);
+    mf->off = off;
+    return 0;
+  }
+  if(ul_unlikely(len > ~head)) return EOVERFLOW;
+  err = ulfd_mmap(&map, mf->fd, NULL, len + head, map_off, mf->flags);
+  if(err) return err;
+  _ulfd_mapfile_unmap(mf);
+
+  mf->map = map; mf->map_len = len + head; mf->map_off = map_off;
+  mf->data = ul_reinterpret_cast(char*, map) + head;
+  mf->len = len; mf->off = off;
+  _ulfd_mapfile_apply_policy(mf);
+  return 0;
+}
+
+ul_hapi int ulfd_mapfile_open(
+  ulfd_mapfile_t* mf, ulfd_t fd, ulfd_int64_t off, size_t len, int prot_and_flags, int policy
+) {
+  int err;
+  if(off < 0 || (prot_and_flags & (ULFD_MAP_ANONYMOUS | ULFD_MAP_FIXED))) return EINVAL;
+  memset(mf, 0, sizeof(*mf));
+  mf->fd = fd;
+  mf->flags = prot_and_flags;
+  mf->policy = policy;
+  mf->granularity = ulfd_mapgranularity();
+  if(len == 0) {
+    err = _ulfd_mapfile_len_to_end(mf, off, &len);
+    if(err) return err;
+  }
+  return _ulfd_mapfile_map(mf, off, len);
+}
+ul_hapi int ulfd_mapfile_close(ulfd_mapfile_t* mf) {
+  int err = mf->map ? ulfd_munmap(mf->map, mf->map_len) : 0;
+  mf->map = NULL; mf->map_len = 0;
+  mf->data = NULL; mf->len = 0;
+  return err;
+}
+
+ul_hapi int ulfd_mapfile_remap(ulfd_mapfile_t* mf, ulfd_int64_t off, size_t len) {
+  int err;
+  if(off < 0) return EINVAL;
+  if(len == 0) {
+    err = _ulfd_mapfile_len_to_end(mf, off, &len);
+    if(err) return err;
+  }
+  if(mf->map && len && off >= mf->map_off
+    && ul_static_cast(size_t, off - mf->map_off) <= mf->map_len
+    && len <= mf->map_len - ul_static_cast(size_t, off - mf->map_off)
+  ) {
+    mf->data = ul_reinterpret_cast(char*, mf->map) + (off - mf->map_off);
+    mf->len = len; mf->off = off;
+    return 0;
+  }
+  return _ulfd_mapfile_map(mf, off, len);
+}
+
+ul_hapi int ulfd_mapfile_resize(ulfd_mapfile_t* mf, size_t len) {
+  size_t head;
+  void* map;
+  int err;
+
+  if((mf->flags & ULFD_MAP_SHARED) && (mf->flags & ULFD_PROT_WRITE)) {
+    ulfd_int64_t length, end = mf->off + ul_static_cast(ulfd_int64_t, len);
+    if(end < mf->off) return EOVERFLOW;
+    err = ulfd_ffilelength(mf->fd, &length);
+    if(err) return err;
+    if(end > length) {
+      err = ulfd_ftruncate(mf->fd, end);
+      if(err) return err;
+    }
+  }
+  if(len == mf->len) return 0;
+
+  if(mf->map && len) {
+    head = ul_static_cast(size_t, mf->off - mf->map_off);
+    if(ul_unlikely(len > ~head)) return EOVERFLOW;
+    map = mf->map;
+    err = ulfd_mremap(&map, mf->map_len, len + head);
+    if(err == 0) {
+      mf->map = map; mf->map_len = len + head;
+      mf->data = ul_reinterpret_cast(char*, map) + head;
+      mf->len = len;
+      _ulfd_mapfile_apply_policy(mf);
+      return 0;
+    }
+    if(err != ENOSYS) return err;
+  }
+  return _ulfd_mapfile_map(mf, mf->off, len);
+}
+
+ul_hapi int ulfd_mapfile_set_policy(ulfd_mapfile_t* mf, int policy) {
+  if(policy < ULFD_MAPFILE_NORMAL || policy > ULFD_MAPFILE_WILLNEED) return EINVAL;
+  if(mf->map && mf->policy != ULFD_MAPFILE_NORMAL) ulfd_madvise(mf->map, mf->map_len, ULFD_MADV_NORMAL);
+  mf->policy = policy;
+  _ulfd_mapfile_apply_policy(mf);
+  return 0;
+}
+
+ul_hapi int ulfd_mapfile_sync(ulfd_mapfile_t* mf, size_t off, size_t len, int flags) {
+  size_t start, pagesize;
+  if(off > mf->len) return EINVAL;
+  if(len == 0 || len > mf->len - off) len = mf->len - off;
+  if(len == 0) return 0;
+
+  /* `msync` needs a page-aligned address, and the mapping itself is page-aligned */
+  pagesize = ulfd_pagesize();
+  start = ul_static_cast(size_t, mf->data - ul_reinterpret_cast(char*, mf->map)) + off;
+  len += start % pagesize;
+  start -= start % pagesize;
+  return ulfd_msync(ul_reinterpret_cast(char*, mf->map) + start, len, flags);
+}
+
+
+#if defined(__AVX2__)
+  #include <immintrin.h>
+  #define _ULFD_SIMD_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #include <emmintrin.h>
+  #define _ULFD_SIMD_SSE2
+#elif defined(__aarch64__) || defined(_M_ARM64)
+  #include <arm_neon.h>
+  #define _ULFD_SIMD_NEON
+#endif
+/* bit `i` is set if `p[i] == c`, `n` <= 64 */
+ul_hapi ulfd_uint64_t _ulfd_mask64_eq(const char* p, size_t n, char c) {
+  ulfd_uint64_t mask = 0;
+  size_t i;
+  if(n == 64) {
+  #if defined(_ULFD_SIMD_AVX2)
+    __m256i d = _mm256_set1_epi8(c);
+    ulfd_uint64_t lo = ul_static_cast(unsigned,
+      _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256(ul_reinterpret_cast(const __m256i*, p)), d)));
+    ulfd_uint64_t hi = ul_static_cast(unsigned,
+      _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256(ul_reinterpret_cast(const __m256i*, p + 32)), d)));
+    return lo | (hi << 32);
+  #elif defined(_ULFD_SIMD_SSE2)
+    __m128i d = _mm_set1_epi8(c);
+    for(i = 0; i < 4; ++i)
+      mask |= ul_static_cast(ulfd_uint64_t, ul_static_cast(unsigned, _mm_movemask_epi8(
+        _mm_cmpeq_epi8(_mm_loadu_si128(ul_reinterpret_cast(const __m128i*, p + i * 16)), d)))) << (i * 16);
+    return mask;
+  #elif defined(_ULFD_SIMD_NEON)
+    /* weight every lane by its bit, then add neighbors until each byte holds 8 lanes */
+    static const unsigned char weights[16] = { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+    uint8x16_t d = vdupq_n_u8(ul_static_cast(unsigned char, c)), w = vld1q_u8(weights);
+    const unsigned char* q = ul_reinterpret_cast(const unsigned char*, p);
+    uint8x16_t m0 = vandq_u8(vceqq_u8(vld1q_u8(q), d), w);
+    uint8x16_t m1 = vandq_u8(vceqq_u8(vld1q_u8(q + 16), d), w);
+    uint8x16_t m2 = vandq_u8(vceqq_u8(vld1q_u8(q + 32), d), w);
+    uint8x16_t m3 = vandq_u8(vceqq_u8(vld1q_u8(q + 48), d), w);
+    uint8x16_t sum = vpaddq_u8(vpaddq_u8(m0, m1), vpaddq_u8(m2, m3));
+    sum = vpaddq_u8(sum, sum);
+    return vgetq_lane_u64(vreinterpretq_u64_u8(sum), 0);
+  #endif
+  }
+  for(i = 0; i < n; ++i)
+    if(p[i] == c) mask |= ul_static_cast(ulfd_uint64_t, 1) << i;
+  return mask;
+}
+/* `x` != 0 */
+ul_hapi int _ulfd_ctz64(ulfd_uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_ctzll(x);
+#else
+  int n = 0;
+  while(!(x & 1)) { x >>= 1; ++n; }
+  return n;
+#endif
+}
+
+ul_hapi int ulfd_mapscan_open(ulfd_mapscan_t* scan, ulfd_t fd, size_t window, int delim) {
+  int err;
+  memset(scan, 0, sizeof(*scan));
+  scan->window = window ? window : ULFD_MAPSCAN_WINDOW;
+  scan->delim = delim;
+  err = ulfd_ffilelength(fd, &scan->size);
+  if(err) return err;
+  scan->mf.fd = fd;
+  if(scan->size == 0) return 0;
+  return ulfd_mapfile_open(&scan->mf, fd, 0,
+    scan->size < ul_static_cast(ulfd_int64_t, scan->window) ? ul_static_cast(size_t, scan->size) : scan->window,
+    ULFD_PROT_READ | ULFD_MAP_SHARED, ULFD_MAPFILE_SEQUENTIAL);
+}
+ul_hapi int ulfd_mapscan_close(ulfd_mapscan_t* scan) {
+  return ulfd_mapfile_close(&scan->mf);
+}
+ul_hapi int ulfd_mapscan_next(ulfd_mapscan_t* scan, const char** pdata, size_t* plen) {
+  ulfd_int64_t hit, end, len;
+  size_t n;
+  int err;
+
+  for(;;) {
+    if(scan->mask) {
+      hit = scan->mask_off + _ulfd_ctz64(scan->mask);
+      scan->mask &= scan->mask - 1;
+      break;
+    }
+    if(scan->scanned >= scan->size) {
+      if(scan->pos >= scan->size) { *pdata = NULL; *plen = 0; return 0; }
+      hit = scan->size - 1;
+      break;
+    }
+    end = scan->mf.off + ul_static_cast(ulfd_int64_t, scan->mf.len);
+    if(scan->scanned >= end) {
+      /* the window restarts at the pending record, with a full window after what is scanned */
+      len = scan->scanned - scan->pos + ul_static_cast(ulfd_int64_t, scan->window);
+      if(len > scan->size - scan->pos) len = scan->size - scan->pos;
+      if(ul_static_cast(ulfd_int64_t, ul_static_cast(size_t, len)) != len) return EOVERFLOW;
+      err = ulfd_mapfile_remap(&scan->mf, scan->pos, ul_static_cast(size_t, len));
+      if(err) return err;
+      end = scan->mf.off + ul_static_cast(ulfd_int64_t, scan->mf.len);
+    }
+    n = end - scan->scanned < 64 ? ul_static_cast(size_t, end - scan->scanned) : 64;
+    scan->mask = _ulfd_mask64_eq(scan->mf.data + (scan->scanned - scan->mf.off), n, ul_static_cast(char, scan->delim));
+    scan->mask_off = scan->scanned;
+    scan->scanned += ul_static_cast(ulfd_int64_t, n);
+  }
+
+  *pdata = scan->mf.data + (scan->pos - scan->mf.off);
+  *plen = ul_static_cast(size_t, hit + 1 - scan->pos);
+  scan->pos = hit + 1;
+  return 0;
+}
+
+#define _ULFD_STREAM_READAHEAD 4096
+#define _ULFD_STREAM_EMPTY  0
+#define _ULFD_STREAM_INPUT  1
+#define _ULFD_STREAM_OUTPUT 2
+
+ul_hapi int ulfd_stream_open(ulfd_stream_t* stream, ulfd_t fd, size_t bufsize, int flags) {
+  if(bufsize == 0) bufsize = ULFD_STREAM_BUFSIZE;
+  stream->buf = ul_reinterpret_cast(char*, ul_malloc(bufsize));
+  if(ul_unlikely(stream->buf == NULL)) return ENOMEM;
+  stream->fd = fd;
+  stream->flags = flags;
+  stream->state = _ULFD_STREAM_EMPTY;
+  stream->cap = bufsize;
+  stream->pos = stream->end = 0;
+  stream->readahead = bufsize < _ULFD_STREAM_READAHEAD ? bufsize : _ULFD_STREAM_READAHEAD;
+  return 0;
+}
+ul_hapi int _ulfd_stream_write_all(ulfd_t fd, const char* data, size_t len) {
+  size_t writen;
+  int err;
+  while(len) {
+    err = ulfd_write(fd, data, len, &writen);
+    if(err) return err;
+    if(ul_unlikely(writen == 0)) return EIO;
+    data += writen; len -= writen;
+  }
+  return 0;
+}
+ul_hapi int ulfd_stream_flush(ulfd_stream_t* stream) {
+  int err;
+  if(stream->state != _ULFD_STREAM_OUTPUT) return 0;
+  err = _ulfd_stream_write_all(stream->fd, stream->buf + stream->pos, stream->end - stream->pos);
+  if(err) return err;
+  stream->pos = stream->end = 0;
+  stream->state = _ULFD_STREAM_EMPTY;
+  return 0;
+}
+ul_hapi int ulfd_stream_close(ulfd_stream_t* stream) {
+  int err = ulfd_stream_flush(stream), err2;
+  ul_free(stream->buf);
+  stream->buf = NULL;
+  if(stream->flags & ULFD_STREAM_OWNFD) {
+    err2 = ulfd_close(stream->fd);
+    if(err == 0) err = err2;
+  }
+  return err;
+}
+/* the unread bytes are given back to `fd` so that writing continues where reading stopped */
+ul_hapi int _ulfd_stream_drop_input(ulfd_stream_t* stream) {
+  if(stream->state == _ULFD_STREAM_INPUT && stream->pos < stream->end) {
+    ulfd_int64_t off;
+    int err = ulfd_seek(stream->fd, -ul_static_cast(ulfd_int64_t, stream->end - stream->pos), ULFD_SEEK_CUR, &off);
+    if(err) return err;
+  }
+  stream->pos = stream->end = 0;
+  stream->state = _ULFD_STREAM_EMPTY;
+  return 0;
+}
+ul_hapi int _ulfd_stream_reserve(ulfd_stream_t* stream, size_t need) {
+  char* buf;
+  size_t cap;
+  if(need <= stream->cap) return 0;
+  cap = stream->cap + (stream->cap >> 1);
+  if(cap < need) cap = need;
+  buf = ul_reinterpret_cast(char*, ul_realloc(stream->buf, cap));
+  if(ul_unlikely(buf == NULL)) return ENOMEM;
+  stream->buf = buf; stream->cap = cap;
+  return 0;
+}
+/* read until `want` bytes are buffered, `*pgot` is 0 at the end of file */
+ul_hapi int _ulfd_stream_fill(ulfd_stream_t* stream, size_t want, size_t* pgot) {
+  size_t n, got, total = 0;
+  int err;
+
+  if(stream->state == _ULFD_STREAM_OUTPUT) {
+    err = ulfd_stream_flush(stream);
+    if(err) return err;
+  }
+  stream->state = _ULFD_STREAM_INPUT;
+  if(stream->pos) {
+    memmove(stream->buf, stream->buf + stream->pos, stream->end - stream->pos);
+    stream->end -= stream->pos;
+    stream->pos = 0;
+  }
+  err = _ulfd_stream_reserve(stream, want);
+  if(err) return err;
+  do {
+    n = stream->readahead;
+    if(n < want - stream->end) n = want - stream->end;
+    if(n > stream->cap - stream->end) n = stream->cap - stream->end;
+    err = ulfd_read(stream->fd, stream->buf + stream->end, n, &got);
+    if(err) return err;
+    if(got == 0) break;
+    stream->end += got; total += got;
+    if(got == n && stream->readahead < stream->cap) {
+      stream->readahead <<= 1;
+      if(stream->readahead > stream->cap) stream->readahead = stream->cap;
+    }
+  } while(stream->end < want);
+  *pgot = total;
+  return 0;
+}
+
+ul_hapi int ulfd_stream_read(ulfd_stream_t* stream, void* buf, size_t count, size_t* pread_bytes) {
+  char* out = ul_reinterpret_cast(char*, buf);
+  size_t done = 0, n, got;
+  int err = 0;
+
+  while(done < count) {
+    if(stream->state == _ULFD_STREAM_INPUT && stream->pos < stream->end) {
+      n = stream->end - stream->pos;
+      if(n > count - done) n = count - done;
+      memcpy(out + done, stream->buf + stream->pos, n);
+      stream->pos += n; done += n;
+      continue;
+    }
+    if(count - done >= stream->cap) {
+      err = ulfd_stream_flush(stream);
+      if(err) break;
+      err = ulfd_read(stream->fd, out + done, count - done, &got);
+      if(err || got == 0) break;
+      done += got;
+    } else {
+      err = _ulfd_stream_fill(stream, 1, &got);
+      if(err || got == 0) break;
+    }
+  }
+  *pread_bytes = done;
+  return done ? 0 : err;
+}
+ul_hapi int ulfd_stream_write(ulfd_stream_t* stream, const void* buf, size_t count, size_t* pwriten_bytes) {
+  const char* in = ul_reinterpret_cast(const char*, buf);
+  int err;
+
+  *pwriten_bytes = 0;
+  if(stream->state == _ULFD_STREAM_INPUT) {
+    err = _ulfd_stream_drop_input(stream);
+    if(err) return err;
+  }
+  if(count > stream->cap - stream->end) {
+    err = ulfd_stream_flush(stream);
+    if(err) return err;
+    if(count >= stream->cap) {
+      err = _ulfd_stream_write_all(stream->fd, in, count);
+      if(err) return err;
+      *pwriten_bytes = count;
+      return 0;
+    }
+  }
+  memcpy(stream->buf + stream->end, in, count);
+  stream->end += count;
+  stream->state = _ULFD_STREAM_OUTPUT;
+  *pwriten_bytes = count;
+  return 0;
+}
+
+ul_hapi int ulfd_stream_peek(ulfd_stream_t* stream, size_t want, const void** pdata, size_t* pavail) {
+  size_t got;
+  int err;
+  if(want == 0) want = 1;
+  if(stream->state != _ULFD_STREAM_INPUT || stream->end - stream->pos < want) {
+    err = _ulfd_stream_fill(stream, want, &got);
+    if(err) return err;
+  }
+  *pdata = stream->buf + stream->pos;
+  *pavail = stream->end - stream->pos;
+  return 0;
+}
+ul_hapi void ulfd_stream_consume(ulfd_stream_t* stream, size_t count) {
+  if(stream->state != _ULFD_STREAM_INPUT) return;
+  if(count > stream->end - stream->pos) count = stream->end - stream->pos;
+  stream->pos += count;
+}
+ul_hapi int ulfd_stream_scan(ulfd_stream_t* stream, int delim, const char** pdata, size_t* plen) {
+  size_t searched = 0, len, got;
+  const char* found;
+  int err;
+
+  if(stream->state != _ULFD_STREAM_INPUT) {
+    err = _ulfd_stream_fill(stream, 1, &got);
+    if(err) return err;
+  }
+  for(;;) {
+    len = stream->end - stream->pos;
+    found = ul_reinterpret_cast(const char*,
+      memchr(stream->buf + stream->pos + searched, delim, len - searched));
+    if(found) {
+      len = ul_static_cast(size_t, found - (stream->buf + stream->pos)) + 1;
+      break;
+    }
+    searched = len;
+    /* `_ulfd_stream_fill` moves the record to the front, so it keeps its length */
+    if(len == stream->cap) {
+      err = _ulfd_stream_reserve(stream, stream->cap + (stream->cap >> 1));
+      if(err) return err;
+    }
+    err = _ulfd_stream_fill(stream, len + 1, &got);
+    if(err) return err;
+    if(got == 0) break;
+  }
+  *pdata = stream->buf + stream->pos;
+  *plen = len;
+  stream->pos += len;
+  return 0;
+}
+
+ul_hapi int ulfd_stream_seek(ulfd_stream_t* stream, ulfd_int64_t off, int origin, ulfd_int64_t* poff) {
+  int err = ulfd_stream_flush(stream);
+  if(err) return err;
+  if(stream->state == _ULFD_STREAM_INPUT && origin == ULFD_SEEK_CUR)
+    off -= ul_static_cast(ulfd_int64_t, stream->end - stream->pos);
+  err = ulfd_seek(stream->fd, off, origin, poff);
+  if(err) return err;
+  stream->pos = stream->end = 0;
+  stream->state = _ULFD_STREAM_EMPTY;
+  stream->readahead = stream->cap < _ULFD_STREAM_READAHEAD ? stream->cap : _ULFD_STREAM_READAHEAD;
+  return 0;
+}
+ul_hapi int ulfd_stream_tell(ulfd_stream_t* stream, ulfd_int64_t* poff) {
+  int err = ulfd_tell(stream->fd, poff);
+  if(err) return err;
+  if(stream->state == _ULFD_STREAM_INPUT) *poff -= ul_static_cast(ulfd_int64_t, stream->end - stream->pos);
+  else if(stream->state == _ULFD_STREAM_OUTPUT) *poff += ul_static_cast(ulfd_int64_t, stream->end - stream->pos);
+  return 0;
+}
+
+#ifdef _WIN32
+  #define ULFD_NO_EPOLL
+  /* pipes and files don't signal readiness in Windows */
+  ul_hapi int ulfd_poller_open(ulfd_poller_t* poller) { (void)poller; return ENOSYS; }
+  ul_hapi int ulfd_poller_close(ulfd_poller_t* poller) { (void)poller; return ENOSYS; }
+  ul_hapi int ulfd_poller_add(ulfd_poller_t* poller, ulfd_t fd, int events, void* udata) {
+    (void)poller; (void)fd; (void)events; (void)udata;
+    return ENOSYS;
+  }
+  ul_hapi int ulfd_poller_mod(ulfd_poller_t* poller, ulfd_t fd, int events, void* udata) {
+    (void)poller; (void)fd; (void)events; (void)udata;
+    return ENOSYS;
+  }
+  ul_hapi int ulfd_poller_del(ulfd_poller_t* poller, ulfd_t fd) { (void)poller; (void)fd; return ENOSYS; }
+  ul_hapi int ulfd_poller_wait(ulfd_poller_t* poller, ulfd_poller_event_t* events, unsigned max, int timeout, unsigned* pcount) {
+    (void)poller; (void)events; (void)max; (void)timeout;
+    *pcount = 0;
+    return ENOSYS;
+  }
+  ul_hapi int ulfd_poller_wake(ulfd_poller_t* poller) { (void)poller; return ENOSYS; }
+#else
+  #include <poll.h>
+  #if defined(__linux__) && !defined(ULFD_NO_EPOLL)
+    #include <sys/epoll.h>
+    #include <sys/eventfd.h>
+    #define ULFD_POSIX_HAS_epoll
+  #elif !defined(ULFD_NO_EPOLL)
+    #define ULFD_NO_EPOLL
+  #endif
+
+  /* never a user pointer */
+  #define _ULFD_POLLER_WAKE_TAG ul_reinterpret_cast(void*, ~ul_static_cast(size_t, 0))
+  #define _ULFD_POLLER_BATCH 64
+
+  ul_hapi int _ulfd_poller_wake_open(ulfd_poller_t* poller) {
+    int pfds[2], i, flags, err;
+  #ifdef ULFD_POSIX_HAS_epoll
+    poller->wake_rd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(poller->wake_rd >= 0) { poller->wake_wr = poller->wake_rd; return 0; }
+    if(errno != ENOSYS && errno != EINVAL) return errno;
+  #endif
+    if(pipe(pfds) < 0) return errno;
+    for(i = 0; i < 2; ++i) {
+      flags = fcntl(pfds[i], F_GETFL);
+      if(flags < 0 || fcntl(pfds[i], F_SETFL, flags | O_NONBLOCK) < 0 || fcntl(pfds[i], F_SETFD, FD_CLOEXEC) < 0) {
+        err = errno;
+        close(pfds[0]); close(pfds[1]);
+        return err;
+      }
+    }
+    poller->wake_rd = pfds[0];
+    poller->wake_wr = pfds[1];
+    return 0;
+  }
+  ul_hapi void _ulfd_poller_wake_drain(ulfd_poller_t* poller) {
+    char buf[64];
+    ssize_t ret;
+    if(poller->wake_rd == poller->wake_wr) {
+      ret = read(poller->wake_rd, buf, 8); /* the eventfd counter */
+      (void)ret;
+    } else {
+      do {
+        ret = read(poller->wake_rd, buf, sizeof(buf));
+      } while(ret > 0);
+    }
+  }
+  ul_hapi int ulfd_poller_wake(ulfd_poller_t* poller) {
+    ulfd_uint64_t one = 1;
+    ssize_t ret = write(poller->wake_wr, &one, poller->wake_rd == poller->wake_wr ? sizeof(one) : 1);
+    /* EAGAIN: a wakeup is pending already */
+    if(ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK) return errno;
+    return 0;
+  }
+
+  #ifdef ULFD_POSIX_HAS_epoll
+    ul_hapi unsigned _ulfd_poller_to_epoll(int events) {
+      unsigned ret = 0;
+      if(events & ULFD_POLL_IN) ret |= EPOLLIN;
+      if(events & ULFD_POLL_OUT) ret |= EPOLLOUT;
+      if(events & ULFD_POLL_ET) ret |= EPOLLET;
+      if(events & ULFD_POLL_ONESHOT) ret |= EPOLLONESHOT;
+      return ret;
+    }
+    ul_hapi int _ulfd_poller_from_epoll(unsigned events) {
+      int ret = 0;
+      if(events & EPOLLIN) ret |= ULFD_POLL_IN;
+      if(events & EPOLLOUT) ret |= ULFD_POLL_OUT;
+      if(events & EPOLLERR) ret |= ULFD_POLL_ERR;
+      if(events & EPOLLHUP) ret |= ULFD_POLL_HUP;
+      return ret;
+    }
+    ul_hapi int _ulfd_poller_ctl(ulfd_poller_t* poller, int op, ulfd_t fd, int events, void* udata) {
+      struct epoll_event ev;
+      ev.events = _ulfd_poller_to_epoll(events);
+      ev.data.ptr = udata;
+      return epoll_ctl(poller->fd, op, fd, &ev) < 0 ? errno : 0;
+    }
+
+    ul_hapi int ulfd_poller_open(ulfd_poller_t* poller) {
+      struct epoll_event ev;
+      int err;
+      poller->fds = poller->slots = NULL;
+      poller->count = poller->cap = 0;
+      poller->fd = epoll_create1(EPOLL_CLOEXEC);
+      if(poller->fd < 0) return errno;
+      err = _ulfd_poller_wake_open(poller);
+      if(err) { close(poller->fd); return err; }
+      ev.events = EPOLLIN;
+      ev.data.ptr = _ULFD_POLLER_WAKE_TAG;
+      if(epoll_ctl(poller->fd, EPOLL_CTL_ADD, poller->wake_rd, &ev) < 0) {
+        err = errno;
+        ulfd_poller_close(poller);
+        return err;
+      }
+      return 0;
+    }
+    ul_hapi int ulfd_poller_close(ulfd_poller_t* poller) {
+      int err = 0;
+      if(poller->wake_wr != poller->wake_rd) close(poller->wake_wr);
+      close(poller->wake_rd);
+      if(close(poller->fd) < 0) err = errno;
+      return err;
+    }
+    ul_hapi int ulfd_poller_add(ulfd_poller_t* poller, ulfd_t fd, int events, void* udata) {
+      return _ulfd_poller_ctl(poller, EPOLL_CTL_ADD, fd, events, udata);
+    }
+    ul_hapi int ulfd_poller_mod(ulfd_poller_t* poller, ulfd_t fd, int events, void* udata) {
+      return _ulfd_poller_ctl(poller, EPOLL_CTL_MOD, fd, events, udata);
+    }
+    ul_hapi int ulfd_poller_del(ulfd_poller_t* poller, ulfd_t fd) {
+      struct epoll_event ev; /* Linux < 2.6.9 wants non-NULL */
+      return epoll_ctl(poller->fd, EPOLL_CTL_DEL, fd, &ev) < 0 ? errno : 0;
+    }
+    ul_hapi int ulfd_poller_wait(ulfd_poller_t* poller, ulfd_poller_event_t* events, unsigned max, int timeout, unsigned* pcount) {
+      struct epoll_event local[_ULFD_POLLER_BATCH];
+      struct epoll_event ev;
+      char* raw;
+      int ret, i;
+      unsigned n = 0;
+
+      *pcount = 0;
+      if(max == 0) return EINVAL;
+      /* `struct epoll_event` is no larger than `ulfd_poller_event_t` on 64-bit targets,
+        so the kernel can fill the caller's array, which is converted from back to front */
+      if(sizeof(struct epoll_event) <= sizeof(ulfd_poller_event_t)) {
+        raw = ul_reinterpret_cast(char*, events);
+        if(max > 0x7FFFFFFF) max = 0x7FFFFFFF;
+      } else {
+        raw = ul_reinterpret_cast(char*, local);
+        if(max > _ULFD_POLLER_BATCH) max = _ULFD_POLLER_BATCH;
+      }
+      ret = epoll_wait(poller->fd, ul_reinterpret_cast(struct epoll_event*, raw), ul_static_cast(int, max), timeout);
+      if(ret < 0) return errno;
+
+      for(i = ret - 1; i >= 0; --i) {
+        memcpy(&ev, raw + ul_static_cast(size_t, i) * sizeof(ev), sizeof(ev));
+        events[i].udata = ev.data.ptr;
+        events[i].events = _ulfd_poller_from_epoll(ev.events);
+      }
+      for(i = 0; i < ret; ++i) {
+        if(events[i].udata == _ULFD_POLLER_WAKE_TAG) _ulfd_poller_wake_drain(poller);
+        else events[n++] = events[i];
+      }
+      *pcount = n;
+      return 0;
+    }
+  #else
+    typedef struct _ulfd_poller_slot_t {
+      void* udata;
+      int events;
+    } _ulfd_poller_slot_t;
+    #define _ulfd_poller_fds(poller) ul_reinterpret_cast(struct pollfd*, (poller)->fds)
+    #define _ulfd_poller_slots(poller) ul_reinterpret_cast(_ulfd_poller_slot_t*, (poller)->slots)
+
+    ul_hapi short _ulfd_poller_to_poll(int events) {
+      short ret = 0;
+      if(events & ULFD_POLL_IN) ret |= POLLIN;
+      if(events & ULFD_POLL_OUT) ret |= POLLOUT;
+      return ret;
+    }
+    /* disabled one-shot descriptors are stored as `~fd`, which poll ignores */
+    ul_hapi size_t _ulfd_poller_find(ulfd_poller_t* poller, ulfd_t fd) {
+      struct pollfd* fds = _ulfd_poller_fds(poller);
+      size_t i;
+      for(i = 1; i < poller->count; ++i)
+        if(fds[i].fd == fd || fds[i].fd == ~fd) return i;
+      return 0;
+    }
+
+    ul_hapi int ulfd_poller_open(ulfd_poller_t* poller) {
+      int err;
+      poller->fd = -1;
+      poller->cap = 16;
+      poller->fds = ul_malloc(poller->cap * sizeof(struct pollfd));
+      poller->slots = ul_malloc(poller->cap * sizeof(_ulfd_poller_slot_t));
+      if(ul_unlikely(poller->fds == NULL || poller->slots == NULL)) {
+        ul_free(poller->fds); ul_free(poller->slots);
+        return ENOMEM;
+      }
+      err = _ulfd_poller_wake_open(poller);
+      if(err) {
+        ul_free(poller->fds); ul_free(poller->slots);
+        return err;
+      }
+      _ulfd_poller_fds(poller)[0].fd = poller->wake_rd;
+      _ulfd_poller_fds(poller)[0].events = POLLIN;
+      poller->count = 1;
+      return 0;
+    }
+    ul_hapi int ulfd_poller_close(ulfd_poller_t* poller) {
+      if(poller->wake_wr != poller->wake_rd) close(poller->wake_wr);
+      close(poller->wake_rd);
+      ul_free(poller->fds);
+      ul_free(poller->slots);
+      return 0;
+    }
+    ul_hapi int ulfd_poller_add(ulfd_poller_t* poller, ulfd_t fd, int events, void* udata) {
+      struct pollfd* fds;
+      void* ptr;
+      if(fd < 0) return EBADF;
+      if(events & ULFD_POLL_ET) return ENOSYS;
+      if(_ulfd_poller_find(poller, fd)) return EEXIST;
+      if(poller->count == poller->cap) {
+        ptr = ul_realloc(poller->fds, poller->cap * 2 * sizeof(struct pollfd));
+        if(ul_unlikely(ptr == NULL)) return ENOMEM;
+        poller->fds = ptr;
+        ptr = ul_realloc(poller->slots, poller->cap * 2 * sizeof(_ulfd_poller_slot_t));
+        if(ul_unlikely(ptr == NULL)) return ENOMEM;
+        poller->slots = ptr;
+        poller->cap *= 2;
+      }
+      fds = _ulfd_poller_fds(poller);
+      fds[poller->count].fd = fd;
+      fds[poller->count].events = _ulfd_poller_to_poll(events);
+      _ulfd_poller_slots(poller)[poller->count].udata = udata;
+      _ulfd_poller_slots(poller)[poller->count].events = events;
+      ++poller->count;
+      return 0;
+    }
+    ul_hapi int ulfd_poller_mod(ulfd_poller_t* poller, ulfd_t fd, int events, void* udata) {
+      size_t i;
+      if(events & ULFD_POLL_ET) return ENOSYS;
+      i = _ulfd_poller_find(poller, fd);
+      if(i == 0) return ENOENT;
+      _ulfd_poller_fds(poller)[i].fd = fd;
+      _ulfd_poller_fds(poller)[i].events = _ulfd_poller_to_poll(events);
+      _ulfd_poller_slots(poller)[i].udata = udata;
+      _ulfd_poller_slots(poller)[i].events = events;
+      return 0;
+    }
+    ul_hapi int ulfd_poller_del(ulfd_poller_t* poller, ulfd_t fd) {
+      size_t i = _ulfd_poller_find(poller, fd);
+      if(i == 0) return ENOENT;
+      --poller->count;
+      _ulfd_poller_fds(poller)[i] = _ulfd_poller_fds(poller)[poller->count];
+      _ulfd_poller_slots(poller)[i] = _ulfd_poller_slots(poller)[poller->count];
+      return 0;
+    }
+    ul_hapi int ulfd_poller_wait(ulfd_poller_t* poller, ulfd_poller_event_t* events, unsigned max, int timeout, unsigned* pcount) {
+      struct pollfd* fds = _ulfd_poller_fds(poller);
+      _ulfd_poller_slot_t* slots = _ulfd_poller_slots(poller);
+      size_t i;
+      unsigned n = 0;
+      int ret, revents;
+
+      *pcount = 0;
+      if(max == 0) return EINVAL;
+      ret = poll(fds, ul_static_cast(nfds_t, poller->count), timeout);
+      if(ret < 0) return errno;
+      if(ret > 0 && fds[0].revents) { _ulfd_poller_wake_drain(poller); --ret; }
+      for(i = 1; i < poller->count && ret > 0 && n < max; ++i) {
+        if(fds[i].revents == 0) continue;
+        --ret;
+        revents = 0;
+        if(fds[i].revents & POLLIN) revents |= ULFD_POLL_IN;
+        if(fds[i].revents & POLLOUT) revents |= ULFD_POLL_OUT;
+        if(fds[i].revents & (POLLERR | POLLNVAL)) revents |= ULFD_POLL_ERR;
+        if(fds[i].revents & POLLHUP) revents |= ULFD_POLL_HUP;
+        events[n].udata = slots[i].udata;
+        events[n].events = revents;
+        ++n;
+        if(slots[i].events & ULFD_POLL_ONESHOT) fds[i].fd = ~fds[i].fd;
+      }
+      *pcount = n;
+      return 0;
+    }
+  #endif
+#endif
+
+#define _ULFD_WATCH_BUFSIZE 65536
+#ifdef _WIN32
+  typedef struct _ulfd_watch_dir_t {
+    HANDLE handle;
+    OVERLAPPED ov;
+    DWORD filter;
+    int mask;
+    DWORD buf[_ULFD_WATCH_BUFSIZE / sizeof(DWORD)];
+  } _ulfd_watch_dir_t;
+  #define _ulfd_watch_dirs(watch) ul_reinterpret_cast(_ulfd_watch_dir_t**, (watch)->dirs)
+
+  ul_hapi int _ulfd_watch_issue(_ulfd_watch_dir_t* dir) {
+    if(!ReadDirectoryChangesW(dir->handle, dir->buf, sizeof(dir->buf), FALSE, dir->filter, NULL, &dir->ov, NULL))
+      return _ul_win32_toerrno(GetLastError());
+    return 0;
+  }
+  ul_hapi void _ulfd_watch_free_dir(_ulfd_watch_dir_t* dir) {
+    DWORD bytes;
+    /* the pending read must be finished before its buffer is freed */
+    CancelIo(dir->handle);
+    GetOverlappedResult(dir->handle, &dir->ov, &bytes, TRUE);
+    CloseHandle(dir->handle);
+    CloseHandle(dir->ov.hEvent);
+    ul_free(dir);
+  }
+
+  ul_hapi int ulfd_watch_open(ulfd_watch_t* watch) {
+    watch->fd = INVALID_HANDLE_VALUE;
+    watch->pos = watch->end = 0;
+    watch->cap = _ULFD_WATCH_BUFSIZE;
+    watch->dirs = NULL;
+    watch->dir_count = 0;
+    watch->current = 0;
+    /* UTF-8 takes at most 3 bytes for each UTF-16 unit, every record has a 12-byte header */
+    watch->names_cap = watch->cap * 2;
+    watch->buf = ul_reinterpret_cast(char*, ul_malloc(watch->cap));
+    watch->names = ul_reinterpret_cast(char*, ul_malloc(watch->names_cap));
+    if(ul_unlikely(watch->buf == NULL || watch->names == NULL)) {
+      ul_free(watch->buf); ul_free(watch->names);
+      return ENOMEM;
+    }
+    return 0;
+  }
+  ul_hapi int ulfd_watch_close(ulfd_watch_t* watch) {
+    size_t i;
+    for(i = 0; i < watch->dir_count; ++i)
+      if(_ulfd_watch_dirs(watch)[i]) _ulfd_watch_free_dir(_ulfd_watch_dirs(watch)[i]);
+    ul_free(watch->dirs);
+    ul_free(watch->buf);
+    ul_free(watch->names);
+    return 0;
+  }
+  ul_hapi int ulfd_watch_add_w(ulfd_watch_t* watch, const wchar_t* wpath, int mask, int* pwd) {
+    _ulfd_watch_dir_t* dir;
+    void* dirs;
+    size_t i, active = 0;
+    int err;
+
+    for(i = 0; i < watch->dir_count; ++i) active += _ulfd_watch_dirs(watch)[i] != NULL;
+    if(active >= MAXIMUM_WAIT_OBJECTS) return ENOSPC;
+    dir = ul_reinterpret_cast(_ulfd_watch_dir_t*, ul_malloc(sizeof(_ulfd_watch_dir_t)));
+    if(ul_unlikely(dir == NULL)) return ENOMEM;
+    memset(&dir->ov, 0, sizeof(dir->ov));
+    dir->mask = mask;
+    dir->filter = 0;
+    if(mask & (ULFD_WATCH_CREATE | ULFD_WATCH_DELETE | ULFD_WATCH_MOVED_FROM | ULFD_WATCH_MOVED_TO))
+      dir->filter |= FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME;
+    if(mask & ULFD_WATCH_MODIFY) dir->filter |= FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_SIZE;
+    if(mask & ULFD_WATCH_ATTRIB) dir->filter |= FILE_NOTIFY_CHANGE_ATTRIBUTES | FILE_NOTIFY_CHANGE_SECURITY;
+    dir->ov.hEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    if(dir->ov.hEvent == NULL) { err = _ul_win32_toerrno(GetLastError()); ul_free(dir); return err; }
+    dir->handle = CreateFileW(wpath, FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+      NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+    if(dir->handle == INVALID_HANDLE_VALUE) {
+      err = _ul_win32_toerrno(GetLastError());
+      CloseHandle(dir->ov.hEvent); ul_free(dir);
+      return err;
+    }
+    err = _ulfd_watch_issue(dir);
+    if(err) {
+      CloseHandle(dir->handle); CloseHandle(dir->ov.hEvent); ul_free(dir);
+      return err;
+    }
+
+    for(i = 0; i < watch->dir_count; ++i) if(_ulfd_watch_dirs(watch)[i] == NULL) break;
+    if(i == watch->dir_count) {
+      dirs = ul_realloc(watch->dirs, (watch->dir_count + 1) * sizeof(_ulfd_watch_dir_t*));
+      if(ul_unlikely(dirs == NULL)) { _ulfd_watch_free_dir(dir); return ENOMEM; }
+      watch->dirs = dirs;
+      ++watch->dir_count;
+    }
+    _ulfd_watch_dirs(watch)[i] = dir;
+    *pwd = ul_static_cast(int, i + 1);
+    return 0;
+  }
+  ul_hapi int ulfd_watch_add(ulfd_watch_t* watch, const char* path, int mask, int* pwd) {
+    int ret;
+    _ulfd_begin_to_wstr(wpath, path);
+    ret = ulfd_watch_add_w(watch, wpath, mask, pwd);
+    _ulfd_end_to_wstr(wpath);
+    return ret;
+  }
+  ul_hapi int ulfd_watch_add_dir(ulfd_watch_t* watch, ulfd_dir_t* dir, int mask, int* pwd) {
+    size_t len = ulfd_wcslen(dir->dirpath);
+    int ret;
+    dir->dirpath[len - 1] = 0; /* drop the trailing L'*' */
+    ret = ulfd_watch_add_w(watch, dir->dirpath, mask, pwd);
+    dir->dirpath[len - 1] = L'*';
+    return ret;
+  }
+  ul_hapi int ulfd_watch_rm(ulfd_watch_t* watch, int wd) {
+    _ulfd_watch_dir_t* dir;
+    if(wd <= 0 || ul_static_cast(size_t, wd) > watch->dir_count) return EINVAL;
+    dir = _ulfd_watch_dirs(watch)[wd - 1];
+    if(dir == NULL) return EINVAL;
+    _ulfd_watch_free_dir(dir);
+    _ulfd_watch_dirs(watch)[wd - 1] = NULL;
+    if(watch->current == wd) watch->pos = watch->end = 0;
+    return 0;
+  }
+  ul_hapi int _ulfd_watch_mask(DWORD action) {
+    switch(action) {
+    case FILE_ACTION_ADDED: return ULFD_WATCH_CREATE;
+    case FILE_ACTION_REMOVED: return ULFD_WATCH_DELETE;
+    case FILE_ACTION_MODIFIED: return ULFD_WATCH_MODIFY | ULFD_WATCH_ATTRIB;
+    case FILE_ACTION_RENAMED_OLD_NAME: return ULFD_WATCH_MOVED_FROM;
+    case FILE_ACTION_RENAMED_NEW_NAME: return ULFD_WATCH_MOVED_TO;
+    default: return 0;
+    }
+  }
+  ul_hapi int ulfd_watch_read(ulfd_watch_t* watch, ulfd_watch_event_t* events, unsigned max, int timeout, unsigned* pcount) {
+    HANDLE handles[MAXIMUM_WAIT_OBJECTS];
+    int wds[MAXIMUM_WAIT_OBJECTS];
+    _ulfd_watch_dir_t* dir;
+    FILE_NOTIFY_INFORMATION* info;
+    DWORD count = 0, ret, bytes, code;
+    size_t i, used = 0;
+    unsigned n = 0;
+    int len, mask, err;
+
+    *pcount = 0;
+    if(max == 0) return EINVAL;
+    if(watch->pos == watch->end) {
+      for(i = 0; i < watch->dir_count; ++i) {
+        if(_ulfd_watch_dirs(watch)[i] == NULL) continue;
+        handles[count] = _ulfd_watch_dirs(watch)[i]->ov.hEvent;
+        wds[count++] = ul_static_cast(int, i + 1);
+      }
+      if(count == 0) return EINVAL;
+      ret = WaitForMultipleObjects(count, handles, FALSE, timeout < 0 ? INFINITE : ul_static_cast(DWORD, timeout));
+      if(ret == WAIT_TIMEOUT) return 0;
+      if(ret >= WAIT_OBJECT_0 + count) return _ul_win32_toerrno(GetLastError());
+      watch->current = wds[ret - WAIT_OBJECT_0];
+      dir = _ulfd_watch_dirs(watch)[watch->current - 1];
+      if(!GetOverlappedResult(dir->handle, &dir->ov, &bytes, FALSE)) {
+        code = GetLastError();
+        /* ERROR_NOTIFY_ENUM_DIR: too many changes, reported as an overflow */
+        if(code != ERROR_NOTIFY_ENUM_DIR) {
+          /* the directory is gone or unreachable, drop the watch like inotify does */
+          _ulfd_watch_free_dir(dir);
+          _ulfd_watch_dirs(watch)[watch->current - 1] = NULL;
+          events[0].wd = watch->current;
+          events[0].mask = ULFD_WATCH_IGNORED;
+          events[0].cookie = 0;
+          events[0].namelen = 0;
+          events[0].name = "";
+          *pcount = 1;
+          return 0;
+        }
+        bytes = 0;
+      }
+      /* the buffer is copied, so the next read can start at once */
+      memcpy(watch->buf, dir->buf, bytes);
+      watch->pos = 0;
+      watch->end = bytes;
+      ResetEvent(dir->ov.hEvent);
+      err = _ulfd_watch_issue(dir);
+      if(bytes == 0) {
+        /* the changes didn't fit into the buffer */
+        events[0].wd = watch->current;
+        events[0].mask = ULFD_WATCH_OVERFLOW;
+        events[0].cookie = 0;
+        events[0].namelen = 0;
+        events[0].name = "";
+        *pcount = 1;
+        return err;
+      }
+      if(err) return err;
+    }
+
+    dir = _ulfd_watch_dirs(watch)[watch->current - 1];
+    while(watch->pos < watch->end && n < max) {
+      info = ul_reinterpret_cast(FILE_NOTIFY_INFORMATION*, watch->buf + watch->pos);
+      watch->pos = info->NextEntryOffset ? watch->pos + info->NextEntryOffset : watch->end;
+      mask = _ulfd_watch_mask(info->Action) & dir->mask;
+      if(mask == 0) continue;
+      len = WideCharToMultiByte(CP_UTF8, 0, info->FileName, ul_static_cast(int, info->FileNameLength / sizeof(WCHAR)),
+        watch->names + used, ul_static_cast(int, watch->names_cap - used - 1), NULL, NULL);
+      if(len <= 0 && info->FileNameLength) continue;
+      watch->names[used + ul_static_cast(size_t, len)] = 0;
+      events[n].wd = watch->current;
+      events[n].mask = mask;
+      events[n].cookie = 0;
+      events[n].namelen = ul_static_cast(size_t, len);
+      events[n].name = watch->names + used;
+      used += ul_static_cast(size_t, len) + 1;
+      ++n;
+    }
+    *pcount = n;
+    return 0;
+  }
+#elif defined(__linux__) && !defined(ULFD_NO_WATCH)
+  #include <sys/inotify.h>
+
+  ul_hapi unsigned _ulfd_watch_to_inotify(int mask) {
+    unsigned ret = 0;
+    if(mask & ULFD_WATCH_CREATE) ret |= IN_CREATE;
+    if(mask & ULFD_WATCH_MODIFY) ret |= IN_MODIFY;
+    if(mask & ULFD_WATCH_DELETE) ret |= IN_DELETE | IN_DELETE_SELF;
+    if(mask & ULFD_WATCH_MOVED_FROM) ret |= IN_MOVED_FROM | IN_MOVE_SELF;
+    if(mask & ULFD_WATCH_MOVED_TO) ret |= IN_MOVED_TO;
+    if(mask & ULFD_WATCH_ATTRIB) ret |= IN_ATTRIB;
+    return ret | IN_ONLYDIR;
+  }
+  ul_hapi int _ulfd_watch_from_inotify(unsigned mask) {
+    int ret = 0;
+    if(mask & IN_CREATE) ret |= ULFD_WATCH_CREATE;
+    if(mask & IN_MODIFY) ret |= ULFD_WATCH_MODIFY;
+    if(mask & (IN_DELETE | IN_DELETE_SELF)) ret |= ULFD_WATCH_DELETE;
+    if(mask & (IN_MOVED_FROM | IN_MOVE_SELF)) ret |= ULFD_WATCH_MOVED_FROM;
+    if(mask & IN_MOVED_TO) ret |= ULFD_WATCH_MOVED_TO;
+    if(mask & IN_ATTRIB) ret |= ULFD_WATCH_ATTRIB;
+    if(mask & IN_Q_OVERFLOW) ret |= ULFD_WATCH_OVERFLOW;
+    if(mask & IN_IGNORED) ret |= ULFD_WATCH_IGNORED;
+    if(mask & IN_ISDIR) ret |= ULFD_WATCH_ISDIR;
+    return ret;
+  }
+
+  ul_hapi int ulfd_watch_open(ulfd_watch_t* watch) {
+    watch->pos = watch->end = 0;
+    watch->cap = _ULFD_WATCH_BUFSIZE;
+    watch->buf = ul_reinterpret_cast(char*, ul_malloc(watch->cap));
+    if(ul_unlikely(watch->buf == NULL)) return ENOMEM;
+    watch->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(watch->fd < 0) { ul_free(watch->buf); return errno; }
+    return 0;
+  }
+  ul_hapi int ulfd_watch_close(ulfd_watch_t* watch) {
+    ul_free(watch->buf);
+    return close(watch->fd) < 0 ? errno : 0;
+  }
+  ul_hapi int ulfd_watch_add(ulfd_watch_t* watch, const char* path, int mask, int* pwd) {
+    int wd = inotify_add_watch(watch->fd, path, _ulfd_watch_to_inotify(mask));
+    if(wd < 0) return errno;
+    *pwd = wd;
+    return 0;
+  }
+  ul_hapi int ulfd_watch_add_w(ulfd_watch_t* watch, const wchar_t* wpath, int mask, int* pwd) {
+    int ret;
+    _ulfd_begin_to_str(path, wpath);
+    ret = ulfd_watch_add(watch, path, mask, pwd);
+    _ulfd_end_to_str(path);
+    return ret;
+  }
+  ul_hapi int ulfd_watch_add_dir(ulfd_watch_t* watch, ulfd_dir_t* dir, int mask, int* pwd) {
+    char path[32];
+    ulfd_t fd;
+    int err = ulfd_dirfd(dir, &fd);
+    if(err) return err;
+    /* inotify has no descriptor form, the magic link resolves to the directory itself */
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+    return ulfd_watch_add(watch, path, mask, pwd);
+  }
+  ul_hapi int ulfd_watch_rm(ulfd_watch_t* watch, int wd) {
+    return inotify_rm_watch(watch->fd, wd) < 0 ? errno : 0;
+  }
+  ul_hapi int ulfd_watch_read(ulfd_watch_t* watch, ulfd_watch_event_t* events, unsigned max, int timeout, unsigned* pcount) {
+    struct inotify_event* ev;
+    struct pollfd pfd;
+    ssize_t got;
+    unsigned n = 0;
+    int ret;
+
+    *pcount = 0;
+    if(max == 0) return EINVAL;
+    if(watch->pos == watch->end) {
+      pfd.fd = watch->fd;
+      pfd.events = POLLIN;
+      ret = poll(&pfd, 1, timeout);
+      if(ret < 0) return errno;
+      if(ret == 0) return 0;
+      got = read(watch->fd, watch->buf, watch->cap);
+      if(got < 0) return errno == EAGAIN ? 0 : errno;
+      watch->pos = 0;
+      watch->end = ul_static_cast(size_t, got);
+    }
+
+    /* records are aligned by the kernel, `len` includes the padding after the name */
+    while(watch->pos < watch->end && n < max) {
+      ev = ul_reinterpret_cast(struct inotify_event*, watch->buf + watch->pos);
+      watch->pos += sizeof(struct inotify_event) + ev->len;
+      events[n].wd = ev->wd;
+      events[n].mask = _ulfd_watch_from_inotify(ev->mask);
+      events[n].cookie = ev->cookie;
+      events[n].name = ev->len ? ev->name : "";
+      events[n].namelen = strlen(events[n].name);
+      ++n;
+    }
+    *pcount = n;
+    return 0;
+  }
+#else
+  #ifndef ULFD_NO_WATCH
+    #define ULFD_NO_WATCH
+  #endif
+  ul_hapi int ulfd_watch_open(ulfd_watch_t* watch) { (void)watch; return ENOSYS; }
+  ul_hapi int ulfd_watch_close(ulfd_watch_t* watch) { (void)watch; return ENOSYS; }
+  ul_hapi int ulfd_watch_add(ulfd_watch_t* watch, const char* path, int mask, int* pwd) {
+    (void)watch; (void)path; (void)mask; (void)pwd;
+    return ENOSYS;
+  }
+  ul_hapi int ulfd_watch_add_w(ulfd_watch_t* watch, const wchar_t* wpath, int mask, int* pwd) {
+    (void)watch; (void)wpath; (void)mask; (void)pwd;
+    return ENOSYS;
+  }
+  ul_hapi int ulfd_watch_add_dir(ulfd_watch_t* watch, ulfd_dir_t* dir, int mask, int* pwd) {
+    (void)watch; (void)dir; (void)mask; (void)pwd;
+    return ENOSYS;
+  }
+  ul_hapi int ulfd_watch_rm(ulfd_watch_t* watch, int wd) { (void)watch; (void)wd; return ENOSYS; }
+  ul_hapi int ulfd_watch_read(ulfd_watch_t* watch, ulfd_watch_event_t* events, unsigned max, int timeout, unsigned* pcount) {
+    (void)watch; (void)events; (void)max; (void)timeout;
+    *pcount = 0;
+    return ENOSYS;
+  }
+#endif
+
+/* temporary files are named "<path>.xxxxxxxx.tmp" */
+#define _ULFD_ATOMIC_SUFFIX_LEN 13
+#define _ULFD_ATOMIC_TRIES      64
+ul_hapi void _ulfd_atomic_suffix(char* out, unsigned long seed) {
+  static const char hex[] = "0123456789abcdef";
+  int i;
+  seed ^= seed >> 15;
+  out[0] = '.';
+  for(i = 8; i > 0; --i) { out[i] = hex[seed & 15]; seed >>= 4; }
+  memcpy(out + 9, ".tmp", 5);
+}
+ul_hapi unsigned long _ulfd_atomic_next(unsigned long seed) {
+  return (seed * 1103515245ul + 12345ul) & 0xFFFFFFFFul;
+}
+
+#ifdef _WIN32
+  ul_hapi int _ulfd_atomic_writer_create(
+    ulfd_atomic_writer_t* writer, const wchar_t* wpath, ulfd_mode_t mode, int flags, size_t bufsize
+  ) {
+    size_t len = wcslen(wpath), i;
+    unsigned long seed;
+    char suffix[_ULFD_ATOMIC_SUFFIX_LEN + 1];
+    ulfd_t fd;
+    int tries, err = EEXIST;
+
+    if(ul_unlikely(len == 0)) return ENOENT;
+    writer->path = ul_reinterpret_cast(wchar_t*, ul_malloc((len * 2 + _ULFD_ATOMIC_SUFFIX_LEN + 2) * sizeof(wchar_t)));
+    if(ul_unlikely(writer->path == NULL)) return ENOMEM;
+    memcpy(writer->path, wpath, (len + 1) * sizeof(wchar_t));
+    writer->tmppath = writer->path + len + 1;
+    memcpy(writer->tmppath, wpath, len * sizeof(wchar_t));
+    writer->tmpfile = 0;
+    writer->flags = flags;
+
+    seed = ul_static_cast(unsigned long, GetCurrentProcessId()) * 2654435761ul
+      ^ ul_static_cast(unsigned long, GetTickCount()) ^ ul_static_cast(unsigned long, ul_reinterpret_cast(size_t, writer));
+    for(tries = 0; tries < _ULFD_ATOMIC_TRIES && err == EEXIST; ++tries) {
+      _ulfd_atomic_suffix(suffix, seed);
+      for(i = 0; i <= _ULFD_ATOMIC_SUFFIX_LEN; ++i) writer->tmppath[len + i] = ul_static_cast(wchar_t, suffix[i]);
+      err = ulfd_open_w(&fd, writer->tmppath, ULFD_O_WRONLY | ULFD_O_CREAT | ULFD_O_EXCL | ULFD_O_CLOEXEC, mode);
+      seed = _ulfd_atomic_next(seed);
+    }
+    if(err) { ul_free(writer->path); return err; }
+    err = ulfd_stream_open(&writer->stream, fd, bufsize, ULFD_STREAM_OWNFD);
+    if(ul_unlikely(err)) {
+      ulfd_close(fd); DeleteFileW(writer->tmppath); ul_free(writer->path);
+    }
+    return err;
+  }
+  /* the handle is closed first, `MOVEFILE_WRITE_THROUGH` also flushes the directory entry */
+  ul_hapi int _ulfd_atomic_writer_publish(ulfd_atomic_writer_t* writer) {
+    DWORD move_flags = 0;
+    int err = ulfd_stream_close(&writer->stream);
+    if(!(writer->flags & ULFD_ATOMIC_NOREPLACE)) move_flags |= MOVEFILE_REPLACE_EXISTING;
+    if(!(writer->flags & ULFD_ATOMIC_NOSYNC)) move_flags |= MOVEFILE_WRITE_THROUGH;
+    if(err == 0 && !MoveFileExW(writer->tmppath, writer->path, move_flags)) err = _ul_win32_toerrno(GetLastError());
+    if(err) DeleteFileW(writer->tmppath);
+    return err;
+  }
+
+  ul_hapi int ulfd_atomic_writer_open_w(ulfd_atomic_writer_t* writer, const wchar_t* wpath, ulfd_mode_t mode, int flags) {
+    return _ulfd_atomic_writer_create(writer, wpath, mode, flags, 0);
+  }
+  ul_hapi int ulfd_atomic_writer_open(ulfd_atomic_writer_t* writer, const char* path, ulfd_mode_t mode, int flags) {
+    int ret;
+    _ulfd_begin_to_wstr(wpath, path);
+    ret = ulfd_atomic_writer_open_w(writer, wpath, mode, flags);
+    _ulfd_end_to_wstr(wpath);
+    return ret;
+  }
+  ul_hapi int ulfd_atomic_write_file_w(const wchar_t* wpath, const void* buf, size_t len, ulfd_mode_t mode, int flags) {
+    ulfd_atomic_writer_t writer;
+    /* `buf` is written at once, so it bypasses the buffer */
+    int err = _ulfd_atomic_writer_create(&writer, wpath, mode, flags, 1);
+    if(err) return err;
+    err = ulfd_atomic_writer_write(&writer, buf, len);
+    if(err) { ulfd_atomic_writer_abort(&writer); return err; }
+    return ulfd_atomic_writer_commit(&writer);
+  }
+  ul_hapi int ulfd_atomic_write_file(const char* path, const void* buf, size_t len, ulfd_mode_t mode, int flags) {
+    int ret;
+    _ulfd_begin_to_wstr(wpath, path);
+    ret = ulfd_atomic_write_file_w(wpath, buf, len, mode, flags);
+    _ulfd_end_to_wstr(wpath);
+    return ret;
+  }
+#else
+  #if defined(__linux__) && defined(O_TMPFILE) && defined(ULFD_POSIX_HAS_openat)
+    #define _ULFD_ATOMIC_TMPFILE
+  #endif
+
+  /* the parent directory of `writer->path`, written over `writer->tmppath` */
+  ul_hapi const char* _ulfd_atomic_dirname(ulfd_atomic_writer_t* writer) {
+    const char* slash = strrchr(writer->path, '/');
+    char* dir = writer->tmppath;
+    if(slash == NULL) { dir[0] = '.'; dir[1] = 0; }
+    else if(slash == writer->path) { dir[0] = '/'; dir[1] = 0; }
+    else {
+      memcpy(dir, writer->path, ul_static_cast(size_t, slash - writer->path));
+      dir[slash - writer->path] = 0;
+    }
+    return dir;
+  }
+  ul_hapi int _ulfd_atomic_sync_dir(ulfd_atomic_writer_t* writer) {
+    int oflag = O_RDONLY, fd, err;
+  #ifdef O_DIRECTORY
+    oflag |= O_DIRECTORY;
+  #endif
+  #ifdef O_CLOEXEC
+    oflag |= O_CLOEXEC;
+  #endif
+    fd = open(_ulfd_atomic_dirname(writer), oflag);
+    if(fd < 0) return errno;
+    err = ulfd_fsync(fd);
+    close(fd);
+    /* some file systems can't sync directories, the rename is as durable as they allow */
+    return err == EINVAL || err == ENOSYS ? 0 : err;
+  }
+
+  ul_hapi int _ulfd_atomic_writer_create(
+    ulfd_atomic_writer_t* writer, const char* path, ulfd_mode_t mode, int flags, size_t bufsize
+  ) {
+    size_t len = strlen(path);
+    unsigned long seed;
+    ulfd_t fd;
+    int tries, err = EEXIST;
+
+    if(ul_unlikely(len == 0)) return ENOENT;
+    writer->path = ul_reinterpret_cast(char*, ul_malloc(len * 2 + _ULFD_ATOMIC_SUFFIX_LEN + 2));
+    if(ul_unlikely(writer->path == NULL)) return ENOMEM;
+    memcpy(writer->path, path, len + 1);
+    writer->tmppath = writer->path + len + 1;
+    writer->flags = flags;
+
+  #ifdef _ULFD_ATOMIC_TMPFILE
+    /* the anonymous file is published through `/proc`, chroots and minimal containers may lack it */
+    if(access("/proc/self/fd", X_OK) == 0)
+      fd = open(_ulfd_atomic_dirname(writer), O_TMPFILE | O_WRONLY | O_CLOEXEC, _ulfd_to_access_mode(mode));
+    else {
+      fd = -1;
+      errno = EOPNOTSUPP;
+    }
+    if(fd >= 0) {
+      writer->tmpfile = 1;
+      err = ulfd_stream_open(&writer->stream, fd, bufsize, ULFD_STREAM_OWNFD);
+      if(ul_unlikely(err)) { close(fd); ul_free(writer->path); }
+      return err;
+    }
+    /* not supported by the kernel or the file system */
+    err = errno;
+    if(err != EOPNOTSUPP && err != EISDIR && err != EINVAL) { ul_free(writer->path); return err; }
+    err = EEXIST;
+  #endif
+    writer->tmpfile = 0;
+    memcpy(writer->tmppath, path, len);
+    seed = ul_static_cast(unsigned long, getpid()) * 2654435761ul
+      ^ ul_static_cast(unsigned long, ul_reinterpret_cast(size_t, writer));
+    for(tries = 0; tries < _ULFD_ATOMIC_TRIES && err == EEXIST; ++tries) {
+      _ulfd_atomic_suffix(writer->tmppath + len, seed);
+      err = ulfd_open(&fd, writer->tmppath, ULFD_O_WRONLY | ULFD_O_CREAT | ULFD_O_EXCL | ULFD_O_CLOEXEC, mode);
+      seed = _ulfd_atomic_next(seed);
+    }
+    if(err) { ul_free(writer->path); return err; }
+    err = ulfd_stream_open(&writer->stream, fd, bufsize, ULFD_STREAM_OWNFD);
+    if(ul_unlikely(err)) {
+      close(fd); unlink(writer->tmppath); ul_free(writer->path);
+    }
+    return err;
+  }
+  #ifdef _ULFD_ATOMIC_TMPFILE
+    /* `/proc` may be gone since `_ulfd_atomic_writer_create`, then try `AT_EMPTY_PATH` (needs CAP_DAC_READ_SEARCH) */
+    ul_hapi int _ulfd_atomic_linkat(ulfd_atomic_writer_t* writer, const char* proc, const char* path) {
+      if(linkat(AT_FDCWD, proc, AT_FDCWD, path, AT_SYMLINK_FOLLOW) == 0) return 0;
+    #ifdef AT_EMPTY_PATH
+      if(errno == ENOENT && linkat(writer->stream.fd, "", AT_FDCWD, path, AT_EMPTY_PATH) == 0) return 0;
+    #endif
+      return errno;
+    }
+    /* link the anonymous file to `path` if it's new, otherwise to a temporary name (`tmpfile` becomes 0) */
+    ul_hapi int _ulfd_atomic_link_tmpfile(ulfd_atomic_writer_t* writer) {
+      char proc[32];
+      size_t len = strlen(writer->path);
+      unsigned long seed;
+      int tries, err;
+
+      snprintf(proc, sizeof(proc), "/proc/self/fd/%d", writer->stream.fd);
+      err = _ulfd_atomic_linkat(writer, proc, writer->path);
+      if(err != EEXIST || (writer->flags & ULFD_ATOMIC_NOREPLACE)) return err;
+      memcpy(writer->tmppath, writer->path, len);
+      seed = ul_static_cast(unsigned long, getpid()) * 2654435761ul
+        ^ ul_static_cast(unsigned long, ul_reinterpret_cast(size_t, writer));
+      for(tries = 0; tries < _ULFD_ATOMIC_TRIES; ++tries) {
+        _ulfd_atomic_suffix(writer->tmppath + len, seed);
+        err = _ulfd_atomic_linkat(writer, proc, writer->tmppath);
+        if(err == 0) {
+          writer->tmpfile = 0;
+          return 0;
+        }
+        if(err != EEXIST) return err;
+        seed = _ulfd_atomic_next(seed);
+      }
+      return EEXIST;
+    }
+  #endif
+  ul_hapi int _ulfd_atomic_rename_noreplace(ulfd_atomic_writer_t* writer) {
+    int err = ulfd_renameat2(ULFD_AT_FDCWD, writer->path, ULFD_AT_FDCWD, writer->tmppath, ULFD_RENAME_NOREPLACE);
+    if(err != ENOSYS && err != EINVAL) return err;
+    /* `link` never replaces `path` */
+    if(link(writer->tmppath, writer->path) < 0) return errno;
+    unlink(writer->tmppath);
+    return 0;
+  }
+  /* the data is synced before the name changes, and the directory after it */
+  ul_hapi int _ulfd_atomic_writer_publish(ulfd_atomic_writer_t* writer) {
+    int err = 0, err2;
+  #ifdef _ULFD_ATOMIC_TMPFILE
+    if(writer->tmpfile) err = _ulfd_atomic_link_tmpfile(writer);
+  #endif
+    err2 = ulfd_stream_close(&writer->stream);
+    if(err == 0) err = err2;
+    if(!writer->tmpfile) {
+      if(err == 0) {
+        if(writer->flags & ULFD_ATOMIC_NOREPLACE) err = _ulfd_atomic_rename_noreplace(writer);
+        else if(rename(writer->tmppath, writer->path) < 0) err = errno;
+      }
+      if(err) unlink(writer->tmppath);
+    }
+    if(err == 0 && !(writer->flags & ULFD_ATOMIC_NOSYNC)) err = _ulfd_atomic_sync_dir(writer);
+    return err;
+  }
+
+  ul_hapi int ulfd_atomic_writer_open(ulfd_atomic_writer_t* writer, const char* path, ulfd_mode_t mode, int flags) {
+    return _ulfd_atomic_writer_create(writer, path, mode, flags, 0);
+  }
+  ul_hapi int ulfd_atomic_writer_open_w(ulfd_atomic_writer_t* writer, const wchar_t* wpath, ulfd_mode_t mode, int flags) {
+    int ret;
+    _ulfd_begin_to_str(path, wpath);
+    ret = ulfd_atomic_writer_open(writer, path, mode, flags);
+    _ulfd_end_to_str(path);
+    return ret;
+  }
+  ul_hapi int ulfd_atomic_write_file(const char* path, const void* buf, size_t len, ulfd_mode_t mode, int flags) {
+    ulfd_atomic_writer_t writer;
+    /* `buf` is written at once, so it bypasses the buffer */
+    int err = _ulfd_atomic_writer_create(&writer, path, mode, flags, 1);
+    if(err) return err;
+    err = ulfd_atomic_writer_write(&writer, buf, len);
+    if(err) { ulfd_atomic_writer_abort(&writer); return err; }
+    return ulfd_atomic_writer_commit(&writer);
+  }
+  ul_hapi int ulfd_atomic_write_file_w(const wchar_t* wpath, const void* buf, size_t len, ulfd_mode_t mode, int flags) {
+    int ret;
+    _ulfd_begin_to_str(path, wpath);
+    ret = ulfd_atomic_write_file(path, buf, len, mode, flags);
+    _ulfd_end_to_str(path);
+    return ret;
+  }
+#endif
+
+ul_hapi int ulfd_atomic_writer_write(ulfd_atomic_writer_t* writer, const void* buf, size_t count) {
+  size_t writen;
+  return ulfd_stream_write(&writer->stream, buf, count, &writen);
+}
+ul_hapi int ulfd_atomic_writer_commit(ulfd_atomic_writer_t* writer) {
+  int err = ulfd_stream_flush(&writer->stream);
+  if(err == 0 && !(writer->flags & ULFD_ATOMIC_NOSYNC))
+    err = (writer->flags & ULFD_ATOMIC_FULLSYNC) ? ulfd_ffullsync(writer->stream.fd) : ulfd_fdatasync(writer->stream.fd);
+  if(err) { ulfd_atomic_writer_abort(writer); return err; }
+  err = _ulfd_atomic_writer_publish(writer);
+  ul_free(writer->path);
+  return err;
+}
+ul_hapi void ulfd_atomic_writer_abort(ulfd_atomic_writer_t* writer) {
+  /* the buffered output is dropped rather than flushed */
+  writer->stream.state = _ULFD_STREAM_EMPTY;
+  ulfd_stream_close(&writer->stream);
+  if(!writer->tmpfile) ulfd_unlink_u(writer->tmppath);
+  ul_free(writer->path);
+}
+
+#ifndef ULFD_TREE_BUFSIZE
+  #define ULFD_TREE_BUFSIZE 16384
+#endif
+typedef struct _ulfd_tree_t {
+  const ulfd_tree_options_t* options;
+  char* src; /* path of the current source entry */
+  char* dst; /* `ulfd_copy_tree`: path of the current destination entry */
+  size_t src_cap, dst_cap;
+  ulfd_uint64_t root_dev, root_ino; /* `ulfd_copy_tree`: the destination root, not to be copied into itself */
+  int err; /* the first failure */
+} _ulfd_tree_t;
+
+/* returns nonzero to stop */
+ul_hapi int _ulfd_tree_error(_ulfd_tree_t* tree, const char* path, int err) {
+  if(tree->err == 0) tree->err = err;
+  if(err == ECANCELED || err == ENOMEM) return err;
+  if(tree->options->on_error == NULL) return 0;
+  return tree->options->on_error(tree->options->userdata, path, err) ? err : 0;
+}
+ul_hapi int _ulfd_tree_progress(_ulfd_tree_t* tree, ulfd_mode_t type, ulfd_uint64_t bytes) {
+  if(tree->options->progress == NULL || !tree->options->progress(tree->options->userdata, tree->src, type, bytes))
+    return 0;
+  if(tree->err == 0) tree->err = ECANCELED;
+  return ECANCELED;
+}
+/* set `(*pbuf)[len..]` to "/name", returns the new length in `*plen` */
+ul_hapi int _ulfd_tree_join(char** pbuf, size_t* pcap, size_t len, const char* name, size_t namelen, size_t* plen) {
+  char* buf = *pbuf;
+  if(len + namelen + 2 > *pcap) {
+    size_t cap2 = len + namelen + 2 + (*pcap >> 1);
+    buf = ul_reinterpret_cast(char*, ul_realloc(buf, cap2));
+    if(ul_unlikely(buf == NULL)) return ENOMEM;
+    *pbuf = buf; *pcap = cap2;
+  }
+  if(len && buf[len - 1] != '/' && buf[len - 1] != _ULFD_WALK_SEP) buf[len++] = _ULFD_WALK_SEP;
+  memcpy(buf + len, name, namelen);
+  buf[len + namelen] = 0;
+  *plen = len + namelen;
+  return 0;
+}
+ul_hapi void _ulfd_tree_init(_ulfd_tree_t* tree, const ulfd_tree_options_t* options, const ulfd_tree_options_t* defaults) {
+  tree->options = options ? options : defaults;
+  tree->src = NULL; tree->dst = NULL;
+  tree->src_cap = 0; tree->dst_cap = 0;
+  tree->root_dev = 0; tree->root_ino = 0;
+  tree->err = 0;
+}
+ul_hapi void _ulfd_tree_deinit(_ulfd_tree_t* tree) {
+  if(tree->src) ul_free(tree->src);
+  if(tree->dst) ul_free(tree->dst);
+}
+
+ul_hapi int _ulfd_tree_remove_entry(_ulfd_tree_t* tree, ulfd_t dirfd, const char* name, ulfd_mode_t type, size_t len);
+/* `tree->src` (of length `len`) is the path of `name` */
+ul_hapi int _ulfd_tree_remove_dir(_ulfd_tree_t* tree, ulfd_t parent, const char* name, size_t len) {
+  ulfd_dir_t dir;
+  ulfd_dirent_t* ent;
+  ulfd_t fd;
+  void* buf;
+  size_t used, sublen;
+  int err, stop = 0, pass;
+
+  buf = ul_malloc(ULFD_TREE_BUFSIZE);
+  if(ul_unlikely(buf == NULL)) return _ulfd_tree_error(tree, tree->src, ENOMEM);
+  /* entries created while it's emptied get one more chance */
+  for(pass = 0; pass < 2 && !stop; ++pass) {
+    /* it may have been replaced by a link since its type was read, which must not be followed */
+    err = _ulfd_opendirat_nofollow(&dir, parent, name);
+    if(err == ELOOP || err == ENOTDIR) {
+      ul_free(buf);
+      err = ulfd_unlinkat(parent, name, 0);
+  #ifdef _WIN32
+      if(err && err != ENOENT) err = ulfd_unlinkat(parent, name, ULFD_AT_REMOVEDIR); /* a directory link or junction */
+  #endif
+      if(err) return err == ENOENT ? 0 : _ulfd_tree_error(tree, tree->src, err);
+      return _ulfd_tree_progress(tree, ULFD_S_IFLNK, 0);
+    }
+    if(err) {
+      if(err != ENOENT) stop = _ulfd_tree_error(tree, tree->src, err);
+      ul_free(buf); return stop;
+    }
+    err = ulfd_dirfd(&dir, &fd);
+    while(err == 0 && !stop) {
+      err = ulfd_readdir_batch(&dir, buf, ULFD_TREE_BUFSIZE, &used);
+      if(err || used == 0) break;
+      for(ent = ul_reinterpret_cast(ulfd_dirent_t*, buf);
+        ul_reinterpret_cast(char*, ent) < ul_reinterpret_cast(char*, buf) + used && !stop;
+        ent = ulfd_dirent_next(ent)
+      ) {
+        err = _ulfd_tree_join(&tree->src, &tree->src_cap, len, ent->name, ent->namelen, &sublen);
+        if(ul_unlikely(err)) break;
+        stop = _ulfd_tree_remove_entry(tree, fd, ent->name, ent->type, sublen);
+        tree->src[len] = 0;
+      }
+    }
+    ulfd_closedir(&dir);
+    if(err && !stop) stop = _ulfd_tree_error(tree, tree->src, err);
+    if(stop) break;
+
+    err = ulfd_unlinkat(parent, name, ULFD_AT_REMOVEDIR);
+    if(err == 0 || err == ENOENT) {
+      ul_free(buf);
+      return err ? 0 : _ulfd_tree_progress(tree, ULFD_S_IFDIR, 0);
+    }
+    if(err != ENOTEMPTY && err != EEXIST) break;
+  }
+  ul_free(buf);
+  return stop ? stop : _ulfd_tree_error(tree, tree->src, err);
+}
+ul_hapi int _ulfd_tree_remove_entry(_ulfd_tree_t* tree, ulfd_t dirfd, const char* name, ulfd_mode_t type, size_t len) {
+  int err;
+  if(type == 0) {
+    ulfd_stat_t state;
+    err = ulfd_fstatat(dirfd, name, &state, ULFD_AT_SYMLINK_NOFOLLOW);
+    if(err) return err == ENOENT ? 0 : _ulfd_tree_error(tree, tree->src, err);
+    type = state.mode & ULFD_S_IFMT;
+  }
+  if(type == ULFD_S_IFDIR) return _ulfd_tree_remove_dir(tree, dirfd, name, len);
+  err = ulfd_unlinkat(dirfd, name, 0);
+  if(err) return err == ENOENT ? 0 : _ulfd_tree_error(tree, tree->src, err);
+  return _ulfd_tree_progress(tree, type, 0);
+}
+ul_hapi int ulfd_remove_all(const char* path, const ulfd_tree_options_t* options) {
+  static const ulfd_tree_options_t defaults = { 0, NULL, NULL, NULL };
+  _ulfd_tree_t tree;
+  ulfd_stat_t state;
+  size_t len;
+  int err;
+
+  err = ulfd_fstatat(ULFD_AT_FDCWD, path, &state, ULFD_AT_SYMLINK_NOFOLLOW);
+  if(err) return err == ENOENT ? 0 : err;
+  _ulfd_tree_init(&tree, options, &defaults);
+  err = _ulfd_tree_join(&tree.src, &tree.src_cap, 0, path, strlen(path), &len);
+  if(err == 0) err = _ulfd_tree_remove_entry(&tree, ULFD_AT_FDCWD, path, state.mode & ULFD_S_IFMT, len);
+  if(tree.err) err = tree.err;
+  _ulfd_tree_deinit(&tree);
+  return err;
+}
+ul_hapi int ulfd_remove_all_w(const wchar_t* wpath, const ulfd_tree_options_t* options) {
+  int ret;
+  _ulfd_begin_to_str(path, wpath);
+  ret = ulfd_remove_all(path, options);
+  _ulfd_end_to_str(path);
+  return ret;
+}
+
+/* create the destination file without writing through a link there, which is replaced (EEXIST with
+  `ULFD_COPY_NOREPLACE`); the mode is copied after the contents, keep the file private until then */
+ul_hapi int _ulfd_tree_create_file(ulfd_t* pfd, ulfd_t dfd, const char* dname, int flags) {
+  ulfd_mode_t mode = (flags & ULFD_COPY_NOATTR) ? 0666 : 0600;
+  int err = _ulfd_openat_nofollow(pfd, dfd, dname,
+    ULFD_O_WRONLY | ULFD_O_CREAT | ((flags & ULFD_COPY_NOREPLACE) ? ULFD_O_EXCL : ULFD_O_TRUNC), mode);
+  if(err == ELOOP && !(flags & ULFD_COPY_NOREPLACE)) {
+    err = ulfd_unlinkat(dfd, dname, 0);
+    if(err == 0 || err == ENOENT)
+      err = _ulfd_openat_nofollow(pfd, dfd, dname, ULFD_O_WRONLY | ULFD_O_CREAT | ULFD_O_EXCL, mode);
+  }
+  return err;
+}
+ul_hapi int _ulfd_tree_copy_file(_ulfd_tree_t* tree, ulfd_t sfd, const char* sname, ulfd_t dfd, const char* dname) {
+  int flags = tree->options->flags;
+  ulfd_t fd_in, fd_out;
+  ulfd_stat_t state;
+  int err;
+
+  err = _ulfd_openat_nofollow(&fd_in, sfd, sname, ULFD_O_RDONLY, 0);
+  if(err) return _ulfd_tree_error(tree, tree->src, err);
+  err = ulfd_fstat(fd_in, &state);
+  if(err) { ulfd_close(fd_in); return _ulfd_tree_error(tree, tree->src, err); }
+  err = _ulfd_tree_create_file(&fd_out, dfd, dname, flags);
+  if(err) { ulfd_close(fd_in); return _ulfd_tree_error(tree, tree->dst, err); }
+  err = ulfd_copy_fd(fd_in, fd_out, flags);
+  ulfd_close(fd_in);
+  if(ulfd_close(fd_out) && err == 0) err = EIO;
+  if(err) { ulfd_unlinkat(dfd, dname, 0); return _ulfd_tree_error(tree, tree->src, err); }
+  return _ulfd_tree_progress(tree, ULFD_S_IFREG, ul_static_cast(ulfd_uint64_t, state.size));
+}
+ul_hapi int _ulfd_tree_copy_link(_ulfd_tree_t* tree, ulfd_t sfd, const char* sname, ulfd_t dfd, const char* dname) {
+  char* target;
+  int err = _ulfd_readlinkat_alloc(&target, sfd, sname);
+  if(err) return _ulfd_tree_error(tree, tree->src, err);
+  err = _ulfd_symlinkat(dfd, dname, target);
+  if(err == EEXIST && !(tree->options->flags & ULFD_COPY_NOREPLACE)) {
+    err = ulfd_unlinkat(dfd, dname, 0);
+    if(err == 0) err = _ulfd_symlinkat(dfd, dname, target);
+  }
+  ul_free(target);
+  if(err) return _ulfd_tree_error(tree, tree->dst, err);
+  return _ulfd_tree_progress(tree, ULFD_S_IFLNK, 0);
+}
+ul_hapi int _ulfd_tree_copy_entry(
+  _ulfd_tree_t* tree, ulfd_t sfd, const char* sname, size_t slen,
+  ulfd_t dfd, const char* dname, size_t dlen, ulfd_mode_t type);
+ul_hapi int _ulfd_tree_copy_dir(
+  _ulfd_tree_t* tree, ulfd_t sfd, const char* sname, size_t slen, ulfd_t dfd, const char* dname, size_t dlen
+) {
+  ulfd_dir_t dir, ddir;
+  ulfd_dirent_t* ent;
+  ulfd_stat_t state, dstate;
+  ulfd_t fd, dst_fd;
+  void* buf;
+  size_t used, subslen, subdlen;
+  int err, dst_err, stop = 0;
+
+  err = _ulfd_opendirat_nofollow(&dir, sfd, sname);
+  if(err) return _ulfd_tree_error(tree, tree->src, err);
+  err = ulfd_dirfd(&dir, &fd);
+  if(err == 0) err = ulfd_fstat(fd, &state);
+  if(err) { ulfd_closedir(&dir); return _ulfd_tree_error(tree, tree->src, err); }
+  /* `newpath` is inside `oldpath` */
+  if(tree->root_ino && ul_static_cast(ulfd_uint64_t, state.dev) == tree->root_dev
+    && ul_static_cast(ulfd_uint64_t, state.ino) == tree->root_ino
+  ) { ulfd_closedir(&dir); return 0; }
+
+  err = ulfd_mkdirat(dfd, dname, 0700);
+  if(err == EEXIST) {
+    err = ulfd_fstatat(dfd, dname, &dstate, ULFD_AT_SYMLINK_NOFOLLOW);
+    if(err == 0 && (dstate.mode & ULFD_S_IFMT) != ULFD_S_IFDIR) err = ENOTDIR;
+  }
+  if(err == 0) err = _ulfd_opendirat_nofollow(&ddir, dfd, dname);
+  if(err) { ulfd_closedir(&dir); return _ulfd_tree_error(tree, tree->dst, err); }
+  err = dst_err = ulfd_dirfd(&ddir, &dst_fd);
+  if(err == 0 && tree->root_ino == 0 && tree->root_dev == 0) {
+    err = ulfd_fstat(dst_fd, &dstate);
+    if(err == 0) {
+      tree->root_dev = ul_static_cast(ulfd_uint64_t, dstate.dev);
+      tree->root_ino = ul_static_cast(ulfd_uint64_t, dstate.ino);
+    }
+  }
+
+  buf = err ? NULL : ul_malloc(ULFD_TREE_BUFSIZE);
+  if(ul_unlikely(err == 0 && buf == NULL)) err = ENOMEM;
+  while(err == 0 && !stop) {
+    err = ulfd_readdir_batch(&dir, buf, ULFD_TREE_BUFSIZE, &used);
+    if(err || used == 0) break;
+    for(ent = ul_reinterpret_cast(ulfd_dirent_t*, buf);
+      ul_reinterpret_cast(char*, ent) < ul_reinterpret_cast(char*, buf) + used && !stop;
+      ent = ulfd_dirent_next(ent)
+    ) {
+      err = _ulfd_tree_join(&tree->src, &tree->src_cap, slen, ent->name, ent->namelen, &subslen);
+      if(err == 0) err = _ulfd_tree_join(&tree->dst, &tree->dst_cap, dlen, ent->name, ent->namelen, &subdlen);
+      if(ul_unlikely(err)) break;
+      stop = _ulfd_tree_copy_entry(tree, fd, ent->name, subslen, dst_fd, ent->name, subdlen, ent->type);
+      tree->src[slen] = 0; tree->dst[dlen] = 0;
+    }
+  }
+  if(buf) ul_free(buf);
+  ulfd_closedir(&dir);
+  if(err && !stop) stop = _ulfd_tree_error(tree, tree->src, err);
+  if(stop) { ulfd_closedir(&ddir); return stop; }
+
+  /* after the contents, which would change the times and may be forbidden by the mode */
+  err = 0;
+  if(!(tree->options->flags & ULFD_COPY_NOATTR) && dst_err == 0) {
+    err = ulfd_futime(dst_fd, state.atime, state.mtime);
+    if(err == 0) err = ulfd_fchmod(dst_fd, state.mode & ULFD_S_IMASK);
+  }
+  ulfd_closedir(&ddir);
+  if(err) return _ulfd_tree_error(tree, tree->dst, err);
+  return _ulfd_tree_progress(tree, ULFD_S_IFDIR, 0);
+}
+ul_hapi int _ulfd_tree_copy_entry(
+  _ulfd_tree_t* tree, ulfd_t sfd, const char* sname, size_t slen,
+  ulfd_t dfd, const char* dname, size_t dlen, ulfd_mode_t type
+) {
+  if(type == 0) {
+    ulfd_stat_t state;
+    int err = ulfd_fstatat(sfd, sname, &state, ULFD_AT_SYMLINK_NOFOLLOW);
+    if(err) return _ulfd_tree_error(tree, tree->src, err);
+    type = state.mode & ULFD_S_IFMT;
+  }
+  switch(type) {
+  case ULFD_S_IFDIR: return _ulfd_tree_copy_dir(tree, sfd, sname, slen, dfd, dname, dlen);
+  case ULFD_S_IFREG: return _ulfd_tree_copy_file(tree, sfd, sname, dfd, dname);
+  case ULFD_S_IFLNK: return _ulfd_tree_copy_link(tree, sfd, sname, dfd, dname);
+  default: return _ulfd_tree_error(tree, tree->src, EOPNOTSUPP);
+  }
+}
+ul_hapi int ulfd_copy_tree(const char* newpath, const char* oldpath, const ulfd_tree_options_t* options) {
+  static const ulfd_tree_options_t defaults = { 0, NULL, NULL, NULL };
+  _ulfd_tree_t tree;
+  ulfd_stat_t state;
+  size_t slen, dlen;
+  int err;
+
+  err = ulfd_fstatat(ULFD_AT_FDCWD, oldpath, &state, ULFD_AT_SYMLINK_NOFOLLOW);
+  if(err) return err;
+  _ulfd_tree_init(&tree, options, &defaults);
+  err = _ulfd_tree_join(&tree.src, &tree.src_cap, 0, oldpath, strlen(oldpath), &slen);
+  if(err == 0) err = _ulfd_tree_join(&tree.dst, &tree.dst_cap, 0, newpath, strlen(newpath), &dlen);
+  if(err == 0)
+    err = _ulfd_tree_copy_entry(&tree, ULFD_AT_FDCWD, oldpath, slen, ULFD_AT_FDCWD, newpath, dlen, state.mode & ULFD_S_IFMT);
+  if(tree.err) err = tree.err;
+  _ulfd_tree_deinit(&tree);
+  return err;
+}
+ul_hapi int ulfd_copy_tree_w(const wchar_t* newpath, const wchar_t* oldpath, const ulfd_tree_options_t* options) {
+  int ret;
+  _ulfd_begin_to_str(_newpath, newpath);
+  _ulfd_begin_to_str2(_oldpath, oldpath, _newpath);
+  ret = ulfd_copy_tree(_newpath, _oldpath, options);
+  _ulfd_end_to_str2(_oldpath);
+  _ulfd_end_to_str(_newpath);
+  return ret;
+}
 
 #endif /* ULFD_H */
@@ -38,6 +38,17 @@ File descriptor (Unix style) (C++ wrapper)
 #include <string>
 #include <utility>
 #include <functional>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <algorithm>
+#include <map>
+#include <limits>
 
 namespace ul {
     namespace fd {
@@ -269,6 +280,26 @@ namespace ul {
             _throw_if_error(ulfd_pwrite(fd, buf, count, off, &write_bytes));
             return write_bytes;
         }
+        inline size_t readv(ulfd_t fd, const ulfd_iovec_t* iov, int iovcnt) {
+            size_t read_bytes;
+            _throw_if_error(ulfd_readv(fd, iov, iovcnt, &read_bytes));
+            return read_bytes;
+        }
+        inline size_t writev(ulfd_t fd, const ulfd_iovec_t* iov, int iovcnt) {
+            size_t write_bytes;
+            _throw_if_error(ulfd_writev(fd, iov, iovcnt, &write_bytes));
+            return write_bytes;
+        }
+        inline size_t preadv(ulfd_t fd, const ulfd_iovec_t* iov, int iovcnt, ulfd_int64_t off, int flags = 0) {
+            size_t read_bytes;
+            _throw_if_error(ulfd_preadv2(fd, iov, iovcnt, off, flags, &read_bytes));
+            return read_bytes;
+        }
+        inline size_t pwritev(ulfd_t fd, const ulfd_iovec_t* iov, int iovcnt, ulfd_int64_t off, int flags = 0) {
+            size_t write_bytes;
+            _throw_if_error(ulfd_pwritev2(fd, iov, iovcnt, off, flags, &write_bytes));
+            return write_bytes;
+        }
         inline size_t pread_user(ulfd_t fd, void* buf, size_t count, ulfd_int64_t off) {
             size_t read_bytes;
             _throw_if_error(ulfd_pread_user(fd, buf, count, off, &read_bytes));
@@ -290,6 +321,28 @@ namespace ul {
             return write_bytes;
         }
 
+        inline size_t logical_block_size(ulfd_t fd) {
+            size_t size;
+            _throw_if_error(ulfd_logical_block_size(fd, &size));
+            return size;
+        }
+        inline void* aligned_alloc(size_t alignment, size_t size) {
+            void* ptr;
+            _throw_if_error(ulfd_aligned_alloc(&ptr, alignment, size));
+            return ptr;
+        }
+        inline void aligned_free(void* ptr) { ulfd_aligned_free(ptr); }
+        inline size_t pread_direct(ulfd_t fd, void* buf, size_t count, ulfd_int64_t off, size_t align = 0) {
+            size_t read_bytes;
+            _throw_if_error(ulfd_pread_direct(fd, buf, count, off, align, &read_bytes));
+            return read_bytes;
+        }
+        inline size_t pwrite_direct(ulfd_t fd, const void* buf, size_t count, ulfd_int64_t off, size_t align = 0) {
+            size_t write_bytes;
+            _throw_if_error(ulfd_pwrite_direct(fd, buf, count, off, align, &write_bytes));
+            return write_bytes;
+        }
+
         inline ulfd_int64_t seek(ulfd_t fd, ulfd_int64_t off, int origin = ULFD_SEEK_SET) {
             ulfd_int64_t r;
             _throw_if_error(ulfd_seek(fd, off, origin, &r));
@@ -306,6 +359,16 @@ namespace ul {
             _throw_if_error(ulfd_copy_file_range(fd_in, off_in, fd_out, off_out, len, &r));
             return r;
         }
+        inline size_t sendfile(ulfd_t fd_out, ulfd_t fd_in, ulfd_int64_t* off_in, size_t len) {
+            size_t r;
+            _throw_if_error(ulfd_sendfile(fd_out, fd_in, off_in, len, &r));
+            return r;
+        }
+        inline size_t splice(ulfd_t fd_in, ulfd_int64_t* off_in, ulfd_t fd_out, ulfd_int64_t* off_out, size_t len, int flags = 0) {
+            size_t r;
+            _throw_if_error(ulfd_splice(fd_in, off_in, fd_out, off_out, len, flags, &r));
+            return r;
+        }
         inline size_t copy_file_range_user(
             ulfd_t fd_in, ulfd_int64_t* off_in, ulfd_t fd_out, ulfd_int64_t* off_out,
             size_t len, void* buf = nullptr, size_t buf_len = 0
@@ -323,9 +386,47 @@ namespace ul {
             return r;
         }
 
+        inline void clone_file(ulfd_t fd_in, ulfd_t fd_out) {
+            _throw_if_error(ulfd_clone_file(fd_in, fd_out));
+        }
+        inline void clone_range(ulfd_t fd_in, ulfd_int64_t off_in, ulfd_t fd_out, ulfd_int64_t off_out, ulfd_int64_t len = 0) {
+            _throw_if_error(ulfd_clone_range(fd_in, off_in, fd_out, off_out, len));
+        }
+        inline void copy_fd(ulfd_t fd_in, ulfd_t fd_out, int flags = 0) {
+            _throw_if_error(ulfd_copy_fd(fd_in, fd_out, flags));
+        }
+
         inline void ffullsync(ulfd_t fd) { _throw_if_error(ulfd_ffullsync(fd)); }
         inline void fsync(ulfd_t fd) { _throw_if_error(ulfd_fsync(fd)); }
         inline void fdatasync(ulfd_t fd) { _throw_if_error(ulfd_fdatasync(fd)); }
+        inline void sync_file_range(ulfd_t fd, ulfd_int64_t off, ulfd_int64_t len, int flags = ULFD_SYNC_RANGE_WRITE) {
+            _throw_if_error(ulfd_sync_file_range(fd, off, len, flags));
+        }
+        // throws the first error, `ring` (optional) must have nothing queued or in flight
+        inline void fsync_group(const std::vector<ulfd_t>& fds, int flags = 0, ulfd_ring_t* ring = nullptr) {
+            _throw_if_error(ulfd_fsync_group(ring, fds.data(), static_cast<unsigned>(fds.size()), flags, nullptr));
+        }
+
+        inline void fadvise(ulfd_t fd, ulfd_int64_t off, ulfd_int64_t len, int advice) {
+            _throw_if_error(ulfd_fadvise(fd, off, len, advice));
+        }
+        inline void readahead(ulfd_t fd, ulfd_int64_t off = 0, ulfd_int64_t len = 0) {
+            _throw_if_error(ulfd_readahead(fd, off, len));
+        }
+        // cached ranges of [off, off + len) as pairs of offset and length, in whole pages
+        inline std::vector<std::pair<ulfd_int64_t, ulfd_int64_t>> residency(ulfd_t fd, ulfd_int64_t off, size_t len) {
+            std::vector<std::pair<ulfd_int64_t, ulfd_int64_t>> r;
+            const size_t page = ulfd_pagesize();
+            std::vector<unsigned char> vec((len + page - 1) / page);
+            _throw_if_error(ulfd_residency(fd, off, len, vec.data()));
+            for(size_t i = 0; i < vec.size(); ++i) {
+                if(!vec[i]) continue;
+                const ulfd_int64_t begin = off + static_cast<ulfd_int64_t>(i * page);
+                if(!r.empty() && r.back().first + r.back().second == begin) r.back().second += static_cast<ulfd_int64_t>(page);
+                else r.emplace_back(begin, static_cast<ulfd_int64_t>(page));
+            }
+            return r;
+        }
 
         inline void lock(ulfd_t fd, ulfd_int64_t off, ulfd_int64_t len, int mode) {
             _throw_if_error(ulfd_lock(fd, off, len, mode));
@@ -333,6 +434,12 @@ namespace ul {
         inline void lockw(ulfd_t fd, ulfd_int64_t off, ulfd_int64_t len, int mode) {
             _throw_if_error(ulfd_lockw(fd, off, len, mode));
         }
+        inline void ofd_lock(ulfd_t fd, ulfd_int64_t off, ulfd_int64_t len, int mode) {
+            _throw_if_error(ulfd_ofd_lock(fd, off, len, mode));
+        }
+        inline void ofd_lockw(ulfd_t fd, ulfd_int64_t off, ulfd_int64_t len, int mode) {
+            _throw_if_error(ulfd_ofd_lockw(fd, off, len, mode));
+        }
 
         inline void ftruncate(ulfd_t fd, ulfd_int64_t length) {
             _throw_if_error(ulfd_ftruncate(fd, length));
@@ -342,6 +449,45 @@ namespace ul {
             _throw_if_error(ulfd_ffilelength(fd, &r));
             return r;
         }
+
+        inline void fallocate(ulfd_t fd, ulfd_int64_t off, ulfd_int64_t len, int flags = 0) {
+            _throw_if_error(ulfd_fallocate(fd, flags, off, len));
+        }
+        inline void punch_hole(ulfd_t fd, ulfd_int64_t off, ulfd_int64_t len) {
+            _throw_if_error(ulfd_punch_hole(fd, off, len));
+        }
+        inline void zero_range(ulfd_t fd, ulfd_int64_t off, ulfd_int64_t len, int flags = 0) {
+            _throw_if_error(ulfd_zero_range(fd, off, len, flags));
+        }
+        // data extents of [off, off + len) as pairs of offset and length (`len` 0 means up to the end of file)
+        inline std::vector<std::pair<ulfd_int64_t, ulfd_int64_t>> extents(ulfd_t fd, ulfd_int64_t off = 0, ulfd_int64_t len = 0) {
+            std::vector<std::pair<ulfd_int64_t, ulfd_int64_t>> r;
+            ulfd_extent_iter_t it;
+            ulfd_int64_t data_off, data_len;
+            int err;
+            _throw_if_error(ulfd_extent_begin(&it, fd, off, len));
+            for(;;) {
+                err = ulfd_extent_next(&it, &data_off, &data_len);
+                if(err || data_len == 0) break;
+                try {
+                    r.emplace_back(data_off, data_len);
+                } catch(...) {
+                    ulfd_extent_end(&it);
+                    throw;
+                }
+            }
+            int err2 = ulfd_extent_end(&it);
+            _throw_if_error(err ? err : err2);
+            return r;
+        }
+        inline ulfd_int64_t copy_sparse(
+            ulfd_t fd_in, ulfd_int64_t off_in, ulfd_t fd_out, ulfd_int64_t off_out,
+            ulfd_int64_t len = 0
+        ) {
+            ulfd_int64_t r;
+            _throw_if_error(ulfd_copy_sparse(fd_in, off_in, fd_out, off_out, len, &r));
+            return r;
+        }
         inline void fchmod(ulfd_t fd, ulfd_mode_t mode) {
             _throw_if_error(ulfd_fchmod(fd, mode));
         }
@@ -499,6 +645,15 @@ namespace ul {
         inline void rename(const NativeStringView& newpath, const NativeStringView& oldpath) {
             _throw_if_error(ulfd_rename_u(newpath, oldpath));
         }
+        inline void copy_file(const NativeStringView& newpath, const NativeStringView& oldpath, int flags = 0) {
+            _throw_if_error(ulfd_copy_file_u(newpath, oldpath, flags));
+        }
+        inline void atomic_write_file(const NativeStringView& path, const void* buf, size_t len, ulfd_mode_t mode = 0664, int flags = 0) {
+            _throw_if_error(ulfd_atomic_write_file_u(path, buf, len, mode, flags));
+        }
+        inline void atomic_write_file(const NativeStringView& path, const std::string& data, ulfd_mode_t mode = 0664, int flags = 0) {
+            atomic_write_file(path, data.data(), data.size(), mode, flags);
+        }
         inline void unlink(const NativeStringView& path) {
             _throw_if_error(ulfd_unlink_u(path));
         }
@@ -574,6 +729,57 @@ namespace ul {
             _throw_if_error(ulfd_readdir_u(&dir, &up));
             return up ? _copy_ustring(up) : String();
         }
+        // returns the number of bytes filled with `ulfd_dirent_t` records, 0 at the end
+        inline size_t readdir_batch(ulfd_dir_t& dir, void* buf, size_t len) {
+            size_t used;
+            _throw_if_error(ulfd_readdir_batch(&dir, buf, len, &used));
+            return used;
+        }
+        // parenthesized, as some systems define `dirfd` as a macro
+        inline ulfd_t (dirfd)(ulfd_dir_t& dir) {
+            ulfd_t fd;
+            _throw_if_error(ulfd_dirfd(&dir, &fd));
+            return fd;
+        }
+
+        inline ulfd_t openat(ulfd_t dirfd, const NativeStringView& path, long oflag, ulfd_mode_t mode) {
+            ulfd_t fd;
+            _throw_if_error(ulfd_openat_u(&fd, dirfd, path, oflag, mode));
+            return fd;
+        }
+        inline ulfd_t openat(ulfd_t dirfd, const NativeStringView& path, long oflag) {
+            ulfd_t fd;
+            if(oflag & ULFD_O_CREAT) throw Exception(EINVAL);
+            _throw_if_error(ulfd_openat_u(&fd, dirfd, path, oflag, 0664));
+            return fd;
+        }
+        inline ulfd_stat_t& fstatat(ulfd_t dirfd, const NativeStringView& path, ulfd_stat_t& state, int flags = 0) {
+            _throw_if_error(ulfd_fstatat_u(dirfd, path, &state, flags));
+            return state;
+        }
+        inline ulfd_stat_t fstatat(ulfd_t dirfd, const NativeStringView& path, int flags = 0) {
+            ulfd_stat_t state;
+            _throw_if_error(ulfd_fstatat_u(dirfd, path, &state, flags));
+            return state;
+        }
+        // only the fields in `mask` are guaranteed, `*pmask` receives the fields filled
+        inline ulfd_stat_t statx(ulfd_t dirfd, const NativeStringView& path, unsigned mask, int flags = 0, unsigned* pmask = nullptr) {
+            ulfd_stat_t state;
+            _throw_if_error(ulfd_statx_u(dirfd, path, flags, mask, &state, pmask));
+            return state;
+        }
+        inline void mkdirat(ulfd_t dirfd, const NativeStringView& path, ulfd_mode_t mode) {
+            _throw_if_error(ulfd_mkdirat_u(dirfd, path, mode));
+        }
+        inline void unlinkat(ulfd_t dirfd, const NativeStringView& path, int flags = 0) {
+            _throw_if_error(ulfd_unlinkat_u(dirfd, path, flags));
+        }
+        inline void renameat2(ulfd_t newdirfd, const NativeStringView& newpath, ulfd_t olddirfd, const NativeStringView& oldpath, int flags = 0) {
+            _throw_if_error(ulfd_renameat2_u(newdirfd, newpath, olddirfd, oldpath, flags));
+        }
+        inline void opendirat(ulfd_dir_t& dir, ulfd_t dirfd, const NativeStringView& path) {
+            _throw_if_error(ulfd_opendirat_u(&dir, dirfd, path));
+        }
 
         inline ulfd_spaceinfo_t& space(const NativeStringView& path, ulfd_spaceinfo_t& info) {
             _throw_if_error(ulfd_space_u(&info, path));
@@ -588,13 +794,17 @@ namespace ul {
         class DirectoryReader {
         public:
             inline DirectoryReader(const NativeStringView& path) { opendir(dir, path.get()); }
+            inline DirectoryReader(ulfd_t dirfd, const NativeStringView& path) { opendirat(dir, dirfd, path.get()); }
             inline ~DirectoryReader() { ulfd_closedir(&dir); }
 
             inline std::string next() { return readdir(dir); }
             inline std::wstring next_w() { return readdir_w(dir); }
             inline String next_u() { return readdir_u(dir); }
+            inline size_t next_batch(void* buf, size_t len) { return readdir_batch(dir, buf, len); }
 
             inline void rewind() { rewinddir(dir); }
+            // owned by the reader, valid until it's destroyed
+            inline ulfd_t fd() { return (dirfd)(dir); }
         private:
             ulfd_dir_t dir;
         };
@@ -751,5 +961,1103 @@ namespace ul {
         private:
             NativeStringView hold_path;
         };
+
+        class Ring {
+        public:
+            inline Ring(unsigned entries, int flags = 0) { _throw_if_error(ulfd_ring_init(&ring, entries, flags)); }
+            inline ~Ring() { ulfd_ring_deinit(&ring); }
+            inline Ring(const Ring&) = delete;
+            inline Ring& operator=(const Ring&) = delete;
+
+            // returns false when the submission queue is full (submit or wait, then retry)
+            inline bool pread(ulfd_t fd, void* buf, size_t count, ulfd_int64_t off, void* userdata = nullptr) {
+                return _queued(ulfd_ring_pread(&ring, fd, buf, count, off, userdata));
+            }
+            inline bool pwrite(ulfd_t fd, const void* buf, size_t count, ulfd_int64_t off, void* userdata = nullptr) {
+                return _queued(ulfd_ring_pwrite(&ring, fd, buf, count, off, userdata));
+            }
+            inline bool fsync(ulfd_t fd, void* userdata = nullptr) {
+                return _queued(ulfd_ring_fsync(&ring, fd, userdata));
+            }
+            inline bool fdatasync(ulfd_t fd, void* userdata = nullptr) {
+                return _queued(ulfd_ring_fdatasync(&ring, fd, userdata));
+            }
+            inline bool sync_file_range(ulfd_t fd, ulfd_int64_t off, ulfd_int64_t len, int flags, void* userdata = nullptr) {
+                return _queued(ulfd_ring_sync_file_range(&ring, fd, off, len, flags, userdata));
+            }
+
+            inline unsigned submit() {
+                unsigned submitted;
+                _throw_if_error(ulfd_ring_submit(&ring, &submitted));
+                return submitted;
+            }
+            inline unsigned wait(ulfd_ring_cqe_t* cqes, unsigned max, unsigned min_complete = 1) {
+                unsigned count;
+                _throw_if_error(ulfd_ring_wait(&ring, cqes, max, min_complete, &count));
+                return count;
+            }
+            inline unsigned submit_wait(ulfd_ring_cqe_t* cqes, unsigned max, unsigned min_complete = 1) {
+                unsigned count;
+                _throw_if_error(ulfd_ring_submit_wait(&ring, cqes, max, min_complete, &count));
+                return count;
+            }
+
+            inline bool is_native() const { return ring.uring_fd >= 0; }
+            inline ulfd_ring_t* get() { return &ring; }
+        private:
+            static inline bool _queued(int err) {
+                if(err == EAGAIN) return false;
+                _throw_if_error(err);
+                return true;
+            }
+            ulfd_ring_t ring;
+        };
+
+        class MappedFile {
+        public:
+            // map a window of `fd` (not owned), `len` 0 means to the end of the file
+            inline MappedFile(
+                ulfd_t fd, ulfd_int64_t off = 0, size_t len = 0,
+                int prot_and_flags = ULFD_PROT_READ | ULFD_MAP_SHARED, int policy = ULFD_MAPFILE_NORMAL
+            ) {
+                _throw_if_error(ulfd_mapfile_open(&mf, fd, off, len, prot_and_flags, policy));
+            }
+            // open and map the whole file, the file is created if the mapping is writable
+            inline MappedFile(
+                const NativeStringView& path,
+                int prot_and_flags = ULFD_PROT_READ | ULFD_MAP_SHARED, int policy = ULFD_MAPFILE_NORMAL
+            ) : guard(open(path, (prot_and_flags & ULFD_PROT_WRITE) ? ULFD_O_RDWR | ULFD_O_CREAT : ULFD_O_RDONLY, 0664)) {
+                _throw_if_error(ulfd_mapfile_open(&mf, guard.get(), 0, 0, prot_and_flags, policy));
+            }
+            inline ~MappedFile() { ulfd_mapfile_close(&mf); }
+
+            inline MappedFile(const MappedFile&) = delete;
+            inline MappedFile(MappedFile&& other) : mf(other.mf), guard(std::move(other.guard)) {
+                other.mf.map = nullptr; other.mf.data = nullptr; other.mf.len = 0;
+            }
+            inline MappedFile& operator=(const MappedFile&) = delete;
+            inline MappedFile& operator=(MappedFile&& other) {
+                if(this == &other) return *this;
+                ulfd_mapfile_close(&mf);
+                mf = other.mf; guard = std::move(other.guard);
+                other.mf.map = nullptr; other.mf.data = nullptr; other.mf.len = 0;
+                return *this;
+            }
+
+            inline char* data() const{ return mf.data; }
+            inline size_t size() const{ return mf.len; }
+            inline ulfd_int64_t offset() const{ return mf.off; }
+            inline char* begin() const{ return mf.data; }
+            inline char* end() const{ return mf.data + mf.len; }
+            inline ulfd_t fd() const{ return mf.fd; }
+
+            inline void remap(ulfd_int64_t off, size_t len = 0) { _throw_if_error(ulfd_mapfile_remap(&mf, off, len)); }
+            inline void resize(size_t len) { _throw_if_error(ulfd_mapfile_resize(&mf, len)); }
+            inline void set_policy(int policy) { _throw_if_error(ulfd_mapfile_set_policy(&mf, policy)); }
+            inline void sync(size_t off = 0, size_t len = 0, int flags = ULFD_MS_SYNC) {
+                _throw_if_error(ulfd_mapfile_sync(&mf, off, len, flags));
+            }
+            inline ulfd_mapfile_t* get() { return &mf; }
+        private:
+            ulfd_mapfile_t mf;
+            FileDescriptorGuard guard;
+        };
+
+        // records of a file split on `delim`, returned in place from a sliding mapping
+        class MapScanner {
+        public:
+            inline explicit MapScanner(ulfd_t fd, int delim = '\n', size_t window = 0) {
+                _throw_if_error(ulfd_mapscan_open(&scan, fd, window, delim));
+            }
+            inline explicit MapScanner(const NativeStringView& path, int delim = '\n', size_t window = 0)
+                : guard(open(path, ULFD_O_RDONLY, 0)) {
+                _throw_if_error(ulfd_mapscan_open(&scan, guard.get(), window, delim));
+            }
+            inline ~MapScanner() { ulfd_mapscan_close(&scan); }
+
+            inline MapScanner(const MapScanner&) = delete;
+            inline MapScanner(MapScanner&& other) : scan(other.scan), guard(std::move(other.guard)) {
+                other.scan.mf.map = nullptr; other.scan.mf.data = nullptr; other.scan.mf.len = 0;
+            }
+            inline MapScanner& operator=(const MapScanner&) = delete;
+            inline MapScanner& operator=(MapScanner&& other) {
+                if(this == &other) return *this;
+                ulfd_mapscan_close(&scan);
+                scan = other.scan; guard = std::move(other.guard);
+                other.scan.mf.map = nullptr; other.scan.mf.data = nullptr; other.scan.mf.len = 0;
+                return *this;
+            }
+
+            // returns the length of the record at `data` (`delim` included), 0 at the end of file;
+            // `data` is valid until the next call
+            inline size_t next(const char*& data) {
+                size_t len;
+                _throw_if_error(ulfd_mapscan_next(&scan, &data, &len));
+                return len;
+            }
+            // `fn(data, len)` for every remaining record, without `delim`; returns the number of records
+            template<typename Fn>
+            inline size_t for_each(Fn fn) {
+                const char* data;
+                size_t len, count = 0;
+                while((len = next(data)) != 0) {
+                    if(data[len - 1] == static_cast<char>(scan.delim)) --len;
+                    fn(data, len);
+                    ++count;
+                }
+                return count;
+            }
+            inline ulfd_int64_t tell() const{ return scan.pos; }
+            inline ulfd_mapscan_t* get() { return &scan; }
+        private:
+            ulfd_mapscan_t scan;
+            FileDescriptorGuard guard;
+        };
+
+        class Stream {
+        public:
+            // buffer `fd`, which is closed with the stream if `flags` has `ULFD_STREAM_OWNFD`
+            inline explicit Stream(ulfd_t fd, size_t bufsize = 0, int flags = 0) {
+                _throw_if_error(ulfd_stream_open(&stream, fd, bufsize, flags));
+            }
+            inline Stream(const NativeStringView& path, long oflag, ulfd_mode_t mode = 0664, size_t bufsize = 0) {
+                FileDescriptorGuard guard(open(path, oflag, mode));
+                _throw_if_error(ulfd_stream_open(&stream, guard.get(), bufsize, ULFD_STREAM_OWNFD));
+                guard.release();
+            }
+            inline ~Stream() { if(stream.buf) ulfd_stream_close(&stream); }
+
+            inline Stream(const Stream&) = delete;
+            inline Stream(Stream&& other) : stream(other.stream) { other.stream.buf = nullptr; }
+            inline Stream& operator=(const Stream&) = delete;
+            inline Stream& operator=(Stream&& other) {
+                if(this == &other) return *this;
+                if(stream.buf) ulfd_stream_close(&stream);
+                stream = other.stream;
+                other.stream.buf = nullptr;
+                return *this;
+            }
+
+            inline size_t read(void* buf, size_t count) {
+                size_t read_bytes;
+                _throw_if_error(ulfd_stream_read(&stream, buf, count, &read_bytes));
+                return read_bytes;
+            }
+            inline void write(const void* buf, size_t count) {
+                size_t writen_bytes;
+                _throw_if_error(ulfd_stream_write(&stream, buf, count, &writen_bytes));
+            }
+            inline void write(const std::string& str) { write(str.data(), str.size()); }
+            // returns the number of buffered bytes at `data`, fewer than `want` only at the end of file
+            inline size_t peek(const char*& data, size_t want = 1) {
+                const void* p;
+                size_t avail;
+                _throw_if_error(ulfd_stream_peek(&stream, want, &p, &avail));
+                data = static_cast<const char*>(p);
+                return avail;
+            }
+            inline void consume(size_t count) { ulfd_stream_consume(&stream, count); }
+            // returns the length of the record at `data` (`delim` included), 0 at the end of file
+            inline size_t scan(const char*& data, int delim = '\n') {
+                size_t len;
+                _throw_if_error(ulfd_stream_scan(&stream, delim, &data, &len));
+                return len;
+            }
+            // `line` doesn't keep `delim`, returns false at the end of file
+            inline bool getline(std::string& line, int delim = '\n') {
+                const char* data;
+                size_t len = scan(data, delim);
+                if(len == 0) return false;
+                if(data[len - 1] == static_cast<char>(delim)) --len;
+                line.assign(data, len);
+                return true;
+            }
+            inline void flush() { _throw_if_error(ulfd_stream_flush(&stream)); }
+            inline ulfd_int64_t seek(ulfd_int64_t off, int origin = ULFD_SEEK_SET) {
+                ulfd_int64_t noff;
+                _throw_if_error(ulfd_stream_seek(&stream, off, origin, &noff));
+                return noff;
+            }
+            inline ulfd_int64_t tell() {
+                ulfd_int64_t off;
+                _throw_if_error(ulfd_stream_tell(&stream, &off));
+                return off;
+            }
+            // flush and release the stream, the destructor ignores errors
+            inline void close() {
+                int err = ulfd_stream_close(&stream);
+                stream.buf = nullptr;
+                _throw_if_error(err);
+            }
+            inline ulfd_t fd() const{ return stream.fd; }
+            inline ulfd_stream_t* get() { return &stream; }
+        private:
+            ulfd_stream_t stream;
+        };
+
+        // the target is replaced by `commit`, the destructor drops uncommitted content
+        class AtomicWriter {
+        public:
+            inline explicit AtomicWriter(const NativeStringView& path, ulfd_mode_t mode = 0664, int flags = 0) {
+                _throw_if_error(ulfd_atomic_writer_open_u(&writer, path, mode, flags));
+            }
+            inline ~AtomicWriter() { if(writer.stream.buf) ulfd_atomic_writer_abort(&writer); }
+
+            inline AtomicWriter(const AtomicWriter&) = delete;
+            inline AtomicWriter(AtomicWriter&& other) : writer(other.writer) { other.writer.stream.buf = nullptr; }
+            inline AtomicWriter& operator=(const AtomicWriter&) = delete;
+            inline AtomicWriter& operator=(AtomicWriter&& other) {
+                if(this == &other) return *this;
+                if(writer.stream.buf) ulfd_atomic_writer_abort(&writer);
+                writer = other.writer;
+                other.writer.stream.buf = nullptr;
+                return *this;
+            }
+
+            inline void write(const void* buf, size_t count) {
+                _throw_if_error(ulfd_atomic_writer_write(&writer, buf, count));
+            }
+            inline void write(const std::string& str) { write(str.data(), str.size()); }
+            inline void commit() {
+                int err = ulfd_atomic_writer_commit(&writer);
+                writer.stream.buf = nullptr;
+                _throw_if_error(err);
+            }
+            inline void abort() {
+                if(writer.stream.buf) ulfd_atomic_writer_abort(&writer);
+                writer.stream.buf = nullptr;
+            }
+            inline ulfd_t fd() const{ return writer.stream.fd; }
+            inline ulfd_atomic_writer_t* get() { return &writer; }
+        private:
+            ulfd_atomic_writer_t writer;
+        };
+
+        class Poller {
+        public:
+            inline Poller() : opened(false) {
+                _throw_if_error(ulfd_poller_open(&poller));
+                opened = true;
+            }
+            inline ~Poller() { if(opened) ulfd_poller_close(&poller); }
+
+            inline Poller(const Poller&) = delete;
+            inline Poller(Poller&& other) : poller(other.poller), opened(other.opened) { other.opened = false; }
+            inline Poller& operator=(const Poller&) = delete;
+            inline Poller& operator=(Poller&& other) {
+                if(this == &other) return *this;
+                if(opened) ulfd_poller_close(&poller);
+                poller = other.poller;
+                opened = other.opened;
+                other.opened = false;
+                return *this;
+            }
+
+            inline void add(ulfd_t fd, int events, void* udata = nullptr) {
+                _throw_if_error(ulfd_poller_add(&poller, fd, events, udata));
+            }
+            inline void mod(ulfd_t fd, int events, void* udata = nullptr) {
+                _throw_if_error(ulfd_poller_mod(&poller, fd, events, udata));
+            }
+            inline void del(ulfd_t fd) { _throw_if_error(ulfd_poller_del(&poller, fd)); }
+            // returns the number of events, 0 on timeout or wakeup
+            inline unsigned wait(ulfd_poller_event_t* events, unsigned max, int timeout = -1) {
+                unsigned count;
+                _throw_if_error(ulfd_poller_wait(&poller, events, max, timeout, &count));
+                return count;
+            }
+            // `events` is resized to the reported events, its capacity (at least 1) bounds the batch
+            inline void wait(std::vector<ulfd_poller_event_t>& events, int timeout = -1) {
+                if(events.capacity() == 0) events.reserve(64);
+                events.resize(events.capacity());
+                events.resize(wait(events.data(), static_cast<unsigned>(events.size()), timeout));
+            }
+            inline void wake() { _throw_if_error(ulfd_poller_wake(&poller)); }
+            inline ulfd_poller_t* get() { return &poller; }
+        private:
+            ulfd_poller_t poller;
+            bool opened;
+        };
+
+        class Watcher {
+        public:
+            inline Watcher() : opened(false) {
+                _throw_if_error(ulfd_watch_open(&watch));
+                opened = true;
+            }
+            inline ~Watcher() { if(opened) ulfd_watch_close(&watch); }
+
+            inline Watcher(const Watcher&) = delete;
+            inline Watcher(Watcher&& other) : watch(other.watch), opened(other.opened) { other.opened = false; }
+            inline Watcher& operator=(const Watcher&) = delete;
+            inline Watcher& operator=(Watcher&& other) {
+                if(this == &other) return *this;
+                if(opened) ulfd_watch_close(&watch);
+                watch = other.watch;
+                opened = other.opened;
+                other.opened = false;
+                return *this;
+            }
+
+            // returns the `wd` of the events
+            inline int add(const NativeStringView& path, int mask = ULFD_WATCH_ALL) {
+                int wd;
+                _throw_if_error(ulfd_watch_add_u(&watch, path, mask, &wd));
+                return wd;
+            }
+            inline int add_dir(ulfd_dir_t* dir, int mask = ULFD_WATCH_ALL) {
+                int wd;
+                _throw_if_error(ulfd_watch_add_dir(&watch, dir, mask, &wd));
+                return wd;
+            }
+            inline void rm(int wd) { _throw_if_error(ulfd_watch_rm(&watch, wd)); }
+            // returns the number of events, 0 on timeout; names are valid until the next read
+            inline unsigned read(ulfd_watch_event_t* events, unsigned max, int timeout = -1) {
+                unsigned count;
+                _throw_if_error(ulfd_watch_read(&watch, events, max, timeout, &count));
+                return count;
+            }
+            // `events` is resized to the reported events, its capacity (at least 1) bounds the batch
+            inline void read(std::vector<ulfd_watch_event_t>& events, int timeout = -1) {
+                if(events.capacity() == 0) events.reserve(64);
+                events.resize(events.capacity());
+                events.resize(read(events.data(), static_cast<unsigned>(events.size()), timeout));
+            }
+            inline ulfd_watch_t* get() { return &watch; }
+        private:
+            ulfd_watch_t watch;
+            bool opened;
+        };
+
+        // byte-range locks of one file shared by the threads of this process (one manager per file):
+        // threads are arbitrated in memory, and the file is locked (OFD locks where available, otherwise
+        // `ulfd_lock`) only for bytes not already held for another thread in a compatible mode
+        class RangeLockManager {
+        private:
+            struct _Range {
+                ulfd_int64_t end; // `_eof` for ranges up to the end of the file
+                int mode;
+                bool pending; // waiting for the file lock
+            };
+            typedef std::multimap<ulfd_int64_t, _Range> _Table;
+            static constexpr ulfd_int64_t _eof = std::numeric_limits<ulfd_int64_t>::max();
+
+        public:
+            class Guard {
+            public:
+                inline Guard() : manager(nullptr) { }
+                inline Guard(Guard&& other) : manager(other.manager), it(other.it) { other.manager = nullptr; }
+                inline Guard& operator=(Guard&& other) {
+                    if(this == &other) return *this;
+                    if(manager) manager->_release(it, false);
+                    manager = other.manager; it = other.it;
+                    other.manager = nullptr;
+                    return *this;
+                }
+                Guard(const Guard&) = delete;
+                Guard& operator=(const Guard&) = delete;
+                inline ~Guard() { if(manager) manager->_release(it, false); }
+
+                inline explicit operator bool() const{ return manager != nullptr; }
+                inline void unlock() {
+                    RangeLockManager* m = manager;
+                    manager = nullptr;
+                    if(m) m->_release(it, true);
+                }
+            private:
+                friend class RangeLockManager;
+                inline Guard(RangeLockManager* m, _Table::iterator i) : manager(m), it(i) { }
+                RangeLockManager* manager;
+                _Table::iterator it;
+            };
+
+            // `fd` isn't owned and must stay open while locks are held
+            inline explicit RangeLockManager(ulfd_t file) : fd(file), max_len(0) {
+                // unlocking nothing tells whether OFD locks are supported
+                ofd = ulfd_ofd_lock(fd, 0, 0, ULFD_F_UNLCK) == 0;
+            }
+            RangeLockManager(const RangeLockManager&) = delete;
+            RangeLockManager& operator=(const RangeLockManager&) = delete;
+
+            // `len` 0 means up to the end of the file; waits for other threads and processes
+            inline Guard lock(ulfd_int64_t off, ulfd_int64_t len, int mode) {
+                return Guard(this, _acquire(off, len, mode, true));
+            }
+            // the guard is empty if the range is held by another thread or process
+            inline Guard try_lock(ulfd_int64_t off, ulfd_int64_t len, int mode) {
+                _Table::iterator it = _acquire(off, len, mode, false);
+                return it == table.end() ? Guard() : Guard(this, it);
+            }
+            // whether the file is locked by OFD locks rather than process-wide `ulfd_lock`
+            inline bool uses_ofd() const{ return ofd; }
+
+        private:
+            // `fn(it)` for the entries overlapping [start, end)
+            template<typename Fn>
+            inline void _overlapping(ulfd_int64_t start, ulfd_int64_t end, Fn fn) {
+                // no entry starting before `start - max_len` can reach `start`
+                for(auto it = table.lower_bound(start - max_len); it != table.end() && it->first < end; ++it)
+                    if(it->second.end > start) fn(it);
+            }
+            inline int _file_lock(ulfd_int64_t start, ulfd_int64_t end, int mode, bool wait) {
+            #ifdef _WIN32
+                // `LockFileEx` doesn't take 0 as "to the end of the file"
+                ulfd_int64_t len = end - start;
+            #else
+                ulfd_int64_t len = end == _eof ? 0 : end - start;
+            #endif
+                if(ofd) return wait ? ulfd_ofd_lockw(fd, start, len, mode) : ulfd_ofd_lock(fd, start, len, mode);
+                return wait ? ulfd_lockw(fd, start, len, mode) : ulfd_lock(fd, start, len, mode);
+            }
+            // release the file lock of [start, end) except for bytes still held by other entries
+            inline int _file_unlock(ulfd_int64_t start, ulfd_int64_t end) {
+                int err = 0, e;
+            #ifdef _WIN32
+                // Windows locks aren't merged, every entry owns its own lock, which must be unlocked exactly
+                err = _file_lock(start, end, ULFD_F_UNLCK, false);
+            #else
+                ulfd_int64_t pos = start;
+                _overlapping(start, end, [&](_Table::iterator it) {
+                    if(it->first > pos && (e = _file_lock(pos, it->first, ULFD_F_UNLCK, false)) != 0 && err == 0) err = e;
+                    if(it->second.end > pos) pos = it->second.end;
+                });
+                if(pos < end && (e = _file_lock(pos, end, ULFD_F_UNLCK, false)) != 0 && err == 0) err = e;
+            #endif
+                return err;
+            }
+
+            inline _Table::iterator _acquire(ulfd_int64_t off, ulfd_int64_t len, int mode, bool wait) {
+                ulfd_int64_t end;
+                bool conflict, covered;
+                int err;
+
+                if(off < 0 || len < 0 || (mode != ULFD_F_RDLCK && mode != ULFD_F_WRLCK)) throw Exception(EINVAL);
+                end = (len == 0 || len > _eof - off) ? _eof : off + len;
+
+                std::unique_lock<std::mutex> guard(mutex);
+                for(;;) {
+                    conflict = false;
+                    _overlapping(off, end, [&](_Table::iterator it) {
+                        if(mode == ULFD_F_WRLCK || it->second.mode == ULFD_F_WRLCK) conflict = true;
+                    });
+                    if(!conflict) break;
+                    if(!wait) return table.end();
+                    released.wait(guard);
+                }
+
+                // a shared range inside ranges other threads already hold shared needs no system call
+                covered = false;
+            #ifndef _WIN32
+                if(mode == ULFD_F_RDLCK) {
+                    ulfd_int64_t pos = off;
+                    _overlapping(off, end, [&](_Table::iterator it) {
+                        if(!it->second.pending && it->first <= pos && it->second.end > pos) pos = it->second.end;
+                    });
+                    covered = pos >= end;
+                }
+            #endif
+                _Table::iterator it = table.emplace(off, _Range{ end, mode, true });
+                if(end - off > max_len) max_len = end - off;
+                err = covered ? 0 : _file_lock(off, end, mode, false);
+                if(err && wait && (err == EAGAIN || err == EACCES || err == EDEADLK)) {
+                    // other threads keep going while this one waits for another process
+                    guard.unlock();
+                    err = _file_lock(off, end, mode, true);
+                    guard.lock();
+                }
+                if(err) {
+                    table.erase(it);
+                #ifndef _WIN32
+                    // bytes other threads released while this one waited were kept for it
+                    _file_unlock(off, end);
+                #endif
+                    released.notify_all();
+                    if(!wait && (err == EAGAIN || err == EACCES || err == EDEADLK)) return table.end();
+                    throw Exception(err);
+                }
+                it->second.pending = false;
+                return it;
+            }
+            inline void _release(_Table::iterator it, bool check) {
+                int err;
+                {
+                    std::lock_guard<std::mutex> guard(mutex);
+                    ulfd_int64_t start = it->first, end = it->second.end;
+                    table.erase(it);
+                    err = _file_unlock(start, end);
+                }
+                released.notify_all();
+                if(check) _throw_if_error(err);
+            }
+
+            ulfd_t fd;
+            bool ofd;
+            _Table table;
+            ulfd_int64_t max_len; // of all ranges ever held, bounds the search of overlapping ranges
+            std::mutex mutex;
+            std::condition_variable released;
+        };
+
+        // scheduler of `Walker`: each worker pops its own tasks depth first and steals the oldest ones of others
+        class _WalkPool {
+        public:
+            struct Queue {
+                std::mutex mutex;
+                std::deque<ulfd_walk_task_t*> tasks;
+            };
+            struct Context {
+                _WalkPool* pool;
+                size_t index;
+            };
+
+            inline explicit _WalkPool(size_t n) : pending(0), queued(0), error(0), stopped(false) {
+                for(size_t i = 0; i < n; ++i) queues.emplace_back(new Queue);
+            }
+            inline ~_WalkPool() {
+                for(auto& queue : queues)
+                    for(ulfd_walk_task_t* task : queue->tasks) ulfd_walk_task_free(task);
+            }
+            _WalkPool(const _WalkPool&) = delete;
+            _WalkPool& operator=(const _WalkPool&) = delete;
+
+            // `options[i]` is used by the i-th worker, the calling thread is the first worker
+            inline int run(const char* root, const std::vector<ulfd_walk_options_t>& options) {
+                ulfd_walk_task_t* task;
+                std::vector<std::thread> threads;
+                int err = ulfd_walk_task_root(&task, root);
+                if(err) return err;
+
+                pending = 1; queued = 1;
+                queues[0]->tasks.push_back(task);
+                for(size_t i = 1; i < queues.size(); ++i)
+                    threads.emplace_back(&_WalkPool::work, this, i, std::cref(options[i]));
+                work(0, options[0]);
+                for(auto& thread : threads) thread.join();
+                return error.load();
+            }
+
+        private:
+            static inline int _push(void* ctx, ulfd_walk_task_t* task) {
+                Context* context = static_cast<Context*>(ctx);
+                return context->pool->push(context->index, task);
+            }
+            inline int push(size_t i, ulfd_walk_task_t* task) {
+                if(stopped.load(std::memory_order_relaxed)) { ulfd_walk_task_free(task); return ECANCELED; }
+                pending.fetch_add(1);
+                {
+                    std::lock_guard<std::mutex> lock(queues[i]->mutex);
+                    queues[i]->tasks.push_back(task);
+                }
+                queued.fetch_add(1);
+                { std::lock_guard<std::mutex> lock(idle_mutex); }
+                idle_cv.notify_one();
+                return 0;
+            }
+            inline ulfd_walk_task_t* pop(size_t i) {
+                ulfd_walk_task_t* task;
+                for(size_t k = 0; k < queues.size(); ++k) {
+                    Queue& queue = *queues[(i + k) % queues.size()];
+                    std::lock_guard<std::mutex> lock(queue.mutex);
+                    if(queue.tasks.empty()) continue;
+                    if(k == 0) { task = queue.tasks.back(); queue.tasks.pop_back(); }
+                    else { task = queue.tasks.front(); queue.tasks.pop_front(); }
+                    queued.fetch_sub(1);
+                    return task;
+                }
+                return nullptr;
+            }
+            inline void work(size_t i, const ulfd_walk_options_t& options) {
+                Context context = { this, i };
+                for(;;) {
+                    ulfd_walk_task_t* task = pop(i);
+                    if(task) {
+                        if(stopped.load(std::memory_order_relaxed)) ulfd_walk_task_free(task);
+                        else {
+                            int err = ulfd_walk_scan(task, &options, &_WalkPool::_push, &context);
+                            if(err) {
+                                int expected = 0;
+                                error.compare_exchange_strong(expected, err);
+                                stopped = true;
+                            }
+                        }
+                        if(pending.fetch_sub(1) == 1) {
+                            { std::lock_guard<std::mutex> lock(idle_mutex); }
+                            idle_cv.notify_all();
+                        }
+                        continue;
+                    }
+                    std::unique_lock<std::mutex> lock(idle_mutex);
+                    idle_cv.wait(lock, [this] { return queued.load() > 0 || pending.load() == 0; });
+                    if(pending.load() == 0) return;
+                }
+            }
+
+            std::vector<std::unique_ptr<Queue>> queues;
+            std::atomic<size_t> pending; // tasks pushed but not scanned yet
+            std::atomic<size_t> queued; // tasks in queues
+            std::atomic<int> error;
+            std::atomic<bool> stopped;
+            std::mutex idle_mutex;
+            std::condition_variable idle_cv;
+        };
+
+        struct WalkEntry {
+            std::string path;
+            size_t name_offset;
+            ulfd_uint64_t ino;
+            ulfd_mode_t type;
+            int depth;
+
+            inline std::string name() const{ return path.substr(name_offset); }
+        };
+
+        // parallel recursive directory walker on top of `ulfd_walk_scan`
+        class Walker {
+        public:
+            typedef std::function<bool(const char* path, int err)> ErrorHandler;
+
+            inline explicit Walker(std::string root_path) : root(std::move(root_path)) {
+                memset(&options, 0, sizeof(options));
+                nthreads = std::thread::hardware_concurrency();
+                if(nthreads == 0) nthreads = 1;
+            }
+            inline ~Walker() { _stop_stream(); }
+            Walker(const Walker&) = delete;
+            Walker& operator=(const Walker&) = delete;
+
+            inline Walker& threads(unsigned n) { nthreads = n ? n : 1; return *this; }
+            inline Walker& follow(bool on = true) { _set_flag(ULFD_WALK_FOLLOW, on); return *this; }
+            inline Walker& stat(bool on = true) { _set_flag(ULFD_WALK_STAT, on); return *this; }
+            inline Walker& max_depth(int depth) { options.max_depth = depth; return *this; }
+            // called for unreadable directories, return true to stop the walk (and throw that error)
+            inline Walker& on_error(ErrorHandler handler) { error_handler = std::move(handler); return *this; }
+
+            // `fn(sink, entry)` returns `ULFD_WALK_*`; every worker owns a copy of `init`, returned after the walk
+            template<typename Sink, typename Fn>
+            inline std::vector<Sink> run(Fn fn, const Sink& init = Sink()) {
+                std::vector<_SinkContext<Sink, Fn>> contexts(nthreads, _SinkContext<Sink, Fn>(init, fn, error_handler));
+                std::vector<ulfd_walk_options_t> all_options(nthreads, options);
+                for(unsigned i = 0; i < nthreads; ++i) {
+                    all_options[i].callback = &_SinkContext<Sink, Fn>::callback;
+                    all_options[i].on_error = &_ContextBase::on_error_callback;
+                    all_options[i].userdata = &contexts[i];
+                }
+
+                int err = _WalkPool(nthreads).run(root.c_str(), all_options);
+                for(auto& context : contexts)
+                    if(context.exception) std::rethrow_exception(context.exception);
+                if(err && err != ECANCELED) throw Exception(err);
+
+                std::vector<Sink> sinks;
+                sinks.reserve(nthreads);
+                for(auto& context : contexts) sinks.push_back(std::move(context.sink));
+                return sinks;
+            }
+            // `fn(entry)` returns `ULFD_WALK_*` and may be called concurrently
+            template<typename Fn>
+            inline void run(Fn fn) {
+                run<_NoSink>(_IgnoreSink<Fn>(fn));
+            }
+
+            class Iterator;
+            // entries are produced in the background by the worker threads, in no particular order
+            inline Iterator begin();
+            inline Iterator end();
+
+        private:
+            struct _NoSink { };
+            template<typename Fn>
+            struct _IgnoreSink {
+                explicit _IgnoreSink(Fn& f) : fn(&f) { }
+                int operator()(_NoSink&, const ulfd_walk_entry_t& entry) const{ return (*fn)(entry); }
+                Fn* fn;
+            };
+
+            struct _ContextBase {
+                explicit _ContextBase(const ErrorHandler& handler) : error_handler(&handler) { }
+                static int on_error_callback(void* userdata, const char* path, int err) {
+                    _ContextBase* context = static_cast<_ContextBase*>(userdata);
+                    if(!*context->error_handler) return 0;
+                    try {
+                        return (*context->error_handler)(path, err) ? 1 : 0;
+                    } catch(...) {
+                        if(!context->exception) context->exception = std::current_exception();
+                        return 1;
+                    }
+                }
+                const ErrorHandler* error_handler;
+                std::exception_ptr exception;
+            };
+            template<typename Sink, typename Fn>
+            struct _SinkContext : _ContextBase {
+                _SinkContext(const Sink& init, Fn& f, const ErrorHandler& handler) : _ContextBase(handler), sink(init), fn(&f) { }
+                static int callback(void* userdata, const ulfd_walk_entry_t* entry) {
+                    _SinkContext* context = static_cast<_SinkContext*>(userdata);
+                    try {
+                        return (*context->fn)(context->sink, *entry);
+                    } catch(...) {
+                        if(!context->exception) context->exception = std::current_exception();
+                        return ULFD_WALK_STOP;
+                    }
+                }
+                Sink sink;
+                Fn* fn;
+            };
+
+            struct _Stream {
+                std::mutex mutex;
+                std::condition_variable not_empty, not_full;
+                std::deque<WalkEntry> entries;
+                bool done = false;
+                bool cancelled = false;
+                std::exception_ptr exception;
+                std::thread producer;
+
+                int push(const ulfd_walk_entry_t& entry) {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    not_full.wait(lock, [this] { return cancelled || entries.size() < 4096; });
+                    if(cancelled) return ULFD_WALK_STOP;
+                    WalkEntry e;
+                    e.path.assign(entry.path, entry.pathlen);
+                    e.name_offset = static_cast<size_t>(entry.name - entry.path);
+                    e.ino = entry.ino; e.type = entry.type; e.depth = entry.depth;
+                    entries.push_back(std::move(e));
+                    not_empty.notify_one();
+                    return ULFD_WALK_CONTINUE;
+                }
+                // returns false at the end
+                bool pop(WalkEntry& entry) {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    not_empty.wait(lock, [this] { return done || !entries.empty(); });
+                    if(entries.empty()) {
+                        if(exception) std::rethrow_exception(exception);
+                        return false;
+                    }
+                    entry = std::move(entries.front());
+                    entries.pop_front();
+                    not_full.notify_one();
+                    return true;
+                }
+            };
+
+            inline void _set_flag(int flag, bool on) {
+                if(on) options.flags |= flag;
+                else options.flags &= ~flag;
+            }
+            inline void _stop_stream() {
+                if(!stream) return;
+                {
+                    std::lock_guard<std::mutex> lock(stream->mutex);
+                    stream->cancelled = true;
+                }
+                stream->not_full.notify_all();
+                if(stream->producer.joinable()) stream->producer.join();
+                stream.reset();
+            }
+
+            std::string root;
+            ulfd_walk_options_t options;
+            unsigned nthreads;
+            ErrorHandler error_handler;
+            std::shared_ptr<_Stream> stream;
+        };
+
+        class Walker::Iterator {
+        public:
+            inline Iterator() : stream(nullptr), valid(false) { }
+            inline explicit Iterator(_Stream* s) : stream(s), valid(false) { ++*this; }
+
+            inline Iterator& operator++() {
+                valid = stream && stream->pop(entry);
+                return *this;
+            }
+            inline const WalkEntry& operator*() const{ return entry; }
+            inline const WalkEntry* operator->() const{ return &entry; }
+            inline bool operator==(const Iterator& other) const{ return valid == other.valid; }
+            inline bool operator!=(const Iterator& other) const{ return valid != other.valid; }
+        private:
+            _Stream* stream;
+            WalkEntry entry;
+            bool valid;
+        };
+
+        inline Walker::Iterator Walker::begin() {
+            _stop_stream();
+            stream = std::make_shared<_Stream>();
+            _Stream* s = stream.get();
+            s->producer = std::thread([this, s] {
+                try {
+                    run([s](const ulfd_walk_entry_t& entry) { return s->push(entry); });
+                } catch(...) {
+                    std::lock_guard<std::mutex> lock(s->mutex);
+                    s->exception = std::current_exception();
+                }
+                std::lock_guard<std::mutex> lock(s->mutex);
+                s->done = true;
+                s->not_empty.notify_all();
+            });
+            return Iterator(s);
+        }
+        inline Walker::Iterator Walker::end() { return Iterator(); }
+
+        struct TreeError {
+            std::string path;
+            int err;
+        };
+        // options of `remove_all` and `copy_tree`
+        struct TreeOptions {
+            typedef std::function<bool(const char* path, ulfd_mode_t type, ulfd_uint64_t bytes)> ProgressHandler;
+
+            unsigned threads = 0; // 0 means one per hardware thread
+            int flags = 0; // `copy_tree`: ULFD_COPY_NOREPLACE, ULFD_COPY_NOATTR
+            // an entry is done, return false to stop (and throw ECANCELED); called from one thread at a time
+            ProgressHandler progress;
+            // an entry failed, return true to stop (and throw that error); called from one thread at a time
+            Walker::ErrorHandler on_error;
+        };
+
+        // state shared by the workers of `remove_all` and `copy_tree`
+        class _TreeState {
+        public:
+            inline explicit _TreeState(const TreeOptions& opts) : options(opts), stop_error(0) {
+                c_options.flags = opts.flags;
+                c_options.progress = &_TreeState::_progress_callback;
+                c_options.on_error = &_TreeState::_error_callback;
+                c_options.userdata = this;
+            }
+            _TreeState(const _TreeState&) = delete;
+            _TreeState& operator=(const _TreeState&) = delete;
+
+            // both return true to stop
+            inline bool fail(const char* path, int err) {
+                std::lock_guard<std::mutex> lock(mutex);
+                errors.push_back(TreeError{ path, err });
+                if(stop_error.load()) return true;
+                try {
+                    if(options.on_error && options.on_error(path, err)) stop_error = err;
+                } catch(...) {
+                    exception = std::current_exception();
+                    stop_error = err;
+                }
+                return stop_error.load() != 0;
+            }
+            inline bool progress(const char* path, ulfd_mode_t type, ulfd_uint64_t bytes) {
+                if(!options.progress) return stop_error.load() != 0;
+                std::lock_guard<std::mutex> lock(mutex);
+                if(stop_error.load()) return true;
+                try {
+                    if(!options.progress(path, type, bytes)) stop_error = ECANCELED;
+                } catch(...) {
+                    exception = std::current_exception();
+                    stop_error = ECANCELED;
+                }
+                return stop_error.load() != 0;
+            }
+            inline void check(int err = 0) {
+                if(exception) std::rethrow_exception(exception);
+                _throw_if_error(stop_error.load());
+                // the C functions report everything else to `on_error`
+                if(err == ENOMEM) throw Exception(err);
+            }
+            inline unsigned threads() const{
+                unsigned n = options.threads ? options.threads : std::thread::hardware_concurrency();
+                return n ? n : 1;
+            }
+
+            const TreeOptions& options;
+            ulfd_tree_options_t c_options;
+            std::vector<TreeError> errors;
+
+        private:
+            static int _progress_callback(void* userdata, const char* path, ulfd_mode_t type, ulfd_uint64_t bytes) {
+                return static_cast<_TreeState*>(userdata)->progress(path, type, bytes) ? 1 : 0;
+            }
+            static int _error_callback(void* userdata, const char* path, int err) {
+                return static_cast<_TreeState*>(userdata)->fail(path, err) ? 1 : 0;
+            }
+
+            std::mutex mutex;
+            std::atomic<int> stop_error;
+            std::exception_ptr exception;
+        };
+        struct _TreeDir {
+            int depth;
+            std::string path; // `copy_tree`: the source
+            std::string dst;
+            ulfd_stat_t state;
+        };
+        static inline void _sort_tree_dirs(std::vector<std::vector<_TreeDir>>& sinks, std::vector<_TreeDir>& dirs) {
+            for(auto& sink : sinks)
+                for(auto& dir : sink) dirs.push_back(std::move(dir));
+            // children before their parents
+            std::sort(dirs.begin(), dirs.end(), [](const _TreeDir& a, const _TreeDir& b) { return a.depth > b.depth; });
+        }
+        static inline std::string _join_tree_path(const std::string& root, const char* rel) {
+            std::string path(root);
+            if(!path.empty() && path.back() != '/' && path.back() != _ULFD_WALK_SEP) path.push_back(_ULFD_WALK_SEP);
+            return path.append(rel);
+        }
+
+        // `ulfd_remove_all` with files unlinked by a pool of workers, directories are removed at the end;
+        // returns the failures that didn't stop the removal
+        inline std::vector<TreeError> remove_all(const std::string& path, const TreeOptions& options = TreeOptions()) {
+            _TreeState state(options);
+            std::vector<_TreeDir> dirs;
+            ulfd_stat_t root_state;
+            int err;
+
+            err = ulfd_fstatat(ULFD_AT_FDCWD, path.c_str(), &root_state, ULFD_AT_SYMLINK_NOFOLLOW);
+            if(err == ENOENT) return state.errors;
+            _throw_if_error(err);
+            if((root_state.mode & ULFD_S_IFMT) == ULFD_S_IFDIR) {
+                Walker walker(path);
+                walker.threads(state.threads());
+                walker.on_error([&state](const char* p, int e) { return state.fail(p, e); });
+                std::vector<std::vector<_TreeDir>> sinks;
+                try {
+                    sinks = walker.run([&state](std::vector<_TreeDir>& sink, const ulfd_walk_entry_t& entry) {
+                        if(entry.type == ULFD_S_IFDIR) {
+                            sink.push_back(_TreeDir{ entry.depth, std::string(entry.path, entry.pathlen), std::string(), ulfd_stat_t() });
+                            return ULFD_WALK_CONTINUE;
+                        }
+                        int e = ulfd_unlinkat(entry.dirfd, entry.dirfd == ULFD_AT_FDCWD ? entry.path : entry.name, 0);
+                        if(e && e != ENOENT) return state.fail(entry.path, e) ? ULFD_WALK_STOP : ULFD_WALK_CONTINUE;
+                        return state.progress(entry.path, entry.type, 0) ? ULFD_WALK_STOP : ULFD_WALK_CONTINUE;
+                    }, std::vector<_TreeDir>());
+                } catch(...) {
+                    state.check();
+                    throw;
+                }
+                state.check();
+                _sort_tree_dirs(sinks, dirs);
+            }
+
+            dirs.push_back(_TreeDir{ 0, path, std::string(), root_state });
+            for(const _TreeDir& dir : dirs) {
+                if(dir.depth) {
+                    err = ulfd_rmdir(dir.path.c_str());
+                    if(err == 0 && state.progress(dir.path.c_str(), ULFD_S_IFDIR, 0)) state.check();
+                    if(err == 0 || err == ENOENT) continue;
+                }
+                // the root, and whatever couldn't be unlinked (or was created meanwhile)
+                state.check(ulfd_remove_all(dir.path.c_str(), &state.c_options));
+            }
+            return std::move(state.errors);
+        }
+
+        static inline int _copy_tree_file(const ulfd_walk_entry_t& entry, const std::string& dst, int flags, ulfd_uint64_t* psize) {
+            ulfd_t fd_in, fd_out;
+            ulfd_stat_t state;
+            int err = _ulfd_openat_nofollow(&fd_in, entry.dirfd, entry.dirfd == ULFD_AT_FDCWD ? entry.path : entry.name, ULFD_O_RDONLY, 0);
+            if(err) return err;
+            err = ulfd_fstat(fd_in, &state);
+            // the parents are directories checked by `_copy_tree_mkdir`, and a link at `dst` isn't written through
+            if(err == 0) err = _ulfd_tree_create_file(&fd_out, ULFD_AT_FDCWD, dst.c_str(), flags);
+            if(err) { ulfd_close(fd_in); return err; }
+            err = ulfd_copy_fd(fd_in, fd_out, flags);
+            ulfd_close(fd_in);
+            if(ulfd_close(fd_out) && err == 0) err = EIO;
+            if(err) ulfd_unlink(dst.c_str());
+            *psize = static_cast<ulfd_uint64_t>(state.size);
+            return err;
+        }
+        static inline int _copy_tree_link(const ulfd_walk_entry_t& entry, const std::string& dst, int flags) {
+            char* target;
+            int err = _ulfd_readlinkat_alloc(&target, entry.dirfd, entry.dirfd == ULFD_AT_FDCWD ? entry.path : entry.name);
+            if(err) return err;
+            err = ulfd_symlink(dst.c_str(), target);
+            if(err == EEXIST && !(flags & ULFD_COPY_NOREPLACE)) {
+                err = ulfd_unlink(dst.c_str());
+                if(err == 0) err = ulfd_symlink(dst.c_str(), target);
+            }
+            ul_free(target);
+            return err;
+        }
+        static inline int _copy_tree_mkdir(const std::string& dst) {
+            ulfd_stat_t state;
+            int err = ulfd_mkdir(dst.c_str(), 0700);
+            if(err != EEXIST) return err;
+            // an existing link isn't followed
+            err = ulfd_fstatat(ULFD_AT_FDCWD, dst.c_str(), &state, ULFD_AT_SYMLINK_NOFOLLOW);
+            if(err == 0 && (state.mode & ULFD_S_IFMT) != ULFD_S_IFDIR) err = ENOTDIR;
+            return err;
+        }
+
+        // `ulfd_copy_tree` with a pool of workers: a directory is created before its entries are handed out,
+        // and the attributes of directories are set at the end; returns the failures that didn't stop the copy
+        inline std::vector<TreeError> copy_tree(
+            const std::string& newpath, const std::string& oldpath, const TreeOptions& options = TreeOptions()
+        ) {
+            _TreeState state(options);
+            std::vector<_TreeDir> dirs;
+            ulfd_stat_t root_state, dst_state;
+            size_t rel_pos;
+            int err;
+
+            _throw_if_error(ulfd_fstatat(ULFD_AT_FDCWD, oldpath.c_str(), &root_state, ULFD_AT_SYMLINK_NOFOLLOW));
+            if((root_state.mode & ULFD_S_IFMT) != ULFD_S_IFDIR) {
+                state.check(ulfd_copy_tree(newpath.c_str(), oldpath.c_str(), &state.c_options));
+                return std::move(state.errors);
+            }
+            _throw_if_error(_copy_tree_mkdir(newpath));
+            _throw_if_error(ulfd_fstatat(ULFD_AT_FDCWD, newpath.c_str(), &dst_state, ULFD_AT_SYMLINK_NOFOLLOW));
+
+            rel_pos = oldpath.size();
+            if(rel_pos && oldpath.back() != '/' && oldpath.back() != _ULFD_WALK_SEP) ++rel_pos;
+            Walker walker(oldpath);
+            walker.threads(state.threads());
+            walker.on_error([&state](const char* p, int e) { return state.fail(p, e); });
+            std::vector<std::vector<_TreeDir>> sinks;
+            try {
+                sinks = walker.run([&](std::vector<_TreeDir>& sink, const ulfd_walk_entry_t& entry) {
+                    std::string dst = _join_tree_path(newpath, entry.path + rel_pos);
+                    const char* name = entry.dirfd == ULFD_AT_FDCWD ? entry.path : entry.name;
+                    ulfd_uint64_t size = 0;
+                    ulfd_stat_t st;
+                    int e;
+                    switch(entry.type) {
+                    case ULFD_S_IFDIR:
+                        e = ulfd_fstatat(entry.dirfd, name, &st, ULFD_AT_SYMLINK_NOFOLLOW);
+                        if(e) return state.fail(entry.path, e) ? ULFD_WALK_STOP : ULFD_WALK_PRUNE;
+                        // `newpath` is inside `oldpath`
+                        if(st.ino && st.dev == dst_state.dev && st.ino == dst_state.ino) return ULFD_WALK_PRUNE;
+                        e = _copy_tree_mkdir(dst);
+                        if(e) return state.fail(dst.c_str(), e) ? ULFD_WALK_STOP : ULFD_WALK_PRUNE;
+                        sink.push_back(_TreeDir{ entry.depth, std::string(entry.path, entry.pathlen), std::move(dst), st });
+                        return ULFD_WALK_CONTINUE;
+                    case ULFD_S_IFREG: e = _copy_tree_file(entry, dst, options.flags, &size); break;
+                    case ULFD_S_IFLNK: e = _copy_tree_link(entry, dst, options.flags); break;
+                    default: e = EOPNOTSUPP; break;
+                    }
+                    if(e) return state.fail(entry.path, e) ? ULFD_WALK_STOP : ULFD_WALK_CONTINUE;
+                    return state.progress(entry.path, entry.type, size) ? ULFD_WALK_STOP : ULFD_WALK_CONTINUE;
+                }, std::vector<_TreeDir>());
+            } catch(...) {
+                state.check();
+                throw;
+            }
+            state.check();
+            _sort_tree_dirs(sinks, dirs);
+
+            // the contents would change the times, and the mode may forbid adding them
+            dirs.push_back(_TreeDir{ 0, oldpath, newpath, root_state });
+            for(const _TreeDir& dir : dirs) {
+                if(!(options.flags & ULFD_COPY_NOATTR)) {
+                    // through a descriptor, in case the directory was replaced by a link meanwhile
+                    ulfd_dir_t d;
+                    ulfd_t fd;
+                    err = _ulfd_opendirat_nofollow(&d, ULFD_AT_FDCWD, dir.dst.c_str());
+                    if(err == 0) {
+                        err = ulfd_dirfd(&d, &fd);
+                        if(err == 0) err = ulfd_futime(fd, dir.state.atime, dir.state.mtime);
+                        if(err == 0) err = ulfd_fchmod(fd, dir.state.mode & ULFD_S_IMASK);
+                        ulfd_closedir(&d);
+                    }
+                    if(err && state.fail(dir.dst.c_str(), err)) state.check();
+                }
+                if(state.progress(dir.path.c_str(), ULFD_S_IFDIR, 0)) state.check();
+            }
+            return std::move(state.errors);
+        }
     }
 }